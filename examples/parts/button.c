@@ -28,6 +28,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "sim_avr.h"
+#include "sim_record.h"
 #include "button.h"
 
 static avr_cycle_count_t
@@ -77,5 +78,6 @@ button_init(
 		const char * name)
 {
 	b->irq = avr_alloc_irq(&avr->irq_pool, 0, IRQ_BUTTON_COUNT, &name);
+	avr_record_input(b->irq + IRQ_BUTTON_OUT);
 	b->avr = avr;
 }
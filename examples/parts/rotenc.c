@@ -24,6 +24,7 @@
 #include <string.h>
 
 #include "sim_avr.h"
+#include "sim_record.h"
 #include "rotenc.h"
 
 const rotenc_pins_t state_table[ROTENC_STATE_COUNT] = {
@@ -164,6 +165,8 @@ rotenc_init(
 			0,
 			IRQ_ROTENC_COUNT,
 			_rotenc_irq_names);
+	for (int i = 0; i < IRQ_ROTENC_COUNT; i++)
+		avr_record_input(rotenc->irq + i);
 	rotenc->avr = avr;
 }
 
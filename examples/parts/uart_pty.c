@@ -42,6 +42,8 @@
 #include "avr_uart.h"
 #include "sim_time.h"
 #include "sim_hex.h"
+#include "sim_record.h"
+#include "sim_post.h"
 
 DEFINE_FIFO(uint8_t,uart_pty_fifo);
 
@@ -61,6 +63,9 @@ uart_pty_in_hook(
 {
 	uart_pty_t * p = (uart_pty_t*)param;
 	TRACE(printf("uart_pty_in_hook %02x\n", value);)
+	// re-executing history, the host has seen this already
+	if (avr_record_replaying(p->avr))
+		return;
 	uart_pty_fifo_write(&p->pty.in, value);
 
 	if (p->tap.s) {
@@ -76,6 +81,9 @@ static void
 uart_pty_flush_incoming(
 		uart_pty_t * p)
 {
+	// keep host input for when replay of the recorded input is over
+	if (avr_record_replaying(p->avr))
+		return;
 	while (p->xon && !uart_pty_fifo_isempty(&p->pty.out)) {
 		TRACE(int r = p->pty.out.read;)
 		uint8_t byte = uart_pty_fifo_read(&p->pty.out);
@@ -115,6 +123,20 @@ uart_pty_flush_timer(
 	return p->xon ? when + avr_hz_to_cycles(p->avr, 1000) : 0;
 }
 
+/*
+ * Posted by the pty thread when it has put bytes in the fifo. Runs on the
+ * AVR thread, waking the AVR up if it sleeps, instead of waiting for the
+ * flush timer.
+ */
+static void
+uart_pty_flush_hook(
+		struct avr_irq_t * irq,
+		uint32_t value,
+		void * param)
+{
+	uart_pty_flush_incoming((uart_pty_t*)param);
+}
+
 /*
  * Called when the uart has room in it's input buffer. This is called repeateadly
  * if necessary, while the xoff is called only when the uart fifo is FULL
@@ -160,7 +182,7 @@ uart_pty_thread(
 
 	while (1) {
 		fd_set read_set, write_set;
-		int max = 0;
+		int max = 0, queued = 0;
 		FD_ZERO(&read_set);
 		FD_ZERO(&write_set);
 
@@ -200,6 +222,7 @@ uart_pty_thread(
 					TRACE(int wi = p->port[ti].out.write;)
 					uart_pty_fifo_write(&p->port[ti].out,
 							p->port[ti].buffer[index]);
+					queued = 1;
 					TRACE(printf("w %3d:%02x (%d/%d) %s\n",
 								wi, p->port[ti].buffer[index],
 								p->port[ti].out.read,
@@ -224,7 +247,11 @@ uart_pty_thread(
 		/* DO NOT call this, this create a concurency issue with the
 		 * FIFO that can't be solved cleanly with a memory barrier
 			uart_pty_flush_incoming(p);
+		 * Post it to the AVR thread instead; the flush timer is there
+		 * for when the queue is full or could not be started.
 		  */
+		if (queued)
+			avr_irq_post(p->avr, p->irq + IRQ_UART_PTY_FLUSH, 1);
 	}
 	return NULL;
 }
@@ -232,6 +259,7 @@ uart_pty_thread(
 static const char * irq_names[IRQ_UART_PTY_COUNT] = {
 	[IRQ_UART_PTY_BYTE_IN] = "8<uart_pty.in",
 	[IRQ_UART_PTY_BYTE_OUT] = "8>uart_pty.out",
+	[IRQ_UART_PTY_FLUSH] = "<uart_pty.flush",
 };
 
 void
@@ -244,6 +272,9 @@ uart_pty_init(
 	p->avr = avr;
 	p->irq = avr_alloc_irq(&avr->irq_pool, 0, IRQ_UART_PTY_COUNT, irq_names);
 	avr_irq_register_notify(p->irq + IRQ_UART_PTY_BYTE_IN, uart_pty_in_hook, p);
+	avr_irq_register_notify(p->irq + IRQ_UART_PTY_FLUSH, uart_pty_flush_hook, p);
+	if (avr_post_start(avr))
+		fprintf(stderr, "%s: Can't start posting, polling instead\n", __FUNCTION__);
 
 	const int hastap = (getenv("SIMAVR_UART_TAP") && atoi(getenv("SIMAVR_UART_TAP"))) ||
 			(getenv("SIMAVR_UART_XTERM") && atoi(getenv("SIMAVR_UART_XTERM")));
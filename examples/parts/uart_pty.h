@@ -30,6 +30,7 @@
 enum {
 	IRQ_UART_PTY_BYTE_IN = 0,
 	IRQ_UART_PTY_BYTE_OUT,
+	IRQ_UART_PTY_FLUSH,		// posted by the pty thread
 	IRQ_UART_PTY_COUNT
 };
 
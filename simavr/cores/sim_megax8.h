@@ -217,6 +217,7 @@ const struct mcu_t SIM_CORENAME = {
 		.wgm = { AVR_IO_REGBIT(TCCR0A, WGM00), AVR_IO_REGBIT(TCCR0A, WGM01), AVR_IO_REGBIT(TCCR0B, WGM02) },
 		.wgm_op = {
 			[0] = AVR_TIMER_WGM_NORMAL8(),
+			[1] = AVR_TIMER_WGM_FCPWM8(),
 			[2] = AVR_TIMER_WGM_CTC(),
 			[3] = AVR_TIMER_WGM_FASTPWM8(),
 			[7] = AVR_TIMER_WGM_OCPWM(),
@@ -327,6 +328,7 @@ const struct mcu_t SIM_CORENAME = {
 		.wgm = { AVR_IO_REGBIT(TCCR2A, WGM20), AVR_IO_REGBIT(TCCR2A, WGM21), AVR_IO_REGBIT(TCCR2B, WGM22) },
 		.wgm_op = {
 			[0] = AVR_TIMER_WGM_NORMAL8(),
+			[1] = AVR_TIMER_WGM_FCPWM8(),
 			[2] = AVR_TIMER_WGM_CTC(),
 			[3] = AVR_TIMER_WGM_FASTPWM8(),
 			[7] = AVR_TIMER_WGM_OCPWM(),
@@ -75,6 +75,7 @@ enum {
 	SIMAVR_CMD_VCD_START_TRACE,
 	SIMAVR_CMD_VCD_STOP_TRACE,
 	SIMAVR_CMD_UART_LOOPBACK,
+	SIMAVR_CMD_VCD_TRIGGER,
 };
 
 #if __AVR__
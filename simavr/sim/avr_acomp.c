@@ -22,6 +22,7 @@
 #include <stdlib.h>
 #include "avr_acomp.h"
 #include "avr_timer.h"
+#include "sim_snapshot.h"
 
 static uint8_t
 avr_acomp_get_state(
@@ -253,11 +254,39 @@ static const char * irq_names[ACOMP_IRQ_COUNT] = {
 	[ACOMP_IRQ_INPUT_STATE] = "32>input_state"
 };
 
+static void
+avr_acomp_snapshot(
+		struct avr_io_t * port,
+		struct avr_snapshot_t * s)
+{
+	avr_acomp_t * p = (avr_acomp_t *)port;
+	uint8_t capture = p->timer_irq != NULL;
+
+	AVR_SNAPSHOT_FIELD(s, p->adc_values);
+	AVR_SNAPSHOT_FIELD(s, p->ain_values);
+	AVR_SNAPSHOT_FIELD(s, capture);
+	if (!s->restore || s->error || capture == (p->timer_irq != NULL))
+		return;
+	// rewire the input capture trigger as avr_acomp_write_acsr() does
+	if (p->timer_irq) {
+		avr_unconnect_irq(p->io.irq + ACOMP_IRQ_OUT, p->timer_irq);
+		p->timer_irq = NULL;
+	} else {
+		avr_irq_t *irq = avr_io_getirq(port->avr,
+				AVR_IOCTL_TIMER_GETIRQ(p->timer_name), TIMER_IRQ_IN_ICP);
+		if (irq) {
+			avr_connect_irq(p->io.irq + ACOMP_IRQ_OUT, irq);
+			p->timer_irq = irq;
+		}
+	}
+}
+
 static avr_io_t _io = {
 	.kind = "ac",
 	.reset = avr_acomp_reset,
 	.irq_names = irq_names,
-	.ioctl = avr_acomp_ioctl
+	.ioctl = avr_acomp_ioctl,
+	.snapshot = avr_acomp_snapshot,
 };
 
 void
@@ -24,6 +24,7 @@
 #include <string.h>
 #include "sim_time.h"
 #include "avr_adc.h"
+#include "sim_snapshot.h"
 
 static avr_cycle_count_t
 avr_adc_int_raise(
@@ -448,11 +449,30 @@ static const char * irq_names[ADC_IRQ_COUNT] = {
 	[ADC_IRQ_RESAMPLE] = "<resample",
 };
 
+static void
+avr_adc_snapshot(
+		struct avr_io_t * port,
+		struct avr_snapshot_t * s)
+{
+	avr_adc_t * p = (avr_adc_t *)port;
+
+	AVR_SNAPSHOT_FIELD(s, p->adc_values);
+	AVR_SNAPSHOT_FIELD(s, p->temp);
+	AVR_SNAPSHOT_FIELD(s, p->first);
+	AVR_SNAPSHOT_FIELD(s, p->read_status);
+	AVR_SNAPSHOT_FIELD(s, p->current_muxi);
+	AVR_SNAPSHOT_FIELD(s, p->current_refi);
+	AVR_SNAPSHOT_FIELD(s, p->current_prescale);
+	AVR_SNAPSHOT_FIELD(s, p->current_extras);
+	AVR_SNAPSHOT_FIELD(s, p->result);
+}
+
 static	avr_io_t	_io = {
 	.kind = "adc",
 	.reset = avr_adc_reset,
 	.irq_names = irq_names,
-	.ioctl = avr_adc_ioctl
+	.ioctl = avr_adc_ioctl,
+	.snapshot = avr_adc_snapshot,
 };
 
 void avr_adc_init(avr_t * avr, avr_adc_t * p)
@@ -463,6 +483,9 @@ void avr_adc_init(avr_t * avr, avr_adc_t * p)
 	avr_register_vector(avr, &p->adc);
 	// allocate this module's IRQ
 	avr_io_setirqs(&p->io, AVR_IOCTL_ADC_GETIRQ, ADC_IRQ_COUNT, NULL);
+	// the analog inputs come from outside, log them when recording
+	for (int i = ADC_IRQ_ADC0; i <= ADC_IRQ_TEMP; i++)
+		p->io.irq[i].flags |= IRQ_FLAG_RECORD;
 
 	avr_register_io_write(avr, p->r_adcsra, avr_adc_write_adcsra, p);
 	// some ADCs don't have ADCSRB (atmega8/16/32)
@@ -25,6 +25,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "avr_eeprom.h"
+#include "sim_snapshot.h"
 
 static avr_cycle_count_t
 avr_eempe_clear(
@@ -145,10 +146,21 @@ avr_eeprom_dealloc(
 	p->eeprom = NULL;
 }
 
+static void
+avr_eeprom_snapshot(
+		struct avr_io_t * port,
+		struct avr_snapshot_t * s)
+{
+	avr_eeprom_t * p = (avr_eeprom_t *)port;
+
+	avr_snapshot_bytes(s, p->eeprom, p->size);
+}
+
 static	avr_io_t	_io = {
 	.kind = "eeprom",
 	.ioctl = avr_eeprom_ioctl,
 	.dealloc = avr_eeprom_dealloc,
+	.snapshot = avr_eeprom_snapshot,
 };
 
 void
@@ -27,6 +27,7 @@
 #include <string.h>
 #include "avr_extint.h"
 #include "avr_ioport.h"
+#include "sim_snapshot.h"
 
 /* Get the bit that controls an interrupt. */
 
@@ -222,10 +223,24 @@ static const char * irq_names[EXTINT_COUNT] = {
 	[EXTINT_IRQ_OUT_INT7] = "<int7",
 };
 
+static void
+avr_extint_snapshot(
+		struct avr_io_t * port,
+		struct avr_snapshot_t * s)
+{
+	avr_extint_t * p = (avr_extint_t *)port;
+
+	for (int i = 0; i < EXTINT_COUNT; i++) {
+		AVR_SNAPSHOT_FIELD(s, p->eint[i].previous_enable);
+		AVR_SNAPSHOT_FIELD(s, p->eint[i].previous_mode);
+	}
+}
+
 static	avr_io_t	_io = {
 	.kind = "extint",
 	.reset = avr_extint_reset,
 	.irq_names = irq_names,
+	.snapshot = avr_extint_snapshot,
 };
 
 void avr_extint_init(avr_t * avr, avr_extint_t * p)
@@ -23,6 +23,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include "avr_flash.h"
+#include "sim_snapshot.h"
+#include "sim_checkpoint.h"
 
 static avr_cycle_count_t
 avr_progen_clear(
@@ -128,11 +130,13 @@ avr_flash_ioctl(
 
 				if (avr_regbit_get(avr, p->pgers)) {
 					z &= ~(p->spm_pagesize - 1);
+					avr_checkpoint_touch_flash(avr, z, p->spm_pagesize);
 					AVR_LOG(avr, LOG_TRACE, "FLASH: Erasing page %04x (%d)\n", (z / p->spm_pagesize), p->spm_pagesize);
 					for (int i = 0; i < p->spm_pagesize; i++)
 						avr->flash[z++] = 0xff;
 				} else if (avr_regbit_get(avr, p->pgwrt)) {
 					z &= ~(p->spm_pagesize - 1);
+					avr_checkpoint_touch_flash(avr, z, p->spm_pagesize);
 					AVR_LOG(avr, LOG_TRACE, "FLASH: Writing page %04x (%d)\n", (z / p->spm_pagesize), p->spm_pagesize);
 					for (int i = 0; i < p->spm_pagesize / 2; i++) {
 						avr->flash[z++] = p->tmppage[i];
@@ -182,11 +186,26 @@ avr_flash_dealloc(
 		free(p->tmppage_used);
 }
 
+static void
+avr_flash_snapshot(
+		struct avr_io_t * port,
+		struct avr_snapshot_t * s)
+{
+	avr_flash_t * p = (avr_flash_t *)port;
+
+	AVR_SNAPSHOT_FIELD(s, p->flags);
+	if (p->tmppage) {
+		avr_snapshot_bytes(s, p->tmppage, p->spm_pagesize);
+		avr_snapshot_bytes(s, p->tmppage_used, p->spm_pagesize / 2);
+	}
+}
+
 static	avr_io_t	_io = {
 	.kind = "flash",
 	.ioctl = avr_flash_ioctl,
 	.reset = avr_flash_reset,
 	.dealloc = avr_flash_dealloc,
+	.snapshot = avr_flash_snapshot,
 };
 
 void
@@ -30,6 +30,7 @@
 #include "avr_timer.h"
 #include "avr_ioport.h"
 #include "sim_time.h"
+#include "sim_snapshot.h"
 
 static uint16_t _avr_timer_get_current_tcnt(avr_timer_t * p);
 static void avr_timer_start(avr_timer_t *p);
@@ -74,6 +75,33 @@ _timer_get_icr(
 				(p->r_tcnth ? (p->io.avr->data[p->r_icrh] << 8) : 0);
 }
 
+/* Control output pins only when waveform generation is on.
+ * This really should happen when the control register is written,
+ * but that would be messy too.
+ */
+
+static uint32_t
+avr_timer_comp_connect(
+		avr_timer_t *p,
+		uint8_t comp,
+		uint8_t mode)
+{
+	avr_timer_comp_t * cp = p->comp + comp;
+
+	if (cp->pin_irq) {
+		if (cp->wave_active && mode == avr_timer_com_normal) {
+			avr_unconnect_irq(&p->io.irq[TIMER_IRQ_OUT_COMP + comp],
+							cp->pin_irq);
+			cp->wave_active = 0;
+		} else if (!cp->wave_active && mode != avr_timer_com_normal) {
+			avr_connect_irq(&p->io.irq[TIMER_IRQ_OUT_COMP + comp],
+							cp->pin_irq);
+			cp->wave_active = 1;
+		}
+	}
+	return (cp->wave_active) ? AVR_IOPORT_OUTPUT : 0;
+}
+
 static avr_cycle_count_t
 avr_timer_comp(
 		avr_timer_t *p,
@@ -96,24 +124,7 @@ avr_timer_comp(
 
 	AVR_LOG(avr, LOG_TRACE, "Timer comp: irq %p, mode %d @%d\n", irq, mode, when);
 
-
-	/* Control output pins only when waveform generation is on.
-	 * This really should happen when the control register is written,
-	 * but that would be messy too.
-	 */
-
-	if (have_pin) {
-		if (cp->wave_active && mode == avr_timer_com_normal) {
-			avr_unconnect_irq(&p->io.irq[TIMER_IRQ_OUT_COMP + comp],
-							cp->pin_irq);
-			cp->wave_active = 0;
-		} else if (!cp->wave_active && mode != avr_timer_com_normal) {
-			avr_connect_irq(&p->io.irq[TIMER_IRQ_OUT_COMP + comp],
-							cp->pin_irq);
-			cp->wave_active = 1;
-		}
-	}
-	flags = (cp->wave_active) ? AVR_IOPORT_OUTPUT : 0;
+	flags = avr_timer_comp_connect(p, comp, mode);
 
 	switch (p->wgm_op_mode_kind) {
 	case avr_timer_wgm_fc_pwm:
@@ -175,6 +186,25 @@ avr_timer_comp(
 	return 0;
 }
 
+/*
+ * Raise TOV, and let anyone listening know the timer overflowed. The
+ * pulse is skipped when nothing is hooked to the IRQ (a timeline, a VCD
+ * trace or a part would be), it is on the path of every overflow.
+ */
+
+static void
+avr_timer_overflow(
+		avr_timer_t *p)
+{
+	avr_irq_t * tov = p->io.irq + TIMER_IRQ_OUT_TOV;
+
+	if (tov->hook) {
+		avr_raise_irq(tov, 1);
+		avr_raise_irq(tov, 0);
+	}
+	avr_raise_interrupt(p->io.avr, &p->overflow);
+}
+
 static void
 avr_timer_comp_on_tov(
 		avr_timer_t *p,
@@ -350,7 +380,7 @@ avr_timer_irq_ext_clock(
 				avr_timer_comp_on_tov(p, 0, compi);
 			}
 		}
-		avr_raise_interrupt(avr, &p->overflow);
+		avr_timer_overflow(p);
 	}
 
 }
@@ -425,12 +455,13 @@ avr_timer_bottom(
 		adj = avr->cycle - when - avr_timer_cycle_adjust(p);
 		p->down = 0;
 		p->bottom = 1;
-		avr_raise_interrupt(avr, &p->overflow);
+		avr_timer_overflow(p);
 
 		for (int compi = 0; compi < AVR_TIMER_COMP_COUNT; compi++) {
 			if (p->comp[compi].r_ocr == 0)
 				break;
-			if (p->comp[compi].comp_cycles) {
+			if (p->comp[compi].comp_cycles &&
+					!(p->summarized & (1 << compi))) {
 				avr_cycle_timer_register(avr,
 										 p->comp[compi].comp_cycles - adj,
 										 dispatch[compi], p);
@@ -470,17 +501,18 @@ avr_timer_tov(
 	} else if (p->wgm_op_mode_kind == avr_timer_wgm_fast_pwm) {
 		avr_cycle_timer_register(avr, p->cs_div_value,
 								 avr_timer_bottom, p);
-		avr_raise_interrupt(avr, &p->overflow);
+		avr_timer_overflow(p);
 	} else if (p->wgm_op_mode_kind != avr_timer_wgm_ctc ||
 			   _avr_timer_get_current_tcnt(p) >= p->tov_top) {
-		avr_raise_interrupt(avr, &p->overflow);
+		avr_timer_overflow(p);
 	}
 	p->tov_base = when;
 
 	for (int compi = 0; compi < AVR_TIMER_COMP_COUNT; compi++) {
 		if (!p->comp[compi].r_ocr)
 			break;
-		if (p->comp[compi].comp_cycles) {
+		if (p->comp[compi].comp_cycles &&
+				!(p->summarized & (1 << compi))) {
 			if (p->comp[compi].comp_cycles < p->tov_cycles &&
 				p->comp[compi].comp_cycles >= (avr->cycle - when)) {
 				avr_cycle_count_t next_match;
@@ -510,6 +542,18 @@ _avr_timer_get_current_tcnt(
 
 	if (p->wgm_op_mode_kind == avr_timer_wgm_none)
 		return _timer_get_tcnt(p);
+	if (p->summary_all) {
+		// no overflows to follow, the count is where the phase is
+		uint64_t when = (avr->cycle - p->tov_base) / p->cs_div_value;
+
+		if (!p->tov_top)
+			return 0;
+		if (p->wgm_op_mode_kind == avr_timer_wgm_fc_pwm) {
+			when %= 2 * p->tov_top;
+			return when <= p->tov_top ? when : 2 * p->tov_top - when;
+		}
+		return when % (p->tov_top + 1);
+	}
 	if (!(p->ext_clock_flags & (AVR_TIMER_EXTCLK_FLAG_TN |
 								AVR_TIMER_EXTCLK_FLAG_AS2)) ||
 			(p->ext_clock_flags & AVR_TIMER_EXTCLK_FLAG_VIRT)
@@ -522,12 +566,14 @@ _avr_timer_get_current_tcnt(
 				if (p->down) {
 					// p->tov_base was reset at top.
 
-					return p->tov_top - when - 1;
-				} else if (p->bottom) {
-					return when - p->tov_top + 1;
-				} else {
-					return when;
+					/* avr_timer_bottom() turns the count a cycle after it
+					 * gets past BOTTOM, read in between it is still there. */
+					return when < p->tov_top ? p->tov_top - when - 1 : 0;
 				}
+				if (p->bottom)
+					when = when - p->tov_top + 1;
+				// and avr_timer_tov() the same at TOP
+				return when == p->tov_top + 1 ? p->tov_top : when;
 			} else {
 				return when;
 			}				
@@ -584,6 +630,8 @@ avr_timer_start(avr_timer_t *p)
 	uint32_t      when, adj;
 	uint32_t      tcnt, to_top;
 
+	if (p->summary_all)
+		return;		// nothing to schedule
 	tcnt = _avr_timer_get_current_tcnt(p);
 	if (p->cs_div_value > 1)
 		adj = (avr->cycle - p->tov_base) % p->cs_div_value;
@@ -614,6 +662,8 @@ avr_timer_start(avr_timer_t *p)
 
 		if (p->comp[compi].r_ocr == 0)
 			break;
+		if (p->summarized & (1 << compi))
+			continue;
 		match = p->comp[compi].ocr;
 		if (match >= p->tov_top)
 			continue; // Equality handled by avr_timer_tov().
@@ -631,6 +681,205 @@ avr_timer_start(avr_timer_t *p)
 	}
 }
 
+/*
+ * PWM summary mode. Comparators that can do without their cycle timers
+ * are those asked for, in a PWM mode clocked by the core, with their
+ * interrupt off, not toggling, and with nothing but the pin listening to
+ * their edges. The overflow can do without its own when they all can,
+ * its interrupt is off and nothing listens to it.
+ */
+
+static void
+avr_timer_summary_check(
+		avr_timer_t * p,
+		uint8_t * summarized,
+		uint8_t * all)
+{
+	avr_t * avr = p->io.avr;
+
+	*summarized = 0;
+	*all = 0;
+	if (!p->summary || !p->cs_div_value ||
+			(p->ext_clock_flags &
+				(AVR_TIMER_EXTCLK_FLAG_TN | AVR_TIMER_EXTCLK_FLAG_AS2)))
+		return;
+	if (p->wgm_op_mode_kind != avr_timer_wgm_pwm &&
+			p->wgm_op_mode_kind != avr_timer_wgm_fast_pwm &&
+			p->wgm_op_mode_kind != avr_timer_wgm_fc_pwm)
+		return;
+	*all = !avr_regbit_get(avr, p->overflow.enable) &&
+			!avr_irq_is_hooked(p->io.irq + TIMER_IRQ_OUT_TOV, NULL);
+	for (int compi = 0; compi < AVR_TIMER_COMP_COUNT; compi++) {
+		avr_timer_comp_p cp = p->comp + compi;
+
+		if (!cp->r_ocr)
+			break;
+		if ((p->summary & (1 << compi)) &&
+				!avr_regbit_get(avr, cp->interrupt.enable) &&
+				avr_regbit_get(avr, cp->com) != avr_timer_com_toggle &&
+				!avr_irq_is_hooked(p->io.irq + TIMER_IRQ_OUT_COMP + compi,
+						cp->pin_irq))
+			*summarized |= 1 << compi;
+		else
+			*all = 0;
+	}
+}
+
+// Take the buffered OCR of the summarized comparators now.
+
+static void
+avr_timer_summary_ocr(
+		avr_timer_t * p)
+{
+	for (int compi = 0; compi < AVR_TIMER_COMP_COUNT; compi++) {
+		avr_timer_comp_p cp = p->comp + compi;
+
+		if (!(p->summarized & (1 << compi)))
+			continue;
+		cp->ocr = _timer_get_ocr(p, compi);
+		cp->comp_cycles = cp->ocr <= p->tov_top ?
+				(cp->ocr + 1) * p->cs_div_value : 0;
+	}
+}
+
+static void
+avr_timer_summary_raise(
+		avr_timer_t * p)
+{
+	avr_t *  avr = p->io.avr;
+	int      dual = p->wgm_op_mode_kind == avr_timer_wgm_fc_pwm;
+	uint32_t period = 0;
+
+	if (!p->summary)
+		return;
+	if (p->summarized)
+		period = dual ? 2 * p->tov_top * p->cs_div_value : p->tov_cycles;
+	avr_raise_irq(p->io.irq + TIMER_IRQ_OUT_PERIOD, period);
+
+	for (int compi = 0; compi < AVR_TIMER_COMP_COUNT; compi++) {
+		uint8_t  mode = avr_regbit_get(avr, p->comp[compi].com);
+		uint32_t ocr = p->comp[compi].ocr, duty = 0;
+		uint32_t flags;
+
+		if (!(p->summarized & (1 << compi)))
+			continue;
+		if (ocr > p->tov_top)
+			ocr = p->tov_top;
+		// high from BOTTOM to the match, or between the two matches
+		if (dual)
+			duty = p->tov_top ?
+				(uint64_t)ocr * AVR_TIMER_DUTY_MAX / p->tov_top : 0;
+		else
+			duty = (uint64_t)(ocr + 1) * AVR_TIMER_DUTY_MAX / (p->tov_top + 1);
+		if (mode == avr_timer_com_set)		// inverted
+			duty = AVR_TIMER_DUTY_MAX - duty;
+		else if (mode == avr_timer_com_normal)	// not connected
+			duty = 0;
+		avr_raise_irq(p->io.irq + TIMER_IRQ_OUT_DUTY + compi, duty);
+
+		// a pin that stays low or high is still driven
+		flags = avr_timer_comp_connect(p, compi, mode);
+		if (mode != avr_timer_com_normal &&
+				(duty == 0 || duty == AVR_TIMER_DUTY_MAX))
+			avr_raise_irq(p->io.irq + TIMER_IRQ_OUT_COMP + compi,
+					flags | (duty != 0));
+	}
+}
+
+// Where the counter is, and whether it is counting down.
+
+static uint16_t
+avr_timer_summary_position(
+		avr_timer_t * p,
+		int * down)
+{
+	uint16_t tcnt = _avr_timer_get_current_tcnt(p);
+
+	*down = 0;
+	if (p->wgm_op_mode_kind != avr_timer_wgm_fc_pwm)
+		return tcnt;
+	if (!p->summary_all)
+		*down = p->down;
+	else if (p->tov_top)
+		*down = (p->io.avr->cycle - p->tov_base) / p->cs_div_value %
+					(2 * p->tov_top) > p->tov_top;
+	return tcnt;
+}
+
+/*
+ * Set tov_base so that the counter carries on from there, either way,
+ * 'frac' cycles into the count.
+ */
+
+static void
+avr_timer_summary_rebase(
+		avr_timer_t * p,
+		uint16_t tcnt,
+		int down,
+		uint32_t frac)
+{
+	uint32_t when = tcnt;
+
+	if (p->summary_all) {
+		if (down)
+			when = 2 * p->tov_top - tcnt;
+		down = 0;
+	} else if (down) {
+		// p->tov_base is at TOP when counting down
+		when = tcnt < p->tov_top ? p->tov_top - 1 - tcnt : 0;
+	}
+	p->down = down;
+	p->bottom = 0;
+	p->tov_base = p->io.avr->cycle - frac -
+			(avr_cycle_count_t)when * p->cs_div_value;
+}
+
+/*
+ * Called when something the summary depends on changes without the timer
+ * being reconfigured: interrupt enables, output modes, the summary mask.
+ * The counter carries on from where it is.
+ */
+static void
+avr_timer_summary_update(
+		avr_timer_t * p)
+{
+	uint8_t  summarized, all;
+	uint16_t tcnt;
+	uint32_t frac;
+	int      down;
+
+	if (!p->summary && !p->summarized)
+		return;
+	avr_timer_summary_check(p, &summarized, &all);
+	if (summarized != p->summarized || all != p->summary_all) {
+		tcnt = avr_timer_summary_position(p, &down);
+		frac = (p->io.avr->cycle - p->tov_base) % p->cs_div_value;
+		avr_timer_cancel_all_cycle_timers(p->io.avr, p, 0);
+		p->summarized = summarized;
+		if (all != p->summary_all) {
+			p->summary_all = all;
+			avr_timer_summary_rebase(p, tcnt, down, frac);
+		}
+		avr_timer_summary_ocr(p);
+		if (p->tov_cycles > 1)
+			avr_timer_start(p);
+	}
+	if (!p->summary)	// just turned off
+		avr_raise_irq(p->io.irq + TIMER_IRQ_OUT_PERIOD, 0);
+	avr_timer_summary_raise(p);
+}
+
+static void
+avr_timer_write_enable(
+		struct avr_t * avr,
+		avr_io_addr_t addr,
+		uint8_t v,
+		void * param)
+{
+	avr_core_watch_write(avr, addr, v);
+	avr_timer_summary_update((avr_timer_t *)param);
+}
+
 static void
 avr_timer_tcnt_write(
 		struct avr_t * avr,
@@ -792,8 +1041,19 @@ avr_timer_reconfigure(
 {
 	avr_t * avr = p->io.avr;
 
+	// from the phase back to counting up from the last overflow, which
+	// does for both
+	if (p->summary_all && p->cs_div_value) {
+		uint16_t tcnt = _avr_timer_get_current_tcnt(p);
+
+		p->tov_base = avr->cycle -
+				(avr->cycle - p->tov_base) % p->cs_div_value -
+				(avr_cycle_count_t)tcnt * p->cs_div_value;
+	}
 	// cancel everything
 	avr_timer_cancel_all_cycle_timers(avr, p, 1);
+	avr_timer_summary_check(p, &p->summarized, &p->summary_all);
+	avr_timer_summary_ocr(p);
 
 	switch (p->wgm_op_mode_kind) {
 		case avr_timer_wgm_normal:
@@ -827,6 +1087,7 @@ avr_timer_reconfigure(
 					__FUNCTION__, p->name, mode, p->mode.kind);
 		}
 	}
+	avr_timer_summary_raise(p);
 }
 
 static void
@@ -851,6 +1112,19 @@ avr_timer_write_ocr(
 	index = (int)(comp - timer->comp);
 	avr_raise_irq(timer->io.irq + TIMER_IRQ_OUT_PWM0 + index, newv);
 
+	if (timer->summarized & (1 << index)) {
+		// no cycle timers to follow it, no need to wait for TOP
+		comp->ocr = newv;
+		if (timer->mode.top == avr_timer_wgm_reg_ocra && index == 0) {
+			avr_timer_reconfigure(timer, 0);
+		} else {
+			comp->comp_cycles = newv <= timer->tov_top ?
+					(newv + 1) * timer->cs_div_value : 0;
+			avr_timer_summary_raise(timer);
+		}
+		return;
+	}
+
 	if (timer->wgm_op_mode_kind == avr_timer_wgm_fc_pwm ||
 		timer->wgm_op_mode_kind == avr_timer_wgm_fast_pwm) {
 		return;     // OCR is buffered
@@ -936,6 +1210,8 @@ avr_timer_write(
 			// cancel everything
 			avr_timer_cancel_all_cycle_timers(avr, p, 1);
 			p->wgm_op_mode_kind = avr_timer_wgm_none;
+			p->summarized = p->summary_all = 0;
+			avr_timer_summary_raise(p);
 			if (cs != 0) {
 				AVR_LOG(avr, LOG_TRACE, "TIMER: %s-%c clock turned off\n",
 						__func__, p->name);
@@ -946,6 +1222,9 @@ avr_timer_write(
 			p->tov_base = avr->cycle - (tcnt * p->cs_div_value) - adj;
 			avr_timer_reconfigure(p, 1);
 		}
+	} else {
+		// the output modes
+		avr_timer_summary_update(p);
 	}
 }
 
@@ -1071,6 +1350,31 @@ avr_timer_ioctl(
 			p->ext_clock_flags |= AVR_TIMER_EXTCLK_FLAG_VIRT;
 			res = 0;
 		}
+	} else if (ctl == AVR_IOCTL_TIMER_SET_SUMMARY(p->name)) {
+		p->summary = *((uint32_t*)io_param) & ((1 << AVR_TIMER_COMP_COUNT) - 1);
+		if (p->summary && !p->summary_hooked) {
+			// follow the interrupt enables, they decide what can go
+			avr_io_addr_t reg[1 + AVR_TIMER_COMP_COUNT] = { p->overflow.enable.reg };
+			int count = 1;
+
+			for (int compi = 0; compi < AVR_TIMER_COMP_COUNT; compi++) {
+				avr_io_addr_t r = p->comp[compi].interrupt.enable.reg;
+				int i = 0;
+
+				while (i < count && reg[i] != r)
+					i++;
+				if (r && i == count)
+					reg[count++] = r;
+			}
+			for (int i = 0; i < count; i++)
+				if (reg[i])
+					avr_register_io_write(port->avr, reg[i],
+							avr_timer_write_enable, p);
+			p->summary_hooked = 1;
+		}
+		// not reconfigured, that would start the count over
+		avr_timer_summary_update(p);
+		return 0;
 	}
 	if (res >= 0)
 		avr_timer_reconfigure(p, 0); // virtual clock: attempt to follow frequency change preserving the phase
@@ -1118,6 +1422,7 @@ avr_timer_reset(
 							AVR_TIMER_EXTCLK_FLAG_AS2);
 	p->down = 0;
 	p->bottom = 0;
+	p->summarized = p->summary_all = 0;
 }
 
 static const char * irq_names[TIMER_IRQ_COUNT] = {
@@ -1128,13 +1433,63 @@ static const char * irq_names[TIMER_IRQ_COUNT] = {
 	[TIMER_IRQ_OUT_COMP + 0] = ">compa",
 	[TIMER_IRQ_OUT_COMP + 1] = ">compb",
 	[TIMER_IRQ_OUT_COMP + 2] = ">compc",
+	[TIMER_IRQ_OUT_TOV] = ">tov",
+	[TIMER_IRQ_OUT_DUTY + 0] = "17>dutya",
+	[TIMER_IRQ_OUT_DUTY + 1] = "17>dutyb",
+	[TIMER_IRQ_OUT_DUTY + 2] = "17>dutyc",
+	[TIMER_IRQ_OUT_PERIOD] = "32>period",
 };
 
+static void
+avr_timer_snapshot(
+		struct avr_io_t * port,
+		struct avr_snapshot_t * s)
+{
+	avr_timer_t * p = (avr_timer_t *)port;
+
+	AVR_SNAPSHOT_FIELD(s, p->mode);
+	AVR_SNAPSHOT_FIELD(s, p->wgm_op_mode_kind);
+	AVR_SNAPSHOT_FIELD(s, p->wgm_op_mode_size);
+	AVR_SNAPSHOT_FIELD(s, p->cs_div_value);
+	AVR_SNAPSHOT_FIELD(s, p->down);
+	AVR_SNAPSHOT_FIELD(s, p->bottom);
+	AVR_SNAPSHOT_FIELD(s, p->ext_clock_flags);
+	AVR_SNAPSHOT_FIELD(s, p->ext_clock);
+	AVR_SNAPSHOT_FIELD(s, p->tov_cycles);
+	AVR_SNAPSHOT_FIELD(s, p->tov_cycles_fract);
+	AVR_SNAPSHOT_FIELD(s, p->phase_accumulator);
+	AVR_SNAPSHOT_FIELD(s, p->tov_base);
+	AVR_SNAPSHOT_FIELD(s, p->tov_top);
+	AVR_SNAPSHOT_FIELD(s, p->summarized);
+	AVR_SNAPSHOT_FIELD(s, p->summary_all);
+	for (int compi = 0; compi < AVR_TIMER_COMP_COUNT; compi++) {
+		AVR_SNAPSHOT_FIELD(s, p->comp[compi].comp_cycles);
+		AVR_SNAPSHOT_FIELD(s, p->comp[compi].ocr);
+		AVR_SNAPSHOT_FIELD(s, p->comp[compi].wave_active);
+	}
+	if (!s->restore || s->error)
+		return;
+
+	// the Tn pin is hooked when the clock source is selected
+	avr_ioport_getirq_t req = {
+		.bit = p->ext_clock_pin
+	};
+	if (avr_ioctl(port->avr, AVR_IOCTL_IOPORT_GETIRQ_REGBIT, &req) > 0) {
+		if ((p->ext_clock_flags & (AVR_TIMER_EXTCLK_FLAG_TN |
+								   AVR_TIMER_EXTCLK_FLAG_AS2)) &&
+				!(p->ext_clock_flags & AVR_TIMER_EXTCLK_FLAG_VIRT))
+			avr_irq_register_notify(req.irq[0], avr_timer_irq_ext_clock, p);
+		else
+			avr_irq_unregister_notify(req.irq[0], avr_timer_irq_ext_clock, p);
+	}
+}
+
 static	avr_io_t	_io = {
 	.kind = "timer",
 	.irq_names = irq_names,
 	.reset = avr_timer_reset,
 	.ioctl = avr_timer_ioctl,
+	.snapshot = avr_timer_snapshot,
 };
 
 void
@@ -1157,6 +1512,9 @@ avr_timer_init(
 	p->io.irq[TIMER_IRQ_OUT_PWM0].flags |= IRQ_FLAG_FILTERED;
 	p->io.irq[TIMER_IRQ_OUT_PWM1].flags |= IRQ_FLAG_FILTERED;
 	p->io.irq[TIMER_IRQ_OUT_PWM2].flags |= IRQ_FLAG_FILTERED;
+	for (int compi = 0; compi < AVR_TIMER_COMP_COUNT; compi++)
+		p->io.irq[TIMER_IRQ_OUT_DUTY + compi].flags |= IRQ_FLAG_FILTERED;
+	p->io.irq[TIMER_IRQ_OUT_PERIOD].flags |= IRQ_FLAG_FILTERED;
 
 	if (p->wgm[0].reg) // these are not present on older AVRs
 		avr_register_io_write(avr, p->wgm[0].reg, avr_timer_write, p);
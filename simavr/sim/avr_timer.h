@@ -42,10 +42,19 @@ enum {
 	TIMER_IRQ_OUT_PWM2,
 	TIMER_IRQ_IN_ICP,	// input capture
 	TIMER_IRQ_OUT_COMP,	// comparator pins output IRQ
-
-	TIMER_IRQ_COUNT = TIMER_IRQ_OUT_COMP + AVR_TIMER_COMP_COUNT
+	// pulsed 1 then 0 on each overflow, even if TOV is not enabled
+	TIMER_IRQ_OUT_TOV = TIMER_IRQ_OUT_COMP + AVR_TIMER_COMP_COUNT,
+	// PWM summary, see AVR_IOCTL_TIMER_SET_SUMMARY. Time the output of
+	// each comparator is high, out of AVR_TIMER_DUTY_MAX
+	TIMER_IRQ_OUT_DUTY,
+	// PWM period in cycles, 0 when no comparator is summarized
+	TIMER_IRQ_OUT_PERIOD = TIMER_IRQ_OUT_DUTY + AVR_TIMER_COMP_COUNT,
+
+	TIMER_IRQ_COUNT
 };
 
+#define AVR_TIMER_DUTY_MAX	0x10000
+
 // Get the internal IRQ corresponding to the INT
 #define AVR_IOCTL_TIMER_GETIRQ(_name) AVR_IOCTL_DEF('t','m','r',(_name))
 
@@ -55,6 +64,26 @@ enum {
 #define AVR_IOCTL_TIMER_SET_VIRTCLK(_number) AVR_IOCTL_DEF('t','m','v',(_number))
 // set frequency of the virtual clock generator
 #define AVR_IOCTL_TIMER_SET_FREQCLK(_number) AVR_IOCTL_DEF('t','m','f',(_number))
+/*
+ * PWM summary mode, for outputs only looked at as a duty cycle (LEDs,
+ * motors, panel lamps). The parameter is a uint32_t mask of comparators,
+ * (1 << AVR_TIMER_COMPA) and so on, 0 to turn it off.
+ * In a PWM mode, a comparator in the mask gets no cycle timers when its
+ * interrupt is off, it doesn't toggle, and nothing but its pin listens
+ * to TIMER_IRQ_OUT_COMP: TIMER_IRQ_OUT_DUTY and TIMER_IRQ_OUT_PERIOD
+ * are raised when OCR, TOP, the prescaler or the output mode change, and
+ * OCR is used at once rather than at TOP or BOTTOM. The pin is only
+ * driven when the duty is 0 or 100%, and the compare match flag is not
+ * set. When all comparators are summarized, the overflow interrupt is
+ * off and nothing listens to TIMER_IRQ_OUT_TOV, the overflow gets no
+ * cycle timer either, and its flag is not set.
+ * What is summarized is looked at again when the mask, the mode, OCR,
+ * the prescaler, the output modes or the interrupt enables are written,
+ * not when something connects to an IRQ: connect to TIMER_IRQ_OUT_COMP
+ * or TIMER_IRQ_OUT_TOV first, or set the mask again after. The count
+ * carries on across all of these, with the mask turned off too.
+ */
+#define AVR_IOCTL_TIMER_SET_SUMMARY(_number) AVR_IOCTL_DEF('t','m','s',(_number))
 
 // Waveform generation modes
 enum {
@@ -168,6 +197,11 @@ typedef struct avr_timer_t {
 	float			phase_accumulator;
 	uint64_t		tov_base;	// MCU cycle when the last overflow occured; when clocked externally holds external clock count
 	uint16_t		tov_top;	// current top value to calculate tnct
+
+	uint8_t			summary;		// comparators in PWM summary mode
+	uint8_t			summarized;		// those that have no cycle timers now
+	uint8_t			summary_all;	// nor the overflow, tov_base is then the phase
+	uint8_t			summary_hooked;	// on the interrupt enable registers
 } avr_timer_t;
 
 void avr_timer_init(avr_t * avr, avr_timer_t * port);
@@ -32,6 +32,7 @@
 #include "sim_hex.h"
 #include "sim_time.h"
 #include "sim_gdb.h"
+#include "sim_snapshot.h"
 
 //#define TRACE(_w) _w
 #ifndef TRACE
@@ -491,11 +492,27 @@ static const char * irq_names[UART_IRQ_COUNT] = {
 	[UART_IRQ_OUT_XOFF] = ">xoff",
 };
 
+static void
+avr_uart_snapshot(
+		struct avr_io_t * port,
+		struct avr_snapshot_t * s)
+{
+	avr_uart_t * p = (avr_uart_t *)port;
+
+	AVR_SNAPSHOT_FIELD(s, p->input);
+	AVR_SNAPSHOT_FIELD(s, p->tx_cnt);
+	AVR_SNAPSHOT_FIELD(s, p->rx_cnt);
+	AVR_SNAPSHOT_FIELD(s, p->flags);
+	AVR_SNAPSHOT_FIELD(s, p->cycles_per_byte);
+	AVR_SNAPSHOT_FIELD(s, p->rxc_raise_time);
+}
+
 static	avr_io_t	_io = {
 	.kind = "uart",
 	.reset = avr_uart_reset,
 	.ioctl = avr_uart_ioctl,
 	.irq_names = irq_names,
+	.snapshot = avr_uart_snapshot,
 };
 
 void
@@ -518,6 +535,8 @@ avr_uart_init(
 	avr_io_setirqs(&p->io, AVR_IOCTL_UART_GETIRQ(p->name), UART_IRQ_COUNT, NULL);
 	// Only call callbacks when the value change...
 	p->io.irq[UART_IRQ_OUT_XOFF].flags |= IRQ_FLAG_FILTERED;
+	// Received bytes come from outside, log them for replay
+	p->io.irq[UART_IRQ_INPUT].flags |= IRQ_FLAG_RECORD;
 
 	avr_register_io_write(avr, p->r_udr, avr_uart_udr_write, p);
 	avr_register_io_read(avr, p->r_udr, avr_uart_read, p);
@@ -24,6 +24,7 @@
 #include "avr_ioport.h"
 #include "avr_usi.h"
 #include "avr_timer.h"
+#include "sim_snapshot.h"
 
 #define _BV(r) ((r).mask << (r).bit)
 
@@ -410,10 +411,22 @@ static const char * irq_names[USI_IRQ_COUNT] = {
 	[USI_IRQ_TIM0_COMP] = "<tim0_comp",
 };
 
+static void
+avr_usi_snapshot(
+		struct avr_io_t * port,
+		struct avr_snapshot_t * s)
+{
+	avr_usi_t * p = (avr_usi_t *)port;
+
+	AVR_SNAPSHOT_FIELD(s, p->clock_high);
+	AVR_SNAPSHOT_FIELD(s, p->in_bit0);
+}
+
 static avr_io_t _io = {
 	.kind = "usi",
 	.reset = avr_usi_reset,
 	.irq_names = irq_names,
+	.snapshot = avr_usi_snapshot,
 };
 
 void avr_usi_init(avr_t * avr, avr_usi_t * p)
@@ -0,0 +1,106 @@
+/*
+	fuzz_avr.c
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * libFuzzer entry points, see sim_fuzz.h. Build with
+ *
+ *	make -C simavr fuzz_avr CC=clang
+ *
+ * and set the firmware and what to fuzz in the environment:
+ *
+ *	SIMAVR_FUZZ_FIRMWARE	ELF or HEX file, required
+ *	SIMAVR_FUZZ_MCU			and SIMAVR_FUZZ_FREQ, for a HEX file
+ *	SIMAVR_FUZZ_INPUT		uart0 (default), twi0@<address> or gpioB
+ *	SIMAVR_FUZZ_READY		PC to checkpoint at, in bytes
+ *	SIMAVR_FUZZ_BUDGET		cycles per input
+ *
+ * then run it as any libFuzzer target, with as many -jobs as there are
+ * cores. Failing inputs abort(), for libFuzzer to save them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "sim_hex.h"
+#include "sim_fuzz.h"
+
+// libFuzzer counts edges from these as well as from its own instrumentation
+static uint8_t counters[AVR_FUZZ_MAP]
+		__attribute__((section("__libfuzzer_extra_counters")));
+
+static avr_fuzz_t fuzz;
+
+int
+LLVMFuzzerInitialize(
+		int * argc,
+		char *** argv)
+{
+	const char * firmware = getenv("SIMAVR_FUZZ_FIRMWARE");
+	const char * env;
+	elf_firmware_t f = {{0}};
+	avr_t * avr;
+
+	if (!firmware) {
+		fprintf(stderr, "fuzz_avr: set SIMAVR_FUZZ_FIRMWARE\n");
+		exit(1);
+	}
+	sim_setup_firmware(firmware, AVR_SEGMENT_OFFSET_FLASH, &f, "fuzz_avr");
+	if ((env = getenv("SIMAVR_FUZZ_MCU")))
+		snprintf(f.mmcu, sizeof(f.mmcu), "%s", env);
+	if ((env = getenv("SIMAVR_FUZZ_FREQ")))
+		f.frequency = strtoul(env, NULL, 0);
+	avr = avr_make_mcu_by_name(f.mmcu);
+	if (!avr || avr_init(avr)) {
+		fprintf(stderr, "fuzz_avr: AVR '%s' not known\n", f.mmcu);
+		exit(1);
+	}
+	avr_load_firmware(avr, &f);
+
+	fuzz.map = counters;
+	if (avr_fuzz_parse_input(&fuzz, (env = getenv("SIMAVR_FUZZ_INPUT")) ?
+			env : "uart0")) {
+		fprintf(stderr, "fuzz_avr: bad SIMAVR_FUZZ_INPUT %s\n", env);
+		exit(1);
+	}
+	if ((env = getenv("SIMAVR_FUZZ_READY")))
+		fuzz.ready = strtoul(env, NULL, 0);
+	if ((env = getenv("SIMAVR_FUZZ_BUDGET")))
+		fuzz.budget = strtoull(env, NULL, 0);
+	if (avr_fuzz_init(&fuzz, avr))
+		exit(1);
+	return 0;
+}
+
+int
+LLVMFuzzerTestOneInput(
+		const uint8_t * data,
+		size_t size)
+{
+	int res = avr_fuzz_run(&fuzz, data, size);
+
+	if (res != AVR_FUZZ_IDLE && res != AVR_FUZZ_BUDGET_HIT) {
+		fprintf(stderr, "fuzz_avr: %s\n", avr_fuzz_result_name(res));
+		abort();
+	}
+	return 0;
+}
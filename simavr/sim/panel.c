@@ -28,6 +28,7 @@
 #include <dlfcn.h>
 #include <time.h>
 #include <sys/time.h>
+#include <signal.h>
 
 #include "blink/sim.h"
 
@@ -37,101 +38,128 @@
 #include "sim_elf.h"
 #include "sim_cycle_timers.h"
 #include "sim_vcd_file.h"
+#include "sim_record.h"
 #include "avr_ioport.h"
 #include "avr_adc.h"
 #include "sim_core_config.h"
 
-static avr_t *The_avr;  // Ugly
+struct panel;
+
+/* Every Blink handle points at one of these, so that push_val() can
+ * find the panel and the item from the handle alone.
+ */
+
+struct handle {
+    struct panel *panel;
+    struct port  *port;                                 // NULL: not a port.
+    int           item;
+};
 
 /* Data structures to track the simulated MCU's I/O ports. */
 
 #define HANDLES_PER_PORT 3
 
 struct port {
-    avr_t       *avr;
-    avr_irq_t   *base_irq;
-    char         port_letter, vcd_letter;
-    uint8_t      output, ddr, actual;
-    uint8_t      sor, sow;                              // Stop indicators.
-    struct port *handle_finder[HANDLES_PER_PORT];       // See push_val().
+    struct panel *panel;
+    avr_t        *avr;
+    avr_irq_t    *base_irq;
+    avr_irq_t    *in_irq;                               // Chained to pins.
+    char          port_letter, vcd_letter;
+    uint8_t       output, ddr, actual;
+    uint8_t       sor, sow;                             // Stop indicators.
+    struct handle handles[HANDLES_PER_PORT];            // See push_val().
 };
 
-/* Blink uses these to control running of the simulator. */
+/* Blink handles associated with ports. */
 
-static struct run_control Brc;
-static int Burst_preset;                                // For stop/start
+#define PORT_HANDLE(pp, i) ((Sim_RH)((pp)->handles + (i)))
 
-/* Blink library function table and initialisation argument. */
+#define SOR     1       // Stop on read
+#define SOW     2       // Stop on write
 
-static struct blink_functs *Bfp;
+/* Non-port Blink items. */
+
+enum {
+    PC_item = 0,
+    Cycles_item,
+    ADC_input_pos_item,
+    ADC_channel_pos_item,
+    ADC_input_neg_item,
+    ADC_channel_neg_item,
+    ADC_SOR_item,
+    PANEL_ITEMS
+};
 
-static int  push_val(Sim_RH handle, unsigned int value);
-static void stop(void);
-static const struct simulator_calls blink_callbacks =
-    {.sim_push_val = push_val,
-     .sim_done = stop,
-    };
+#define PANEL_HANDLE(p, i) ((Sim_RH)((p)->handles + (i)))
 
 /* For ADC input. */
 
 #define ADC_CHANNEL_COUNT 16
 
-static avr_irq_t   *ADC_base_irq;
-static int          ADC_sor;
-static unsigned int ADC_chan_pos, ADC_chan_neg;
+/* The state of a panel, passed to the simulator's callbacks. */
 
-static unsigned int ADC_update_chan = ADC_CHANNEL_COUNT;
-static Sim_RH       ADC_update_handle;
-static char         ADC_vcd_letter;
+struct panel {
+    avr_t                *avr;
 
-/* Blink handles associated with ports. */
+    /* Blink library function table, and how it controls the simulator. */
 
-#define PORT_HANDLE(pp, i) (pp->handle_finder + i)
+    struct blink_functs  *bfp;
+    struct run_control    brc;
+    int                   burst_preset;                 // For stop/start
+    int                   burst_done;
 
-#define SOR     1       // Stop on read
-#define SOW     2       // Stop on write
+    avr_irq_t            *adc_base_irq;
+    int                   adc_sor;
+    unsigned int          adc_chan_pos, adc_chan_neg;
+    unsigned int          adc_update_chan;
+    Sim_RH                adc_update_handle;
+    char                  adc_vcd_letter;
 
-/* Handles for non-port Blink items. */
+    /* File handle and timestamp for VCD recording of input. */
 
-#define PC_handle              ((Sim_RH)1)
-#define Cycles_handle          ((Sim_RH)2)
-#define ADC_input_pos_handle   ((Sim_RH)3)
-#define ADC_channel_pos_handle ((Sim_RH)4)
-#define ADC_input_neg_handle   ((Sim_RH)5)
-#define ADC_channel_neg_handle ((Sim_RH)6)
-#define ADC_SOR_handle         ((Sim_RH)7)
+    FILE                 *vcd_fh;
+    long unsigned int     last_stamp;
 
-/* Make handles useable as case labels. */
+    /* Ugly way to avoid deadlock during VCD playback, perhaps the IRQ
+     * mechanism should be modified to eliminate this.
+     */
 
-#define CS(x) ((intptr_t)(x))
+    int                   blink_input_active;
 
-/* File handle and timestamp for VCD recording of input. */
+    struct timeval        last_tv;                      // Display update.
+    struct handle         handles[PANEL_ITEMS];
+};
 
-static FILE              *vcd_fh;
-static long unsigned int  Last_stamp = (long unsigned int)-1;
+static int  push_val(Sim_RH handle, unsigned int value);
+static void stop(void);
+static const struct simulator_calls blink_callbacks =
+    {.sim_push_val = push_val,
+     .sim_done = stop,
+    };
 
-/* Ugly way to avoid deadlock during VCD playback, perhaps the IRQ
- * mechanism should be modified to eliminate this.
+/* Blink's sim_done callback has no argument, and Blink has one window
+ * per process: this is the panel it shows.  Everything else is reached
+ * through handles and callback parameters.
  */
 
-static int Blink_input_active;
+static struct panel *Blink_panel;
 
 /* Ask Blink for the number of cycles to simulate. */
 
-static void get_next_burst(void)
+static void get_next_burst(struct panel *p)
 {
     do {
-        Bfp->run_control(&Brc);
-        if (ADC_update_chan < ADC_CHANNEL_COUNT) {
+        p->bfp->run_control(&p->brc);
+        if (p->adc_update_chan < ADC_CHANNEL_COUNT) {
             uint32_t  input;
 
             /* Deferred ADC channel update. */
 
-            input = ADC_base_irq[ADC_update_chan].value;
-            Bfp->new_value(ADC_update_handle, input);
-            ADC_update_chan = ADC_CHANNEL_COUNT; // Sentinel value.
+            input = p->adc_base_irq[p->adc_update_chan].value;
+            p->bfp->new_value(p->adc_update_handle, input);
+            p->adc_update_chan = ADC_CHANNEL_COUNT; // Sentinel value.
         }
-    } while (Brc.burst == 0);
+    } while (p->brc.burst == 0);
 }
 
 /* Stop the simulation when some event occurs.  Argument is the
@@ -142,27 +170,27 @@ static avr_cycle_count_t burst_complete(struct avr_t      *avr,
                                         avr_cycle_count_t  when,
                                         void              *param);
 
-static void stop_on_event(avr_t *avr, Sim_RH button)
+static void stop_on_event(struct panel *p, Sim_RH button)
 {
     /* This cancels the previous end-of-burst callback and re-schedules it
      * for immediate execution.  That stops simavr from running.
      */
 
-    avr_cycle_timer_register(avr, 0, burst_complete, NULL);
+    avr_cycle_timer_register(p->avr, 0, burst_complete, p);
 
     /* Tell UI. */
 
-    Bfp->stopped();                             /* Notify UI. */
-    Bfp->new_flags(button, 1);                  /* Change lamp colour. */
+    p->bfp->stopped();                          /* Notify UI. */
+    p->bfp->new_flags(button, 1);               /* Change lamp colour. */
 
     /* Get next execution burst from Blink. */
 
-    get_next_burst();
-    Burst_preset = 1;
+    get_next_burst(p);
+    p->burst_preset = 1;
 
     /* Revert SoR control lamp colour. */
 
-    Bfp->new_flags(button, 0);                  /* Change lamp colour. */
+    p->bfp->new_flags(button, 0);               /* Change lamp colour. */
 }
 
 /* Notification of reading from a GPIO port.  Enabled for Stop on Read. */
@@ -172,7 +200,7 @@ static void d_read_notify(struct avr_irq_t *irq, uint32_t value, void *param)
     struct port *pp;
 
     pp = (struct port *)param;
-    stop_on_event(pp->avr, PORT_HANDLE(pp, SOR));
+    stop_on_event(pp->panel, PORT_HANDLE(pp, SOR));
 }
 
 /* ADC input is being read. */
@@ -183,29 +211,32 @@ static void adc_read_notify(struct avr_irq_t *irq, uint32_t value, void *param)
         avr_adc_mux_t mux;
         uint32_t      v;
     }         e;
-    uint32_t  input;
+    uint32_t      input;
+    struct panel *p = (struct panel *)param;
 
     /* Show the channel(s) being read and current value(s). */
 
     e.v = value;
-    if (e.mux.src != ADC_chan_pos) {
-        ADC_chan_pos = e.mux.src;
-        Bfp->new_value(ADC_channel_pos_handle, ADC_chan_pos);
-        input = ADC_base_irq[ADC_chan_pos].value;
-        Bfp->new_value(ADC_input_pos_handle, input);
+    if (e.mux.src != p->adc_chan_pos) {
+        p->adc_chan_pos = e.mux.src;
+        p->bfp->new_value(PANEL_HANDLE(p, ADC_channel_pos_item),
+                          p->adc_chan_pos);
+        input = p->adc_base_irq[p->adc_chan_pos].value;
+        p->bfp->new_value(PANEL_HANDLE(p, ADC_input_pos_item), input);
     }
 
-    if (e.mux.kind == ADC_MUX_DIFF && e.mux.diff != ADC_chan_neg) {
-        ADC_chan_neg = e.mux.diff;
-        Bfp->new_value(ADC_channel_neg_handle, ADC_chan_neg);
-        input = ADC_base_irq[ADC_chan_neg].value;
-        Bfp->new_value(ADC_input_neg_handle, input);
+    if (e.mux.kind == ADC_MUX_DIFF && e.mux.diff != p->adc_chan_neg) {
+        p->adc_chan_neg = e.mux.diff;
+        p->bfp->new_value(PANEL_HANDLE(p, ADC_channel_neg_item),
+                          p->adc_chan_neg);
+        input = p->adc_base_irq[p->adc_chan_neg].value;
+        p->bfp->new_value(PANEL_HANDLE(p, ADC_input_neg_item), input);
     }
 
-    if (ADC_sor) {
+    if (p->adc_sor) {
         /* Stop so that the entries can be changed. */
 
-        stop_on_event((avr_t *)param, ADC_SOR_handle);
+        stop_on_event(p, PANEL_HANDLE(p, ADC_SOR_item));
     }
 }
 
@@ -225,7 +256,7 @@ static void d_out_notify(avr_irq_t *irq, uint32_t value, void *param)
 
     pp = (struct port *)param;
     if (irq->irq == IOPORT_IRQ_DIRECTION_ALL) {
-        Bfp->new_flags(PORT_HANDLE(pp, 0), ~value);
+        pp->panel->bfp->new_flags(PORT_HANDLE(pp, 0), ~value);
         ddr = pp->ddr = (uint8_t)value;
         out = pp->output;
     } else {
@@ -233,9 +264,9 @@ static void d_out_notify(avr_irq_t *irq, uint32_t value, void *param)
         out = pp->output = (uint8_t)value;
     }
     pp->actual = (out & ddr) | (pp->actual & ~ddr);
-    Bfp->new_value(PORT_HANDLE(pp, 0), pp->actual);
+    pp->panel->bfp->new_value(PORT_HANDLE(pp, 0), pp->actual);
     if (pp->sow)
-        stop_on_event(pp->avr, PORT_HANDLE(pp, SOW));
+        stop_on_event(pp->panel, PORT_HANDLE(pp, SOW));
 }
 
 /* Notification of a pin change.  Used to display VCD input, but will
@@ -247,9 +278,9 @@ static void vcd_in_notify(avr_irq_t *irq, uint32_t value, void *param)
     struct port *pp;
     uint8_t      mask;
 
-    if (Blink_input_active)
-        return;
     pp = (struct port *)param;
+    if (pp->panel->blink_input_active)
+        return;
     mask = (1 << irq->irq);
     if ((mask & pp->ddr) == 0) {
         /* VCD input. */
@@ -258,7 +289,7 @@ static void vcd_in_notify(avr_irq_t *irq, uint32_t value, void *param)
             pp->actual |= mask;
         else
             pp->actual &= ~mask;
-        Bfp->new_value(PORT_HANDLE(pp, 0), pp->actual);
+        pp->panel->bfp->new_value(PORT_HANDLE(pp, 0), pp->actual);
     }
 }
 
@@ -266,21 +297,23 @@ static void vcd_in_notify(avr_irq_t *irq, uint32_t value, void *param)
 
 static void vcd_adc_in_notify(avr_irq_t *irq, uint32_t value, void *param)
 {
-    unsigned int channel;
+    struct panel *p = (struct panel *)param;
+    unsigned int  channel;
 
-    if (Blink_input_active)
+    if (p->blink_input_active)
         return;
     channel = irq->irq;
-    Bfp->new_value(ADC_channel_pos_handle, channel);
-    Bfp->new_value(ADC_input_pos_handle, value);
-    if (channel == ADC_chan_neg)
-        Bfp->new_value(ADC_input_neg_handle, value);
+    p->bfp->new_value(PANEL_HANDLE(p, ADC_channel_pos_item), channel);
+    p->bfp->new_value(PANEL_HANDLE(p, ADC_input_pos_item), value);
+    if (channel == p->adc_chan_neg)
+        p->bfp->new_value(PANEL_HANDLE(p, ADC_input_neg_item), value);
 }
 
 /* New port bits from Blink. */
 
 static void port_input(struct port *pp, unsigned int value)
 {
+    struct panel            *p = pp->panel;
     unsigned int             changed, mask, dirty, i;
 
     changed = value ^ pp->actual;
@@ -299,12 +332,12 @@ static void port_input(struct port *pp, unsigned int value)
 
                     bit = ((value & mask) != 0);
 
-                    /* Push changed bit into simavr.
-                     * The first 8 IRQs set individual bits.
+                    /* Push changed bit into simavr, through
+                     * an IRQ chained to the pin, so it can be recorded.
                      */
 
-                    avr_raise_irq(pp->base_irq + i, bit);
-                    if (vcd_fh) {
+                    avr_raise_irq(pp->in_irq + i, bit);
+                    if (p->vcd_fh) {
                         avr_t             *avr;
                         long unsigned int  stamp;
 
@@ -312,11 +345,11 @@ static void port_input(struct port *pp, unsigned int value)
 
                         avr = pp->avr;
                         stamp = (avr->cycle * 100*1000*1000) / avr->frequency;
-                        if (stamp != Last_stamp) {
-                            fprintf(vcd_fh, "\n#%lu", stamp);
-                            Last_stamp = stamp;
+                        if (stamp != p->last_stamp) {
+                            fprintf(p->vcd_fh, "\n#%lu", stamp);
+                            p->last_stamp = stamp;
                         }
-                        fprintf(vcd_fh, " %c%c",
+                        fprintf(p->vcd_fh, " %c%c",
                                 bit + '0', pp->vcd_letter + i);
                     }
                 }
@@ -339,93 +372,91 @@ static void port_input(struct port *pp, unsigned int value)
 
 /* Write analogue input value to VCD file. */
 
-static void write_adc_vcd(unsigned int chan, unsigned int value)
+static void write_adc_vcd(struct panel *p, unsigned int chan,
+                          unsigned int value)
 {
     long unsigned int  stamp;
 
-    stamp = (The_avr->cycle * 100*1000*1000) / The_avr->frequency;
-    if (stamp != Last_stamp) {
-        fprintf(vcd_fh, "\n#%lu", stamp);
-        Last_stamp = stamp;
+    stamp = (p->avr->cycle * 100*1000*1000) / p->avr->frequency;
+    if (stamp != p->last_stamp) {
+        fprintf(p->vcd_fh, "\n#%lu", stamp);
+        p->last_stamp = stamp;
     }
 
     /* Using real, what is the correct VCD form for integers? */
 
-    fprintf(vcd_fh, " r%u %c", value, ADC_vcd_letter + chan);
+    fprintf(p->vcd_fh, " r%u %c", value, p->adc_vcd_letter + chan);
 }
 
 /* Function called by Blink with new input values. */
 
 static int push_val(Sim_RH handle, unsigned int value)
 {
-    struct port  *pp, **ppp;
-    uintptr_t     handle_type;
-
-    Blink_input_active = 1;
-    handle_type = (uintptr_t)handle;
-    if (handle_type <= 'Z') {
-        switch (handle_type) {
-        case CS(PC_handle):
+    struct handle *hp = (struct handle *)handle;
+    struct panel  *p = hp->panel;
+    struct port   *pp = hp->port;
+
+    p->blink_input_active = 1;
+    if (!pp) {
+        switch (hp->item) {
+        case PC_item:
             fprintf(stderr, "Changed PC!\n");
             break;
-        case CS(Cycles_handle):
+        case Cycles_item:
             fprintf(stderr, "Changed cycle count!\n");
             break;
-        case CS(ADC_input_pos_handle):
-            avr_raise_irq(ADC_base_irq + ADC_chan_pos, value);
-            if (ADC_chan_pos == ADC_chan_neg) {
+        case ADC_input_pos_item:
+            avr_raise_irq(p->adc_base_irq + p->adc_chan_pos, value);
+            if (p->adc_chan_pos == p->adc_chan_neg) {
                 /* Update other entry field. */
 
-                ADC_update_chan = ADC_chan_pos;
-                ADC_update_handle = ADC_input_neg_handle;
+                p->adc_update_chan = p->adc_chan_pos;
+                p->adc_update_handle = PANEL_HANDLE(p, ADC_input_neg_item);
             }
-            if (vcd_fh)
-                write_adc_vcd(ADC_chan_pos, value);
+            if (p->vcd_fh)
+                write_adc_vcd(p, p->adc_chan_pos, value);
             break;
-        case CS(ADC_channel_pos_handle):
+        case ADC_channel_pos_item:
             if (value < ADC_CHANNEL_COUNT) {
-                ADC_chan_pos = value;
-                ADC_update_chan = value;
-                ADC_update_handle = ADC_input_pos_handle;
+                p->adc_chan_pos = value;
+                p->adc_update_chan = value;
+                p->adc_update_handle = PANEL_HANDLE(p, ADC_input_pos_item);
             }
             break;
-        case CS(ADC_input_neg_handle):
-            avr_raise_irq(ADC_base_irq + ADC_chan_neg, value);
-            if (ADC_chan_pos == ADC_chan_neg) {
+        case ADC_input_neg_item:
+            avr_raise_irq(p->adc_base_irq + p->adc_chan_neg, value);
+            if (p->adc_chan_pos == p->adc_chan_neg) {
                 /* Update other entry field. */
 
-                ADC_update_chan = ADC_chan_pos;
-                ADC_update_handle = ADC_input_pos_handle;
+                p->adc_update_chan = p->adc_chan_pos;
+                p->adc_update_handle = PANEL_HANDLE(p, ADC_input_pos_item);
             }
-            if (vcd_fh)
-                write_adc_vcd(ADC_chan_neg, value);
+            if (p->vcd_fh)
+                write_adc_vcd(p, p->adc_chan_neg, value);
             break;
-        case CS(ADC_channel_neg_handle):
+        case ADC_channel_neg_item:
             if (value < ADC_CHANNEL_COUNT) {
-                ADC_chan_neg = value;
-                ADC_update_chan = value;
-                ADC_update_handle = ADC_input_neg_handle;
+                p->adc_chan_neg = value;
+                p->adc_update_chan = value;
+                p->adc_update_handle = PANEL_HANDLE(p, ADC_input_neg_item);
             }
             break;
-        case CS(ADC_SOR_handle):
+        case ADC_SOR_item:
             /* Stop on read. */
 
-            ADC_sor = value;
+            p->adc_sor = value;
             break;
         }
 
         /* Immediate return from Blink_run_control() if ADC channel changed.*/
 
-        Blink_input_active = 0;
-        return ADC_update_chan < ADC_CHANNEL_COUNT;
+        p->blink_input_active = 0;
+        return p->adc_update_chan < ADC_CHANNEL_COUNT;
     }
 
     /* Other handles are associated with a port. */
 
-    ppp = (struct port **)handle;
-    pp = *ppp;
-    handle_type = ppp - pp->handle_finder;
-    switch (handle_type) {
+    switch (hp->item) {
     case 0:
         /* New input value for port. */
 
@@ -450,19 +481,17 @@ static int push_val(Sim_RH handle, unsigned int value)
         pp->sow = value;
         break;
     }
-    Blink_input_active = 0;
+    p->blink_input_active = 0;
     return 0;
 }
 
-static int burst_done;
-
 /* The simulator calls back here after each burst of execution. */
 
 static avr_cycle_count_t burst_complete(struct avr_t      *avr,
                                         avr_cycle_count_t  when,
                                         void              *param)
 {
-    burst_done = 1;
+    ((struct panel *)param)->burst_done = 1;
     return 0;
 }
 
@@ -509,23 +538,28 @@ static int my_avr_run(avr_t *avr)
 
 static void panel_close(avr_t *avr, void *data)
 {
-    if (vcd_fh)
-        fclose(vcd_fh);
-    vcd_fh = NULL;
+    struct panel *p = (struct panel *)data;
+
+    if (p->vcd_fh)
+        fclose(p->vcd_fh);
+    p->vcd_fh = NULL;
 }
 
 /* Clean-up function, called when window closed. */
 
 static void stop(void)
 {
-    avr_terminate(The_avr);
+    if (Blink_panel)
+        avr_terminate(Blink_panel->avr);
 }
 
 /* Open the VCD output file. */
 
-static void start_vcd(avr_t *avr, elf_firmware_t *fwp,
+static void start_vcd(struct panel *p, elf_firmware_t *fwp,
                       const char *firmware)
 {
+    avr_t     *avr = p->avr;
+    FILE      *vcd_fh;
     avr_vcd_t *vcd;
     time_t     now;
     int        len;
@@ -541,7 +575,7 @@ static void start_vcd(avr_t *avr, elf_firmware_t *fwp,
     if (len > 4 && fn_buf[len - 4] == '.')
         len -= 4;
     strcpy(fn_buf + len, "_input.vcd");
-    vcd_fh = fopen(fn_buf, "w");
+    vcd_fh = p->vcd_fh = fopen(fn_buf, "w");
     if (!vcd_fh) {
         fprintf(stderr,
                 "Failed to open file %s for recording panel input: %s\n",
@@ -552,6 +586,7 @@ static void start_vcd(avr_t *avr, elf_firmware_t *fwp,
     /* Request callback at simulation end. */
 
     avr->custom.deinit = panel_close;
+    avr->custom.data = p;
 
     /* Write VCD file header. */
 
@@ -570,7 +605,8 @@ static void start_vcd(avr_t *avr, elf_firmware_t *fwp,
 
 static void port_reg(char port_letter, struct port *pp)
 {
-    Blink_RH   row;
+    struct blink_functs *Bfp = pp->panel->bfp;
+    Blink_RH             row;
     char       name_buff[8];
 
     sprintf(name_buff, "PORT%c", port_letter);
@@ -583,18 +619,22 @@ static void port_reg(char port_letter, struct port *pp)
     Bfp->new_flags(PORT_HANDLE(pp, 0), 0xff);  /* All inputs - inverted. */
 }
 
-static void show_adc(void)
+static void show_adc(struct panel *p)
 {
-    Blink_RH   row;
+    struct blink_functs *Bfp = p->bfp;
+    Blink_RH             row;
 
     row = Bfp->new_row("ADC");
-    Bfp->add_register("mV", ADC_input_neg_handle, 13, RO_STYLE_DECIMAL, row);
-    Bfp->add_register("Channel -", ADC_channel_neg_handle, 4,
+    Bfp->add_register("mV", PANEL_HANDLE(p, ADC_input_neg_item), 13,
+                      RO_STYLE_DECIMAL, row);
+    Bfp->add_register("Channel -", PANEL_HANDLE(p, ADC_channel_neg_item), 4,
                       RO_STYLE_SPIN, row);
-    Bfp->add_register("mV", ADC_input_pos_handle, 13, RO_STYLE_DECIMAL, row);
-    Bfp->add_register("Channel +", ADC_channel_pos_handle, 4,
+    Bfp->add_register("mV", PANEL_HANDLE(p, ADC_input_pos_item), 13,
+                      RO_STYLE_DECIMAL, row);
+    Bfp->add_register("Channel +", PANEL_HANDLE(p, ADC_channel_pos_item), 4,
                       RO_STYLE_SPIN, row);
-    Bfp->add_register("SoR", ADC_SOR_handle, 1, RO_ALT_COLOURS, row);
+    Bfp->add_register("SoR", PANEL_HANDLE(p, ADC_SOR_item), 1,
+                      RO_ALT_COLOURS, row);
     Bfp->close_row(row);
 }
 
@@ -603,17 +643,28 @@ static void show_adc(void)
  */
 
 int Run_with_panel(avr_t *avr, elf_firmware_t *fwp, const char *firmware,
-                   int vcd_input)
+                   int vcd_input, volatile sig_atomic_t *quit)
 {
-    void        *handle;
-    struct port *pp;
-    Blink_RH     row;
-    int          state, len, i;
-    char         port_letter, vcd_letter;
-    char        *fwcp;
-    char         wn[64];
-
-    The_avr = avr;
+    void                *handle;
+    struct panel        *p;
+    struct blink_functs *Bfp;
+    struct port         *pp;
+    Blink_RH             row;
+    int                  state, len, i;
+    char                 port_letter, vcd_letter;
+    char                *fwcp;
+    char                 wn[64];
+
+    p = calloc(1, sizeof *p);
+    if (!p)
+        return 0;
+    p->avr = avr;
+    p->adc_update_chan = ADC_CHANNEL_COUNT;
+    p->last_stamp = (long unsigned int)-1;
+    for (i = 0; i < PANEL_ITEMS; ++i) {                 // See push_val().
+        p->handles[i].panel = p;
+        p->handles[i].item = i;
+    }
 
     /* Load the Blink library. This is a dynamic load because Blink
      * should not be a hard pre-requisite for simavr.
@@ -628,7 +679,7 @@ int Run_with_panel(avr_t *avr, elf_firmware_t *fwp, const char *firmware,
         return 0;
     }
 
-    Bfp = (struct blink_functs *)dlsym(handle, "Blink_FPs");
+    Bfp = p->bfp = (struct blink_functs *)dlsym(handle, "Blink_FPs");
     if (Bfp == NULL) {
         fprintf(stderr, "%s\n", dlerror());
         return 0;
@@ -641,22 +692,23 @@ int Run_with_panel(avr_t *avr, elf_firmware_t *fwp, const char *firmware,
     free(fwcp);
     if (len > 4 && wn[len - 4] == '.')
         wn[len - 4] = '\0';
+    Blink_panel = p;
     if (!Bfp->init(wn, (struct simulator_calls *)&blink_callbacks))
         return 0;
 
     /* Display simulated PC and cycle count. */
 
     row = Bfp->new_row("AVR");
-    Bfp->add_register("Cycles", Cycles_handle, 32,
+    Bfp->add_register("Cycles", PANEL_HANDLE(p, Cycles_item), 32,
                       RO_INSENSITIVE | RO_STYLE_DECIMAL, row);
-    Bfp->add_register("PC", PC_handle, 20,
+    Bfp->add_register("PC", PANEL_HANDLE(p, PC_item), 20,
                       RO_INSENSITIVE | RO_STYLE_HEX, row);
     Bfp->close_row(row);
 
     /* Check for VCD output. */
 
     if (avr->vcd) {
-        start_vcd(avr, fwp, firmware);
+        start_vcd(p, fwp, firmware);
         vcd_letter = '!';
     }
 
@@ -675,11 +727,35 @@ int Run_with_panel(avr_t *avr, elf_firmware_t *fwp, const char *firmware,
             pp = calloc(1, sizeof *pp);
             if (!pp)
                 return 0;
+            pp->panel = p;
             pp->avr = avr;
             pp->base_irq = base_irq;
             pp->port_letter = port_letter;
-            for (i = 0; i < HANDLES_PER_PORT; ++i)      // See push_val().
-                pp->handle_finder[i] = pp;
+
+            /* Input from Blink goes to the first 8 IRQs, that set
+             * individual bits, through IRQs of our own.
+             */
+
+            {
+                char        names[8][16];
+                const char *np[8];
+
+                for (i = 0; i < 8; ++i) {
+                    snprintf(names[i], sizeof names[i], "<panel.%c%d",
+                             port_letter, i);
+                    np[i] = names[i];
+                }
+                pp->in_irq = avr_alloc_irq(&avr->irq_pool, 0, 8, np);
+                for (i = 0; i < 8; ++i) {
+                    avr_record_input(pp->in_irq + i);
+                    avr_connect_irq(pp->in_irq + i, base_irq + i);
+                }
+            }
+            for (i = 0; i < HANDLES_PER_PORT; ++i) {    // See push_val().
+                pp->handles[i].panel = p;
+                pp->handles[i].port = pp;
+                pp->handles[i].item = i;
+            }
 #if 0
             avr_irq_register_notify(base_irq + IOPORT_IRQ_REG_PORT,
                                     d_out_notify, pp);
@@ -706,10 +782,10 @@ int Run_with_panel(avr_t *avr, elf_firmware_t *fwp, const char *firmware,
              * The "readable" name contains a simavr ioctl.
              */
 
-            if (vcd_fh && vcd_letter <= 120) {
+            if (p->vcd_fh && vcd_letter <= 120) {
                 pp->vcd_letter = vcd_letter;
                 for (i = 0; i < 8; ++i, ++vcd_letter) {
-                    fprintf(vcd_fh, "$var wire 1 %c iog%c_%d $end\n",
+                    fprintf(p->vcd_fh, "$var wire 1 %c iog%c_%d $end\n",
                             vcd_letter, pp->port_letter, i);
                 }
             } else {
@@ -720,20 +796,20 @@ int Run_with_panel(avr_t *avr, elf_firmware_t *fwp, const char *firmware,
 
     /* ADC set-up. */
 
-    ADC_base_irq = avr_io_getirq(avr, AVR_IOCTL_ADC_GETIRQ, 0);
-    if (ADC_base_irq) {
-        avr_irq_register_notify(ADC_base_irq + ADC_IRQ_OUT_TRIGGER,
-                                adc_read_notify, avr);
-        show_adc();
-        if (vcd_fh && vcd_letter < 127) {
+    p->adc_base_irq = avr_io_getirq(avr, AVR_IOCTL_ADC_GETIRQ, 0);
+    if (p->adc_base_irq) {
+        avr_irq_register_notify(p->adc_base_irq + ADC_IRQ_OUT_TRIGGER,
+                                adc_read_notify, p);
+        show_adc(p);
+        if (p->vcd_fh && vcd_letter < 127) {
             unsigned int limit;
 
             limit = 127 - vcd_letter;
             if (limit > ADC_CHANNEL_COUNT)
                 limit = ADC_CHANNEL_COUNT;
-            ADC_vcd_letter = vcd_letter;
+            p->adc_vcd_letter = vcd_letter;
             for (i = 0; i < limit; ++i, ++vcd_letter) {
-                fprintf(vcd_fh, "$var real 32 %c adc0_%d $end\n",
+                fprintf(p->vcd_fh, "$var real 32 %c adc0_%d $end\n",
                         vcd_letter, i);
             }
         }
@@ -744,55 +820,54 @@ int Run_with_panel(avr_t *avr, elf_firmware_t *fwp, const char *firmware,
 
         if (vcd_input) {
             for (i = 0; i < ADC_CHANNEL_COUNT; ++i) {
-                avr_irq_register_notify(ADC_base_irq + i, vcd_adc_in_notify,
-                                        NULL);
+                avr_irq_register_notify(p->adc_base_irq + i,
+                                        vcd_adc_in_notify, p);
             }
         }
     }
 
     /* Complete VCD header. */
 
-    if (vcd_fh)
-        fprintf(vcd_fh, "$upscope $end\n$enddefinitions $end\n");
+    if (p->vcd_fh)
+        fprintf(p->vcd_fh, "$upscope $end\n$enddefinitions $end\n");
 
     /* Run. */
 
     do {
-        if (Burst_preset) {
-            Burst_preset = 0;
+        if (p->burst_preset) {
+            p->burst_preset = 0;
         } else {
             /* Get next execution burst from Blink. */
 
-            get_next_burst();
+            get_next_burst(p);
         }
 
         /* Request callback on cycles performed. */
 
-        avr_cycle_timer_register(avr, Brc.burst, burst_complete, NULL);
+        avr_cycle_timer_register(avr, p->brc.burst, burst_complete, p);
 
         /* Run the simulation.  Stops on requested cycles done, fatal error
          * or endless sleep.
          */
 
-        burst_done = 0;
+        p->burst_done = 0;
         do
             state = my_avr_run(avr);
-        while (!burst_done && state < cpu_Done);
+        while (!p->burst_done && state < cpu_Done && !*quit);
 
         /* Display the PC and cycle count.  Limited to about 10 Hz. */
 
         {
-            static struct timeval last_tv;
-            struct timeval        tv;
+            struct timeval tv;
 
             gettimeofday(&tv, NULL);
-            if (tv.tv_usec - last_tv.tv_usec > 100000 ||
-                tv.tv_sec > last_tv.tv_sec) {
-                last_tv = tv;
-                Bfp->new_value(PC_handle, avr->pc);         // Update PC ...
-                Bfp->new_value(Cycles_handle, avr->cycle);  // and cycle count.
+            if (tv.tv_usec - p->last_tv.tv_usec > 100000 ||
+                tv.tv_sec > p->last_tv.tv_sec) {
+                p->last_tv = tv;
+                Bfp->new_value(PANEL_HANDLE(p, PC_item), avr->pc);
+                Bfp->new_value(PANEL_HANDLE(p, Cycles_item), avr->cycle);
             }
         }
-    } while (state < cpu_Done);
+    } while (state < cpu_Done && !*quit);
     return 1;
 }
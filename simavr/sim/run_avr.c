@@ -24,18 +24,34 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <libgen.h>
+#include <ctype.h>
 #include <string.h>
 #include <signal.h>
+#include <unistd.h>
 #include "sim_avr.h"
 #include "sim_elf.h"
 #include "sim_core.h"
 #include "sim_gdb.h"
 #include "sim_hex.h"
+#include "sim_stack.h"
+#include "sim_stats.h"
+#include "sim_int_stats.h"
+#include "sim_timeline.h"
+#include "sim_reverse.h"
+#include "sim_record.h"
+#include "sim_batch.h"
+#include "sim_fuzz.h"
 #include "sim_vcd_file.h"
+#include "sim_trigger.h"
+#include "sim_fw_cache.h"
+#include "sim_pace.h"
+#include "sim_log.h"
+#include "sim_time.h"
 
 #include "sim_core_decl.h"
 
-extern int Run_with_panel(avr_t *, elf_firmware_t *, const char *, int);
+extern int Run_with_panel(avr_t *, elf_firmware_t *, const char *, int,
+						  volatile sig_atomic_t *);
 
 #ifndef NO_COLOR
 /* Replacements for ANSI escape codes if color is disabled. */
@@ -57,6 +73,8 @@ display_usage(
 	 "       [--list-irqs]       List all supported IRQs for given core and exit\n"
 	 "       [-v]                Raise verbosity level\n"
 	 "                           (can be passed more than once)\n"
+	 "       [--async-log]       Format and write log messages on another\n"
+	 "                           thread, with the cycle they were logged at\n"
 	 "       [--freq|-f <freq>]  Sets the frequency (in Hz) for an .hex firmware\n"
 	 "       [--mcu|-m <device>] Sets the MCU type for an .hex firmware\n"
 	 "       [--gdb|-g [<port>]] Listen for gdb connection on <port> "
@@ -73,11 +91,57 @@ display_usage(
          "       [--panel|-p]        Show control panel (Disabled)\n"
 #endif // CONFIG_PANEL
 	 "       [--input|-i <file>] A VCD file to use as input signals\n"
+	 "       [--input-loop [<n>]] Play the input file again, <n> more times\n"
+	 "                           or forever\n"
 	 "       [--output|-o <file>] A VCD file to save the traced signals\n"
 	 "       [--add-trace|-at    <name=[portpin|irq|trace]@addr/mask>] or \n"
 	 "                           <name=[sram8|sram16]@addr>] or \n"
 	 "                           <name=ioirq@XXXX/N\n"
 	 "                           Add signal to be included in VCD output\n"
+	 "       [--vcd-writer <block|drop>] Write the VCD output on a thread of\n"
+	 "                           its own, waiting for it or losing changes\n"
+	 "                           when it falls behind\n"
+	 "       [--capture <pre>[:<post>]] Only write the VCD output around\n"
+	 "                           triggers: <pre> usec before, <post> after\n"
+	 "       [--capture-changes <n>] Or at most <n> changes before them\n"
+	 "       [--trigger <spec>]  pc=<address>, uart0=<text>, or\n"
+	 "                           <ioctl>[_<n>]=<value>[/<mask>] for an IRQ.\n"
+	 "                           A crash, or SIMAVR_CMD_VCD_TRIGGER, triggers\n"
+	 "                           too\n"
+	 "       [--stack]           Track stack usage and report it on exit\n"
+	 "       [--stats]           Count instructions, IO accesses, interrupts,\n"
+	 "                           timers and IRQs and report them on exit\n"
+	 "       [--int-stats]       Report interrupt latency and duration on exit\n"
+	 "       [--speed <x|max>]   Hold the simulation to <x> times real time,\n"
+	 "                           running or sleeping, or run flat out. Lag\n"
+	 "                           and jitter are reported on exit\n"
+	 "       [--timeline <file>] Record calls, interrupts, sleep and peripheral\n"
+	 "                           events as Chrome trace JSON (chrome://tracing)\n"
+	 "       [--timeline-max <n>] Keep at most <n> timeline events, the rest\n"
+	 "                           are dropped and counted. Default 1000000,\n"
+	 "                           0 for no limit\n"
+	 "       [--reverse]         Keep history for gdb's reverse-stepi and\n"
+	 "                           reverse-continue\n"
+	 "       [--record <file>]   Log the inputs from outside the AVR (UART, ADC,\n"
+	 "                           VCD input, panel) to a file on exit\n"
+	 "       [--replay <file>]   Run again with the inputs of a --record file\n"
+	 "       [--batch <file>]    Run the jobs of a manifest (see sim_batch.h)\n"
+	 "                           in parallel, instead of one firmware\n"
+	 "       [--sweep <file>]    Run a firmware over a grid or a sample of\n"
+	 "                           settings (see sim_batch.h), results as CSV\n"
+	 "       [--jobs <n>]        Threads for --batch or --sweep, default one\n"
+	 "                           per CPU\n"
+	 "       [--results <file>]  Write the results there, not to stdout\n"
+	 "       [--fuzz <dir>]      Fuzz the firmware's input, starting from the\n"
+	 "                           inputs in <dir> and adding new ones there\n"
+	 "       [--fuzz-input <in>] uart0 (default), twi0@<address> or gpioB\n"
+	 "       [--fuzz-ready <pc>] Checkpoint there, ready for each input\n"
+	 "       [--fuzz-budget <n>] Cycles per input, default 1000000\n"
+	 "       [--fuzz-runs <n>]   Stop after <n> inputs, default never\n"
+	 "       [--fuzz-crashes <dir>] Save failing inputs there, not in --fuzz\n"
+	 "       [--fw-cache <dir>]  Keep parsed firmware files there, to load\n"
+	 "                           them faster the next time. Before the\n"
+	 "                           firmware. Default $SIMAVR_FW_CACHE\n"
 	 "       [-ff <.hex file>]   Load next .hex file as flash\n"
 	 "       [-ee <.hex file>]   Load next .hex file as eeprom\n"
 	 "       <firmware>          A .hex or an ELF file. ELF files are\n"
@@ -85,10 +149,13 @@ display_usage(
 	exit(1);
 }
 
-static avr_t      * avr = NULL;
+// Set by a signal, the run loop then terminates the simulation.
+static volatile sig_atomic_t quit;
 
 static void
-list_all_irqs(char *mcu)
+list_all_irqs(
+		avr_t *avr,
+		char *mcu)
 {
 	int i;
 
@@ -111,14 +178,49 @@ list_cores()
 	exit(1);
 }
 
+static int
+run_batch(
+		const char *manifest,
+		int sweep,
+		int jobs,
+		const char *results,
+		const char *progname)
+{
+	avr_batch_t b = {0};
+	FILE *out = stdout;
+	avr_cycle_count_t cycles = 0;
+	int failed;
+
+	if (sweep ? avr_batch_sweep_load(&b, manifest) :
+			avr_batch_load(&b, manifest))
+		exit(1);
+	if (results && !(out = fopen(results, "w"))) {
+		perror(results);
+		exit(1);
+	}
+	failed = avr_batch_run(&b, jobs);
+	if (sweep)
+		avr_batch_report_csv(&b, out);
+	else
+		avr_batch_report(&b, out);
+	if (out != stdout)
+		fclose(out);
+	for (int i = 0; i < b.count; i++)
+		cycles += b.job[i].cycles;
+	fprintf(stderr, "%s: %d jobs, %d failed, %.3f s, %.1f MHz simulated\n",
+			progname, b.count, failed, b.wall,
+			b.wall > 0 ? cycles / b.wall / 1e6 : 0.0);
+	avr_batch_free(&b);
+	return failed ? 1 : 0;
+}
+
 static void
 sig_int(
 		int sign)
 {
-	printf("signal caught, simavr terminating\n");
-	if (avr)
-		avr_terminate(avr);
-	exit(0);
+	if (quit)
+		_exit(1);	// again, the run loop is not getting there
+	quit = 1;
 }
 
 int
@@ -136,6 +238,24 @@ main(
 	elf_firmware_t f = {{0}};
 	uint32_t f_cpu = 0;
 	int gdb = 0;
+	int stack = 0;
+	int stats = 0;
+	int int_stats = 0;
+	double speed = -1;		// not paced
+	int async_log = 0;
+	const char *timeline = NULL;
+	uint32_t timeline_max = 1000000;	// about 24MB
+	int reverse = 0;
+	const char *record = NULL;
+	const char *replay = NULL;
+	const char *batch = NULL;
+	int sweep = 0;
+	const char *results = NULL;
+	int jobs = 0;
+	const char *fuzz = NULL;
+	const char *fuzz_crashes = NULL;
+	uint32_t fuzz_runs = 0;
+	avr_fuzz_t *fz = calloc(1, sizeof(*fz));
 	int list_irqs = 0;
 	int log = LOG_ERROR;
 	int port = 1234;
@@ -144,6 +264,12 @@ main(
 	int trace_vectors[8] = {0};
 	int trace_vectors_count = 0;
 	const char *vcd_input = NULL;
+	int vcd_input_loop = 0;
+	int vcd_writer = AVR_VCD_WRITER_NONE;
+	int capture = 0;
+	unsigned long capture_pre = 0, capture_post = 0, capture_changes = 0;
+	const char *triggers[16];
+	int trigger_count = 0;
 	const char *firmware = NULL;
 
 #ifndef NO_COLOR
@@ -182,6 +308,10 @@ main(
 				vcd_input = argv[++pi];
 			else
 				display_usage(basename(argv[0]));
+		} else if (!strcmp(argv[pi], "--input-loop")) {
+			vcd_input_loop = -1;
+			if (pi + 1 < argc && isdigit((unsigned char)argv[pi + 1][0]))
+				vcd_input_loop = atoi(argv[++pi]);
 		} else if (!strcmp(argv[pi], "-o") || !strcmp(argv[pi], "--output")) {
 			if (pi + 1 >= argc) {
 				fprintf(stderr, "%s: missing mandatory argument for %s.\n",
@@ -311,8 +441,126 @@ main(
 			gdb++;
 			if (pi < (argc-2) && argv[pi+1][0] != '-')
 				port = atoi(argv[++pi]);
+		} else if (!strcmp(argv[pi], "--vcd-writer")) {
+			if (pi < argc-1 && !strcmp(argv[pi+1], "block"))
+				vcd_writer = AVR_VCD_WRITER_BLOCK;
+			else if (pi < argc-1 && !strcmp(argv[pi+1], "drop"))
+				vcd_writer = AVR_VCD_WRITER_DROP;
+			else
+				display_usage(basename(argv[0]));
+			pi++;
+		} else if (!strcmp(argv[pi], "--capture")) {
+			char *end;
+
+			if (pi + 1 >= argc)
+				display_usage(basename(argv[0]));
+			capture_pre = strtoul(argv[++pi], &end, 0);
+			if (*end == ':')
+				capture_post = strtoul(end + 1, &end, 0);
+			if (*end)
+				display_usage(basename(argv[0]));
+			capture = 1;
+		} else if (!strcmp(argv[pi], "--capture-changes")) {
+			if (pi + 1 >= argc)
+				display_usage(basename(argv[0]));
+			capture_changes = strtoul(argv[++pi], NULL, 0);
+			capture = 1;
+		} else if (!strcmp(argv[pi], "--trigger")) {
+			if (pi + 1 >= argc || trigger_count == 16)
+				display_usage(basename(argv[0]));
+			triggers[trigger_count++] = argv[++pi];
+		} else if (!strcmp(argv[pi], "--stack")) {
+			stack = 1;
+		} else if (!strcmp(argv[pi], "--stats")) {
+			stats = 1;
+		} else if (!strcmp(argv[pi], "--int-stats")) {
+			int_stats = 1;
+		} else if (!strcmp(argv[pi], "--speed")) {
+			if (pi + 1 >= argc)
+				display_usage(basename(argv[0]));
+			pi++;
+			speed = !strcmp(argv[pi], "max") ? 0 : atof(argv[pi]);
+			if (speed < 0)
+				display_usage(basename(argv[0]));
+		} else if (!strcmp(argv[pi], "--timeline")) {
+			if (pi < argc-1)
+				timeline = argv[++pi];
+			else
+				display_usage(basename(argv[0]));
+		} else if (!strcmp(argv[pi], "--timeline-max")) {
+			if (pi + 1 >= argc)
+				display_usage(basename(argv[0]));
+			timeline_max = strtoul(argv[++pi], NULL, 0);
+		} else if (!strcmp(argv[pi], "--reverse")) {
+			reverse = 1;
+		} else if (!strcmp(argv[pi], "--record")) {
+			if (pi + 1 < argc)
+				record = argv[++pi];
+			else
+				display_usage(basename(argv[0]));
+		} else if (!strcmp(argv[pi], "--replay")) {
+			if (pi + 1 < argc)
+				replay = argv[++pi];
+			else
+				display_usage(basename(argv[0]));
+		} else if (!strcmp(argv[pi], "--batch")) {
+			if (pi + 1 < argc)
+				batch = argv[++pi];
+			else
+				display_usage(basename(argv[0]));
+		} else if (!strcmp(argv[pi], "--sweep")) {
+			sweep = 1;
+			if (pi + 1 < argc)
+				batch = argv[++pi];
+			else
+				display_usage(basename(argv[0]));
+		} else if (!strcmp(argv[pi], "--jobs")) {
+			if (pi + 1 < argc)
+				jobs = atoi(argv[++pi]);
+			else
+				display_usage(basename(argv[0]));
+		} else if (!strcmp(argv[pi], "--results")) {
+			if (pi + 1 < argc)
+				results = argv[++pi];
+			else
+				display_usage(basename(argv[0]));
+		} else if (!strcmp(argv[pi], "--fuzz")) {
+			if (pi + 1 < argc)
+				fuzz = argv[++pi];
+			else
+				display_usage(basename(argv[0]));
+		} else if (!strcmp(argv[pi], "--fuzz-input")) {
+			if (pi + 1 >= argc || avr_fuzz_parse_input(fz, argv[++pi]))
+				display_usage(basename(argv[0]));
+		} else if (!strcmp(argv[pi], "--fuzz-ready")) {
+			if (pi + 1 < argc)
+				fz->ready = strtoul(argv[++pi], NULL, 0);
+			else
+				display_usage(basename(argv[0]));
+		} else if (!strcmp(argv[pi], "--fuzz-budget")) {
+			if (pi + 1 < argc)
+				fz->budget = strtoull(argv[++pi], NULL, 0);
+			else
+				display_usage(basename(argv[0]));
+		} else if (!strcmp(argv[pi], "--fuzz-runs")) {
+			if (pi + 1 < argc)
+				fuzz_runs = strtoul(argv[++pi], NULL, 0);
+			else
+				display_usage(basename(argv[0]));
+		} else if (!strcmp(argv[pi], "--fuzz-crashes")) {
+			if (pi + 1 < argc)
+				fuzz_crashes = argv[++pi];
+			else
+				display_usage(basename(argv[0]));
+		} else if (!strcmp(argv[pi], "--fw-cache")) {
+			if (pi + 1 < argc)
+				avr_fw_cache_set_dir(argv[++pi]);
+			else
+				display_usage(basename(argv[0]));
 		} else if (!strcmp(argv[pi], "-v")) {
 			log++;
+		} else if (!strcmp(argv[pi], "--async-log")) {
+			async_log = 1;
 		} else if (!strcmp(argv[pi], "-ee")) {
 			loadBase = AVR_SEGMENT_OFFSET_EEPROM;
 		} else if (!strcmp(argv[pi], "-ff")) {
@@ -322,6 +570,8 @@ main(
 			sim_setup_firmware(firmware, loadBase, &f, argv[0]);
 		}
 	}
+	if (batch)
+		return run_batch(batch, sweep, jobs, results, argv[0]);
 
 	// Frequency and MCU type were set early so they can be checked when
 	// loading a hex file. Set them again because they can also be set
@@ -332,15 +582,17 @@ main(
 	if (f_cpu)
 		f.frequency = f_cpu;
 
-	avr = avr_make_mcu_by_name(f.mmcu);
+	avr_t *avr = avr_make_mcu_by_name(f.mmcu);
 	if (!avr) {
 		fprintf(stderr, "%s: AVR '%s' not known\n", argv[0], f.mmcu);
 		exit(1);
 	}
 	avr_init(avr);
 	if (list_irqs)
-		list_all_irqs(f.mmcu);        // Does not return.
+		list_all_irqs(avr, f.mmcu);        // Does not return.
 	avr->log = (log > LOG_TRACE ? LOG_TRACE : log);
+	if (async_log && avr_log_start(avr, NULL, 0))
+		fprintf(stderr, "%s: Warning: asynchronous logging failed\n", argv[0]);
 #ifdef CONFIG_SIMAVR_TRACE
 	avr->trace = trace;
 #endif //CONFIG_SIMAVR_TRACE
@@ -351,6 +603,21 @@ main(
 			   f.flashbase);
 		avr->pc = f.flashbase;
 	}
+	if (avr->vcd && vcd_writer != AVR_VCD_WRITER_NONE)
+		avr_vcd_set_writer(avr->vcd, vcd_writer);
+	if (capture && !avr->vcd)
+		fprintf(stderr, "%s: Warning: --capture with no VCD output\n",
+				argv[0]);
+	else if (capture)
+		avr_vcd_set_capture(avr->vcd,
+				avr_usec_to_cycles(avr, capture_pre), capture_changes,
+				avr_usec_to_cycles(avr, capture_post));
+	for (int ti = 0; ti < trigger_count; ti++)
+		if (avr_trigger_parse(avr, triggers[ti])) {
+			fprintf(stderr, "%s: Invalid trigger '%s'\n",
+					argv[0], triggers[ti]);
+			exit(1);
+		}
 	for (int ti = 0; ti < trace_vectors_count; ti++) {
 		for (int vi = 0; vi <= avr->interrupts.max_vector; vi++)
 			if (avr->interrupts.vectors[vi]->vector == trace_vectors[ti])
@@ -365,7 +632,51 @@ main(
 					argv[0], vcd_input);
 			vcd_input = NULL;
 		}
+		input.loop = vcd_input_loop;
+	}
+
+	if (stack)
+		avr_stack_watch_start(avr);
+	if (stats)
+		avr_stats_start(avr);
+	if (int_stats)
+		avr_int_stats_start(avr);
+	if (speed >= 0 && avr_pace_start(avr, speed))
+		fprintf(stderr, "%s: Warning: pacing failed\n", argv[0]);
+	if (timeline) {
+		if (avr_timeline_start(avr, timeline, AVR_TIMELINE_ALL)) {
+			fprintf(stderr, "%s: Warning: timeline %s failed\n",
+					argv[0], timeline);
+		} else
+			avr->timeline->max_events = timeline_max;
+	}
+
+	if (reverse && avr_reverse_start(avr, 0, 0))
+		fprintf(stderr, "%s: Warning: reverse execution failed\n", argv[0]);
+	if ((record || replay) && !avr_record_start(avr))
+		fprintf(stderr, "%s: Warning: input recording failed\n", argv[0]);
+	// the logged IRQs are looked up when due, after the panel is made
+	if (replay && avr_record_load(avr, replay)) {
+		fprintf(stderr, "%s: Unable to replay %s\n", argv[0], replay);
+		exit(1);
+	}
+
+	if (fuzz) {
+		int failures;
+
+		if (!fz->name)
+			avr_fuzz_parse_input(fz, "uart0");
+		if (avr_fuzz_init(fz, avr)) {
+			fprintf(stderr, "%s: Unable to fuzz %s\n", argv[0], firmware);
+			exit(1);
+		}
+		failures = avr_fuzz_loop(fz, fuzz,
+				fuzz_crashes ? fuzz_crashes : fuzz, fuzz_runs, 0, stderr);
+		avr_fuzz_free(fz);
+		avr_terminate(avr);
+		return failures ? 1 : 0;
 	}
+	free(fz);
 
 	// even if not setup at startup, activate gdb if crashing
 	avr->gdb_port = port;
@@ -382,17 +693,30 @@ main(
 	if (panel) {
 		// Panel has its own run loop.
 
-		if (!Run_with_panel(avr, &f, firmware, vcd_input != NULL))
+		if (!Run_with_panel(avr, &f, firmware, vcd_input != NULL, &quit))
 			fprintf(stderr, "%s: Failed: Could not show panel.\n", argv[0]);
         } else {
 #else
 	{
 #endif // CONFIG_PANEL
-		for (;;) {
+		while (!quit) {
 			int state = avr_run(avr);
 			if (state == cpu_Done || state == cpu_Crashed)
 				break;
 		}
 	}
+	if (quit)
+		printf("signal caught, simavr terminating\n");
+	if (record)
+		avr_record_save(avr, record);
+	// so that the reports come after the messages
+	avr_log_stop(avr);
+	avr_stack_watch_report(avr, stdout);
+	avr_stats_report(avr, stdout, 20);
+	avr_int_stats_report(avr, stdout);
+	avr_pace_report(avr, stdout);
+	if (avr->timeline && avr->timeline->dropped)
+		printf("timeline: %u events dropped past --timeline-max %u\n",
+				avr->timeline->dropped, timeline_max);
 	avr_terminate(avr);
 }
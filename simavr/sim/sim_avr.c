@@ -30,6 +30,20 @@
 #include "sim_core.h"
 #include "sim_time.h"
 #include "sim_gdb.h"
+#include "sim_stack.h"
+#include "sim_timeline.h"
+#include "sim_checkpoint.h"
+#include "sim_record.h"
+#include "sim_reverse.h"
+#include "sim_post.h"
+#include "sim_stats.h"
+#include "sim_int_stats.h"
+#include "sim_trigger.h"
+#include "sim_shared_flash.h"
+#include "sim_symbols.h"
+#include "sim_pace.h"
+#include "sim_board.h"
+#include "sim_log.h"
 #include "avr_uart.h"
 #include "sim_vcd_file.h"
 #include "avr/avr_mcu_section.h"
@@ -52,10 +66,11 @@ avr_global_logger(
 		const char * format,
 		... )
 {
+	avr_logger_p logger = avr && avr->logger ? avr->logger : _avr_global_logger;
 	va_list args;
 	va_start(args, format);
-	if (_avr_global_logger)
-		_avr_global_logger(avr, level, format, args);
+	if (logger)
+		logger(avr, level, format, args);
 	va_end(args);
 }
 
@@ -72,6 +87,14 @@ avr_global_logger_get(void)
 	return _avr_global_logger;
 }
 
+void
+avr_logger_set(
+		avr_t * avr,
+		avr_logger_p logger)
+{
+	avr->logger = logger;
+}
+
 uint64_t
 avr_get_time_stamp(
 		avr_t * avr )
@@ -207,7 +230,21 @@ avr_terminate(
 		avr_vcd_close(avr->vcd);
 		avr->vcd = NULL;
 	}
+	avr_stack_watch_stop(avr);
+	avr_stats_stop(avr);
+	avr_int_stats_stop(avr);
+	avr_timeline_stop(avr);
+	avr_reverse_stop(avr);
+	avr_checkpoint_stop(avr);
+	avr_record_stop(avr);
+	avr_post_stop(avr);
+	avr_trigger_stop(avr);
+	avr_shared_flash_stop(avr);
+	avr_symbols_stop(avr);
+	avr_pace_stop(avr);
 	avr_deallocate_ios(avr);
+	// last, for the messages of the above
+	avr_log_stop(avr);
 
 	if (avr->flash) free(avr->flash);
 	if (avr->base) free(avr->base);
@@ -228,6 +265,8 @@ void
 avr_reset(
 		avr_t * avr)
 {
+	avr_cycle_count_t cycle = avr->cycle;
+
 	AVR_LOG(avr, LOG_TRACE, "%s reset\n", avr->mmcu);
 
 	avr->resetting = 1;
@@ -235,6 +274,8 @@ avr_reset(
 	for(int i = 0x20; i <= avr->ioend; i++)
 		avr->data[i] = 0;
 	_avr_sp_set(avr, avr->ramend);
+	if (avr->stack)
+		avr_stack_reset(avr);
 	avr->pc = avr->reset_pc;	// Likely to be zero
 	for (int i = 0; i < 8; i++)
 		avr->sreg[i] = 0;
@@ -250,6 +291,16 @@ avr_reset(
 	}
 	avr->cycle = 0; // Prevent crash
 	avr->resetting = 0;
+	if (avr->reverse)
+		avr_reverse_forget(avr);
+	if (avr->record)
+		avr_record_reset(avr);
+	if (avr->pace)
+		avr_pace_reset(avr);
+	if (avr->post)
+		avr_post_reset(avr, cycle);
+	if (avr->board)
+		avr_board_reset(avr, cycle);
 }
 
 void
@@ -257,7 +308,11 @@ avr_sadly_crashed(
 		avr_t *avr,
 		uint8_t signal)
 {
-	AVR_LOG(avr, LOG_ERROR, "%s\n", __FUNCTION__);
+	char where[128];
+
+	AVR_LOG(avr, LOG_ERROR, "%s at %s\n", __FUNCTION__,
+			avr_symbols_format(avr, avr->pc, where, sizeof(where)));
+	avr_trigger_fire(avr, "crash");
 	avr->state = cpu_Stopped;
 	if (avr->gdb_port) {
 		// enable gdb server, and wait
@@ -372,6 +427,7 @@ avr_loadcode(
 		avr_abort();
 	}
 	memcpy(avr->flash + address, code, size);
+	avr_checkpoint_touch_flash(avr, address, size);
 }
 
 /* This function can be called during the execution of an AVR instruction,
@@ -443,8 +499,27 @@ avr_callback_run_gdb(
 	if (step)
 		avr->state = cpu_Running;
 
-	avr_flashaddr_t new_pc = avr->pc;
+	if (avr->reverse)
+		avr_reverse_tick(avr);
+	if (!avr_run_gdb_step(avr))
+		return;
+	if (avr->reverse)
+		avr_reverse_stepped(avr);
+
+	// if we were stepping, use this state to inform remote gdb
+	if (step)
+		avr->state = cpu_StepDone;
+}
+
+int
+avr_run_gdb_step(
+		avr_t * avr)
+{
+	avr_flashaddr_t new_pc;
 
+	if (avr->post)
+		avr_post_drain(avr);
+	new_pc = avr->pc;
 	if (avr->state == cpu_Running) {
 		new_pc = avr_run_one(avr);
 #if CONFIG_SIMAVR_TRACE
@@ -463,21 +538,26 @@ avr_callback_run_gdb(
 			if (avr->log)
 				AVR_LOG(avr, LOG_TRACE, "simavr: sleeping with interrupts off, quitting gracefully\n");
 			avr->state = cpu_Done;
-			return;
+			return 0;
 		}
 		/*
 		 * try to sleep for as long as we can (?)
+		 * but not when re-executing for a reverse gdb command.
 		 */
-		avr->sleep(avr, sleep);
+		if (!avr->reverse || !avr->reverse->searching)
+			avr->sleep(avr, sleep);
+		if (avr->post)
+			sleep = avr_post_slept(avr, sleep);
+		if (avr->timeline)
+			avr_timeline_sleep(avr, 1 + sleep);
 		avr->cycle += 1 + sleep;
+		if (avr->stats)
+			avr->stats->sleep_cycles += 1 + sleep;
 	}
 	// Interrupt servicing might change the PC too, during 'sleep'
 	if (avr->state == cpu_Running || avr->state == cpu_Sleeping)
 		avr_service_interrupts(avr);
-
-	// if we were stepping, use this state to inform remote gdb
-	if (step)
-		avr->state = cpu_StepDone;
+	return 1;
 }
 
 /*
@@ -491,13 +571,20 @@ avr_callback_sleep_raw(
 		avr_t *avr,
 		avr_cycle_count_t how_long)
 {
+	if (avr->pace) {
+		avr_pace_sleep(avr, how_long);
+		return;
+	}
 	/* figure out how long we should wait to match the sleep deadline */
 	uint64_t deadline_ns = avr_cycles_to_nsec(avr, avr->cycle + how_long);
 	uint64_t runtime_ns = avr_get_time_stamp(avr);
 	if (runtime_ns >= deadline_ns)
 		return;
 	uint64_t sleep_us = (deadline_ns - runtime_ns) / 1000;
-	usleep(sleep_us);
+	if (avr->post)
+		avr_post_sleep(avr, sleep_us);	// posting wakes it up
+	else
+		usleep(sleep_us);
 	return;
 }
 
@@ -505,8 +592,11 @@ void
 avr_callback_run_raw(
 		avr_t * avr)
 {
-	avr_flashaddr_t new_pc = avr->pc;
+	avr_flashaddr_t new_pc;
 
+	if (avr->post)
+		avr_post_drain(avr);
+	new_pc = avr->pc;
 	if (avr->state == cpu_Running) {
 		new_pc = avr_run_one(avr);
 #if CONFIG_SIMAVR_TRACE
@@ -531,7 +621,13 @@ avr_callback_run_raw(
 		 * try to sleep for as long as we can (?)
 		 */
 		avr->sleep(avr, sleep);
+		if (avr->post)
+			sleep = avr_post_slept(avr, sleep);
+		if (avr->timeline)
+			avr_timeline_sleep(avr, 1 + sleep);
 		avr->cycle += 1 + sleep;
+		if (avr->stats)
+			avr->stats->sleep_cycles += 1 + sleep;
 	}
 	// Interrupt servicing might change the PC too, during 'sleep'
 	if (avr->state == cpu_Running || avr->state == cpu_Sleeping) {
@@ -559,6 +655,7 @@ avr_core_allocate(
 {
 	uint8_t * b = malloc(coreLen);
 	memcpy(b, core, coreLen);
+	((avr_t *)b)->core_size = coreLen;
 	return (avr_t *)b;
 }
 
@@ -37,6 +37,7 @@ extern "C" {
 #endif
 
 #include <stdint.h>
+#include <stdarg.h>
 #include "sim_irq.h"
 #include "sim_interrupts.h"
 #include "sim_cmds.h"
@@ -74,7 +75,9 @@ enum {
 
 /**
  * Logging macros and associated log levels.
- * The current log level is kept in avr->log.
+ * The current log level is kept in avr->log. Messages above it are
+ * dropped by AVR_LOG() itself, before their arguments are evaluated,
+ * whatever the logger; messages without an AVR always get to it.
  */
 enum {
 	LOG_NONE = 0,
@@ -89,7 +92,9 @@ enum {
 #ifndef AVR_LOG
 #define AVR_LOG(avr, level, ...) \
 	do { \
-		avr_global_logger(avr, level, __VA_ARGS__); \
+		struct avr_t * __avr_log = (avr); \
+		if (!__avr_log || __avr_log->log >= (level)) \
+			avr_global_logger(__avr_log, level, __VA_ARGS__); \
 	} while(0)
 #endif
 #define AVR_TRACE(avr, ... ) \
@@ -140,6 +145,7 @@ struct avr_trace_data_t {
 		uint16_t sp;
 	} old[OLD_PC_SIZE]; // catches reset..
 	int			old_pci;
+	int			donttrace;	// in a function excluded by RESTRICT_TRACE
 
 #if AVR_STACK_WATCH
 	#define STACK_FRAME_SIZE	32
@@ -161,6 +167,13 @@ struct avr_trace_data_t {
 typedef void (*avr_run_t)(
 		struct avr_t * avr);
 
+/*
+ * Type for custom logging functions. They only get the messages of an
+ * instance up to its avr->log level, AVR_LOG() drops the others first;
+ * raise avr->log to LOG_DEBUG for all of them. 'avr' can be NULL.
+ */
+typedef void (*avr_logger_p)(struct avr_t* avr, const int level, const char * format, va_list ap);
+
 #define AVR_FUSE_LOW	0
 #define AVR_FUSE_HIGH	1
 #define AVR_FUSE_EXT	2
@@ -199,6 +212,10 @@ typedef struct avr_t {
 	// filled by the ELF data, this allow tracking of invalid jumps
 	uint32_t			codeend;
 
+	// size of the core allocation: this avr_t and the IO modules that
+	// follow it. Set by avr_core_allocate(), used by sim_snapshot.c
+	uint32_t			core_size;
+
 	int					state;		// stopped, running, sleeping
 	int					saved_state;
 	uint32_t			frequency;	// frequency we are running at
@@ -362,6 +379,8 @@ typedef struct avr_t {
 	// DEBUG ONLY -- value ignored if CONFIG_SIMAVR_TRACE = 0
 	uint8_t	trace : 1,
 			log : 4; // log level, default to 1
+	// this instance's logging function, NULL for the global one
+	avr_logger_p	logger;
 
 	// Only used if CONFIG_SIMAVR_TRACE is defined
 	struct avr_trace_data_t *trace_data;
@@ -376,6 +395,51 @@ typedef struct avr_t {
 	// gdb hooking structure. Only present when gdb server is active
 	struct avr_gdb_t * gdb;
 
+	// Stack usage tracking, see sim_stack.h. Only present when enabled
+	struct avr_stack_t * stack;
+
+	// Performance counters, see sim_stats.h. Only present when enabled
+	struct avr_stats_t * stats;
+
+	// Trace-event timeline recorder, see sim_timeline.h. Only present when enabled
+	struct avr_timeline_t * timeline;
+
+	// Dirty memory tracking, see sim_checkpoint.h. Only present while
+	// checkpoints exist
+	struct avr_dirty_t * dirty;
+
+	// External input log, see sim_record.h. Only present when enabled
+	struct avr_record_t * record;
+
+	// Reverse execution for gdb, see sim_reverse.h. Only present when enabled
+	struct avr_reverse_t * reverse;
+
+	// IRQs raised from other threads, see sim_post.h. Only present when started
+	struct avr_post_t * post;
+
+	// Edge coverage for fuzzing, see sim_fuzz.h. Only present when fuzzing
+	struct avr_fuzz_t * fuzz;
+
+	// VCD capture triggers, see sim_trigger.h. Only present when set
+	struct avr_trigger_t * trigger;
+
+	// Flash image shared with other instances, see sim_shared_flash.h.
+	// Only present when started
+	struct avr_shared_flash_t * shared_flash;
+
+	// Address to name index, see sim_symbols.h. Only present when the
+	// firmware has symbols
+	struct avr_symbols_t * symbols;
+
+	// Real-time pacing, see sim_pace.h. Only present when started
+	struct avr_pace_t * pace;
+
+	// The board it is on, see sim_board.h. Only present when added to one
+	struct avr_board_mcu_t * board;
+
+	// Asynchronous logging, see sim_log.h. Only present when started
+	struct avr_log_t * log_ring;
+
 	// if non-zero, the gdb server will be started when the core
 	// crashed even if not activated at startup
 	// if zero, the simulator will just exit() in case of a crash
@@ -519,7 +583,7 @@ avr_sadly_crashed(
 		uint8_t signal);
 
 /*
- * Logs a message using the current logger
+ * Logs a message using the logger of 'avr', or the global one
  */
 void
 avr_global_logger(
@@ -528,27 +592,29 @@ avr_global_logger(
 		const char * format,
 		... );
 
-#ifndef AVR_CORE
-#include <stdarg.h>
 /*
- * Type for custom logging functions
+ * Sets a global logging function in place of the default, for the
+ * instances that have none of their own. Call it before starting threads.
  */
-typedef void (*avr_logger_p)(struct avr_t* avr, const int level, const char * format, va_list ap);
-
-/* Sets a global logging function in place of the default */
 void
 avr_global_logger_set(
 		avr_logger_p logger);
 /* Gets the current global logger function */
 avr_logger_p
 avr_global_logger_get(void);
-#endif
+/* Sets the logging function of one instance, NULL for the global one */
+void
+avr_logger_set(
+		avr_t * avr,
+		avr_logger_p logger);
 
 /*
  * These are callbacks for the two 'main' behaviour in simavr
  */
 void avr_callback_sleep_gdb(avr_t * avr, avr_cycle_count_t howLong);
 void avr_callback_run_gdb(avr_t * avr);
+/* One instruction (or sleep) of avr_callback_run_gdb(), without gdb */
+int avr_run_gdb_step(avr_t * avr);
 void avr_callback_sleep_raw(avr_t * avr, avr_cycle_count_t howLong);
 void avr_callback_run_raw(avr_t * avr);
 
@@ -0,0 +1,940 @@
+/*
+	sim_batch.c
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "sim_fw_cache.h"
+#include "sim_hex.h"
+#include "sim_time.h"
+#include "sim_record.h"
+#include "sim_shared_flash.h"
+#include "avr_uart.h"
+#include "avr_adc.h"
+#include "avr_acomp.h"
+#include "avr_ioport.h"
+#include "sim_batch.h"
+
+typedef struct avr_batch_image_t {
+	char *				filename;
+	elf_firmware_t		fw;
+	int					error;
+} avr_batch_image_t;
+
+avr_batch_job_t *
+avr_batch_add(
+		avr_batch_t * b,
+		const char * firmware)
+{
+	avr_batch_job_t * j;
+
+	if (b->count == b->size) {
+		int size = b->size ? b->size * 2 : 64;
+
+		j = realloc(b->job, size * sizeof(*j));
+		if (!j)
+			return NULL;
+		b->job = j;
+		b->size = size;
+	}
+	j = &b->job[b->count];
+	memset(j, 0, sizeof(*j));
+	j->firmware = strdup(firmware);
+	if (!j->firmware)
+		return NULL;
+	j->timeout = AVR_BATCH_TIMEOUT;
+	j->uart = '0';
+	b->count++;
+	return j;
+}
+
+/*
+ * Read one key=value word at *p, the value unquoted and unescaped into
+ * a new string. Returns 0 at the end of the line, -1 on a syntax error.
+ */
+static int
+_avr_batch_word(
+		char ** p,
+		char ** key,
+		char ** value)
+{
+	char * s = *p, * d;
+
+	while (isspace((unsigned char)*s))
+		s++;
+	if (!*s || *s == '#')
+		return 0;
+	*key = s;
+	while (*s && *s != '=' && !isspace((unsigned char)*s))
+		s++;
+	if (*s != '=')
+		return -1;
+	*s++ = 0;
+	d = *value = malloc(strlen(s) + 1);
+	if (!d)
+		return -1;
+	if (*s != '"') {
+		while (*s && !isspace((unsigned char)*s))
+			*d++ = *s++;
+	} else {
+		for (s++; *s != '"'; s++) {
+			if (!*s) {
+				free(*value);
+				return -1;
+			}
+			if (*s != '\\') {
+				*d++ = *s;
+				continue;
+			}
+			switch (*++s) {
+				case 'n': *d++ = '\n'; break;
+				case 'r': *d++ = '\r'; break;
+				case 't': *d++ = '\t'; break;
+				case 'x': {
+					char hex[3] = { 0 };
+
+					if (isxdigit((unsigned char)s[1])) {
+						hex[0] = *++s;
+						if (isxdigit((unsigned char)s[1]))
+							hex[1] = *++s;
+					}
+					*d++ = strtoul(hex, NULL, 16);
+				}	break;
+				case 0:
+					free(*value);
+					return -1;
+				default: *d++ = *s; break;
+			}
+		}
+		s++;
+	}
+	*d = 0;
+	*p = s;
+	return 1;
+}
+
+// Index of an analog input key, or -1.
+static int
+_avr_batch_analog(
+		const char * key)
+{
+	char * end;
+	unsigned long n;
+
+	if (!strncmp(key, "ain", 3) && (key[3] == '0' || key[3] == '1') &&
+			!key[4])
+		return 16 + key[3] - '0';
+	if (strncmp(key, "adc", 3) || !isdigit((unsigned char)key[3]))
+		return -1;
+	n = strtoul(key + 3, &end, 10);
+	return *end || n > 15 ? -1 : (int)n;
+}
+
+// The settings that take a number, and can be swept.
+static int
+_avr_batch_numeric(
+		const char * key)
+{
+	static const char * keys[] = {
+		"freq", "timeout", "vcc", "avcc", "aref", NULL,
+	};
+
+	for (int i = 0; keys[i]; i++)
+		if (!strcmp(key, keys[i]))
+			return 1;
+	return _avr_batch_analog(key) >= 0;
+}
+
+/*
+ * Set 'key' of 'job', which then owns 'value'. Returns -1 for an unknown
+ * key, and the value is left to the caller.
+ */
+static int
+_avr_batch_set(
+		avr_batch_job_t * job,
+		const char * key,
+		char * value)
+{
+	char ** str = NULL;
+	int analog = _avr_batch_analog(key);
+
+	if (!strcmp(key, "firmware"))
+		str = &job->firmware;
+	else if (!strcmp(key, "mmcu"))
+		str = &job->mmcu;
+	else if (!strcmp(key, "stimulus"))
+		str = &job->stimulus;
+	else if (!strcmp(key, "expect"))
+		str = &job->expect;
+	else if (!strcmp(key, "probe"))
+		str = &job->probe;
+	else if (!strcmp(key, "freq"))
+		job->frequency = strtoul(value, NULL, 0);
+	else if (!strcmp(key, "timeout"))
+		job->timeout = strtoul(value, NULL, 0);
+	else if (!strcmp(key, "uart") && value[0])
+		job->uart = value[0];
+	else if (!strcmp(key, "vcc"))
+		job->vcc = strtoul(value, NULL, 0);
+	else if (!strcmp(key, "avcc"))
+		job->avcc = strtoul(value, NULL, 0);
+	else if (!strcmp(key, "aref"))
+		job->aref = strtoul(value, NULL, 0);
+	else if (analog >= 0) {
+		job->analog[analog] = strtoul(value, NULL, 0);
+		job->analog_set |= 1 << analog;
+	} else
+		return -1;
+	if (str) {
+		free(*str);
+		*str = value;
+	} else
+		free(value);
+	return 0;
+}
+
+static void
+_avr_batch_free_settings(
+		avr_batch_job_t * job)
+{
+	free(job->firmware);
+	free(job->mmcu);
+	free(job->stimulus);
+	free(job->expect);
+	free(job->probe);
+}
+
+int
+avr_batch_load(
+		avr_batch_t * b,
+		const char * filename)
+{
+	FILE * f = fopen(filename, "r");
+	char * line = NULL;
+	size_t size = 0;
+	int lineno = 0, res = 0;
+
+	if (!f) {
+		perror(filename);
+		return -1;
+	}
+	while (res == 0 && getline(&line, &size, f) != -1) {
+		avr_batch_job_t job = { .timeout = AVR_BATCH_TIMEOUT, .uart = '0' };
+		char * p = line, * key, * value;
+		int r;
+
+		lineno++;
+		while ((r = _avr_batch_word(&p, &key, &value)) > 0) {
+			if (_avr_batch_set(&job, key, value)) {
+				free(value);
+				r = -1;
+				break;
+			}
+		}
+		if (r == 0 && !job.firmware && (job.mmcu || job.stimulus ||
+				job.expect || job.probe || job.frequency || job.vcc ||
+				job.avcc || job.aref || job.analog_set ||
+				job.timeout != AVR_BATCH_TIMEOUT))
+			r = -1;
+		if (r == 0 && job.firmware) {
+			avr_batch_job_t * j = avr_batch_add(b, job.firmware);
+
+			if (j) {
+				free(j->firmware);
+				*j = job;
+				continue;
+			}
+			r = -1;
+		}
+		if (r < 0) {
+			AVR_LOG(NULL, LOG_ERROR, "BATCH: %s:%d: bad job\n",
+					filename, lineno);
+			res = -1;
+		}
+		_avr_batch_free_settings(&job);
+	}
+	free(line);
+	fclose(f);
+	return res;
+}
+
+typedef struct avr_batch_axis_t {
+	char *		key;
+	uint32_t *	value;		// a list, or lo, hi and step of a range
+	int			count;
+	int			range;
+} avr_batch_axis_t;
+
+// Parse "lo:hi:step" or "a,b,c". Returns -1 on a syntax error.
+static int
+_avr_batch_axis(
+		avr_batch_axis_t * a,
+		const char * s)
+{
+	char * end;
+
+	a->range = strchr(s, ':') != NULL;
+	for (;;) {
+		uint32_t * v = realloc(a->value, (a->count + 1) * sizeof(*v));
+
+		if (!v)
+			return -1;
+		a->value = v;
+		v[a->count++] = strtoul(s, &end, 0);
+		if (end == s)
+			return -1;
+		if (!*end)
+			break;
+		if (*end != (a->range ? ':' : ','))
+			return -1;
+		s = end + 1;
+	}
+	if (a->range && (a->count != 3 || !a->value[2] ||
+			a->value[1] < a->value[0]))
+		return -1;
+	return 0;
+}
+
+// Points of the axis, the first one is 0.
+static uint32_t
+_avr_batch_axis_size(
+		avr_batch_axis_t * a)
+{
+	if (a->range)
+		return (a->value[1] - a->value[0]) / a->value[2] + 1;
+	return a->count;
+}
+
+static uint32_t
+_avr_batch_axis_value(
+		avr_batch_axis_t * a,
+		uint32_t i)
+{
+	return a->range ? a->value[0] + i * a->value[2] : a->value[i];
+}
+
+// A job from 'base' with the given point of every axis.
+static int
+_avr_batch_sweep_job(
+		avr_batch_t * b,
+		avr_batch_job_t * base,
+		avr_batch_axis_t * axis,
+		int axes,
+		uint32_t * point)
+{
+	avr_batch_job_t * j = avr_batch_add(b, base->firmware);
+	char * firmware;
+	int res = 0;
+
+	if (!j)
+		return -1;
+	firmware = j->firmware;
+	*j = *base;
+	j->firmware = firmware;
+	{
+		char ** str[] = { &j->mmcu, &j->stimulus, &j->expect, &j->probe };
+
+		for (int i = 0; i < 4; i++)
+			if (*str[i] && !(*str[i] = strdup(*str[i])))
+				res = -1;
+	}
+	for (int i = 0; i < axes; i++) {
+		char value[16], * v;
+
+		snprintf(value, sizeof(value), "%u",
+				_avr_batch_axis_value(&axis[i], point[i]));
+		if (!(v = strdup(value)) || _avr_batch_set(j, axis[i].key, v))
+			res = -1;
+	}
+	return res;
+}
+
+int
+avr_batch_sweep_load(
+		avr_batch_t * b,
+		const char * filename)
+{
+	FILE * f = fopen(filename, "r");
+	avr_batch_job_t base = { .timeout = AVR_BATCH_TIMEOUT, .uart = '0' };
+	avr_batch_axis_t * axis = NULL;
+	int axes = 0, res = 0;
+	uint32_t samples = 0, seed = 1;
+	uint64_t points = 1;
+	char * line = NULL;
+	size_t size = 0;
+	uint32_t * point;
+
+	if (!f) {
+		perror(filename);
+		return -1;
+	}
+	while (res == 0 && getline(&line, &size, f) != -1) {
+		char * p = line, * key, * value;
+		int r = 0;
+
+		while (res == 0 && (r = _avr_batch_word(&p, &key, &value)) > 0) {
+			if (!strcmp(key, "samples"))
+				samples = strtoul(value, NULL, 0);
+			else if (!strcmp(key, "seed"))
+				seed = strtoul(value, NULL, 0);
+			else if (_avr_batch_numeric(key) && strpbrk(value, ":,")) {
+				avr_batch_axis_t * a = realloc(axis,
+						(axes + 1) * sizeof(*a));
+
+				if (!a) {
+					res = -1;
+				} else {
+					axis = a;
+					a += axes++;
+					memset(a, 0, sizeof(*a));
+					a->key = strdup(key);
+					if (!a->key || _avr_batch_axis(a, value))
+						res = -1;
+				}
+			} else if (_avr_batch_set(&base, key, value) == 0)
+				continue;	// it has the value
+			else
+				res = -1;
+			free(value);
+		}
+		if (r < 0)
+			res = -1;
+	}
+	free(line);
+	fclose(f);
+	if (res == 0 && !base.firmware)
+		res = -1;
+	for (int i = 0; res == 0 && i < axes; i++)
+		if ((points *= _avr_batch_axis_size(&axis[i])) > AVR_BATCH_SWEEP_MAX)
+			res = -1;
+	if (samples > AVR_BATCH_SWEEP_MAX)
+		res = -1;
+	point = calloc(axes + 1, sizeof(*point));
+	if (res == 0 && point && samples) {
+		uint64_t rng = seed ? seed : 1;
+
+		for (uint32_t n = 0; res == 0 && n < samples; n++) {
+			for (int i = 0; i < axes; i++) {
+				rng ^= rng << 13;
+				rng ^= rng >> 7;
+				rng ^= rng << 17;
+				point[i] = (rng >> 32) % _avr_batch_axis_size(&axis[i]);
+			}
+			res = _avr_batch_sweep_job(b, &base, axis, axes, point);
+		}
+	} else if (res == 0 && point) {
+		// the last axis changes fastest, as in nested loops
+		for (uint64_t n = 0; res == 0 && n < points; n++) {
+			res = _avr_batch_sweep_job(b, &base, axis, axes, point);
+			for (int i = axes - 1; i >= 0; i--) {
+				if (++point[i] < _avr_batch_axis_size(&axis[i]))
+					break;
+				point[i] = 0;
+			}
+		}
+	} else
+		res = -1;
+	if (res)
+		AVR_LOG(NULL, LOG_ERROR, "BATCH: %s: bad sweep\n", filename);
+	free(point);
+	for (int i = 0; i < axes; i++) {
+		free(axis[i].key);
+		free(axis[i].value);
+	}
+	free(axis);
+	_avr_batch_free_settings(&base);
+	return res;
+}
+
+// Read each firmware file once, before the jobs start.
+static void
+_avr_batch_read_images(
+		avr_batch_t * b)
+{
+	for (int i = 0; i < b->count; i++) {
+		avr_batch_job_t * j = &b->job[i];
+		avr_batch_image_t * im;
+		int n;
+
+		for (n = 0; n < b->images; n++)
+			if (!strcmp(b->image[n].filename, j->firmware))
+				break;
+		j->image = n;
+		if (n < b->images)
+			continue;
+		im = realloc(b->image, (n + 1) * sizeof(*im));
+		if (!im) {
+			j->image = -1;
+			continue;
+		}
+		b->image = im;
+		im += n;
+		memset(im, 0, sizeof(*im));
+		im->filename = strdup(j->firmware);
+		// wanted by .hex files, the jobs can still override them
+		if (j->mmcu)
+			snprintf(im->fw.mmcu, sizeof(im->fw.mmcu), "%s", j->mmcu);
+		im->fw.frequency = j->frequency;
+		im->error = sim_read_firmware(j->firmware, 0, &im->fw);
+		if (im->error)
+			AVR_LOG(NULL, LOG_ERROR, "BATCH: unable to read %s\n",
+					j->firmware);
+		b->images++;
+	}
+}
+
+static void
+_avr_batch_free_chunks(
+		fw_chunk_t * c)
+{
+	while (c) {
+		fw_chunk_t * next = c->next;
+
+		free(c);
+		c = next;
+	}
+}
+
+/*
+ * avr_load_firmware() consumes the chunks, so each job gets its own copy
+ * of them; the symbols are shared.
+ */
+static int
+_avr_batch_copy_image(
+		avr_batch_image_t * im,
+		elf_firmware_t * fw)
+{
+	fw_chunk_t ** last = &fw->chunks;
+
+	*fw = im->fw;
+	fw->chunks = NULL;
+	fw->tracecount = 0;
+#if ELF_SYMBOLS
+	fw->dwarf_file = NULL;
+	fw->dwarf = NULL;
+	fw->cache = NULL;
+#endif
+	for (fw_chunk_t * c = im->fw.chunks; c; c = c->next) {
+		fw_chunk_t * n = malloc(sizeof(*n) + c->size);
+
+		if (!n) {
+			_avr_batch_free_chunks(fw->chunks);
+			return -1;
+		}
+		memcpy(n, c, sizeof(*n) + c->size);
+		n->next = NULL;
+		*last = n;
+		last = &n->next;
+	}
+	return 0;
+}
+
+static void
+_avr_batch_uart_out(
+		struct avr_irq_t * irq,
+		uint32_t value,
+		void * param)
+{
+	avr_batch_job_t * j = param;
+
+	if (j->output_len + 1 >= j->output_size) {
+		uint32_t size = j->output_size ? j->output_size * 2 : 256;
+		char * o = realloc(j->output, size);
+
+		if (!o)
+			return;
+		j->output = o;
+		j->output_size = size;
+	}
+	j->output[j->output_len++] = value;
+	j->output[j->output_len] = 0;
+	// no need to run on once the output is wrong
+	if (j->expect && (j->output_len > j->expect_len ||
+			j->expect[j->output_len - 1] != (char)value))
+		j->status = AVR_BATCH_MISMATCH;
+}
+
+static void
+_avr_batch_sleep(
+		avr_t * avr,
+		avr_cycle_count_t how_long)
+{
+}
+
+// Supplies and analog inputs, after the firmware has set its own.
+static void
+_avr_batch_analog_inputs(
+		avr_t * avr,
+		avr_batch_job_t * j)
+{
+	if (j->vcc)
+		avr_raise_irq(avr->irq + CORE_IRQ_VCC, j->vcc);
+	if (j->avcc)
+		avr_raise_irq(avr->irq + CORE_IRQ_AVCC, j->avcc);
+	if (j->aref)
+		avr_raise_irq(avr->irq + CORE_IRQ_AREF, j->aref);
+	for (int i = 0; i < AVR_BATCH_ANALOG; i++) {
+		avr_irq_t * adc = NULL, * acomp;
+
+		if (!(j->analog_set & (1 << i)))
+			continue;
+		// the comparator has its own view of the ADC inputs
+		if (i < 16) {
+			adc = avr_io_getirq(avr, AVR_IOCTL_ADC_GETIRQ, ADC_IRQ_ADC0 + i);
+			acomp = avr_io_getirq(avr, AVR_IOCTL_ACOMP_GETIRQ,
+					ACOMP_IRQ_ADC0 + i);
+		} else
+			acomp = avr_io_getirq(avr, AVR_IOCTL_ACOMP_GETIRQ,
+					ACOMP_IRQ_AIN0 + i - 16);
+		if (adc)
+			avr_raise_irq(adc, j->analog[i]);
+		if (acomp)
+			avr_raise_irq(acomp, j->analog[i]);
+	}
+}
+
+static void
+_avr_batch_csv_string(
+		FILE * out,
+		const char * s,
+		uint32_t len)
+{
+	putc('"', out);
+	for (uint32_t i = 0; s && i < len; i++) {
+		if (s[i] == '"')
+			putc('"', out);
+		putc(s[i], out);
+	}
+	putc('"', out);
+}
+
+// Read the probes into j->values, empty fields for the unknown ones.
+static void
+_avr_batch_probe(
+		avr_t * avr,
+		avr_batch_job_t * j)
+{
+	char * probe, * p, * name;
+	size_t size;
+	FILE * out;
+
+	if (!j->probe || !(probe = strdup(j->probe)))
+		return;
+	out = open_memstream(&j->values, &size);
+	if (!out) {
+		free(probe);
+		return;
+	}
+	for (p = probe; (name = strsep(&p, ",")); ) {
+		avr_ioport_state_t state;
+		unsigned long addr;
+
+		if (name != probe)
+			putc(',', out);
+		if (!strcmp(name, "uart"))
+			_avr_batch_csv_string(out, j->output, j->output_len);
+		else if (!strncmp(name, "pin", 3) && name[3] &&
+				avr_ioctl(avr, AVR_IOCTL_IOPORT_GETSTATE(name[3]),
+						&state) == 0) {
+			if (!name[4])
+				fprintf(out, "%u", (unsigned)state.pin);
+			else if (name[4] >= '0' && name[4] <= '7' && !name[5])
+				fprintf(out, "%u", (unsigned)(state.pin >> (name[4] - '0')) & 1);
+		} else if (!strncmp(name, "mem:", 4) &&
+				(addr = strtoul(name + 4, NULL, 0)) <= avr->ramend)
+			fprintf(out, "%u", avr->data[addr]);
+		else if (!strncmp(name, "mem16:", 6) &&
+				(addr = strtoul(name + 6, NULL, 0)) < avr->ramend)
+			fprintf(out, "%u", avr->data[addr] | (avr->data[addr + 1] << 8));
+	}
+	fclose(out);
+	free(probe);
+}
+
+static double
+_avr_batch_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+_avr_batch_run_job(
+		avr_batch_t * b,
+		avr_batch_job_t * j)
+{
+	double start = _avr_batch_now();
+	elf_firmware_t fw;
+	avr_cycle_count_t limit;
+	avr_irq_t * out;
+	avr_t * avr;
+
+	if (j->image < 0 || b->image[j->image].error ||
+			_avr_batch_copy_image(&b->image[j->image], &fw)) {
+		j->status = AVR_BATCH_ERROR;
+		return;
+	}
+	if (j->mmcu)
+		snprintf(fw.mmcu, sizeof(fw.mmcu), "%s", j->mmcu);
+	if (j->frequency)
+		fw.frequency = j->frequency;
+	avr = fw.mmcu[0] ? avr_make_mcu_by_name(fw.mmcu) : NULL;
+	if (!avr || avr_init(avr)) {
+		AVR_LOG(NULL, LOG_ERROR, "BATCH: %s: AVR '%s' not known\n",
+				j->firmware, fw.mmcu);
+		_avr_batch_free_chunks(fw.chunks);
+		free(avr);
+		j->status = AVR_BATCH_ERROR;
+		return;
+	}
+	avr_load_firmware(avr, &fw);
+	// jobs of the same firmware share its flash pages
+	avr_shared_flash_start(avr);
+	// full speed: no real-time sleeping, no console echo of the UARTs
+	avr->sleep = _avr_batch_sleep;
+	for (char u = '0'; u <= '9'; u++) {
+		uint32_t flags = 0;
+
+		if (avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS(u), &flags) < 0)
+			continue;
+		flags &= ~(AVR_UART_FLAG_POLL_SLEEP | AVR_UART_FLAG_STDIO);
+		avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS(u), &flags);
+	}
+	_avr_batch_analog_inputs(avr, j);
+	out = avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ(j->uart), UART_IRQ_OUTPUT);
+	if (j->expect)
+		j->expect_len = strlen(j->expect);
+	if (out)
+		avr_irq_register_notify(out, _avr_batch_uart_out, j);
+	if (!avr->frequency || (j->expect && !out) ||
+			(j->stimulus && avr_record_load(avr, j->stimulus))) {
+		j->status = AVR_BATCH_ERROR;
+	} else {
+		limit = avr_usec_to_cycles(avr, j->timeout);
+		while (j->status == AVR_BATCH_PENDING) {
+			int state = avr_run(avr);
+
+			if (j->status != AVR_BATCH_PENDING)
+				break;		// output mismatch
+			if (state == cpu_Done)
+				j->status = AVR_BATCH_DONE;
+			else if (state == cpu_Crashed)
+				j->status = AVR_BATCH_CRASHED;
+			else if (avr->cycle >= limit)
+				j->status = AVR_BATCH_TIMEOUT_HIT;
+		}
+	}
+	j->cycles = avr->cycle;
+	_avr_batch_probe(avr, j);
+	avr_terminate(avr);
+	free(avr);
+	j->pass = (j->status == AVR_BATCH_DONE ||
+				j->status == AVR_BATCH_TIMEOUT_HIT) &&
+			(!j->expect || (j->output && !strcmp(j->output, j->expect)));
+	j->wall = _avr_batch_now() - start;
+}
+
+static void *
+_avr_batch_worker(
+		void * param)
+{
+	avr_batch_t * b = param;
+	int i;
+
+	// jobs are whole simulations: handing them out in turn balances well
+	while ((i = __atomic_fetch_add(&b->next, 1, __ATOMIC_RELAXED)) < b->count)
+		_avr_batch_run_job(b, &b->job[i]);
+	return NULL;
+}
+
+int
+avr_batch_run(
+		avr_batch_t * b,
+		int threads)
+{
+	double start = _avr_batch_now();
+	pthread_t * t;
+	int n = 0, failed = 0;
+
+	if (threads <= 0)
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (threads > b->count)
+		threads = b->count;
+	if (threads < 1)
+		threads = 1;
+	_avr_batch_read_images(b);
+	b->next = 0;
+	t = calloc(threads, sizeof(*t));
+	for (n = 0; t && n < threads - 1; n++)
+		if (pthread_create(&t[n], NULL, _avr_batch_worker, b))
+			break;
+	_avr_batch_worker(b);
+	while (n--)
+		pthread_join(t[n], NULL);
+	free(t);
+	b->wall = _avr_batch_now() - start;
+	for (int i = 0; i < b->count; i++)
+		failed += !b->job[i].pass;
+	return failed;
+}
+
+const char *
+avr_batch_status_name(
+		int status)
+{
+	static const char * names[] = {
+		[AVR_BATCH_PENDING] = "pending",
+		[AVR_BATCH_DONE] = "done",
+		[AVR_BATCH_TIMEOUT_HIT] = "timeout",
+		[AVR_BATCH_MISMATCH] = "mismatch",
+		[AVR_BATCH_CRASHED] = "crashed",
+		[AVR_BATCH_ERROR] = "error",
+	};
+
+	return status >= 0 && status <= AVR_BATCH_ERROR ? names[status] : "?";
+}
+
+static void
+_avr_batch_string(
+		FILE * out,
+		const char * s,
+		uint32_t len)
+{
+	putc('"', out);
+	for (uint32_t i = 0; s && i < len; i++) {
+		unsigned char c = s[i];
+
+		if (c == '"' || c == '\\')
+			fprintf(out, "\\%c", c);
+		else if (c < 0x20 || c >= 0x7f)
+			fprintf(out, "\\u%04x", c);
+		else
+			putc(c, out);
+	}
+	putc('"', out);
+}
+
+void
+avr_batch_report(
+		avr_batch_t * b,
+		FILE * out)
+{
+	for (int i = 0; i < b->count; i++) {
+		avr_batch_job_t * j = &b->job[i];
+
+		fprintf(out, "{\"job\":%d,\"firmware\":", i);
+		_avr_batch_string(out, j->firmware, strlen(j->firmware));
+		fprintf(out, ",\"status\":\"%s\",\"pass\":%s,"
+				"\"cycles\":%" PRI_avr_cycle_count ",\"wall\":%.6f,"
+				"\"mhz\":%.3f,\"output\":",
+				avr_batch_status_name(j->status), j->pass ? "true" : "false",
+				j->cycles, j->wall,
+				j->wall > 0 ? j->cycles / j->wall / 1e6 : 0.0);
+		_avr_batch_string(out, j->output, j->output_len);
+		fprintf(out, "}\n");
+	}
+}
+
+void
+avr_batch_report_csv(
+		avr_batch_t * b,
+		FILE * out)
+{
+	static const char * analog[AVR_BATCH_ANALOG] = {
+		"adc0", "adc1", "adc2", "adc3", "adc4", "adc5", "adc6", "adc7",
+		"adc8", "adc9", "adc10", "adc11", "adc12", "adc13", "adc14", "adc15",
+		"ain0", "ain1",
+	};
+	uint32_t analog_set = 0;
+	const char * probe = NULL;
+
+	// columns for whatever any job sets, probes as the first job has them
+	for (int i = 0; i < b->count; i++) {
+		analog_set |= b->job[i].analog_set;
+		if (!probe)
+			probe = b->job[i].probe;
+	}
+	fprintf(out, "job,firmware,freq,vcc,avcc,aref");
+	for (int a = 0; a < AVR_BATCH_ANALOG; a++)
+		if (analog_set & (1 << a))
+			fprintf(out, ",%s", analog[a]);
+	fprintf(out, ",status,pass,cycles");
+	if (probe)
+		fprintf(out, ",%s", probe);
+	putc('\n', out);
+	for (int i = 0; i < b->count; i++) {
+		avr_batch_job_t * j = &b->job[i];
+
+		fprintf(out, "%d,", i);
+		_avr_batch_csv_string(out, j->firmware, strlen(j->firmware));
+		fprintf(out, ",%u,%u,%u,%u", j->frequency, j->vcc, j->avcc, j->aref);
+		for (int a = 0; a < AVR_BATCH_ANALOG; a++)
+			if (analog_set & (1 << a))
+				fprintf(out, ",%u", j->analog[a]);
+		fprintf(out, ",%s,%d,%" PRI_avr_cycle_count,
+				avr_batch_status_name(j->status), j->pass, j->cycles);
+		if (probe && j->values)
+			fprintf(out, ",%s", j->values);
+		else if (probe)		// it did not run, empty fields
+			for (const char * c = probe; c; c = strchr(c + 1, ','))
+				putc(',', out);
+		putc('\n', out);
+	}
+}
+
+void
+avr_batch_free(
+		avr_batch_t * b)
+{
+	for (int i = 0; i < b->count; i++) {
+		avr_batch_job_t * j = &b->job[i];
+
+		_avr_batch_free_settings(j);
+		free(j->output);
+		free(j->values);
+	}
+	for (int i = 0; i < b->images; i++) {
+		avr_batch_image_t * im = &b->image[i];
+
+		free(im->filename);
+		_avr_batch_free_chunks(im->fw.chunks);
+#if ELF_SYMBOLS
+		// symbols from the firmware cache are in its mapping
+		for (uint32_t s = 0; !im->fw.map && s < im->fw.symbolcount; s++)
+			free(im->fw.symbol[s]);
+		free(im->fw.symbol);
+		free(im->fw.dwarf_file);
+		free(im->fw.dwarf);
+		free(im->fw.cache);
+#endif
+		avr_fw_cache_unmap(&im->fw);
+	}
+	free(b->job);
+	free(b->image);
+	memset(b, 0, sizeof(*b));
+}
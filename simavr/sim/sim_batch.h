@@ -0,0 +1,172 @@
+/*
+	sim_batch.h
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Running many firmware jobs at once, one simulator instance per job, on
+ * a pool of threads.
+ *
+ * Each distinct firmware file is read once and every job that uses it
+ * loads a copy of the parsed image, then shares its flash pages with the
+ * other jobs of that firmware (sim_shared_flash.h). Jobs run at full
+ * speed, without real-time sleeping, until the firmware ends (sleep with
+ * interrupts off), crashes, or reaches its time limit in simulated time.
+ * The output of one UART is collected and compared with the expected
+ * text; a job can also be fed the inputs of a --record log (sim_record.h)
+ * as stimulus.
+ *
+ * VCD traces asked for by the firmware are not written, as jobs running
+ * the same firmware would share the file.
+ *
+ * A manifest has one job per line, as key=value words: firmware=,
+ * mmcu=, freq=, stimulus=, timeout= (simulated microseconds), uart= and
+ * expect=. Values can be double-quoted, with C escapes (\n, \r, \t, \\,
+ * \" and \xHH). Only firmware= is needed; '#' starts a comment.
+ *
+ * Jobs can also set the supplies, vcc=, avcc= and aref=, and the analog
+ * inputs adc0= to adc15=, ain0= and ain1=, all in millivolts, and read
+ * back values at the end with probe=, a comma separated list of pinB
+ * (the PINB register), pinB3 (one bit of it), mem:<address>,
+ * mem16:<address> (little endian) and uart (the output text).
+ *
+ * A sweep file has the same words, possibly over several lines, but
+ * numeric settings can be given as lo:hi:step ranges or as a,b,c lists.
+ * It makes a job for every point of the grid of those, or for samples=<n>
+ * random points, seed=<n>, taken uniformly from the ranges and lists.
+ * avr_batch_report_csv() then writes a line per point.
+ */
+
+#ifndef __SIM_BATCH_H__
+#define __SIM_BATCH_H__
+
+#include <stdio.h>
+#include "sim_avr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AVR_BATCH_TIMEOUT	1000000		// default limit, simulated usec
+#define AVR_BATCH_ANALOG	18			// adc0 to adc15, ain0 and ain1
+#define AVR_BATCH_SWEEP_MAX	1000000		// jobs a sweep can make
+
+enum {
+	AVR_BATCH_PENDING = 0,
+	AVR_BATCH_DONE,			// the firmware ended
+	AVR_BATCH_TIMEOUT_HIT,	// ran to the time limit
+	AVR_BATCH_MISMATCH,		// the output went away from the expected one
+	AVR_BATCH_CRASHED,
+	AVR_BATCH_ERROR,		// could not be set up
+};
+
+typedef struct avr_batch_job_t {
+	// what to run, strings are owned by the job
+	char *				firmware;
+	char *				mmcu;		// NULL for the one in the firmware
+	char *				stimulus;	// input log to replay, or NULL
+	char *				expect;		// expected UART output, or NULL
+	uint32_t			frequency;	// 0 for the one in the firmware
+	uint32_t			timeout;	// simulated usec
+	char				uart;
+	uint32_t			vcc, avcc, aref;	// mV, 0 for the firmware's
+	uint32_t			analog[AVR_BATCH_ANALOG];	// mV
+	uint32_t			analog_set;	// bit per analog input given
+	char *				probe;		// what to read back, or NULL
+
+	// results
+	int					status;
+	int					pass;
+	avr_cycle_count_t	cycles;
+	double				wall;		// seconds
+	char *				output;
+	uint32_t			output_len, output_size;
+	char *				values;		// of the probes, CSV fields
+
+	int					image;		// private, index in avr_batch_t.image
+	uint32_t			expect_len;	// private, of expect, for each byte out
+} avr_batch_job_t;
+
+struct avr_batch_image_t;
+
+typedef struct avr_batch_t {
+	avr_batch_job_t *	job;
+	int					count, size;
+	struct avr_batch_image_t *image;	// parsed firmware, one per file
+	int					images;
+	int					next;		// next job to hand out
+	double				wall;		// of the whole run
+} avr_batch_t;
+
+// Add a job with default settings, returns NULL if out of memory.
+avr_batch_job_t *
+avr_batch_add(
+		avr_batch_t * b,
+		const char * firmware);
+
+// Add the jobs of a manifest file. Returns -1 on error.
+int
+avr_batch_load(
+		avr_batch_t * b,
+		const char * filename);
+
+// Add the jobs of a sweep file. Returns -1 on error.
+int
+avr_batch_sweep_load(
+		avr_batch_t * b,
+		const char * filename);
+
+/*
+ * Run all the jobs on 'threads' threads, 0 for one per CPU.
+ * Returns the number of jobs that did not pass.
+ */
+int
+avr_batch_run(
+		avr_batch_t * b,
+		int threads);
+
+// Write the results, one JSON object per line and job.
+void
+avr_batch_report(
+		avr_batch_t * b,
+		FILE * out);
+
+/*
+ * Write the results as CSV, a line per job with its settings, status
+ * and probed values, under a header line.
+ */
+void
+avr_batch_report_csv(
+		avr_batch_t * b,
+		FILE * out);
+
+// Free the jobs, their results and the parsed firmware.
+void
+avr_batch_free(
+		avr_batch_t * b);
+
+const char *
+avr_batch_status_name(
+		int status);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* __SIM_BATCH_H__ */
@@ -0,0 +1,426 @@
+/*
+	sim_board.c
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <sched.h>
+#include "sim_avr.h"
+#include "sim_time.h"
+#include "sim_board.h"
+#include "avr_uart.h"
+
+#define AVR_BOARD_NEVER		(~(uint64_t)0)
+
+// First cycle at or after 'nsec', the reverse of avr_cycles_to_nsec().
+static avr_cycle_count_t
+_avr_board_cycles(
+		avr_t * avr,
+		uint64_t nsec)
+{
+	uint64_t khz = avr->frequency / 1000;
+
+	return nsec / 1000000 * khz + (nsec % 1000000 * khz + 999999) / 1000000;
+}
+
+// Where it is on the board, in nsec, resets included.
+static uint64_t
+_avr_board_now(
+		avr_board_mcu_t * m)
+{
+	return m->base + avr_cycles_to_nsec(m->avr, m->avr->cycle);
+}
+
+// The cycle it will be at at 'nsec' on the board, 0 if it is gone by.
+static avr_cycle_count_t
+_avr_board_cycle_at(
+		avr_board_mcu_t * m,
+		uint64_t nsec)
+{
+	return nsec > m->base ? _avr_board_cycles(m->avr, nsec - m->base) : 0;
+}
+
+static void
+_avr_board_publish(
+		avr_board_mcu_t * m,
+		uint64_t time)
+{
+	__atomic_store_n(&m->time, time, __ATOMIC_RELEASE);
+}
+
+static avr_board_mcu_t *
+_avr_board_find(
+		avr_board_t * b,
+		avr_t * avr,
+		int * index)
+{
+	for (int i = 0; i < b->count; i++)
+		if (b->mcu[i]->avr == avr) {
+			*index = i;
+			return b->mcu[i];
+		}
+	return NULL;
+}
+
+int
+avr_board_add(
+		avr_board_t * b,
+		avr_t * avr)
+{
+	avr_board_mcu_t ** mcu = realloc(b->mcu, (b->count + 1) * sizeof(*mcu));
+	avr_board_mcu_t * m = calloc(1, sizeof(*m));
+
+	if (mcu)
+		b->mcu = mcu;
+	if (!mcu || !m || !avr->frequency) {
+		free(m);
+		return -1;
+	}
+	m->board = b;
+	m->avr = avr;
+	m->state = cpu_Running;
+	m->done = 1;
+	avr->board = m;
+	b->mcu[b->count] = m;
+	return b->count++;
+}
+
+// The spare block if the destination has finished with one.
+static avr_board_block_t *
+_avr_board_block(
+		avr_board_link_t * l)
+{
+	avr_board_block_t * k = __atomic_exchange_n(&l->spare, NULL,
+			__ATOMIC_ACQUIRE);
+
+	if (!k)
+		k = malloc(sizeof(*k));
+	if (k)
+		k->next = NULL;
+	return k;
+}
+
+/*
+ * Runs on the source thread, from anything that raises the IRQ. It never
+ * waits: the block after the last slot is linked before that slot is
+ * published, so the destination always finds it.
+ */
+static void
+_avr_board_send(
+		struct avr_irq_t * irq,
+		uint32_t value,
+		void * param)
+{
+	avr_board_link_t * l = param;
+	avr_board_mcu_t * src = l->board->mcu[l->src];
+	avr_board_mcu_t * dst = l->board->mcu[l->dst];
+	uint64_t now = _avr_board_now(src);
+	uint32_t head = l->head;
+	avr_board_block_t * k = l->write, * next = NULL;
+
+	if (__atomic_load_n(&dst->time, __ATOMIC_ACQUIRE) == AVR_BOARD_NEVER)
+		return;		// it has stopped
+	if (head % AVR_BOARD_QUEUE == AVR_BOARD_QUEUE - 1) {
+		next = _avr_board_block(l);
+		if (!next) {
+			AVR_LOG(src->avr, LOG_ERROR, "BOARD: %s: out of memory, "
+					"value lost\n", irq->name ? irq->name : "link");
+			return;
+		}
+		k->next = next;
+	}
+	k->slot[head % AVR_BOARD_QUEUE].when = now + l->latency;
+	k->slot[head % AVR_BOARD_QUEUE].value = value;
+	if (next)
+		l->write = next;
+	__atomic_store_n(&l->head, head + 1, __ATOMIC_RELEASE);
+}
+
+int
+avr_board_connect(
+		avr_board_t * b,
+		avr_t * src,
+		avr_irq_t * src_irq,
+		avr_t * dst,
+		avr_irq_t * dst_irq,
+		uint64_t latency)
+{
+	avr_board_mcu_t * s, * d;
+	avr_board_link_t ** link, * l;
+	avr_cycle_count_t period;
+	int * in;
+
+	if (!src_irq || !dst_irq || !latency)
+		return -1;
+	l = calloc(1, sizeof(*l));
+	if (!l)
+		return -1;
+	if (!(s = _avr_board_find(b, src, &l->src)) ||
+			!(d = _avr_board_find(b, dst, &l->dst)) ||
+			!(l->read = l->write = _avr_board_block(l))) {
+		free(l);
+		return -1;
+	}
+	link = realloc(b->link, (b->links + 1) * sizeof(*link));
+	if (link)
+		b->link = link;
+	in = link ? realloc(d->in, (d->in_count + 1) * sizeof(*in)) : NULL;
+	if (in)
+		d->in = in;
+	if (!in) {
+		free(l->read);
+		free(l);
+		return -1;
+	}
+	l->board = b;
+	l->src_irq = src_irq;
+	l->dst_irq = dst_irq;
+	l->latency = latency;
+	d->in[d->in_count++] = b->links;
+	b->link[b->links++] = l;
+	/*
+	 * The source has to say how far it has got often enough for the
+	 * destination not to wait on it.
+	 */
+	period = _avr_board_cycles(src, latency / 2);
+	if (!period)
+		period = 1;
+	if (!s->period || period < s->period)
+		s->period = period;
+	avr_irq_register_notify(src_irq, _avr_board_send, l);
+	return 0;
+}
+
+// No input time-stamped before the returned time is still to come.
+static uint64_t
+_avr_board_horizon(
+		avr_board_t * b,
+		avr_board_mcu_t * m)
+{
+	uint64_t horizon = AVR_BOARD_NEVER;
+
+	for (int i = 0; i < m->in_count; i++) {
+		avr_board_link_t * l = b->link[m->in[i]];
+		uint64_t t = __atomic_load_n(&b->mcu[l->src]->time, __ATOMIC_ACQUIRE);
+
+		if (t != AVR_BOARD_NEVER && t + l->latency < horizon)
+			horizon = t + l->latency;
+	}
+	return horizon;
+}
+
+// The link with the oldest input, the first one added on a tie.
+static avr_board_link_t *
+_avr_board_next_input(
+		avr_board_t * b,
+		avr_board_mcu_t * m)
+{
+	avr_board_link_t * next = NULL;
+
+	for (int i = 0; i < m->in_count; i++) {
+		avr_board_link_t * l = b->link[m->in[i]];
+
+		if (__atomic_load_n(&l->head, __ATOMIC_ACQUIRE) == l->tail)
+			continue;
+		if (!next || l->read->slot[l->tail % AVR_BOARD_QUEUE].when <
+				next->read->slot[next->tail % AVR_BOARD_QUEUE].when)
+			next = l;
+	}
+	return next;
+}
+
+/*
+ * The only place an AVR waits for the others. It says how far it has got,
+ * waits until every input up to now has arrived, raises the ones that are
+ * due, and comes back at the next input, before it could miss one, or
+ * when the others need to know how far it has got.
+ */
+static avr_cycle_count_t
+_avr_board_check(
+		avr_t * avr,
+		avr_cycle_count_t when,
+		void * param)
+{
+	avr_board_mcu_t * m = param;
+	avr_board_t * b = m->board;
+	uint64_t now = _avr_board_now(m);
+	avr_cycle_count_t next = m->limit;
+	avr_board_link_t * l;
+
+	_avr_board_publish(m, now);
+	if (avr->cycle >= m->limit) {
+		m->done = 1;
+		return 0;
+	}
+	while (m->horizon <= now) {
+		m->horizon = _avr_board_horizon(b, m);
+		if (m->horizon <= now)
+			sched_yield();
+	}
+	while ((l = _avr_board_next_input(b, m))) {
+		uint32_t tail = l->tail;
+		avr_board_block_t * k = l->read;
+		uint64_t at = k->slot[tail % AVR_BOARD_QUEUE].when;
+
+		if (at > now) {
+			avr_cycle_count_t c = _avr_board_cycle_at(m, at);
+
+			if (c < next)
+				next = c;
+			break;
+		}
+		avr_raise_irq(l->dst_irq, k->slot[tail % AVR_BOARD_QUEUE].value);
+		if (tail % AVR_BOARD_QUEUE == AVR_BOARD_QUEUE - 1) {
+			// on to the next block, and hand this one back
+			l->read = k->next;
+			free(__atomic_exchange_n(&l->spare, k, __ATOMIC_RELEASE));
+		}
+		__atomic_store_n(&l->tail, tail + 1, __ATOMIC_RELEASE);
+	}
+	if (m->horizon != AVR_BOARD_NEVER &&
+			_avr_board_cycle_at(m, m->horizon) < next)
+		next = _avr_board_cycle_at(m, m->horizon);
+	if (m->period && avr->cycle + m->period < next)
+		next = avr->cycle + m->period;
+	return next > when ? next : when + 1;
+}
+
+static void
+_avr_board_sleep(
+		avr_t * avr,
+		avr_cycle_count_t how_long)
+{
+}
+
+static void *
+_avr_board_thread(
+		void * param)
+{
+	avr_board_mcu_t * m = param;
+	avr_t * avr = m->avr;
+
+	while (!m->done) {
+		int state = avr_run(avr);
+
+		if (state == cpu_Done || state == cpu_Crashed) {
+			m->state = state;
+			break;
+		}
+	}
+	avr_cycle_timer_cancel(avr, _avr_board_check, m);
+	m->done = 1;
+	// nothing more will come from this one
+	_avr_board_publish(m, AVR_BOARD_NEVER);
+	return NULL;
+}
+
+int
+avr_board_run(
+		avr_board_t * b,
+		uint32_t usec)
+{
+	int n, crashed = 0;
+
+	for (int i = 0; i < b->count; i++) {
+		avr_board_mcu_t * m = b->mcu[i];
+		avr_t * avr = m->avr;
+
+		avr->sleep = _avr_board_sleep;
+		for (char u = '0'; u <= '9'; u++) {
+			uint32_t flags = 0;
+
+			if (avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS(u), &flags) < 0)
+				continue;
+			flags &= ~AVR_UART_FLAG_POLL_SLEEP;
+			avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS(u), &flags);
+		}
+		m->limit = usec ? avr->cycle + avr_usec_to_cycles(avr, usec) :
+				~(avr_cycle_count_t)0;
+		m->time = _avr_board_now(m);
+		m->horizon = 0;
+		m->done = 0;
+		m->state = avr->state;
+		avr_cycle_timer_register(avr, 1, _avr_board_check, m);
+	}
+	for (n = 1; n < b->count; n++)
+		if (pthread_create(&b->mcu[n]->thread, NULL,
+				_avr_board_thread, b->mcu[n]))
+			break;
+	for (int i = n; i < b->count; i++) {
+		// the others must not wait for it
+		AVR_LOG(b->mcu[i]->avr, LOG_ERROR, "BOARD: can't start a thread\n");
+		avr_cycle_timer_cancel(b->mcu[i]->avr, _avr_board_check, b->mcu[i]);
+		b->mcu[i]->done = 1;
+		b->mcu[i]->state = cpu_Crashed;
+		_avr_board_publish(b->mcu[i], AVR_BOARD_NEVER);
+	}
+	if (b->count)
+		_avr_board_thread(b->mcu[0]);
+	while (--n > 0)
+		pthread_join(b->mcu[n]->thread, NULL);
+	for (int i = 0; i < b->count; i++)
+		crashed += b->mcu[i]->state == cpu_Crashed;
+	return crashed;
+}
+
+/*
+ * The cycle timers are gone with the reset, the check is registered again
+ * when running. The count starts over, the limit and the time on the
+ * board are moved with it.
+ */
+void
+avr_board_reset(
+		avr_t * avr,
+		avr_cycle_count_t cycle)
+{
+	avr_board_mcu_t * m = avr->board;
+
+	m->base += avr_cycles_to_nsec(avr, cycle);
+	if (m->limit != ~(avr_cycle_count_t)0)
+		m->limit = m->limit > cycle ? m->limit - cycle : 0;
+	if (!m->done)
+		avr_cycle_timer_register(avr, 1, _avr_board_check, m);
+}
+
+void
+avr_board_free(
+		avr_board_t * b)
+{
+	for (int i = 0; i < b->links; i++) {
+		avr_board_link_t * l = b->link[i];
+
+		avr_irq_unregister_notify(l->src_irq, _avr_board_send, l);
+		while (l->read) {
+			avr_board_block_t * k = l->read;
+
+			l->read = k->next;
+			free(k);
+		}
+		free(l->spare);
+		free(l);
+	}
+	for (int i = 0; i < b->count; i++) {
+		b->mcu[i]->avr->board = NULL;
+		free(b->mcu[i]->in);
+		free(b->mcu[i]);
+	}
+	free(b->link);
+	free(b->mcu);
+	*b = (avr_board_t) { 0 };
+}
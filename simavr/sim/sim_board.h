@@ -0,0 +1,160 @@
+/*
+	sim_board.h
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A board of several AVRs, each one run by its own thread.
+ *
+ * The AVRs talk through links: an IRQ of one AVR is carried to an IRQ of
+ * another one with a fixed latency in simulated time, the time the signal
+ * needs to cross, for example one byte time for a UART. That latency is
+ * what lets the AVRs run in parallel: an AVR that has got to simulated
+ * time T cannot affect another one before T + latency, so the other one
+ * may run that far ahead of it without waiting.
+ *
+ * Each AVR publishes how far it has got, and each link is a lock-free
+ * queue of time-stamped values. The queue grows by blocks as needed, so
+ * an AVR never waits to send: two AVRs sending to each other faster than
+ * they read could otherwise each wait on the other for ever. A value is
+ * raised on the destination IRQ at the first instruction boundary at or
+ * after its time stamp, so a run gives the same results whatever the
+ * threads do. Between two checks the AVRs run their instructions without
+ * any synchronisation; the checks come at least twice per latency of the
+ * links involved, so links with a longer latency cost less.
+ *
+ * The board uses one cycle timer of every AVR, runs them at full speed
+ * and turns off the real-time sleeping of UARTs polled for input.
+ */
+
+#ifndef __SIM_BOARD_H__
+#define __SIM_BOARD_H__
+
+#include <pthread.h>
+#include "sim_avr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AVR_BOARD_QUEUE		256		// values per block of a link's queue
+
+// The time a byte takes on a UART, start and stop bit included.
+#define AVR_BOARD_UART_NSEC(baud)	(10 * 1000000000ULL / (baud))
+
+typedef struct avr_board_block_t {
+	struct avr_board_block_t *	next;
+	struct {
+		uint64_t	when;		// nsec
+		uint32_t	value;
+	}							slot[AVR_BOARD_QUEUE];
+} avr_board_block_t;
+
+typedef struct avr_board_link_t {
+	struct avr_board_t *	board;
+	int						src, dst;	// index of the AVRs
+	avr_irq_t *				src_irq;
+	avr_irq_t *				dst_irq;
+	uint64_t				latency;	// nsec
+	// written by the source thread only
+	uint32_t				head;
+	avr_board_block_t *		write;
+	// written by the destination thread only
+	uint32_t				tail;
+	avr_board_block_t *		read;
+	// a block read to the end, for the source to use again
+	avr_board_block_t *		spare;
+} avr_board_link_t;
+
+typedef struct avr_board_mcu_t {
+	struct avr_board_t *	board;
+	avr_t *				avr;
+	/*
+	 * Simulated nsec this AVR has got to: it will not raise a link
+	 * before that. Written by its thread only.
+	 */
+	uint64_t			time;
+	uint64_t			base;		// nsec it was at when last reset
+	int *				in;			// links to this AVR
+	int					in_count;
+	uint64_t			horizon;	// nsec, no input is missing before it
+	avr_cycle_count_t	period;		// at most that long between checks
+	avr_cycle_count_t	limit;
+	int					done;		// or not running
+	int					state;		// when it stopped
+	pthread_t			thread;
+} avr_board_mcu_t;
+
+typedef struct avr_board_t {
+	avr_board_mcu_t **	mcu;
+	int					count;
+	avr_board_link_t **	link;
+	int					links;
+} avr_board_t;
+
+// Add an initialised AVR, with its firmware loaded. Returns its index.
+int
+avr_board_add(
+		avr_board_t * b,
+		avr_t * avr);
+
+/*
+ * Carry 'src_irq' of 'src' to 'dst_irq' of 'dst', 'latency' nsec later.
+ * Both AVRs must be on the board and the latency can't be zero.
+ * Returns -1 on error.
+ */
+int
+avr_board_connect(
+		avr_board_t * b,
+		avr_t * src,
+		avr_irq_t * src_irq,
+		avr_t * dst,
+		avr_irq_t * dst_irq,
+		uint64_t latency);
+
+/*
+ * Run every AVR on its own thread, the first one on the calling thread,
+ * until they have all ended, crashed or run for 'usec' of simulated time,
+ * 0 for no limit. Returns the number of AVRs that crashed or could not
+ * be run.
+ */
+int
+avr_board_run(
+		avr_board_t * b,
+		uint32_t usec);
+
+/*
+ * Carry on from the cycle count starting over, called by avr_reset() with
+ * the cycle it was at: the time on the board goes on from there.
+ */
+void
+avr_board_reset(
+		avr_t * avr,
+		avr_cycle_count_t cycle);
+
+// Free the board, but not the AVRs, before those are terminated.
+void
+avr_board_free(
+		avr_board_t * b);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* __SIM_BOARD_H__ */
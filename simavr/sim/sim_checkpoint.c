@@ -0,0 +1,227 @@
+/*
+	sim_checkpoint.c
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "sim_avr.h"
+#include "sim_checkpoint.h"
+#include "sim_snapshot.h"
+#include "sim_stack.h"
+
+// Number of bitmap words for 'size' bytes in blocks of 1 << 'shift'.
+static uint32_t
+_avr_dirty_words(
+		uint32_t size,
+		int shift)
+{
+	uint32_t blocks = (size + (1 << shift) - 1) >> shift;
+
+	return (blocks + 31) / 32;
+}
+
+static void
+_avr_dirty_clear(
+		avr_t * avr)
+{
+	avr_dirty_t * d = avr->dirty;
+
+	memset(d->data, 0, _avr_dirty_words(avr->ramend + 1,
+					AVR_DIRTY_DATA_SHIFT) * sizeof(uint32_t));
+	memset(d->flash, 0, _avr_dirty_words(avr->flashend + 1,
+					AVR_DIRTY_FLASH_SHIFT) * sizeof(uint32_t));
+}
+
+// Copy back the dirty blocks of 'dst' from 'src', and clear them.
+static void
+_avr_dirty_restore(
+		uint32_t * map,
+		int shift,
+		uint8_t * dst,
+		const uint8_t * src,
+		uint32_t size)
+{
+	uint32_t words = _avr_dirty_words(size, shift);
+
+	for (uint32_t w = 0; w < words; w++) {
+		while (map[w]) {
+			int bit = __builtin_ctz(map[w]);
+			uint32_t start = ((w * 32) + bit) << shift;
+			uint32_t len = 1 << shift;
+
+			if (start + len > size)
+				len = size - start;
+			memcpy(dst + start, src + start, len);
+			map[w] &= map[w] - 1;
+		}
+	}
+}
+
+avr_checkpoint_t *
+avr_checkpoint_take(
+		avr_t * avr)
+{
+	avr_checkpoint_t * c;
+	avr_snapshot_t s = { .avr = avr, .no_memory = 1 };
+
+	if (!avr->dirty) {
+		avr_dirty_t * d = calloc(1, sizeof(*d));
+
+		if (!d)
+			return NULL;
+		d->data = calloc(_avr_dirty_words(avr->ramend + 1,
+						AVR_DIRTY_DATA_SHIFT), sizeof(uint32_t));
+		d->flash = calloc(_avr_dirty_words(avr->flashend + 1,
+						AVR_DIRTY_FLASH_SHIFT), sizeof(uint32_t));
+		if (!d->data || !d->flash) {
+			free(d->data);
+			free(d->flash);
+			free(d);
+			return NULL;
+		}
+		avr->dirty = d;
+	}
+	c = calloc(1, sizeof(*c));
+	if (!c)
+		return NULL;
+	c->avr = avr;
+	c->data = malloc(avr->ramend + 1);
+	c->flash = malloc(avr->flashend + 1);
+	avr_snapshot_state(&s);
+	if (!c->data || !c->flash || s.error) {
+		free(c->data);
+		free(c->flash);
+		free(s.buf);
+		free(c);
+		return NULL;
+	}
+	memcpy(c->data, avr->data, avr->ramend + 1);
+	memcpy(c->flash, avr->flash, avr->flashend + 1);
+	c->state = s.buf;
+	c->state_len = s.len;
+
+	avr->dirty->checkpoints++;
+	avr->dirty->base = c;
+	_avr_dirty_clear(avr);
+	return c;
+}
+
+int
+avr_checkpoint_restore(
+		avr_checkpoint_t * c)
+{
+	avr_t * avr = c->avr;
+	avr_dirty_t * d = avr->dirty;
+	avr_snapshot_t s = {
+		.avr = avr, .restore = 1, .no_memory = 1,
+		.buf = c->state, .len = c->state_len };
+
+	if (d->base == c) {
+		// registers and IO are not tracked
+		memcpy(avr->data, c->data, avr->ioend + 1);
+		_avr_dirty_restore(d->data, AVR_DIRTY_DATA_SHIFT,
+						   avr->data, c->data, avr->ramend + 1);
+		_avr_dirty_restore(d->flash, AVR_DIRTY_FLASH_SHIFT,
+						   avr->flash, c->flash, avr->flashend + 1);
+	} else {
+		memcpy(avr->data, c->data, avr->ramend + 1);
+		// only what changed, not to copy shared pages (sim_shared_flash.h)
+		for (uint32_t a = 0; a <= avr->flashend; a += 4096) {
+			uint32_t n = avr->flashend + 1 - a < 4096 ?
+								avr->flashend + 1 - a : 4096;
+
+			if (memcmp(avr->flash + a, c->flash + a, n))
+				memcpy(avr->flash + a, c->flash + a, n);
+		}
+		_avr_dirty_clear(avr);
+		d->base = c;
+	}
+	avr_snapshot_state(&s);
+	if (s.error) {
+		AVR_LOG(avr, LOG_ERROR, "CHECKPOINT: restore failed\n");
+		return -1;
+	}
+	if (avr->stack)
+		avr_stack_reset(avr);
+	return 0;
+}
+
+void
+avr_checkpoint_free(
+		avr_checkpoint_t * c)
+{
+	avr_t * avr;
+
+	if (!c)
+		return;
+	avr = c->avr;
+	if (avr->dirty) {
+		if (avr->dirty->base == c)
+			avr->dirty->base = NULL;
+		if (--avr->dirty->checkpoints == 0)
+			avr_checkpoint_stop(avr);
+	}
+	free(c->data);
+	free(c->flash);
+	free(c->state);
+	free(c);
+}
+
+void
+avr_checkpoint_touch_data(
+		avr_t * avr,
+		uint32_t addr,
+		uint32_t len)
+{
+	if (!avr->dirty || !len || addr > avr->ramend)
+		return;
+	if (addr + len > avr->ramend + 1)
+		len = avr->ramend + 1 - addr;
+	for (uint32_t b = addr >> AVR_DIRTY_DATA_SHIFT;
+			b <= (addr + len - 1) >> AVR_DIRTY_DATA_SHIFT; b++)
+		avr_dirty_mark(avr->dirty->data, b);
+}
+
+void
+avr_checkpoint_touch_flash(
+		avr_t * avr,
+		uint32_t addr,
+		uint32_t len)
+{
+	if (!avr->dirty || !len || addr > avr->flashend)
+		return;
+	if (addr + len > avr->flashend + 1)
+		len = avr->flashend + 1 - addr;
+	for (uint32_t b = addr >> AVR_DIRTY_FLASH_SHIFT;
+			b <= (addr + len - 1) >> AVR_DIRTY_FLASH_SHIFT; b++)
+		avr_dirty_mark(avr->dirty->flash, b);
+}
+
+void
+avr_checkpoint_stop(
+		avr_t * avr)
+{
+	if (!avr->dirty)
+		return;
+	free(avr->dirty->data);
+	free(avr->dirty->flash);
+	free(avr->dirty);
+	avr->dirty = NULL;
+}
@@ -0,0 +1,107 @@
+/*
+	sim_checkpoint.h
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * In-memory checkpoints, for going back to the same point many times.
+ *
+ * A checkpoint holds a copy of the data space and flash, plus the rest of
+ * the state as a sim_snapshot.h stream. While any checkpoint exists, SRAM
+ * and flash writes mark blocks in a dirty bitmap, so restoring the most
+ * recently taken or restored checkpoint only copies back the blocks
+ * written since; registers and IO are small and always copied.
+ *
+ * Code that writes avr->data or avr->flash directly, rather than through
+ * the core, must report it with avr_checkpoint_touch_*(). Free the
+ * checkpoints before calling avr_terminate().
+ */
+
+#ifndef __SIM_CHECKPOINT_H__
+#define __SIM_CHECKPOINT_H__
+
+#include "sim_avr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AVR_DIRTY_DATA_SHIFT	5	// 32 byte blocks of SRAM
+#define AVR_DIRTY_FLASH_SHIFT	8	// 256 byte blocks of flash
+
+// Dirty block tracking, hung off avr->dirty while checkpoints exist.
+typedef struct avr_dirty_t {
+	struct avr_checkpoint_t * base;	// what the bitmaps are relative to
+	int				checkpoints;	// live checkpoints
+	uint32_t *		data;
+	uint32_t *		flash;
+} avr_dirty_t;
+
+typedef struct avr_checkpoint_t {
+	struct avr_t *	avr;
+	uint8_t *		data;		// data space, 0 to ramend
+	uint8_t *		flash;
+	uint8_t *		state;		// everything else
+	size_t			state_len;
+} avr_checkpoint_t;
+
+avr_checkpoint_t *
+avr_checkpoint_take(
+		struct avr_t * avr);
+
+// Go back to 'c', which stays valid for further restores.
+int
+avr_checkpoint_restore(
+		avr_checkpoint_t * c);
+
+void
+avr_checkpoint_free(
+		avr_checkpoint_t * c);
+
+// Report writes made behind the core's back.
+void
+avr_checkpoint_touch_data(
+		struct avr_t * avr,
+		uint32_t addr,
+		uint32_t len);
+void
+avr_checkpoint_touch_flash(
+		struct avr_t * avr,
+		uint32_t addr,
+		uint32_t len);
+
+// Private, called by the core with avr->dirty set
+static inline void
+avr_dirty_mark(
+		uint32_t * map,
+		uint32_t block)
+{
+	map[block >> 5] |= 1u << (block & 31);
+}
+
+// Private, called by avr_terminate()
+void
+avr_checkpoint_stop(
+		struct avr_t * avr);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* __SIM_CHECKPOINT_H__ */
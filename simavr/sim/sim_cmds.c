@@ -25,6 +25,7 @@
 #include "sim_avr.h"
 #include "sim_cmds.h"
 #include "sim_vcd_file.h"
+#include "sim_trigger.h"
 #include "avr_uart.h"
 #include "avr/avr_mcu_section.h"
 
@@ -161,6 +162,17 @@ _simavr_cmd_vcd_stop_trace(
 	return 0;
 }
 
+static int
+_simavr_cmd_vcd_trigger(
+		avr_t * avr,
+		uint8_t v,
+		void * param)
+{
+	avr_trigger_fire(avr, "command");
+
+	return 0;
+}
+
 static int
 _simavr_cmd_uart_loopback(
 		avr_t * avr,
@@ -190,4 +202,5 @@ avr_cmd_init(
 	avr_cmd_register(avr, SIMAVR_CMD_VCD_START_TRACE, &_simavr_cmd_vcd_start_trace, NULL);
 	avr_cmd_register(avr, SIMAVR_CMD_VCD_STOP_TRACE, &_simavr_cmd_vcd_stop_trace, NULL);
 	avr_cmd_register(avr, SIMAVR_CMD_UART_LOOPBACK, &_simavr_cmd_uart_loopback, NULL);
+	avr_cmd_register(avr, SIMAVR_CMD_VCD_TRIGGER, &_simavr_cmd_vcd_trigger, NULL);
 }
@@ -26,6 +26,13 @@
 #include "sim_avr.h"
 #include "sim_core.h"
 #include "sim_gdb.h"
+#include "sim_stack.h"
+#include "sim_timeline.h"
+#include "sim_symbols.h"
+#include "sim_checkpoint.h"
+#include "sim_stats.h"
+#include "sim_fuzz.h"
+#include "sim_trigger.h"
 #include "avr_flash.h"
 #include "avr_watchdog.h"
 
@@ -80,12 +87,9 @@ int dont_trace(const char * name)
 /* Get symbol or line number for a flash addess.
  * Returns NULL only if in a tracing-restricted function.
  * Show registed values when restriction changes.
+ * This function is global to make it easy to call in a host gdb session.
  */
 
-static int donttrace;
-
-/* This function is global to make it easy to call in a host gdb session. */
-
 const char *avr_where(avr_t *avr)
 {
 	avr_flashaddr_t  pc;
@@ -98,15 +102,15 @@ const char *avr_where(avr_t *avr)
 #ifdef RESTRICT_TRACE
 		int	dont = dont_trace(s);
 		if (dont) {
-			if (!donttrace) {
+			if (!avr->trace_data->donttrace) {
 				printf("\nCalling restricted function %s\n", s);
 				DUMP_REG();
 			}
-		} else if (donttrace) {
+		} else if (avr->trace_data->donttrace) {
 			DUMP_REG();
 		}
-		donttrace = dont;
-		if (donttrace)
+		avr->trace_data->donttrace = dont;
+		if (dont)
 			return NULL;
 #endif
 		if (s)
@@ -121,7 +125,7 @@ const char *avr_where(avr_t *avr)
 		printf("%04x: %-25s " _f, avr->pc, symn, ## argsf);	\
 }
 
-#define SREG() if (avr->trace && donttrace == 0) {	  \
+#define SREG() if (avr->trace && avr->trace_data->donttrace == 0) {	  \
 	printf("%04x: \t\t\t\t\t\t\t\tSREG = ", avr->pc); \
 	for (int _sbi = 0; _sbi < 8; _sbi++)\
 		printf("%c", avr->sreg[_sbi] ? toupper(_sreg_bit_name[_sbi]) : '.');\
@@ -258,6 +262,8 @@ void avr_core_watch_write(avr_t *avr, uint16_t addr, uint8_t v)
 		avr_gdb_handle_watchpoints(avr, addr, AVR_GDB_WATCH_WRITE);
 	}
 
+	if (avr->dirty)
+		avr_dirty_mark(avr->dirty->data, addr >> AVR_DIRTY_DATA_SHIFT);
 	avr->data[addr] = v;
 	_call_register_irqs(avr, addr);
 	_call_sram_irqs(avr, addr);
@@ -344,6 +350,8 @@ static inline void _avr_set_ram(avr_t * avr, uint16_t addr, uint8_t v)
 
 		io_addr = addr - avr->io_offset;
 		REG_TOUCH(avr, io_addr + 32);
+		if (avr->stats)
+			avr->stats->io_writes[io_addr]++;
 		if (io_addr == R_SREG) {
 			avr->iobase[R_SREG] = v;
 			// unsplit the SREG
@@ -360,6 +368,9 @@ static inline void _avr_set_ram(avr_t * avr, uint16_t addr, uint8_t v)
 					avr_raise_irq(avr->io[io_addr].irq + i, (v >> i) & 1);
 			}
 		}
+		// SPL is written last, so the SP is complete now
+		if (unlikely(io_addr == R_SPL) && avr->stack)
+			avr_stack_sp_changed(avr);
 	} else {
 		avr_core_watch_write(avr, addr, v);
 	}
@@ -376,8 +387,8 @@ inline uint16_t _avr_sp_get(avr_t * avr)
 
 inline void _avr_sp_set(avr_t * avr, uint16_t sp)
 {
-	_avr_set_ram(avr, R_SPL + avr->io_offset, sp);
 	_avr_set_ram(avr, R_SPH + avr->io_offset, sp >> 8);
+	_avr_set_ram(avr, R_SPL + avr->io_offset, sp);
 }
 
 /*
@@ -399,6 +410,8 @@ static inline uint8_t _avr_get_ram(avr_t * avr, uint16_t addr)
 
 		avr->data[addr] = avr->io[io].r.c(avr, addr, avr->io[io].r.param);
 	}
+	if (avr->stats && addr >= avr->io_offset && addr <= avr->ioend)
+		avr->stats->io_reads[io]++;
 	return avr_core_watch_read(avr, addr);
 }
 
@@ -511,8 +524,13 @@ static void _avr_invalid_opcode(avr_t * avr)
                 _avr_flash_read16le(avr, avr->pc),
                 simavr_font.normal);
 #else
-	AVR_LOG(avr, LOG_ERROR, "%sCORE: *** %04x: Invalid Opcode SP=%04x O=%04x%s\n",
-			simavr_font.red, avr->pc, _avr_sp_get(avr), _avr_flash_read16le(avr, avr->pc), simavr_font.normal);
+	char where[128];
+
+	AVR_LOG(avr, LOG_ERROR, "%sCORE: *** %04x: %-25s Invalid Opcode SP=%04x O=%04x%s\n",
+			simavr_font.red, avr->pc, avr->symbols ?
+				avr_symbols_format(avr, avr->pc, where, sizeof(where)) : "",
+			_avr_sp_get(avr), _avr_flash_read16le(avr, avr->pc),
+			simavr_font.normal);
 #endif
 }
 
@@ -522,7 +540,7 @@ static void _avr_invalid_opcode(avr_t * avr)
  */
 void avr_dump_state(avr_t * avr)
 {
-	if (!avr->trace || donttrace)
+	if (!avr->trace || avr->trace_data->donttrace)
 		return;
 
 	int doit = 0;
@@ -1146,8 +1164,13 @@ avr_flashaddr_t avr_run_one(avr_t * avr)
 					if (e)
 						z |= avr->data[avr->eind] << 16;
 					STATE("%si%s Z[%04x]\n", e?"e":"", p?"call":"jmp", z << 1);
-					if (p)
+					if (p) {
 						cycle += _avr_push_addr(avr, new_pc) - 1;
+						if (avr->stack)
+							avr_stack_call(avr, avr->pc, z << 1, 0);
+						if (avr->timeline)
+							avr_timeline_call(avr, z << 1, 0);
+					}
 					new_pc = z << 1;
 					cycle++;
 					TRACE_JUMP();
@@ -1159,6 +1182,10 @@ avr_flashaddr_t avr_run_one(avr_t * avr)
 				case 0x9508: {	// RET -- Return -- 1001 0101 0000 1000
 					new_pc = _avr_pop_addr(avr);
 					cycle += 1 + avr->address_size;
+					if (avr->stack)
+						avr_stack_return(avr);
+					if (avr->timeline)
+						avr_timeline_return(avr);
 					STATE("ret%s\n", opcode & 0x10 ? "i" : "");
 SREG();
 					TRACE_JUMP();
@@ -1449,6 +1476,10 @@ SREG();
 							new_pc += 2;
 							cycle += 1 + _avr_push_addr(avr, new_pc);
 							new_pc = a << 1;
+							if (avr->stack)
+								avr_stack_call(avr, avr->pc, new_pc, 0);
+							if (avr->timeline)
+								avr_timeline_call(avr, new_pc, 0);
 							TRACE_JUMP();
 							STACK_FRAME_PUSH();
 						}	break;
@@ -1571,6 +1602,10 @@ SREG();
 			if (o != 0) {
 				TRACE_JUMP();
 				STACK_FRAME_PUSH();
+				if (avr->stack)
+					avr_stack_call(avr, avr->pc, new_pc, 0);
+				if (avr->timeline)
+					avr_timeline_call(avr, new_pc, 0);
 			}
 		}	break;
 
@@ -1646,6 +1681,14 @@ SREG();
 		default: _avr_invalid_opcode(avr); new_pc = avr->pc;
 
 	}
+	if (avr->stats)
+		avr_stats_instruction(avr, opcode, cycle);
+	if (avr->trigger)
+		avr_trigger_check_pc(avr, new_pc);
+	// flow changes, but not going over the second word of LDS/STS
+	if (avr->fuzz && new_pc != avr->pc + 2 &&
+			!(new_pc == avr->pc + 4 && (opcode & 0xfc0f) == 0x9000))
+		avr_fuzz_edge(avr, new_pc);
 	avr->cycle += cycle;
 	if ((avr->state == cpu_Running) &&
 		(avr->run_cycle_count > cycle) &&
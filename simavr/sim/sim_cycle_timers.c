@@ -25,6 +25,7 @@
 #include "sim_avr.h"
 #include "sim_time.h"
 #include "sim_cycle_timers.h"
+#include "sim_stats.h"
 
 #define QUEUE(__q, __e) { \
 		(__e)->next = (__q); \
@@ -247,6 +248,9 @@ avr_cycle_timer_process(
 
 			pool->timer = t->next;
 			t->next = NULL;
+			if (avr->stats)
+				avr_stats_count(&avr->stats->timers,
+						(const void *)t->timer, NULL);
 			avr_cycle_count_t w = t->timer(avr, when, t->param);
 
 			// Make sure the return value is either zero, or greater
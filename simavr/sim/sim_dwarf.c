@@ -35,6 +35,8 @@
 #include <libdwarf/libdwarf.h>
 
 #include "sim_avr.h"
+#include "sim_elf.h"
+#include "sim_symbols.h"
 
 //#define VERBOSE
 #define CHECK(fn) \
@@ -46,6 +48,7 @@
 struct ctx {
     avr_t              *avr;
     Dwarf_Debug         db;             // libdwarf instance handle.
+    int                 index;          // Fill the sim_symbols.h index.
 
     // Source lines.
 
@@ -138,7 +141,14 @@ static void process(struct ctx *ctxp, Dwarf_Die die)
 #ifdef VERBOSE
                 printf("%s = %llx\n", name, symv);
 #endif
-                if (symv > DATA_OFFSET) {
+                if (ctxp->index) {
+                    if (symv > DATA_OFFSET)
+                        avr_symbols_add(avr, AVR_SYMBOLS_DATA,
+                                        symv - DATA_OFFSET, 0, name, 0);
+                    else
+                        avr_symbols_add(avr, AVR_SYMBOLS_CODE, symv, 0,
+                                        name, 0);
+                } else if (symv > DATA_OFFSET) {
                     symv -= DATA_OFFSET;
 
                     /* Is it an I/O register or RAM? */
@@ -163,7 +173,6 @@ static void process(struct ctx *ctxp, Dwarf_Die die)
             }
         }
         dwarf_dealloc_loc_head_c(head);
-#if CONFIG_SIMAVR_TRACE
     } else if (tag == DW_TAG_subprogram) {
         rv = dwarf_lowpc(die, &addr, &err);
         if (rv == DW_DLV_NO_ENTRY) {
@@ -174,6 +183,23 @@ static void process(struct ctx *ctxp, Dwarf_Die die)
             goto clean;
         }
         CHECK("dwarf_lowpc");
+        if (ctxp->index) {
+            enum Dwarf_Form_Class class;
+            Dwarf_Half            form;
+
+            rv = dwarf_highpc_b(die, &addr2, &form, &class, &err);
+            CHECK("dwarf_highpc_b");
+            if (rv == DW_DLV_NO_ENTRY)
+                addr2 = 0;
+            else if (class == DW_FORM_CLASS_CONSTANT)  // Offset from low.
+                addr2 += addr;
+            else if (class != DW_FORM_CLASS_ADDRESS)
+                addr2 = 0;
+            avr_symbols_add(ctxp->avr, AVR_SYMBOLS_CODE, addr,
+                            addr2 > addr ? addr2 - addr : 0, name, 0);
+            goto clean;
+        }
+#if CONFIG_SIMAVR_TRACE
         set_flash_name(ctxp->avr, addr, name);
 
 #ifdef VERBOSE
@@ -263,7 +289,49 @@ static void get_lines(struct ctx *ctxp, Dwarf_Die die)
 }
 #endif
 
-int avr_read_dwarf(avr_t *avr, const char *filename)
+/* Add a Compilation Unit's line table to the index. */
+
+static void index_lines(struct ctx *ctxp, Dwarf_Die die)
+{
+    Dwarf_Line_Context  lc;
+    Dwarf_Line         *lines;
+    Dwarf_Signed        count;
+    Dwarf_Unsigned      version;
+    Dwarf_Error         err;
+    Dwarf_Small         single;
+    int                 rv;
+
+    rv = dwarf_srclines_b(die, &version, &single, &lc, &err);
+    if (rv == DW_DLV_NO_ENTRY)
+        return;
+    CHECK("dwarf_srclines_b");
+    rv = dwarf_srclines_from_linecontext(lc, &lines, &count, &err);
+    CHECK("dwarf_srclines_from_linecontext");
+    for (int i = 0; i < count; ++i) {
+        Dwarf_Unsigned    lineno;
+        Dwarf_Addr        addr;
+        Dwarf_Bool        end;
+        char             *file;
+
+        rv = dwarf_lineendsequence(lines[i], &end, &err);
+        CHECK("dwarf_lineendsequence");
+        rv = dwarf_lineaddr(lines[i], &addr, &err);
+        CHECK("dwarf_lineaddr");
+        if (end || addr == 0) // Inlined?
+            continue;
+        rv = dwarf_lineno(lines[i], &lineno, &err);
+        CHECK("dwarf_lineno");
+        rv = dwarf_linesrc(lines[i], &file, &err);
+        CHECK("dwarf_linesrc");
+        if (rv == DW_DLV_NO_ENTRY)
+            continue;
+        avr_symbols_add(ctxp->avr, AVR_SYMBOLS_LINE, addr, 0, file, lineno);
+        dwarf_dealloc(ctxp->db, file, DW_DLA_STRING);
+    }
+    dwarf_srclines_dealloc_b(lc);
+}
+
+static int read_dwarf(avr_t *avr, const char *filename, int index)
 {
     struct ctx      ctx, *ctxp;
     Dwarf_Die       die;
@@ -279,6 +347,7 @@ int avr_read_dwarf(avr_t *avr, const char *filename)
     }
 
     ctx.avr = avr;
+    ctx.index = index;
     rv = dwarf_init_b(fd, DW_GROUPNUMBER_ANY, NULL, NULL, &ctx.db, &err);
     if (rv != DW_DLV_OK) {
         if (rv == DW_DLV_NO_ENTRY)
@@ -312,6 +381,11 @@ int avr_read_dwarf(avr_t *avr, const char *filename)
             continue;
         CHECK("dwarf_siblingof_b");
 
+        if (index) {
+            traverse_tree(&ctx, die);
+            index_lines(&ctx, die);
+            continue;
+        }
 #if CONFIG_SIMAVR_TRACE
         Dwarf_Addr  prev_addr = -1;
         const char *last_symbol = NULL;
@@ -363,7 +437,18 @@ int avr_read_dwarf(avr_t *avr, const char *filename)
     return 0;
 }
 
+int avr_read_dwarf(avr_t *avr, const char *filename)
+{
+    return read_dwarf(avr, filename, 0);
+}
+
+int avr_read_dwarf_symbols(avr_t *avr, const char *filename)
+{
+    return read_dwarf(avr, filename, 1);
+}
+
 # else // No libdwarf
 #include "sim_avr.h"
 int avr_read_dwarf(avr_t *avr, const char *filename) { return 0; }
+int avr_read_dwarf_symbols(avr_t *avr, const char *filename) { return 0; }
 #endif
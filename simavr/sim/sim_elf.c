@@ -41,6 +41,8 @@
 
 #include "sim_elf.h"
 #include "sim_vcd_file.h"
+#include "sim_fw_cache.h"
+#include "sim_symbols.h"
 #include "avr_eeprom.h"
 #include "avr_ioport.h"
 
@@ -125,6 +127,52 @@ static void do_chunk(fw_chunk_t *chunk, uint8_t *buf,
 		*end = chunk->addr + size;
 }
 
+#if ELF_SYMBOLS
+/*
+ * Parse the DWARF information, or take the names from the firmware cache
+ * if it has them. Names found by parsing are then added to the cache entry.
+ */
+static void
+elf_load_dwarf(
+		avr_t * avr,
+		elf_firmware_t * firmware)
+{
+	struct avr_trace_data_t * td = avr->trace_data;
+	const char ** code = NULL, ** data = NULL;
+
+	if (firmware->dwarf) {
+		avr_fw_cache_set_names(avr, firmware);
+	} else if (firmware->dwarf_file) {
+		// what was there before, for the cache to know what is new
+		if (firmware->cache) {
+			if (td->codeline) {
+				code = malloc(td->codeline_size * sizeof(*code) + 1);
+				if (code)
+					memcpy(code, td->codeline,
+							td->codeline_size * sizeof(*code));
+			}
+			data = malloc(td->data_names_size * sizeof(*data) + 1);
+			if (data && td->data_names_size)
+				memcpy(data, avr->data_names,
+						td->data_names_size * sizeof(*data));
+		}
+		avr_read_dwarf(avr, firmware->dwarf_file);
+		if (firmware->cache && (code || !td->codeline) && data)
+			avr_fw_cache_add_names(avr, firmware, code, data);
+	}
+	// the index reads it again, for its own tables, if it is asked
+	if (firmware->dwarf_file)
+		avr_symbols_set_dwarf(avr, firmware->dwarf_file);
+	free(code);
+	free(data);
+	free(firmware->dwarf);
+	free(firmware->dwarf_file);
+	free(firmware->cache);
+	firmware->dwarf = NULL;
+	firmware->dwarf_file = firmware->cache = NULL;
+}
+#endif
+
 void
 avr_load_firmware(
 		avr_t * avr,
@@ -141,6 +189,20 @@ avr_load_firmware(
 	if (firmware->aref)
 		avr->aref = firmware->aref;
 #if ELF_SYMBOLS
+	/* Index the symbols, for any build, see sim_symbols.h. */
+
+	for (int i = 0; i < firmware->symbolcount; i++) {
+		avr_symbol_t * s = firmware->symbol[i];
+
+		if (s->addr <= avr->flashend)
+			avr_symbols_add(avr, AVR_SYMBOLS_CODE, s->addr, s->size,
+							s->symbol, 0);
+		else if (s->addr >= AVR_SEGMENT_OFFSET_DATA &&
+				 s->addr < AVR_SEGMENT_OFFSET_EEPROM)
+			avr_symbols_add(avr, AVR_SYMBOLS_DATA,
+							s->addr - AVR_SEGMENT_OFFSET_DATA, s->size,
+							s->symbol, 0);
+	}
 #if CONFIG_SIMAVR_TRACE
 	/* Store the symbols read from the ELF file. */
 
@@ -191,9 +253,7 @@ avr_load_firmware(
 
 	// Parse given ELF file for DWARF info.
 
-	if (firmware->dwarf_file)
-		avr_read_dwarf(avr, firmware->dwarf_file);
-	free(firmware->dwarf_file);
+	elf_load_dwarf(avr, firmware);
 
 	// Fill out the flash and data space name tables with duplicates.
 
@@ -203,9 +263,7 @@ avr_load_firmware(
 #else
 	// Parse given ELF file for DWARF info.
 
-	if (firmware->dwarf_file)
-		avr_read_dwarf(avr, firmware->dwarf_file);
-	free(firmware->dwarf_file);
+	elf_load_dwarf(avr, firmware);
 #endif
 #endif // ELF_SYMBOLS
 
@@ -91,6 +91,10 @@ typedef struct elf_firmware_t {
 	uint32_t	symbolcount;
 	uint32_t	highest_data_symbol;
 	char *		dwarf_file;	// Must be dynamically allocated.
+	avr_symbol_t **  dwarf;		// DWARF names, from the firmware cache
+	uint32_t	dwarfcount;
+	char *		cache;		// Cache entry to add DWARF names to.
+	const void *	map;		// Cache entry holding the symbols, if any.
 #endif
 } elf_firmware_t ;
 
@@ -112,6 +116,10 @@ avr_load_firmware(
 
 int avr_read_dwarf(avr_t *avr, const char *filename);
 
+// The same, for the address index of sim_symbols.h, in any build.
+
+int avr_read_dwarf_symbols(avr_t *avr, const char *filename);
+
 #ifdef __cplusplus
 };
 #endif
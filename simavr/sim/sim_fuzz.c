@@ -0,0 +1,672 @@
+/*
+	sim_fuzz.c
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "sim_avr.h"
+#include "sim_core.h"
+#include "sim_checkpoint.h"
+#include "sim_fuzz.h"
+#include "avr_uart.h"
+#include "avr_twi.h"
+#include "avr_ioport.h"
+
+static void
+_avr_fuzz_sleep(
+		avr_t * avr,
+		avr_cycle_count_t how_long)
+{
+}
+
+static void
+_avr_fuzz_bad_opcode(
+		struct avr_irq_t * irq,
+		uint32_t value,
+		void * param)
+{
+	avr_fuzz_t * f = param;
+
+	f->bad_opcode = 1;
+}
+
+static void
+_avr_fuzz_xoff(
+		struct avr_irq_t * irq,
+		uint32_t value,
+		void * param)
+{
+	avr_fuzz_t * f = param;
+
+	f->stop = value != 0;
+}
+
+static void
+_avr_fuzz_xon(
+		struct avr_irq_t * irq,
+		uint32_t value,
+		void * param)
+{
+	avr_fuzz_t * f = param;
+
+	if (value)
+		f->stop = 0;
+}
+
+// The firmware answered the last START or byte.
+static void
+_avr_fuzz_twi_out(
+		struct avr_irq_t * irq,
+		uint32_t value,
+		void * param)
+{
+	avr_fuzz_t * f = param;
+	avr_twi_msg_irq_t v = { .u.v = value };
+
+	if (f->twi != 1 || !(v.u.twi.msg & TWI_COND_ADDR) ||
+			(v.u.twi.msg & TWI_COND_READ))
+		return;
+	if (!(v.u.twi.msg & TWI_COND_ACK))
+		f->pos = f->size;	// not taking any more
+	f->stop = 0;
+}
+
+static avr_cycle_count_t
+_avr_fuzz_gpio_timer(
+		avr_t * avr,
+		avr_cycle_count_t when,
+		void * param)
+{
+	avr_fuzz_t * f = param;
+
+	if (f->pos >= f->size)
+		return 0;
+	avr_raise_irq(f->in, f->data[f->pos++]);
+	f->last = avr->cycle;
+	return when + f->interval;
+}
+
+// All the input is in.
+static int
+_avr_fuzz_fed(
+		avr_fuzz_t * f)
+{
+	if (f->input == AVR_FUZZ_TWI)
+		return f->twi == 2 || (f->twi == 0 && !f->size);
+	return f->pos >= f->size;
+}
+
+// Give the firmware what it can take now.
+static void
+_avr_fuzz_feed(
+		avr_fuzz_t * f)
+{
+	avr_t * avr = f->avr;
+
+	switch (f->input) {
+		case AVR_FUZZ_UART:
+			while (!f->stop && f->pos < f->size) {
+				avr_raise_irq(f->in, f->data[f->pos++]);
+				f->last = avr->cycle;
+			}
+			break;
+		case AVR_FUZZ_TWI:
+			if (f->stop || f->twi == 2 || !f->size)
+				break;
+			f->stop = 1;
+			f->last = avr->cycle;
+			if (f->twi == 0) {
+				f->twi = 1;
+				avr_raise_irq(f->in, avr_twi_irq_msg(
+						TWI_COND_START | TWI_COND_ADDR | TWI_COND_WRITE,
+						f->twi_addr, 1));
+			} else if (f->pos < f->size) {
+				avr_raise_irq(f->in, avr_twi_irq_msg(TWI_COND_WRITE,
+						f->twi_addr, f->data[f->pos++]));
+			} else {
+				f->twi = 2;
+				f->stop = 0;
+				avr_raise_irq(f->in, avr_twi_irq_msg(TWI_COND_STOP,
+						f->twi_addr, 0));
+			}
+			break;
+	}
+}
+
+int
+avr_fuzz_parse_input(
+		avr_fuzz_t * f,
+		const char * spec)
+{
+	unsigned long addr;
+	char * end;
+
+	if (!strncmp(spec, "uart", 4) && spec[4] && !spec[5]) {
+		f->input = AVR_FUZZ_UART;
+		f->name = spec[4];
+	} else if (!strncmp(spec, "gpio", 4) && spec[4] && !spec[5]) {
+		f->input = AVR_FUZZ_GPIO;
+		f->name = spec[4];
+	} else if (!strncmp(spec, "twi", 3) && spec[3] && spec[4] == '@') {
+		f->input = AVR_FUZZ_TWI;
+		f->name = spec[3];
+		addr = strtoul(spec + 5, &end, 0);
+		if (end == spec + 5 || *end || addr > 0x7f)
+			return -1;
+		f->twi_addr = addr;
+	} else
+		return -1;
+	return 0;
+}
+
+int
+avr_fuzz_init(
+		avr_fuzz_t * f,
+		avr_t * avr)
+{
+	avr_cycle_count_t limit;
+
+	if (!f->budget)
+		f->budget = AVR_FUZZ_BUDGET;
+	if (!f->interval)
+		f->interval = AVR_FUZZ_INTERVAL;
+	if (!f->settle)
+		f->settle = AVR_FUZZ_SETTLE;
+	if (!f->map)
+		f->map = f->own_map;
+	f->avr = avr;
+	switch (f->input) {
+		case AVR_FUZZ_UART:
+			f->in = avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ(f->name),
+					UART_IRQ_INPUT);
+			if (f->in) {
+				avr_irq_register_notify(avr_io_getirq(avr,
+						AVR_IOCTL_UART_GETIRQ(f->name), UART_IRQ_OUT_XOFF),
+						_avr_fuzz_xoff, f);
+				avr_irq_register_notify(avr_io_getirq(avr,
+						AVR_IOCTL_UART_GETIRQ(f->name), UART_IRQ_OUT_XON),
+						_avr_fuzz_xon, f);
+			}
+			break;
+		case AVR_FUZZ_TWI:
+			f->in = avr_io_getirq(avr, AVR_IOCTL_TWI_GETIRQ(f->name),
+					TWI_IRQ_INPUT);
+			if (f->in)
+				avr_irq_register_notify(avr_io_getirq(avr,
+						AVR_IOCTL_TWI_GETIRQ(f->name), TWI_IRQ_OUTPUT),
+						_avr_fuzz_twi_out, f);
+			break;
+		case AVR_FUZZ_GPIO:
+			f->in = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(f->name),
+					IOPORT_IRQ_PIN_ALL_IN);
+			break;
+	}
+	if (!f->in) {
+		AVR_LOG(avr, LOG_ERROR, "FUZZ: no input '%c' to fuzz\n", f->name);
+		return -1;
+	}
+	avr_irq_register_notify(avr->irq + CORE_IRQ_BAD_OPCODE,
+			_avr_fuzz_bad_opcode, f);
+
+	// full speed: no real-time sleeping, no console echo of the UARTs
+	avr->sleep = _avr_fuzz_sleep;
+	for (char u = '0'; u <= '9'; u++) {
+		uint32_t flags = 0;
+
+		if (avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS(u), &flags) < 0)
+			continue;
+		flags &= ~(AVR_UART_FLAG_POLL_SLEEP | AVR_UART_FLAG_STDIO);
+		avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS(u), &flags);
+	}
+	limit = avr->cycle + f->budget * 100;
+	while (f->ready && avr->pc != f->ready) {
+		int state = avr_run(avr);
+
+		if (state == cpu_Done || state == cpu_Crashed ||
+				avr->cycle >= limit) {
+			AVR_LOG(avr, LOG_ERROR, "FUZZ: ready PC 0x%04x not reached\n",
+					f->ready);
+			return -1;
+		}
+	}
+	f->checkpoint = avr_checkpoint_take(avr);
+	if (!f->checkpoint)
+		return -1;
+	f->ready_stop = f->stop;
+	avr->fuzz = f;
+	return 0;
+}
+
+int
+avr_fuzz_run(
+		avr_fuzz_t * f,
+		const uint8_t * data,
+		size_t size)
+{
+	avr_t * avr = f->avr;
+	avr_cycle_count_t limit = avr->cycle + f->budget;
+	int res = AVR_FUZZ_BUDGET_HIT;
+
+	if (!f->checkpoint)
+		return AVR_FUZZ_ERROR;
+	memset(f->map, 0, AVR_FUZZ_MAP);
+	f->prev = 0;
+	f->data = data;
+	f->size = size;
+	f->pos = 0;
+	f->twi = 0;
+	f->bad_opcode = 0;
+	f->last = avr->cycle;
+	if (f->input == AVR_FUZZ_GPIO && size)
+		avr_cycle_timer_register(avr, 1, _avr_fuzz_gpio_timer, f);
+
+	while (avr->cycle < limit) {
+		int state;
+
+		_avr_fuzz_feed(f);
+		state = avr_run(avr);
+		if (state == cpu_Crashed) {
+			res = AVR_FUZZ_CRASHED;
+			break;
+		}
+		if (f->bad_opcode) {
+			res = AVR_FUZZ_BAD_OPCODE;
+			break;
+		}
+		if (_avr_sp_get(avr) > avr->ramend) {
+			res = AVR_FUZZ_STACK;
+			break;
+		}
+		if (state == cpu_Done) {
+			res = AVR_FUZZ_IDLE;
+			break;
+		}
+		if (_avr_fuzz_fed(f) && avr->cycle - f->last >= f->settle &&
+				(state == cpu_Sleeping || avr->pc == f->ready)) {
+			res = AVR_FUZZ_IDLE;
+			break;
+		}
+	}
+	avr_checkpoint_restore(f->checkpoint);
+	f->stop = f->ready_stop;
+	f->data = NULL;
+	return res;
+}
+
+void
+avr_fuzz_free(
+		avr_fuzz_t * f)
+{
+	avr_t * avr = f->avr;
+
+	if (!avr)
+		return;
+	avr_irq_unregister_notify(avr->irq + CORE_IRQ_BAD_OPCODE,
+			_avr_fuzz_bad_opcode, f);
+	if (f->input == AVR_FUZZ_UART && f->in) {
+		avr_irq_unregister_notify(avr_io_getirq(avr,
+				AVR_IOCTL_UART_GETIRQ(f->name), UART_IRQ_OUT_XOFF),
+				_avr_fuzz_xoff, f);
+		avr_irq_unregister_notify(avr_io_getirq(avr,
+				AVR_IOCTL_UART_GETIRQ(f->name), UART_IRQ_OUT_XON),
+				_avr_fuzz_xon, f);
+	} else if (f->input == AVR_FUZZ_TWI && f->in)
+		avr_irq_unregister_notify(avr_io_getirq(avr,
+				AVR_IOCTL_TWI_GETIRQ(f->name), TWI_IRQ_OUTPUT),
+				_avr_fuzz_twi_out, f);
+	if (f->checkpoint)
+		avr_checkpoint_free(f->checkpoint);
+	f->checkpoint = NULL;
+	if (avr->fuzz == f)
+		avr->fuzz = NULL;
+	f->avr = NULL;
+}
+
+const char *
+avr_fuzz_result_name(
+		int result)
+{
+	static const char * names[] = {
+		[AVR_FUZZ_IDLE] = "idle",
+		[AVR_FUZZ_BUDGET_HIT] = "budget",
+		[AVR_FUZZ_CRASHED] = "crash",
+		[AVR_FUZZ_BAD_OPCODE] = "bad-opcode",
+		[AVR_FUZZ_STACK] = "stack",
+		[AVR_FUZZ_ERROR] = "error",
+	};
+
+	if (result < 0 || result > AVR_FUZZ_ERROR)
+		return "?";
+	return names[result];
+}
+
+/*
+ * The standalone fuzzer. An input is kept when it makes an edge run a
+ * number of times, counted in AFL's buckets, that no input did before.
+ */
+
+typedef struct avr_fuzz_input_t {
+	uint8_t *	data;
+	size_t		size;
+} avr_fuzz_input_t;
+
+typedef struct avr_fuzz_state_t {
+	avr_fuzz_t *		f;
+	uint8_t				virgin[AVR_FUZZ_MAP];	// buckets seen per edge
+	avr_fuzz_input_t *	corpus;
+	int					count, size;
+	uint64_t			rng;
+} avr_fuzz_state_t;
+
+static uint32_t
+_avr_fuzz_rand(
+		avr_fuzz_state_t * s)
+{
+	s->rng ^= s->rng << 13;
+	s->rng ^= s->rng >> 7;
+	s->rng ^= s->rng << 17;
+	return s->rng >> 32;
+}
+
+static uint8_t
+_avr_fuzz_bucket(
+		uint8_t count)
+{
+	if (count <= 3)
+		return count == 3 ? 4 : count;
+	if (count < 8)
+		return 8;
+	if (count < 16)
+		return 16;
+	if (count < 32)
+		return 32;
+	return count < 128 ? 64 : 128;
+}
+
+// Add the buckets hit by the last run, returns how many were new.
+static int
+_avr_fuzz_new_coverage(
+		avr_fuzz_state_t * s)
+{
+	const uint8_t * map = s->f->map;
+	int found = 0;
+
+	// the map is mostly zeroes, skip them eight at a time
+	for (int w = 0; w < AVR_FUZZ_MAP; w += 8) {
+		uint64_t word;
+
+		memcpy(&word, map + w, sizeof(word));
+		if (!word)
+			continue;
+		for (int i = w; i < w + 8; i++) {
+			uint8_t b;
+
+			if (!map[i])
+				continue;
+			b = _avr_fuzz_bucket(map[i]);
+			if (b & ~s->virgin[i]) {
+				s->virgin[i] |= b;
+				found++;
+			}
+		}
+	}
+	return found;
+}
+
+static int
+_avr_fuzz_edges(
+		avr_fuzz_state_t * s)
+{
+	int edges = 0;
+
+	for (int i = 0; i < AVR_FUZZ_MAP; i++)
+		edges += s->virgin[i] != 0;
+	return edges;
+}
+
+static int
+_avr_fuzz_keep(
+		avr_fuzz_state_t * s,
+		const uint8_t * data,
+		size_t size)
+{
+	avr_fuzz_input_t * in;
+
+	if (s->count == s->size) {
+		int n = s->size ? s->size * 2 : 64;
+
+		in = realloc(s->corpus, n * sizeof(*in));
+		if (!in)
+			return -1;
+		s->corpus = in;
+		s->size = n;
+	}
+	in = &s->corpus[s->count];
+	in->data = malloc(size ? size : 1);
+	if (!in->data)
+		return -1;
+	memcpy(in->data, data, size);
+	in->size = size;
+	s->count++;
+	return 0;
+}
+
+// Write 'data' to a file named after its hash, so it is only there once.
+static void
+_avr_fuzz_save(
+		avr_fuzz_t * f,
+		const char * dir,
+		const char * prefix,
+		const uint8_t * data,
+		size_t size)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	char path[1024];
+	FILE * o;
+
+	if (!dir)
+		return;
+	for (size_t i = 0; i < size; i++)
+		h = (h ^ data[i]) * 0x100000001b3ULL;
+	snprintf(path, sizeof(path), "%s/%s%016llx", dir, prefix,
+			(unsigned long long)h);
+	o = fopen(path, "wb");
+	if (!o) {
+		AVR_LOG(f->avr, LOG_ERROR, "FUZZ: can't write %s\n", path);
+		return;
+	}
+	fwrite(data, 1, size, o);
+	fclose(o);
+}
+
+static void
+_avr_fuzz_load(
+		avr_fuzz_state_t * s,
+		const char * dir)
+{
+	DIR * d = dir ? opendir(dir) : NULL;
+	struct dirent * e;
+
+	if (!d)
+		return;
+	while ((e = readdir(d))) {
+		char path[1024];
+		uint8_t buf[AVR_FUZZ_MAX_LEN];
+		struct stat st;
+		size_t size;
+		FILE * in;
+		int res;
+
+		snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+		if (stat(path, &st) || !S_ISREG(st.st_mode))
+			continue;
+		in = fopen(path, "rb");
+		if (!in)
+			continue;
+		size = fread(buf, 1, sizeof(buf), in);
+		fclose(in);
+		res = avr_fuzz_run(s->f, buf, size);
+		if (res != AVR_FUZZ_IDLE && res != AVR_FUZZ_BUDGET_HIT)
+			continue;	// mutating it would find the same
+		if (_avr_fuzz_new_coverage(s))
+			_avr_fuzz_keep(s, buf, size);
+	}
+	closedir(d);
+}
+
+static size_t
+_avr_fuzz_mutate(
+		avr_fuzz_state_t * s,
+		uint8_t * buf,
+		size_t size)
+{
+	static const uint8_t interesting[] = {
+		0, 1, 0x7f, 0x80, 0xff, '\r', '\n', ' ', '0', '9', 'A', 'z',
+	};
+	int n = 1 + (_avr_fuzz_rand(s) & 3);
+
+	while (n--) {
+		uint32_t r = _avr_fuzz_rand(s);
+		size_t at = size ? r % size : 0;
+
+		r >>= 16;
+		switch (r % 8) {
+			case 0:		// flip a bit
+				if (size)
+					buf[at] ^= 1 << (r / 8 % 8);
+				break;
+			case 1:		// random byte
+				if (size)
+					buf[at] = _avr_fuzz_rand(s);
+				break;
+			case 2:		// a bit more or less
+				if (size)
+					buf[at] += (r & 0x100) ? 1 + r / 8 % 16 : -(1 + r / 8 % 16);
+				break;
+			case 3:		// interesting byte
+				if (size)
+					buf[at] = interesting[r / 8 % sizeof(interesting)];
+				break;
+			case 4:		// insert
+				if (size < AVR_FUZZ_MAX_LEN) {
+					memmove(buf + at + 1, buf + at, size - at);
+					buf[at] = _avr_fuzz_rand(s);
+					size++;
+				}
+				break;
+			case 5:		// delete
+				if (size) {
+					memmove(buf + at, buf + at + 1, size - at - 1);
+					size--;
+				}
+				break;
+			case 6: {	// repeat a piece
+				size_t len = 1 + r / 8 % 8;
+
+				if (at + len > size || size + len > AVR_FUZZ_MAX_LEN)
+					break;
+				memmove(buf + at + len, buf + at, size - at);
+				size += len;
+			}	break;
+			case 7: {	// splice in the end of another input
+				avr_fuzz_input_t * o = &s->corpus[_avr_fuzz_rand(s) % s->count];
+				size_t from = o->size ? _avr_fuzz_rand(s) % o->size : 0;
+				size_t len = o->size - from;
+
+				if (at + len > AVR_FUZZ_MAX_LEN)
+					len = AVR_FUZZ_MAX_LEN - at;
+				memcpy(buf + at, o->data + from, len);
+				if (at + len > size)
+					size = at + len;
+			}	break;
+		}
+	}
+	return size;
+}
+
+int
+avr_fuzz_loop(
+		avr_fuzz_t * f,
+		const char * corpus,
+		const char * crashes,
+		uint32_t runs,
+		uint32_t seed,
+		FILE * log)
+{
+	avr_fuzz_state_t * s = calloc(1, sizeof(*s));
+	uint8_t buf[AVR_FUZZ_MAX_LEN];
+	uint32_t budget_hits = 0;
+	int failures = 0;
+
+	if (!s)
+		return -1;
+	s->f = f;
+	s->rng = seed ? seed : 0x2545f4914f6cdd1dULL;
+	_avr_fuzz_load(s, corpus);
+	if (!s->count) {
+		avr_fuzz_run(f, buf, 0);
+		_avr_fuzz_new_coverage(s);
+		_avr_fuzz_keep(s, buf, 0);
+	}
+	if (log)
+		fprintf(log, "FUZZ: %d inputs, %d edges\n", s->count,
+				_avr_fuzz_edges(s));
+	for (uint32_t i = 1; (!runs || i <= runs) && s->count; i++) {
+		avr_fuzz_input_t * in = &s->corpus[_avr_fuzz_rand(s) % s->count];
+		size_t size;
+		int res;
+
+		memcpy(buf, in->data, in->size);
+		size = _avr_fuzz_mutate(s, buf, in->size);
+		res = avr_fuzz_run(f, buf, size);
+		if (res == AVR_FUZZ_BUDGET_HIT)
+			budget_hits++;
+		if (res != AVR_FUZZ_IDLE && res != AVR_FUZZ_BUDGET_HIT) {
+			char prefix[32];
+
+			if (!_avr_fuzz_new_coverage(s))
+				continue;	// seen that one already
+			failures++;
+			snprintf(prefix, sizeof(prefix), "%s-",
+					avr_fuzz_result_name(res));
+			_avr_fuzz_save(f, crashes, prefix, buf, size);
+			if (log)
+				fprintf(log, "FUZZ: #%u %s with %u bytes\n", i,
+						avr_fuzz_result_name(res), (unsigned)size);
+			continue;
+		}
+		if (_avr_fuzz_new_coverage(s)) {
+			_avr_fuzz_keep(s, buf, size);
+			_avr_fuzz_save(f, corpus, "", buf, size);
+		} else if (i & (i - 1))
+			continue;
+		if (log)
+			fprintf(log, "FUZZ: #%u %d inputs, %d edges, %d failures, "
+					"%u over budget\n", i, s->count, _avr_fuzz_edges(s),
+					failures, budget_hits);
+	}
+	for (int i = 0; i < s->count; i++)
+		free(s->corpus[i].data);
+	free(s->corpus);
+	free(s);
+	return failures;
+}
@@ -0,0 +1,170 @@
+/*
+	sim_fuzz.h
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Fuzzing the input handlers of a firmware.
+ *
+ * The firmware is run once up to a "ready" PC and checkpointed there
+ * (sim_checkpoint.h). Each input is then fed to a UART, as a TWI master
+ * writing to the firmware, or as successive values of an IO port, and
+ * the firmware runs until it crashes, executes a bad opcode, returns past
+ * the top of its stack, uses up its cycle budget, or goes idle: asleep
+ * or ended once the whole input is in. The checkpoint is then restored
+ * for the next input. Ending up back at the ready PC with the input all
+ * in and handled counts as idle too, for firmware that polls rather than
+ * sleeps.
+ *
+ * The AVR is run at full speed: its sleep callback is replaced, and UARTs
+ * neither sleep when polled for input nor echo to the console.
+ *
+ * While running an input, every change of flow (jumps, calls, returns,
+ * taken branches and skips) counts the edge from the previous one in a
+ * bitmap, as AFL does, for the fuzzer to find inputs that reach new code.
+ *
+ * avr_fuzz_loop() is a small fuzzer of its own, for run_avr --fuzz;
+ * fuzz_avr.c has the entry points for libFuzzer.
+ */
+
+#ifndef __SIM_FUZZ_H__
+#define __SIM_FUZZ_H__
+
+#include <stdio.h>
+#include "sim_avr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AVR_FUZZ_MAP		65536	// edge counters
+#define AVR_FUZZ_BUDGET		1000000	// default cycles per input
+#define AVR_FUZZ_SETTLE		20000	// cycles idle after the last input
+#define AVR_FUZZ_INTERVAL	1000	// default cycles between port values
+#define AVR_FUZZ_MAX_LEN	256		// of generated inputs
+
+enum {
+	AVR_FUZZ_UART = 0,	// bytes into UART_IRQ_INPUT, with flow control
+	AVR_FUZZ_TWI,		// one write to the firmware as a TWI slave
+	AVR_FUZZ_GPIO,		// successive values of the pins of a port
+};
+
+enum {
+	AVR_FUZZ_IDLE = 0,	// handled the input, nothing wrong seen
+	AVR_FUZZ_BUDGET_HIT,
+	AVR_FUZZ_CRASHED,
+	AVR_FUZZ_BAD_OPCODE,
+	AVR_FUZZ_STACK,		// SP went above RAMEND
+	AVR_FUZZ_ERROR,		// could not run it
+};
+
+typedef struct avr_fuzz_t {
+	// settings, filled before avr_fuzz_init()
+	int					input;		// AVR_FUZZ_UART...
+	char				name;		// of the UART, TWI or port ('B'...)
+	uint8_t				twi_addr;	// 7 bit address of the firmware
+	avr_flashaddr_t		ready;		// PC in bytes, 0 to start at once
+	avr_cycle_count_t	budget;		// cycles per input, 0 for the default
+	avr_cycle_count_t	interval;	// between port values, 0 for the default
+	avr_cycle_count_t	settle;		// idle after the input, 0 for the default
+	uint8_t *			map;		// edge counters, NULL for our own
+
+	// private
+	avr_t *				avr;
+	uint32_t			prev;		// last location, for the edges
+	struct avr_checkpoint_t * checkpoint;
+	avr_irq_t *			in;			// where the input goes
+	const uint8_t *		data;
+	size_t				size, pos;
+	int					stop;		// UART full, or waiting for the TWI
+	int					ready_stop;	// what 'stop' was at the checkpoint
+	int					twi;		// 0 idle, 1 started, 2 stopped
+	int					bad_opcode;
+	avr_cycle_count_t	last;		// cycle the last input went in
+	uint8_t				own_map[AVR_FUZZ_MAP];
+} avr_fuzz_t;
+
+/*
+ * Set the input from "uart0", "twi0@0x10", with the firmware's 7 bit
+ * address, or "gpioB". Returns -1 if it does not read like one.
+ */
+int
+avr_fuzz_parse_input(
+		avr_fuzz_t * f,
+		const char * spec);
+
+/*
+ * Run the firmware loaded in 'avr' up to the ready PC and checkpoint it
+ * there. Returns -1 if the input peripheral does not exist or the PC is
+ * not reached within the budget.
+ */
+int
+avr_fuzz_init(
+		avr_fuzz_t * f,
+		avr_t * avr);
+
+// Run one input and go back to the checkpoint. Returns AVR_FUZZ_*.
+int
+avr_fuzz_run(
+		avr_fuzz_t * f,
+		const uint8_t * data,
+		size_t size);
+
+/*
+ * Fuzz for 'runs' inputs, 0 for ever, starting from the files in
+ * 'corpus' and adding the new inputs that reach new edges there. Failing
+ * inputs are written to 'crashes'. Returns the number of failing inputs
+ * found.
+ */
+int
+avr_fuzz_loop(
+		avr_fuzz_t * f,
+		const char * corpus,
+		const char * crashes,
+		uint32_t runs,
+		uint32_t seed,
+		FILE * log);
+
+// Free the checkpoint, before avr_terminate().
+void
+avr_fuzz_free(
+		avr_fuzz_t * f);
+
+const char *
+avr_fuzz_result_name(
+		int result);
+
+// Private, called by the core with avr->fuzz set, on a change of flow.
+static inline void
+avr_fuzz_edge(
+		struct avr_t * avr,
+		avr_flashaddr_t to)
+{
+	avr_fuzz_t * f = avr->fuzz;
+	uint32_t cur = ((to >> 1) * 0x9e3779b1u) >> 16;
+
+	f->map[(cur ^ f->prev) & (AVR_FUZZ_MAP - 1)]++;
+	f->prev = cur >> 1;
+}
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* __SIM_FUZZ_H__ */
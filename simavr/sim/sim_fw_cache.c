@@ -0,0 +1,588 @@
+/*
+	sim_fw_cache.c
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE		// asprintf()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "sim_fw_cache.h"
+
+#define ALIGN4(n)	(((n) + 3) & ~3)
+
+typedef struct avr_fw_cache_header_t {
+	char			magic[8];		// "SIMAVRFC"
+	uint32_t		version;
+	uint32_t		size;			// of the entry
+	uint64_t		key;
+	uint32_t		fw_size;		// sizeof(elf_firmware_t)
+	uint32_t		flags;			// AVR_FW_CACHE_FLAGS, how it was built
+	// offsets in the entry, and counts
+	uint32_t		chunks, chunk_count;
+	uint32_t		symbols, symbol_count;
+	uint32_t		names, name_count;	// from DWARF, 0 until known
+	uint32_t		dwarf;			// the file has debug information
+	elf_firmware_t	fw;				// its pointers are not used
+} avr_fw_cache_header_t;
+
+typedef struct avr_fw_cache_chunk_t {
+	uint32_t		type, addr, size, fill_size;
+	uint8_t			data[0];
+} avr_fw_cache_chunk_t;
+
+typedef struct avr_fw_cache_buf_t {
+	uint8_t *		b;
+	uint32_t		len, size;
+} avr_fw_cache_buf_t;
+
+// The build options that change elf_firmware_t, or what is in an entry.
+#ifdef CONFIG_PULL_UPS
+#define AVR_FW_CACHE_PULL_UPS	(1 << 0)
+#else
+#define AVR_FW_CACHE_PULL_UPS	0
+#endif
+#define AVR_FW_CACHE_FLAGS	(AVR_FW_CACHE_PULL_UPS | (ELF_SYMBOLS ? 1 << 1 : 0))
+
+/*
+ * Runs of sim_batch.h read firmware from several threads: the directory
+ * is taken from the environment once, and only used with the lock held.
+ */
+static pthread_once_t cache_dir_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t cache_dir_lock = PTHREAD_MUTEX_INITIALIZER;
+static char * cache_dir;
+
+static void
+_avr_fw_cache_dir_init(void)
+{
+	const char * dir = getenv("SIMAVR_FW_CACHE");
+
+	cache_dir = dir && dir[0] ? strdup(dir) : NULL;
+}
+
+void
+avr_fw_cache_set_dir(
+		const char * dir)
+{
+	pthread_once(&cache_dir_once, _avr_fw_cache_dir_init);
+	pthread_mutex_lock(&cache_dir_lock);
+	free(cache_dir);
+	cache_dir = dir && dir[0] ? strdup(dir) : NULL;
+	pthread_mutex_unlock(&cache_dir_lock);
+}
+
+// The path of the entry for 'key', or NULL when there is no cache.
+static char *
+_avr_fw_cache_path(
+		uint64_t key)
+{
+	char * path = NULL;
+
+	pthread_once(&cache_dir_once, _avr_fw_cache_dir_init);
+	pthread_mutex_lock(&cache_dir_lock);
+	if (cache_dir &&
+			asprintf(&path, "%s/%016" PRIx64 ".fwc", cache_dir, key) < 0)
+		path = NULL;
+	pthread_mutex_unlock(&cache_dir_lock);
+	return path;
+}
+
+static int
+_avr_fw_cache_on(void)
+{
+	int on;
+
+	pthread_once(&cache_dir_once, _avr_fw_cache_dir_init);
+	pthread_mutex_lock(&cache_dir_lock);
+	on = cache_dir != NULL;
+	pthread_mutex_unlock(&cache_dir_lock);
+	return on;
+}
+
+// FNV-1a
+static uint64_t
+_avr_fw_cache_hash(
+		uint64_t h,
+		const void * data,
+		size_t len)
+{
+	const uint8_t * d = data;
+
+	while (len--)
+		h = (h ^ *d++) * 0x100000001b3ull;
+	return h;
+}
+
+#define HASH(_h, _v) _avr_fw_cache_hash(_h, &(_v), sizeof(_v))
+
+int
+avr_fw_cache_key(
+		const char * filename,
+		uint32_t base,
+		const elf_firmware_t * fw,
+		uint64_t * key)
+{
+	uint64_t h = 0xcbf29ce484222325ull;
+	uint32_t version = AVR_FW_CACHE_VERSION;
+	uint32_t fw_size = sizeof(elf_firmware_t), flags = AVR_FW_CACHE_FLAGS;
+	struct stat st;
+	void * m;
+	int fd;
+
+	if (!_avr_fw_cache_on())
+		return -1;
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &st) || !st.st_size ||
+			(m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) ==
+			MAP_FAILED) {
+		close(fd);
+		return -1;
+	}
+	h = _avr_fw_cache_hash(h, m, st.st_size);
+	munmap(m, st.st_size);
+	close(fd);
+
+	// what the caller set, field by field for the padding
+	h = HASH(h, version);
+	h = HASH(h, fw_size);
+	h = HASH(h, flags);
+	h = HASH(h, base);
+	h = _avr_fw_cache_hash(h, fw->mmcu, strnlen(fw->mmcu, sizeof(fw->mmcu)));
+	h = HASH(h, fw->frequency);
+	h = HASH(h, fw->vcc);
+	h = HASH(h, fw->avcc);
+	h = HASH(h, fw->aref);
+	h = _avr_fw_cache_hash(h, fw->tracename,
+			strnlen(fw->tracename, sizeof(fw->tracename)));
+	h = HASH(h, fw->traceperiod);
+	h = HASH(h, fw->tracecount);
+	for (int i = 0; i < fw->tracecount && i < 32; i++) {
+		h = HASH(h, fw->trace[i].kind);
+		h = HASH(h, fw->trace[i].mask);
+		h = HASH(h, fw->trace[i].addr);
+		h = _avr_fw_cache_hash(h, fw->trace[i].name,
+				strnlen(fw->trace[i].name, sizeof(fw->trace[i].name)));
+	}
+#ifdef CONFIG_PULL_UPS
+	for (int i = 0; i < 8; i++) {
+		h = HASH(h, fw->external_state[i].port);
+		h = HASH(h, fw->external_state[i].mask);
+		h = HASH(h, fw->external_state[i].value);
+	}
+#endif
+	h = HASH(h, fw->command_register_addr);
+	h = HASH(h, fw->console_register_addr);
+	h = HASH(h, fw->flashbase);
+	*key = h;
+	return 0;
+}
+
+/*
+ * Check 'count' padded records from 'offset', each a 'head' byte header
+ * followed by a string, or by as many bytes as the header's 'size' field
+ * at 'size_at' when it is not -1. Returns -1 if they don't all fit in the
+ * entry.
+ */
+static int
+_avr_fw_cache_check(
+		const avr_fw_cache_header_t * h,
+		uint32_t offset,
+		uint32_t count,
+		uint32_t head,
+		int size_at)
+{
+	const uint8_t * p = (const uint8_t *)h;
+
+	if (count && (offset < sizeof(*h) || (offset & 3) || offset > h->size))
+		return -1;
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t left = h->size - offset, len;
+
+		if (left < head)
+			return -1;
+		if (size_at >= 0) {
+			memcpy(&len, p + offset + size_at, sizeof(len));
+		} else {
+			const uint8_t * e = memchr(p + offset + head, 0, left - head);
+
+			if (!e)
+				return -1;
+			len = e - (p + offset + head) + 1;
+		}
+		if (len > left - head || ALIGN4(head + len) > left)
+			return -1;
+		offset += ALIGN4(head + len);
+	}
+	return 0;
+}
+
+// Map an entry, checked. Returns NULL if there is none.
+static const avr_fw_cache_header_t *
+_avr_fw_cache_map(
+		const char * path,
+		uint64_t key)
+{
+	const avr_fw_cache_header_t * h;
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return NULL;
+	// well short of where the offsets would wrap around
+	if (fstat(fd, &st) || st.st_size < sizeof(*h) || st.st_size > 1 << 30 ||
+			(h = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) ==
+			MAP_FAILED) {
+		close(fd);
+		return NULL;
+	}
+	close(fd);
+	if (memcmp(h->magic, "SIMAVRFC", 8) ||
+			h->version != AVR_FW_CACHE_VERSION ||
+			h->fw_size != sizeof(elf_firmware_t) ||
+			h->flags != AVR_FW_CACHE_FLAGS ||
+			h->size != st.st_size || h->key != key) {
+		munmap((void *)h, st.st_size);
+		return NULL;
+	}
+	// it is only read from, but it may have been cut short or garbled
+	if (h->fw.tracecount < 0 || h->fw.tracecount > 32 ||
+			_avr_fw_cache_check(h, h->chunks, h->chunk_count,
+				sizeof(avr_fw_cache_chunk_t),
+				offsetof(avr_fw_cache_chunk_t, size)) ||
+			_avr_fw_cache_check(h, h->symbols, h->symbol_count,
+				sizeof(avr_symbol_t), -1) ||
+			_avr_fw_cache_check(h, h->names, h->name_count,
+				sizeof(avr_symbol_t), -1)) {
+		AVR_LOG(NULL, LOG_WARNING, "FW cache: %s is damaged\n", path);
+		munmap((void *)h, st.st_size);
+		return NULL;
+	}
+	return h;
+}
+
+#if ELF_SYMBOLS
+// Symbols stored one after the other, as pointers into the entry.
+static avr_symbol_t **
+_avr_fw_cache_symbols(
+		const avr_fw_cache_header_t * h,
+		uint32_t offset,
+		uint32_t count)
+{
+	avr_symbol_t ** s = malloc((count ? count : 1) * sizeof(*s));
+	const uint8_t * p = (const uint8_t *)h + offset;
+
+	for (uint32_t i = 0; s && i < count; i++) {
+		s[i] = (avr_symbol_t *)p;
+		p += ALIGN4(sizeof(avr_symbol_t) + strlen(s[i]->symbol) + 1);
+	}
+	return s;
+}
+#endif
+
+int
+avr_fw_cache_read(
+		uint64_t key,
+		const char * filename,
+		elf_firmware_t * fw)
+{
+	char * path = _avr_fw_cache_path(key);
+	const avr_fw_cache_header_t * h;
+	const uint8_t * p;
+	fw_chunk_t ** last = &fw->chunks;
+
+	if (!path)
+		return -1;
+	if (!(h = _avr_fw_cache_map(path, key))) {
+		free(path);
+		return -1;
+	}
+	*fw = h->fw;
+	fw->chunks = NULL;
+	// the loader consumes the chunks, they are copies
+	p = (const uint8_t *)h + h->chunks;
+	for (uint32_t i = 0; i < h->chunk_count; i++) {
+		const avr_fw_cache_chunk_t * c = (const avr_fw_cache_chunk_t *)p;
+		fw_chunk_t * n = malloc(sizeof(*n) + c->size);
+
+		if (!n)
+			break;
+		n->type = c->type;
+		n->addr = c->addr;
+		n->size = c->size;
+		n->fill_size = c->fill_size;
+		n->next = NULL;
+		memcpy(n->data, c->data, c->size);
+		*last = n;
+		last = &n->next;
+		p += ALIGN4(sizeof(*c) + c->size);
+	}
+#if ELF_SYMBOLS
+	// the entry stays mapped, the symbols are in there
+	fw->symbol = _avr_fw_cache_symbols(h, h->symbols, h->symbol_count);
+	fw->symbolcount = h->symbol_count;
+	fw->map = h;
+	fw->dwarf = NULL;
+	fw->dwarfcount = 0;
+	fw->dwarf_file = NULL;
+	fw->cache = NULL;
+	// the file is still given, for sim_symbols.h
+	if (h->dwarf)
+		fw->dwarf_file = strdup(filename);
+	if (h->names) {
+		fw->dwarf = _avr_fw_cache_symbols(h, h->names, h->name_count);
+		fw->dwarfcount = h->name_count;
+	} else if (h->dwarf) {
+		fw->cache = path;
+		path = NULL;
+	}
+#endif
+	free(path);
+	return 0;
+}
+
+void
+avr_fw_cache_unmap(
+		elf_firmware_t * fw)
+{
+#if ELF_SYMBOLS
+	const avr_fw_cache_header_t * h = fw->map;
+
+	if (h)
+		munmap((void *)h, h->size);
+	fw->map = NULL;
+#endif
+}
+
+static int
+_avr_fw_cache_put(
+		avr_fw_cache_buf_t * b,
+		const void * data,
+		uint32_t len)
+{
+	uint32_t n = ALIGN4(len);
+
+	if (b->len + n > b->size) {
+		uint32_t size = b->size ? b->size * 2 : 4096;
+		uint8_t * nb;
+
+		while (size < b->len + n)
+			size *= 2;
+		if (!(nb = realloc(b->b, size)))
+			return -1;
+		b->b = nb;
+		b->size = size;
+	}
+	memcpy(b->b + b->len, data, len);
+	memset(b->b + b->len + len, 0, n - len);
+	b->len += n;
+	return 0;
+}
+
+#if ELF_SYMBOLS
+static int
+_avr_fw_cache_put_symbol(
+		avr_fw_cache_buf_t * b,
+		uint32_t addr,
+		uint32_t size,
+		const char * name)
+{
+	avr_symbol_t s = { .addr = addr, .size = size };
+
+	if (_avr_fw_cache_put(b, &s, sizeof(s)))
+		return -1;
+	// the name follows, in the same padded record
+	b->len -= ALIGN4(sizeof(s));
+	b->len += sizeof(s);
+	return _avr_fw_cache_put(b, name, strlen(name) + 1) ? -1 : 0;
+}
+#endif
+
+/*
+ * Write it under a temporary name of its own, then rename it in place,
+ * other threads and processes may be writing the same entry.
+ */
+static int
+_avr_fw_cache_save(
+		const char * path,
+		avr_fw_cache_buf_t * b)
+{
+	char * tmp;
+	int fd, res = -1;
+
+	((avr_fw_cache_header_t *)b->b)->size = b->len;
+	if (asprintf(&tmp, "%s.XXXXXX", path) < 0)
+		return -1;
+	fd = mkstemp(tmp);
+	if (fd >= 0) {
+		// mkstemp() makes it private, the cache can be shared
+		int ok = !fchmod(fd, 0644) && write(fd, b->b, b->len) == b->len;
+
+		if (!close(fd) && ok)
+			res = rename(tmp, path);
+		if (res)
+			unlink(tmp);
+	}
+	free(tmp);
+	return res;
+}
+
+int
+avr_fw_cache_write(
+		uint64_t key,
+		elf_firmware_t * fw)
+{
+	char * path = _avr_fw_cache_path(key);
+	avr_fw_cache_buf_t b = { 0 };
+	avr_fw_cache_header_t h = { .magic = "SIMAVRFC" };
+	int res = -1;
+
+	if (!path)
+		return -1;
+	h.version = AVR_FW_CACHE_VERSION;
+	h.key = key;
+	h.fw_size = sizeof(elf_firmware_t);
+	h.flags = AVR_FW_CACHE_FLAGS;
+	h.fw = *fw;
+	h.fw.chunks = NULL;
+#if ELF_SYMBOLS
+	h.fw.symbol = NULL;
+	h.fw.dwarf = NULL;
+	h.fw.dwarf_file = NULL;
+	h.fw.cache = NULL;
+	h.fw.map = NULL;
+	h.dwarf = fw->dwarf_file != NULL;
+#endif
+	if (_avr_fw_cache_put(&b, &h, sizeof(h)))
+		goto out;
+	h.chunks = b.len;
+	for (fw_chunk_t * c = fw->chunks; c; c = c->next, h.chunk_count++) {
+		avr_fw_cache_chunk_t cc = {
+			.type = c->type, .addr = c->addr,
+			.size = c->size, .fill_size = c->fill_size,
+		};
+
+		if (_avr_fw_cache_put(&b, &cc, sizeof(cc)))
+			goto out;
+		b.len -= ALIGN4(sizeof(cc));
+		b.len += sizeof(cc);
+		if (_avr_fw_cache_put(&b, c->data, c->size))
+			goto out;
+	}
+#if ELF_SYMBOLS
+	h.symbols = b.len;
+	h.symbol_count = fw->symbolcount;
+	for (uint32_t i = 0; i < fw->symbolcount; i++)
+		if (_avr_fw_cache_put_symbol(&b, fw->symbol[i]->addr,
+				fw->symbol[i]->size, fw->symbol[i]->symbol))
+			goto out;
+#endif
+	memcpy(b.b, &h, sizeof(h));
+	res = _avr_fw_cache_save(path, &b);
+#if ELF_SYMBOLS
+	// for the names to be added when it is loaded
+	if (!res && fw->dwarf_file) {
+		fw->cache = path;
+		path = NULL;
+	}
+#endif
+out:
+	if (res)
+		AVR_LOG(NULL, LOG_WARNING, "FW cache: can't write %s\n", path);
+	free(b.b);
+	free(path);
+	return res;
+}
+
+#if ELF_SYMBOLS
+void
+avr_fw_cache_set_names(
+		avr_t * avr,
+		const elf_firmware_t * fw)
+{
+	struct avr_trace_data_t * td = avr->trace_data;
+
+	for (uint32_t i = 0; i < fw->dwarfcount; i++) {
+		uint32_t addr = fw->dwarf[i]->addr;
+		const char ** ep = NULL;
+
+		if (addr >= AVR_SEGMENT_OFFSET_DATA) {
+			addr -= AVR_SEGMENT_OFFSET_DATA;
+			if (addr < td->data_names_size)
+				ep = &avr->data_names[addr];
+		} else if (td->codeline && (addr >> 1) < td->codeline_size)
+			ep = &td->codeline[addr >> 1];
+		// as avr_read_dwarf(), only where there was no name
+		if (ep && !*ep)
+			*ep = fw->dwarf[i]->symbol;
+	}
+}
+
+int
+avr_fw_cache_add_names(
+		avr_t * avr,
+		const elf_firmware_t * fw,
+		const char ** code,
+		const char ** data)
+{
+	struct avr_trace_data_t * td = avr->trace_data;
+	const avr_fw_cache_header_t * h;
+	avr_fw_cache_header_t nh;
+	avr_fw_cache_buf_t b = { 0 };
+	uint32_t size;
+	int res = -1;
+
+	if (!fw->cache || !(h = _avr_fw_cache_map(fw->cache,
+			strtoull(strrchr(fw->cache, '/') + 1, NULL, 16))))
+		return -1;
+	size = h->size;
+	nh = *h;
+	if (_avr_fw_cache_put(&b, h, h->size))
+		goto out;
+	nh.names = b.len;
+	nh.name_count = 0;
+	for (uint32_t i = 0; td->codeline && i < td->codeline_size; i++)
+		if (!code[i] && td->codeline[i]) {
+			if (_avr_fw_cache_put_symbol(&b, i << 1, 0, td->codeline[i]))
+				goto out;
+			nh.name_count++;
+		}
+	for (uint32_t i = 0; i < td->data_names_size; i++)
+		if (!data[i] && avr->data_names[i]) {
+			if (_avr_fw_cache_put_symbol(&b, AVR_SEGMENT_OFFSET_DATA + i, 0,
+					avr->data_names[i]))
+				goto out;
+			nh.name_count++;
+		}
+	memcpy(b.b, &nh, sizeof(nh));
+	res = _avr_fw_cache_save(fw->cache, &b);
+out:
+	munmap((void *)h, size);
+	free(b.b);
+	return res;
+}
+#endif
@@ -0,0 +1,106 @@
+/*
+	sim_fw_cache.h
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A cache of parsed firmware files, for many short runs of the same ones.
+ *
+ * The cache is a directory, $SIMAVR_FW_CACHE or set with
+ * avr_fw_cache_set_dir(), off when there is none. sim_read_firmware()
+ * looks there for an entry named after a hash of the file's contents and
+ * of what was set in the elf_firmware_t beforehand, and writes one after
+ * parsing a file when there was none.
+ *
+ * An entry holds the elf_firmware_t, with offsets in place of pointers:
+ * the chunks, the .mmcu settings and trace requests, and the symbols. It
+ * is mapped, and the symbols are used where they are. Names from DWARF
+ * debug information are only known once the firmware is loaded in an
+ * AVR: they are added to the entry then, and are used in place of reading
+ * the DWARF the next time.
+ *
+ * Entries are in the host's byte order and for one build of simavr, they
+ * are checked before use, and replaced by renaming so that
+ * several processes can share a cache.
+ */
+
+#ifndef __SIM_FW_CACHE_H__
+#define __SIM_FW_CACHE_H__
+
+#include "sim_elf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AVR_FW_CACHE_VERSION	2
+
+// NULL turns the cache off.
+void
+avr_fw_cache_set_dir(
+		const char * dir);
+
+/*
+ * Hash of 'filename' and of the settings in 'fw', before it is read.
+ * Returns -1 if there is no cache, or the file can't be read.
+ */
+int
+avr_fw_cache_key(
+		const char * filename,
+		uint32_t base,
+		const elf_firmware_t * fw,
+		uint64_t * key);
+// Fill 'fw' from the entry for 'key'. Returns -1 if there is none.
+int
+avr_fw_cache_read(
+		uint64_t key,
+		const char * filename,
+		elf_firmware_t * fw);
+// Unmap the entry avr_fw_cache_read() left in 'fw', once done with it.
+void
+avr_fw_cache_unmap(
+		elf_firmware_t * fw);
+// Write an entry for 'fw', just read.
+int
+avr_fw_cache_write(
+		uint64_t key,
+		elf_firmware_t * fw);
+
+// Set the DWARF names of an entry, read by avr_fw_cache_read(), in 'avr'.
+void
+avr_fw_cache_set_names(
+		avr_t * avr,
+		const elf_firmware_t * fw);
+/*
+ * Add the names avr_read_dwarf() gave 'avr' to the entry 'fw' was read
+ * from or written to. 'code' and 'data' are copies of its name tables
+ * from before.
+ */
+int
+avr_fw_cache_add_names(
+		avr_t * avr,
+		const elf_firmware_t * fw,
+		const char ** code,
+		const char ** data);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* __SIM_FW_CACHE_H__ */
@@ -32,6 +32,10 @@
 #include "sim_hex.h"
 #include "avr_eeprom.h"
 #include "sim_gdb.h"
+#include "sim_symbols.h"
+#include "sim_stats.h"
+#include "sim_checkpoint.h"
+#include "sim_reverse.h"
 
 // For debug printfs: "#define DBG(w) w"
 #define DBG(w)
@@ -64,6 +68,11 @@ typedef struct avr_gdb_t {
 
 	uint16_t ior_base;
 	uint8_t  ior_count, mad;
+
+	// Last watchpoint hit while re-executing for a reverse command.
+
+	const char * watch_what;
+	uint32_t     watch_addr;
 } avr_gdb_t;
 
 
@@ -229,6 +238,8 @@ gdb_send_stop_status(
 	if (reason) {
 		if (pp)
 			sprintf(cmd + n, "%s:%x;", reason, *pp);
+		else if (strchr(reason, ':'))	// comes with its value
+			sprintf(cmd + n, "%s;", reason);
 		else
 			sprintf(cmd + n, "%s:;", reason);
 	}
@@ -370,6 +381,34 @@ handle_monitor(avr_t * avr, avr_gdb_t * g, char * cmd)
 		} else if (strncmp(ip, "halt", 4) == 0) {
 			avr->state = cpu_Stopped;
 			ip += 4;
+		} else if (strncmp(ip, "stats", 5) == 0) {
+			// "stats" starts counting or shows the counters,
+			// "stats clear" zeroes them and "stats off" stops.
+
+			ip += 5;
+			while (*ip == ' ' || *ip == '\t')
+				++ip;
+			if (strncmp(ip, "clear", 5) == 0) {
+				avr_stats_clear(avr);
+				ip += 5;
+			} else if (strncmp(ip, "off", 3) == 0) {
+				avr_stats_stop(avr);
+				ip += 3;
+			} else if (!avr->stats) {
+				avr_stats_start(avr);
+				message(g, "Statistics started.\n");
+			} else {
+				FILE * f = tmpfile();
+				char   line[120];
+
+				if (!f)
+					return 5;
+				avr_stats_report(avr, f, 10);
+				rewind(f);
+				while (fgets(line, sizeof line, f))
+					message(g, line);
+				fclose(f);
+			}
 		} else if (strncmp(ip, "ior", 3) == 0) {
 			unsigned int base;
 			int          n, m, count;
@@ -395,6 +434,20 @@ handle_monitor(avr_t * avr, avr_gdb_t * g, char * cmd)
 				g->ior_count = count;
 			}
 			ip += n;
+		} else if (strncmp(ip, "where", 5) == 0) {
+			// "where" names the PC's function and line,
+			// "where <address>" those of a flash address.
+
+			unsigned int addr = avr->pc;
+			char         where[128];
+			int          n = 0;
+
+			ip += 5;
+			sscanf(ip, "%x%n", &addr, &n);
+			ip += n;
+			avr_symbols_format(avr, addr, where, sizeof(where) - 1);
+			strcat(where, "\n");
+			message(g, where);
 	DBG(
 		} else if (strncmp(ip, "say ", 4) == 0) {
 			// Put a message in the debug output.
@@ -402,7 +455,8 @@ handle_monitor(avr_t * avr, avr_gdb_t * g, char * cmd)
 			ip += strlen(ip);
 		)
 		} else {
-			tohex("Monitor subcommands are: ior halt reset" DBG(" say") "\n",
+			tohex("Monitor subcommands are: ior halt reset stats where"
+				  DBG(" say") "\n",
 				  dehex, sizeof dehex);
 			gdb_send_reply(g, dehex);
 			return -1;
@@ -519,6 +573,9 @@ handle_v(avr_t * avr, avr_gdb_t * g, char * cmd, int length)
 		}
 	} else if (strncmp(cmd, "FlashDone", 9) == 0) {
 		DBG(printf("FlashDone\n");) //Remove
+		avr_checkpoint_touch_flash(avr, 0, avr->flashend + 1);
+		if (avr->reverse)
+			avr_reverse_truncate(avr);
 	} else {
 		gdb_send_reply(g, "");
 		return;
@@ -534,6 +591,17 @@ handle_v(avr_t * avr, avr_gdb_t * g, char * cmd, int length)
 	}
 }
 
+/* Where reverse-continue stops, other than watchpoints. */
+static int
+gdb_reverse_stop(
+		avr_t * avr,
+		void * param)
+{
+	avr_gdb_t * g = param;
+
+	return gdb_watch_find(&g->breakpoints, avr->pc) != -1;
+}
+
 static void
 gdb_handle_command(
 		avr_gdb_t * g,
@@ -548,9 +616,14 @@ gdb_handle_command(
 			if (strncmp(cmd, "Supported", 9) == 0) {
 				/* If GDB asked what features we support, report back
 				 * the features we support, which is just memory layout
-				 * information and stop reasons for now.
+				 * information and stop reasons for now, and going
+				 * backwards if there is history.
 				 */
-				gdb_send_reply(g, "qXfer:memory-map:read+;swbreak+;hwbreak+");
+				if (avr->reverse)
+					gdb_send_reply(g, "qXfer:memory-map:read+;swbreak+;hwbreak+;"
+								   "ReverseStep+;ReverseContinue+");
+				else
+					gdb_send_reply(g, "qXfer:memory-map:read+;swbreak+;hwbreak+");
 				break;
 			} else if (strncmp(cmd, "Attached", 8) == 0) {
 				/* Respond that we are attached to an existing process..
@@ -627,6 +700,8 @@ gdb_handle_command(
 			uint8_t *src = (uint8_t*)rep;
 			for (int i = 0; i < 35; i++)
 				src += gdb_write_register(g, i, src);
+			if (avr->reverse)
+				avr_reverse_truncate(avr);
 			gdb_send_reply(g, "OK");
 		}	break;
 		case 'g': {	// read all general purpose registers
@@ -650,6 +725,8 @@ gdb_handle_command(
 			sscanf(cmd, "%x", &regi);
 			read_hex_string(val, (uint8_t*)rep, strlen(val));
 			gdb_write_register(g, regi, (uint8_t*)rep);
+			if (avr->reverse)
+				avr_reverse_truncate(avr);
 			gdb_send_reply(g, "OK");
 		}	break;
 		case 'm': {	// read memory
@@ -704,9 +781,11 @@ gdb_handle_command(
 			}
 			if (addr < 0xffff) {
 				read_hex_string(start + 1, avr->flash + addr, strlen(start+1));
+				avr_checkpoint_touch_flash(avr, addr, len);
 				gdb_send_reply(g, "OK");
 			} else if (addr >= 0x800000 && (addr - 0x800000) <= avr->ramend) {
 				read_hex_string(start + 1, avr->data + addr - 0x800000, strlen(start+1));
+				avr_checkpoint_touch_data(avr, addr - 0x800000, len);
 				gdb_send_reply(g, "OK");
 			} else if (addr >= 0x810000 && (addr - 0x810000) <= avr->e2end) {
 				read_hex_string(start + 1, (uint8_t*)rep, strlen(start+1));
@@ -717,6 +796,8 @@ gdb_handle_command(
 				AVR_LOG(avr, LOG_ERROR, "GDB: write memory error %08x, %08x\n", addr, len);
 				gdb_send_reply(g, "E01");
 			}
+			if (avr->reverse)
+				avr_reverse_truncate(avr);
 		}	break;
 		case 'c': {	// continue
 			avr->state = cpu_Running;
@@ -724,6 +805,32 @@ gdb_handle_command(
 		case 's': {	// step
 			avr->state = cpu_Step;
 		}	break;
+		case 'b': {	// reverse step or continue
+			int res;
+
+			if (!avr->reverse || (*cmd != 's' && *cmd != 'c')) {
+				gdb_send_reply(g, "");
+				break;
+			}
+			if (*cmd == 's')
+				res = avr_reverse_step(avr);
+			else
+				res = avr_reverse_continue(avr, gdb_reverse_stop, g);
+			switch (res) {
+				case AVR_REVERSE_STOPPED:
+					gdb_send_stop_status(g, 5, "hwbreak", NULL);
+					break;
+				case AVR_REVERSE_WATCH:
+					gdb_send_stop_status(g, 5, g->watch_what, &g->watch_addr);
+					break;
+				case AVR_REVERSE_BEGIN:
+					gdb_send_stop_status(g, 5, "replaylog:begin", NULL);
+					break;
+				default:
+					gdb_send_reply(g, "E01");
+					break;
+			}
+		}	break;
 		case 'r': {	// deprecated, suggested for AVRStudio compatibility
 			avr_reset(avr);
 			avr->state = cpu_Stopped;
@@ -884,6 +991,8 @@ void avr_gdb_handle_break(avr_t *avr)
 {
 	avr_gdb_t *g = avr->gdb;
 
+	if (avr->reverse && avr->reverse->searching)
+		return;
 	message(g, "Simavr executed 'break' instruction.\n");
 	//gdb_send_stop_status(g, 5, "swbreak", NULL);  Correct but ignored!
 	gdb_send_quick_status(g, 5);
@@ -918,6 +1027,13 @@ avr_gdb_handle_watchpoints(
 		what = (kind & AVR_GDB_WATCH_ACCESS) ? "awatch" :
 			(kind & AVR_GDB_WATCH_WRITE) ? "watch" : "rwatch";
 		false_addr = addr + 0x800000;
+		if (avr->reverse && avr->reverse->searching) {
+			// Re-executing, the reverse command decides where to stop.
+			g->watch_what = what;
+			g->watch_addr = false_addr;
+			avr->reverse->hit = 1;
+			return;
+		}
 		gdb_send_stop_status(g, 5, what, &false_addr);
 		avr->state = cpu_Stopped;
 	}
@@ -24,6 +24,7 @@
 #include <string.h>
 #include "sim_hex.h"
 #include "sim_elf.h"
+#include "sim_fw_cache.h"
 
 // friendly hex dump
 void hdump(const char *w, uint8_t *b, size_t l)
@@ -216,9 +217,9 @@ read_ihex_file(
  * Included here as it mostly specific to HEX files.
  */
 
-void
-sim_setup_firmware(const char * filename, uint32_t loadBase,
-                   elf_firmware_t * fp, const char * progname)
+static int
+sim_parse_firmware(const char * filename, uint32_t loadBase,
+                   elf_firmware_t * fp)
 {
 	fw_chunk_t * chunks = NULL, *cp;
 	char       * suffix = strrchr(filename, '.');
@@ -226,23 +227,15 @@ sim_setup_firmware(const char * filename, uint32_t loadBase,
 	if (!suffix || strcasecmp(suffix, ".hex")) {
 		/* Not suffix .hex, try reading as an ELF file. */
 
-		if (elf_read_firmware(filename, fp) == -1) {
-			fprintf(stderr, "%s: Unable to load firmware from file %s\n",
-					progname, filename);
-			exit(1);
-		}
-		return;
+		return elf_read_firmware(filename, fp) == -1 ? -1 : 0;
 	}
 
 	if (!(fp->mmcu[0] && fp->frequency > 0))
 		printf("MCU type and frequency are not set when loading .hex file\n");
 
 	read_ihex_chunks(filename, &chunks);
-	if (!chunks) {
-		fprintf(stderr, "%s: Unable to load IHEX file %s\n",
-				progname, filename);
-		exit(1);
-	}
+	if (!chunks)
+		return -1;
 
 	for (cp = chunks; cp; cp = cp->next) {
 		if (cp->addr + loadBase < (1*1024*1024)) {
@@ -259,6 +252,35 @@ sim_setup_firmware(const char * filename, uint32_t loadBase,
 		printf("Chunk type %d: %d at %#x\n", cp->type, cp->size, cp->addr);
 	}
 	fp->chunks = chunks;
+	return 0;
+}
+
+/* Use the firmware cache, if there is one, see sim_fw_cache.h */
+int
+sim_read_firmware(const char * filename, uint32_t loadBase,
+                  elf_firmware_t * fp)
+{
+	uint64_t key;
+
+	if (avr_fw_cache_key(filename, loadBase, fp, &key))
+		return sim_parse_firmware(filename, loadBase, fp);
+	if (!avr_fw_cache_read(key, filename, fp))
+		return 0;
+	if (sim_parse_firmware(filename, loadBase, fp))
+		return -1;
+	avr_fw_cache_write(key, fp);
+	return 0;
+}
+
+void
+sim_setup_firmware(const char * filename, uint32_t loadBase,
+                   elf_firmware_t * fp, const char * progname)
+{
+	if (sim_read_firmware(filename, loadBase, fp)) {
+		fprintf(stderr, "%s: Unable to load firmware from file %s\n",
+				progname, filename);
+		exit(1);
+	}
 }
 
 #ifdef IHEX_TEST
@@ -34,6 +34,14 @@ extern "C" {
 
 struct elf_firmware_t;                          // Predeclaration ...
 
+// Returns -1 if the file cannot be read.
+int
+sim_read_firmware(
+				   const char * filename,       // Firmware file
+				   uint32_t loadBase,           // Base of load region
+				   struct elf_firmware_t * fp); // Data returned here
+
+// As sim_read_firmware(), but exits on failure.
 void
 sim_setup_firmware(
 				   const char * filename,       // Firmware file
@@ -0,0 +1,211 @@
+/*
+	sim_int_stats.c
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "sim_avr.h"
+#include "sim_int_stats.h"
+
+static void
+_avr_int_histogram_add(
+		avr_int_histogram_t * h,
+		avr_cycle_count_t value)
+{
+	uint32_t v = value > UINT32_MAX ? UINT32_MAX : value;
+	int b = 0;
+
+	while (b < AVR_INT_STATS_BUCKETS - 1 && (v >> b))
+		b++;
+	h->bucket[b]++;
+	if (!h->count || v < h->min)
+		h->min = v;
+	if (v > h->max)
+		h->max = v;
+	h->count++;
+	h->sum += v;
+}
+
+static void
+_avr_int_stats_notify(
+		struct avr_irq_t * irq,
+		uint32_t value,
+		void * param)
+{
+	avr_t * avr = (avr_t *)param;
+	avr_int_stats_t * s = avr->interrupts.stats;
+	avr_int_vector_stats_t * v;
+
+	if (!s)
+		return;
+	v = &s->vector[(irq->irq >> 8) & (MAX_VECTOR_COUNT - 1)];
+	switch (irq->irq & 0xff) {
+		case AVR_INT_IRQ_PENDING:
+			if (value) {
+				v->raised++;
+				v->pending = 1;
+				v->pending_since = avr->cycle;
+			} else if (v->pending) {
+				v->cancelled++;
+				v->pending = 0;
+			}
+			break;
+		case AVR_INT_IRQ_RUNNING:
+			if (value) {
+				// the handler is not on avr->interrupts.running[] yet
+				uint8_t depth = avr->interrupts.running_ptr + 1;
+
+				if (v->pending)
+					_avr_int_histogram_add(&v->latency,
+										   avr->cycle - v->pending_since);
+				v->pending = 0;
+				v->running = 1;
+				v->running_since = avr->cycle;
+				v->serviced++;
+				if (depth > v->max_nesting)
+					v->max_nesting = depth;
+				if (depth > s->max_nesting)
+					s->max_nesting = depth;
+			} else if (v->running) {
+				_avr_int_histogram_add(&v->duration,
+									   avr->cycle - v->running_since);
+				v->running = 0;
+			}
+			break;
+	}
+}
+
+int
+avr_int_stats_start(
+		avr_t * avr)
+{
+	avr_int_table_p table = &avr->interrupts;
+
+	if (table->stats)
+		return 0;
+	table->stats = calloc(1, sizeof(avr_int_stats_t));
+	if (!table->stats)
+		return -1;
+	for (int i = 1; i <= table->max_vector; i++) {
+		avr_int_vector_t * vector = table->vectors[i];
+
+		if (!vector)
+			continue;
+		avr_irq_register_notify(vector->irq + AVR_INT_IRQ_PENDING,
+								_avr_int_stats_notify, avr);
+		avr_irq_register_notify(vector->irq + AVR_INT_IRQ_RUNNING,
+								_avr_int_stats_notify, avr);
+	}
+	return 0;
+}
+
+void
+avr_int_stats_stop(
+		avr_t * avr)
+{
+	avr_int_table_p table = &avr->interrupts;
+
+	if (!table->stats)
+		return;
+	for (int i = 1; i <= table->max_vector; i++) {
+		avr_int_vector_t * vector = table->vectors[i];
+
+		if (!vector)
+			continue;
+		avr_irq_unregister_notify(vector->irq + AVR_INT_IRQ_PENDING,
+								  _avr_int_stats_notify, avr);
+		avr_irq_unregister_notify(vector->irq + AVR_INT_IRQ_RUNNING,
+								  _avr_int_stats_notify, avr);
+	}
+	free(table->stats);
+	table->stats = NULL;
+}
+
+void
+avr_int_stats_clear(
+		avr_t * avr)
+{
+	avr_int_stats_t * s = avr->interrupts.stats;
+
+	if (!s)
+		return;
+	s->max_nesting = 0;
+	for (int i = 0; i < MAX_VECTOR_COUNT; i++) {
+		avr_int_vector_stats_t * v = &s->vector[i];
+
+		// keep the in-flight state so the next sample is still valid
+		v->raised = v->missed = v->cancelled = v->serviced = 0;
+		v->max_nesting = 0;
+		memset(&v->latency, 0, sizeof(v->latency));
+		memset(&v->duration, 0, sizeof(v->duration));
+	}
+}
+
+static void
+_avr_int_histogram_report(
+		avr_t * avr,
+		FILE * out,
+		const char * title,
+		avr_int_histogram_t * h)
+{
+	double us = 1000000.0 / avr->frequency;
+
+	if (!h->count)
+		return;
+	fprintf(out, "    %s: min %u max %u mean %.1f cycles "
+			"(%.3f/%.3f/%.3f us)\n",
+			title, h->min, h->max, (double)h->sum / h->count,
+			h->min * us, h->max * us, (double)h->sum / h->count * us);
+	for (int b = 0; b < AVR_INT_STATS_BUCKETS; b++) {
+		uint64_t lo, hi;
+
+		if (!h->bucket[b])
+			continue;
+		lo = b ? 1ull << (b - 1) : 0;
+		hi = b ? (1ull << b) - 1 : 0;
+		fprintf(out, "      %10" PRIu64 " - %-10" PRIu64
+				" (%10.3f - %-10.3f us) %10" PRIu64 "\n",
+				lo, hi, lo * us, hi * us, h->bucket[b]);
+	}
+}
+
+void
+avr_int_stats_report(
+		avr_t * avr,
+		FILE * out)
+{
+	avr_int_stats_t * s = avr->interrupts.stats;
+
+	if (!s)
+		return;
+	fprintf(out, "Interrupts: maximum nesting %d\n", s->max_nesting);
+	for (int i = 1; i < MAX_VECTOR_COUNT; i++) {
+		avr_int_vector_stats_t * v = &s->vector[i];
+
+		if (!v->raised && !v->missed && !v->serviced)
+			continue;
+		fprintf(out, "  vector %2d: raised %" PRIu64 " serviced %" PRIu64
+				" missed %" PRIu64 " cancelled %" PRIu64 " nesting %d\n",
+				i, v->raised, v->serviced, v->missed, v->cancelled,
+				v->max_nesting);
+		_avr_int_histogram_report(avr, out, "latency", &v->latency);
+		_avr_int_histogram_report(avr, out, "duration", &v->duration);
+	}
+}
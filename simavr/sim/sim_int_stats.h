@@ -0,0 +1,98 @@
+/*
+	sim_int_stats.h
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Per-vector interrupt timing, built on the AVR_INT_IRQ_PENDING and
+ * AVR_INT_IRQ_RUNNING signals of each vector.
+ *
+ * Latency is from the interrupt becoming pending to the first cycle of
+ * its handler, so it includes the cycles of the vector call itself.
+ * Duration is from handler entry to RETI, including any nested handlers.
+ * Histograms use power of two buckets: bucket 0 counts zero, bucket n
+ * counts values from 2^(n-1) to 2^n - 1.
+ */
+
+#ifndef __SIM_INT_STATS_H__
+#define __SIM_INT_STATS_H__
+
+#include <stdio.h>
+#include "sim_avr_types.h"
+#include "sim_interrupts.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AVR_INT_STATS_BUCKETS	33
+
+typedef struct avr_int_histogram_t {
+	uint64_t	count;
+	uint64_t	sum;
+	uint32_t	min, max;		// in cycles
+	uint64_t	bucket[AVR_INT_STATS_BUCKETS];
+} avr_int_histogram_t;
+
+typedef struct avr_int_vector_stats_t {
+	uint64_t			raised;		// became pending
+	uint64_t			missed;		// edge raised again while still pending
+	uint64_t			cancelled;	// cleared without being serviced
+	uint64_t			serviced;
+	uint8_t				max_nesting;	// deepest handler nesting on entry
+
+	avr_int_histogram_t	latency;
+	avr_int_histogram_t	duration;
+
+	// internal state
+	uint8_t				pending : 1, running : 1;
+	avr_cycle_count_t	pending_since;
+	avr_cycle_count_t	running_since;
+} avr_int_vector_stats_t;
+
+typedef struct avr_int_stats_t {
+	uint8_t					max_nesting;
+	avr_int_vector_stats_t	vector[MAX_VECTOR_COUNT];
+} avr_int_stats_t;
+
+// Allocate avr->interrupts.stats and hook every registered vector.
+// Call after the firmware is loaded, as the cores register vectors in init.
+int
+avr_int_stats_start(
+		struct avr_t * avr);
+
+void
+avr_int_stats_stop(
+		struct avr_t * avr);
+
+void
+avr_int_stats_clear(
+		struct avr_t * avr);
+
+// Print per-vector counts and both histograms in cycles and microseconds.
+void
+avr_int_stats_report(
+		struct avr_t * avr,
+		FILE * out);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* __SIM_INT_STATS_H__ */
@@ -28,6 +28,10 @@
 #include "sim_interrupts.h"
 #include "sim_avr.h"
 #include "sim_core.h"
+#include "sim_stack.h"
+#include "sim_timeline.h"
+#include "sim_stats.h"
+#include "sim_int_stats.h"
 
 /* Macro to handle the indirect bit. */
 
@@ -172,6 +176,9 @@ avr_raise_interrupt(
 		avr_regbit_set(avr, vector->raised);
 
 	if (vector->pending) {
+		// a level is re-asserted while it holds, that is not an event lost
+		if (avr->interrupts.stats && !vector->level)
+			avr->interrupts.stats->vector[vec_num].missed++;
 		if (vector->trace) {
 			printf("IRQ%d: I=%d already raised (enabled %d) "
 			       "(cycle %lld pc 0x%x)\n",
@@ -394,6 +401,13 @@ avr_service_interrupts(
 		if (vp->trace)
 			printf("IRQ%d calling\n", vp->vector);
 		avr->cycle += _avr_push_addr(avr, avr->pc);
+		if (avr->stack)
+			avr_stack_call(avr, avr->pc, vp->vector * avr->vector_size,
+						   vp->vector);
+		if (avr->timeline)
+			avr_timeline_call(avr, vp->vector * avr->vector_size, vp->vector);
+		if (avr->stats)
+			avr->stats->interrupts[vp->vector]++;
 		avr_sreg_set(avr, S_I, 0);
 		avr->pc = vp->vector * avr->vector_size;
 
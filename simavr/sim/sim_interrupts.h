@@ -72,6 +72,9 @@ typedef struct avr_int_table_t {
 
 	uint8_t           running[MAX_VECTOR_COUNT];
 	avr_irq_t		  irq[AVR_INT_IRQ_COUNT];
+
+	// Optional timing statistics, see sim_int_stats.h
+	struct avr_int_stats_t * stats;
 } avr_int_table_t, *avr_int_table_p;
 
 /*
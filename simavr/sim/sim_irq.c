@@ -23,6 +23,8 @@
 #include <stdio.h>
 #include <string.h>
 #include "sim_avr.h"
+#include "sim_stats.h"
+#include "sim_record.h"
 
 // internal structure for a hook, never seen by the notify procs
 typedef struct avr_irq_hook_t {
@@ -193,6 +195,17 @@ avr_irq_unregister_notify(
 	}
 }
 
+int
+avr_irq_is_hooked(
+		avr_irq_t * irq,
+		avr_irq_t * except)
+{
+	for (avr_irq_hook_t * hook = irq->hook; hook; hook = hook->next)
+		if (hook->notify || hook->chain != except)
+			return 1;
+	return 0;
+}
+
 void
 avr_raise_irq_float(
 		avr_irq_t * irq,
@@ -201,6 +214,8 @@ avr_raise_irq_float(
 {
 	if (!irq)
 		return ;
+	if ((irq->flags & IRQ_FLAG_RECORD) && avr_record_raise(irq, value, floating))
+		return;
 	uint32_t output = (irq->flags & IRQ_FLAG_NOT) ? !value : value;
 	// if value is the same but it's the first time, raise it anyway
 	if (irq->value == output &&
@@ -209,6 +224,8 @@ avr_raise_irq_float(
 	irq->flags &= ~(IRQ_FLAG_INIT | IRQ_FLAG_FLOATING);
 	if (floating)
 		irq->flags |= IRQ_FLAG_FLOATING;
+	if (irq->pool && irq->pool->avr && irq->pool->avr->stats)
+		avr_stats_count(&irq->pool->avr->stats->irqs, irq, irq->name);
 	avr_irq_hook_t *hook = irq->hook;
 	while (hook) {
 		avr_irq_hook_t * next = hook->next;
@@ -58,6 +58,7 @@ enum {
 	IRQ_FLAG_INIT		= (1 << 3), //!< this irq hasn't been used yet
 	IRQ_FLAG_FLOATING	= (1 << 4), //!< this 'pin'/signal is floating
 	IRQ_FLAG_USER		= (1 << 5), //!< Can be used by irq users
+	IRQ_FLAG_RECORD		= (1 << 6), //!< external input, see sim_record.h
 };
 
 /*
@@ -143,6 +144,11 @@ avr_irq_unregister_notify(
 		avr_irq_t * irq,
 		avr_irq_notify_t notify,
 		void * param);
+//! 1 if raising 'irq' notifies anything, other than the 'except' IRQ it is connected to
+int
+avr_irq_is_hooked(
+		avr_irq_t * irq,
+		avr_irq_t * except);
 
 #ifdef __cplusplus
 };
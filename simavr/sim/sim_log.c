@@ -0,0 +1,503 @@
+/*
+	sim_log.c
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <inttypes.h>
+#include "sim_avr.h"
+#include "sim_log.h"
+
+enum {
+	_AVR_LOG_NONE = 0,		// %%
+	_AVR_LOG_INT,			// and what is promoted to it
+	_AVR_LOG_LONG,
+	_AVR_LOG_LLONG,
+	_AVR_LOG_SIZE,
+	_AVR_LOG_PTR,
+	_AVR_LOG_DOUBLE,
+	_AVR_LOG_STR,
+	_AVR_LOG_BAD,			// formatted on the spot
+};
+
+typedef struct _avr_log_spec_t {
+	int		len;			// from the '%' to the conversion, included
+	int		stars;			// int arguments for the width and precision
+	int		prec;			// -1 for none, -2 for the last star
+	int		arg;
+} _avr_log_spec_t;
+
+typedef union _avr_log_arg_t {
+	uint64_t		u;
+	double			d;
+	const void *	p;
+} _avr_log_arg_t;
+
+/*
+ * A message in the ring. Strings follow the arguments, which hold their
+ * offset in the record; a message formatted on the spot has no format,
+ * and its text follows instead. A record of size 0 says the rest of the
+ * ring is unused, and the next one is at its start.
+ */
+typedef struct _avr_log_record_t {
+	uint32_t			size;
+	uint32_t			level;
+	const char *		format;
+	avr_cycle_count_t	cycle;
+	_avr_log_arg_t		arg[];
+} _avr_log_record_t;
+
+static void
+_avr_log_spec(
+		const char * f,
+		_avr_log_spec_t * s)
+{
+	const char * p = f + 1;
+	int size = 0;
+
+	s->stars = 0;
+	s->prec = -1;
+	while (*p && strchr("-+ #0'", *p))
+		p++;
+	if (*p == '*') {
+		s->stars++;
+		p++;
+	} else
+		while (isdigit((unsigned char)*p))
+			p++;
+	if (*p == '.') {
+		p++;
+		if (*p == '*') {
+			s->stars++;
+			s->prec = -2;
+			p++;
+		} else
+			s->prec = strtol(p, (char **)&p, 10);
+	}
+	switch (*p) {
+		case 'h':
+			p += p[1] == 'h' ? 2 : 1;
+			break;
+		case 'l':
+			size = p[1] == 'l' ? _AVR_LOG_LLONG : _AVR_LOG_LONG;
+			p += p[1] == 'l' ? 2 : 1;
+			break;
+		case 'j':
+			size = _AVR_LOG_LLONG;
+			p++;
+			break;
+		case 'z':
+		case 't':
+			size = _AVR_LOG_SIZE;
+			p++;
+			break;
+		case 'L':
+			size = _AVR_LOG_BAD;
+			p++;
+			break;
+	}
+	switch (*p) {
+		case '%':
+			s->arg = _AVR_LOG_NONE;
+			break;
+		case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+			s->arg = size ? size : _AVR_LOG_INT;
+			break;
+		case 'c':
+			s->arg = size ? _AVR_LOG_BAD : _AVR_LOG_INT;
+			break;
+		case 'e': case 'E': case 'f': case 'F':
+		case 'g': case 'G': case 'a': case 'A':
+			s->arg = size == _AVR_LOG_BAD ? _AVR_LOG_BAD : _AVR_LOG_DOUBLE;
+			break;
+		case 's':
+			s->arg = size ? _AVR_LOG_BAD : _AVR_LOG_STR;
+			break;
+		case 'p':
+			s->arg = _AVR_LOG_PTR;
+			break;
+		default:	// %n, wide strings and the unknown
+			s->arg = _AVR_LOG_BAD;
+			break;
+	}
+	s->len = p - f + (*p ? 1 : 0);
+}
+
+/*
+ * Take the arguments of 'format' from 'ap'. Strings are left as pointers,
+ * with a bit set in 'strings' and their length in 'len'.
+ * Returns the number of arguments, -1 when they can't be kept.
+ */
+static int
+_avr_log_args(
+		const char * f,
+		va_list ap,
+		_avr_log_arg_t * arg,
+		uint32_t * strings,
+		uint32_t * len)
+{
+	_avr_log_spec_t sp;
+	int n = 0;
+
+	*strings = 0;
+	while ((f = strchr(f, '%'))) {
+		_avr_log_spec(f, &sp);
+		f += sp.len;
+		if (sp.arg == _AVR_LOG_BAD ||
+				n + sp.stars + (sp.arg != _AVR_LOG_NONE) > AVR_LOG_ARGS)
+			return -1;
+		for (int i = 0; i < sp.stars; i++)
+			arg[n++].u = va_arg(ap, int);
+		switch (sp.arg) {
+			case _AVR_LOG_INT:
+				arg[n++].u = va_arg(ap, int);
+				break;
+			case _AVR_LOG_LONG:
+				arg[n++].u = va_arg(ap, long);
+				break;
+			case _AVR_LOG_LLONG:
+				arg[n++].u = va_arg(ap, long long);
+				break;
+			case _AVR_LOG_SIZE:
+				arg[n++].u = va_arg(ap, size_t);
+				break;
+			case _AVR_LOG_PTR:
+				arg[n++].p = va_arg(ap, void *);
+				break;
+			case _AVR_LOG_DOUBLE:
+				arg[n++].d = va_arg(ap, double);
+				break;
+			case _AVR_LOG_STR: {
+				const char * s = va_arg(ap, const char *);
+				int prec = sp.prec == -2 ? (int)arg[n - 1].u : sp.prec;
+
+				if (!s)
+					s = "(null)";
+				// it needs not be terminated when there is a precision
+				len[n] = prec >= 0 ? strnlen(s, prec) : strlen(s);
+				*strings |= 1 << n;
+				arg[n++].p = s;
+			}	break;
+		}
+	}
+	return n;
+}
+
+static _avr_log_record_t *
+_avr_log_reserve(
+		avr_log_t * l,
+		uint32_t size,
+		uint32_t * total)
+{
+	uint32_t pos = l->head & (l->size - 1);
+	uint32_t skip = pos + size > l->size ? l->size - pos : 0;
+
+	if (l->head + skip + size - __atomic_load_n(&l->tail, __ATOMIC_ACQUIRE) >
+			l->size) {
+		l->dropped++;
+		return NULL;
+	}
+	if (skip) {
+		((_avr_log_record_t *)(l->ring + pos))->size = 0;
+		pos = 0;
+	}
+	*total = skip + size;
+	return (_avr_log_record_t *)(l->ring + pos);
+}
+
+static void
+_avr_log_publish(
+		avr_log_t * l,
+		uint32_t total)
+{
+	__atomic_store_n(&l->head, l->head + total, __ATOMIC_RELEASE);
+	// only make a system call when the writer waits
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&l->idle, __ATOMIC_RELAXED)) {
+		pthread_mutex_lock(&l->lock);
+		pthread_cond_signal(&l->wake);
+		pthread_mutex_unlock(&l->lock);
+	}
+}
+
+static void
+_avr_log_logger(
+		avr_t * avr,
+		const int level,
+		const char * format,
+		va_list ap)
+{
+	avr_log_t * l = avr->log_ring;
+	_avr_log_arg_t arg[AVR_LOG_ARGS];
+	_avr_log_record_t * r;
+	uint32_t len[AVR_LOG_ARGS];
+	uint32_t strings, size = 0, total;
+	int count;
+	va_list aq;
+
+	if (avr->log < level)
+		return;
+	if (!pthread_equal(pthread_self(), l->owner)) {
+		avr_logger_p logger = l->logger ? l->logger : avr_global_logger_get();
+
+		logger(avr, level, format, ap);
+		return;
+	}
+	va_copy(aq, ap);
+	count = _avr_log_args(format, aq, arg, &strings, len);
+	va_end(aq);
+	if (count >= 0) {
+		size = sizeof(*r) + count * sizeof(arg[0]);
+		for (int i = 0; i < count; i++)
+			if (strings & (1 << i))
+				size += len[i] + 1;
+		size = (size + 7) & ~7;
+	}
+	if (count >= 0 && size <= l->size / 4) {
+		char * dst;
+
+		if (!(r = _avr_log_reserve(l, size, &total)))
+			return;
+		r->format = format;
+		dst = (char *)(r->arg + count);
+		for (int i = 0; i < count; i++) {
+			if (!(strings & (1 << i))) {
+				r->arg[i] = arg[i];
+				continue;
+			}
+			memcpy(dst, arg[i].p, len[i]);
+			dst[len[i]] = 0;
+			r->arg[i].u = dst - (char *)r;
+			dst += len[i] + 1;
+		}
+	} else {
+		int text;
+
+		va_copy(aq, ap);
+		text = vsnprintf(NULL, 0, format, aq);
+		va_end(aq);
+		if (text < 0)
+			return;
+		if (text > l->size / 4 - sizeof(*r) - 8)
+			text = l->size / 4 - sizeof(*r) - 8;
+		size = (sizeof(*r) + text + 1 + 7) & ~7;
+		if (!(r = _avr_log_reserve(l, size, &total)))
+			return;
+		r->format = NULL;
+		vsnprintf((char *)r->arg, text + 1, format, ap);
+	}
+	r->size = size;
+	r->level = level;
+	r->cycle = avr->cycle;
+	_avr_log_publish(l, total);
+}
+
+#define _AVR_LOG_PRINT(_v) \
+	do { \
+		if (sp.stars == 0) fprintf(out, spec, _v); \
+		else if (sp.stars == 1) fprintf(out, spec, st[0], _v); \
+		else fprintf(out, spec, st[0], st[1], _v); \
+	} while (0)
+
+static void
+_avr_log_write(
+		avr_log_t * l,
+		const _avr_log_record_t * r)
+{
+	int s = !l->out && r->level >= LOG_ERROR;
+	FILE * out = l->out ? l->out : s ? stderr : stdout;
+	const char * f = r->format ? r->format : (const char *)r->arg;
+	const _avr_log_arg_t * a = r->arg;
+	_avr_log_spec_t sp;
+	char spec[32];
+	int st[2];
+
+	while (*f) {
+		size_t n;
+
+		if (l->bol[s]) {
+			fprintf(out, "[%" PRIu64 "] ", (uint64_t)r->cycle);
+			l->bol[s] = 0;
+		}
+		if ((n = strcspn(f, r->format ? "%\n" : "\n"))) {
+			fwrite(f, 1, n, out);
+			f += n;
+			continue;
+		}
+		if (*f == '\n') {
+			fputc('\n', out);
+			l->bol[s] = 1;
+			f++;
+			continue;
+		}
+		_avr_log_spec(f, &sp);
+		if (sp.len >= sizeof(spec)) {	// kept, but can't be printed
+			a += sp.stars + (sp.arg != _AVR_LOG_NONE);
+			f += sp.len;
+			continue;
+		}
+		memcpy(spec, f, sp.len);
+		spec[sp.len] = 0;
+		f += sp.len;
+		for (int i = 0; i < sp.stars; i++)
+			st[i] = (int)(a++)->u;
+		switch (sp.arg) {
+			case _AVR_LOG_NONE:
+				fputc('%', out);
+				break;
+			case _AVR_LOG_INT:
+				_AVR_LOG_PRINT((int)a->u);
+				break;
+			case _AVR_LOG_LONG:
+				_AVR_LOG_PRINT((long)a->u);
+				break;
+			case _AVR_LOG_LLONG:
+				_AVR_LOG_PRINT((long long)a->u);
+				break;
+			case _AVR_LOG_SIZE:
+				_AVR_LOG_PRINT((size_t)a->u);
+				break;
+			case _AVR_LOG_PTR:
+				_AVR_LOG_PRINT(a->p);
+				break;
+			case _AVR_LOG_DOUBLE:
+				_AVR_LOG_PRINT(a->d);
+				break;
+			case _AVR_LOG_STR:
+				_AVR_LOG_PRINT((const char *)r + a->u);
+				break;
+		}
+		if (sp.arg != _AVR_LOG_NONE)
+			a++;
+	}
+}
+
+static void *
+_avr_log_writer(
+		void * param)
+{
+	avr_log_t * l = param;
+	uint64_t tail = l->tail;
+
+	for (;;) {
+		_avr_log_record_t * r;
+		uint32_t pos;
+
+		if (__atomic_load_n(&l->head, __ATOMIC_ACQUIRE) == tail) {
+			int quit;
+
+			fflush(l->out ? l->out : stdout);
+			if (!l->out)
+				fflush(stderr);
+			pthread_mutex_lock(&l->lock);
+			__atomic_store_n(&l->idle, 1, __ATOMIC_RELAXED);
+			__atomic_thread_fence(__ATOMIC_SEQ_CST);
+			while (!l->quit &&
+					__atomic_load_n(&l->head, __ATOMIC_ACQUIRE) == tail)
+				pthread_cond_wait(&l->wake, &l->lock);
+			__atomic_store_n(&l->idle, 0, __ATOMIC_RELAXED);
+			quit = l->quit &&
+					__atomic_load_n(&l->head, __ATOMIC_ACQUIRE) == tail;
+			pthread_mutex_unlock(&l->lock);
+			if (quit)
+				break;
+			continue;
+		}
+		pos = tail & (l->size - 1);
+		r = (_avr_log_record_t *)(l->ring + pos);
+		if (r->size) {
+			_avr_log_write(l, r);
+			tail += r->size;
+		} else
+			tail += l->size - pos;
+		__atomic_store_n(&l->tail, tail, __ATOMIC_RELEASE);
+	}
+	return NULL;
+}
+
+int
+avr_log_start(
+		avr_t * avr,
+		FILE * out,
+		uint32_t size)
+{
+	avr_log_t * l;
+
+	if (avr->log_ring)
+		return 0;
+	if (!size)
+		size = AVR_LOG_RING;
+	// a power of two, with room for a few records
+	while (size & (size - 1))
+		size &= size - 1;
+	if (size < 4096)
+		size = 4096;
+	l = calloc(1, sizeof(*l));
+	if (!l)
+		return -1;
+	l->ring = malloc(size);
+	if (!l->ring) {
+		free(l);
+		return -1;
+	}
+	l->avr = avr;
+	l->out = out;
+	l->size = size;
+	l->bol[0] = l->bol[1] = 1;
+	l->owner = pthread_self();
+	pthread_mutex_init(&l->lock, NULL);
+	pthread_cond_init(&l->wake, NULL);
+	if (pthread_create(&l->thread, NULL, _avr_log_writer, l)) {
+		pthread_cond_destroy(&l->wake);
+		pthread_mutex_destroy(&l->lock);
+		free(l->ring);
+		free(l);
+		return -1;
+	}
+	l->logger = avr->logger;
+	avr->log_ring = l;
+	avr_logger_set(avr, _avr_log_logger);
+	return 0;
+}
+
+void
+avr_log_stop(
+		avr_t * avr)
+{
+	avr_log_t * l = avr->log_ring;
+
+	if (!l)
+		return;
+	pthread_mutex_lock(&l->lock);
+	l->quit = 1;
+	pthread_cond_signal(&l->wake);
+	pthread_mutex_unlock(&l->lock);
+	pthread_join(l->thread, NULL);
+	pthread_cond_destroy(&l->wake);
+	pthread_mutex_destroy(&l->lock);
+	avr_logger_set(avr, l->logger);
+	avr->log_ring = NULL;
+	if (l->dropped)
+		AVR_LOG(avr, LOG_WARNING, "LOG: %" PRIu64 " messages dropped\n",
+				l->dropped);
+	free(l->ring);
+	free(l);
+}
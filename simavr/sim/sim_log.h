@@ -0,0 +1,91 @@
+/*
+	sim_log.h
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Asynchronous logging. Once started, the messages of an AVR are not
+ * formatted by the thread running it: the logger copies the format
+ * pointer, the cycle and the arguments into a ring, strings included,
+ * and a writer thread formats them, each line prefixed with the cycle.
+ * The running thread takes no lock and makes no system call, unless the
+ * writer is waiting for messages and has to be woken up.
+ *
+ * Formats must be string constants, as AVR_LOG() ones are. Messages
+ * logged from other threads, and those with conversions the ring doesn't
+ * know about, are formatted on the spot; when the ring is full, messages
+ * are dropped and counted rather than making the AVR wait.
+ *
+ * The writer has written everything when avr_log_stop() returns, which
+ * avr_terminate() calls.
+ */
+
+#ifndef __SIM_LOG_H__
+#define __SIM_LOG_H__
+
+#include <stdio.h>
+#include <pthread.h>
+#include "sim_avr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AVR_LOG_RING		(256 * 1024)	// default size, in bytes
+#define AVR_LOG_ARGS		16				// arguments of one message
+
+typedef struct avr_log_t {
+	avr_t *				avr;
+	avr_logger_p		logger;		// the one before, for other threads
+	FILE *				out;		// NULL for stdout and stderr
+	int					bol[2];		// at the start of a line, on each
+	pthread_t			owner;		// the thread running the AVR
+	pthread_t			thread;
+	pthread_mutex_t		lock;
+	pthread_cond_t		wake;
+	int					idle;		// the writer is waiting for messages
+	int					quit;
+
+	uint64_t			head;		// written up to, by the running thread
+	uint64_t			tail;		// read up to, by the writer
+	uint64_t			dropped;
+	uint32_t			size;		// a power of two
+	uint8_t *			ring;
+} avr_log_t;
+
+/*
+ * Start logging the messages of 'avr' to 'out', or to stdout and stderr
+ * like the default logger when NULL, through a ring of 'size' bytes, 0
+ * for AVR_LOG_RING. Must be called by the thread running 'avr'.
+ */
+int
+avr_log_start(
+		avr_t * avr,
+		FILE * out,
+		uint32_t size);
+// Write what is left and go back to the logger from before.
+void
+avr_log_stop(
+		avr_t * avr);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* __SIM_LOG_H__ */
@@ -0,0 +1,240 @@
+/*
+	sim_pace.c
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+#include "sim_pace.h"
+#include "sim_time.h"
+#include "sim_post.h"
+
+static uint64_t
+_avr_pace_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// When 'cycle' is due on the wall clock
+static uint64_t
+_avr_pace_due(
+		avr_t * avr,
+		avr_pace_t * p,
+		avr_cycle_count_t cycle)
+{
+	double ns = (double)(cycle - p->start_cycle) * 1e9 /
+					avr->frequency / p->speed;
+
+	return p->start_ns + (uint64_t)ns;
+}
+
+static void
+_avr_pace_rebase(
+		avr_t * avr,
+		avr_pace_t * p)
+{
+	p->start_ns = _avr_pace_now();
+	p->start_cycle = avr->cycle;
+}
+
+// Wait for 'cycle' to be due, or note how late it is.
+static void
+_avr_pace_wait(
+		avr_t * avr,
+		avr_pace_t * p,
+		avr_cycle_count_t cycle)
+{
+	uint64_t due, now;
+
+	if (p->speed <= 0 || !avr->frequency)
+		return;
+	due = _avr_pace_due(avr, p, cycle);
+	now = _avr_pace_now();
+	p->stats.checks++;
+	p->stats.lag_ns = (int64_t)(now - due);
+	if (now >= due) {
+		p->late++;
+		p->late_ns += now - due;
+		if (p->stats.lag_ns > p->stats.max_lag_ns)
+			p->stats.max_lag_ns = p->stats.lag_ns;
+		// too far behind to catch up, start over from here
+		if (now - due > p->max_lag_ns) {
+			p->start_ns = now;
+			p->start_cycle = cycle;
+			p->stats.resyncs++;
+		}
+		return;
+	}
+	p->stats.sleeps++;
+	if (avr->post) {
+		avr_post_sleep(avr, (due - now) / 1000);	// posting wakes it up
+	} else {
+#ifdef __APPLE__
+		struct timespec ts = {
+				(due - now) / 1000000000, (due - now) % 1000000000 };
+
+		nanosleep(&ts, NULL);
+#else
+		struct timespec ts = { due / 1000000000, due % 1000000000 };
+
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+					&ts, NULL) == EINTR)
+			;
+#endif
+	}
+	now = _avr_pace_now();
+	if (now > due) {
+		p->jitter_ns += now - due;
+		if (now - due > p->stats.max_jitter_ns)
+			p->stats.max_jitter_ns = now - due;
+	}
+}
+
+static avr_cycle_count_t
+_avr_pace_timer(
+		avr_t * avr,
+		avr_cycle_count_t when,
+		void * param)
+{
+	avr_pace_t * p = param;
+
+	_avr_pace_wait(avr, p, when);
+	return when + avr_usec_to_cycles(avr, AVR_PACE_CHECK_US);
+}
+
+int
+avr_pace_start(
+		avr_t * avr,
+		double speed)
+{
+	avr_pace_t * p = avr->pace;
+
+	if (!p) {
+		p = calloc(1, sizeof(*p));
+		if (!p)
+			return -1;
+		p->max_lag_ns = AVR_PACE_MAX_LAG_NS;
+		avr->pace = p;
+	}
+	p->speed = speed > 0 ? speed : 0;
+	avr_pace_reset(avr);
+	return 0;
+}
+
+void
+avr_pace_set_speed(
+		avr_t * avr,
+		double speed)
+{
+	avr_pace_t * p = avr->pace;
+
+	if (!p)
+		return;
+	p->speed = speed > 0 ? speed : 0;
+	_avr_pace_rebase(avr, p);
+}
+
+void
+avr_pace_reset(
+		avr_t * avr)
+{
+	avr_pace_t * p = avr->pace;
+
+	if (!p)
+		return;
+	_avr_pace_rebase(avr, p);
+	avr_cycle_timer_register_usec(avr, AVR_PACE_CHECK_US, _avr_pace_timer, p);
+}
+
+void
+avr_pace_sleep(
+		avr_t * avr,
+		avr_cycle_count_t how_long)
+{
+	_avr_pace_wait(avr, avr->pace, avr->cycle + how_long);
+}
+
+avr_cycle_count_t
+avr_pace_cycle(
+		avr_t * avr)
+{
+	avr_pace_t * p = avr->pace;
+	uint64_t now = _avr_pace_now();
+
+	if (p->speed <= 0 || now <= p->start_ns)
+		return p->start_cycle;
+	return p->start_cycle + (avr_cycle_count_t)((double)(now - p->start_ns) *
+					avr->frequency * p->speed / 1e9);
+}
+
+int
+avr_pace_get_stats(
+		avr_t * avr,
+		avr_pace_stats_t * s)
+{
+	avr_pace_t * p = avr->pace;
+
+	if (!p)
+		return -1;
+	*s = p->stats;
+	s->mean_lag_ns = p->late ? p->late_ns / p->late : 0;
+	s->mean_jitter_ns = p->stats.sleeps ? p->jitter_ns / p->stats.sleeps : 0;
+	return 0;
+}
+
+void
+avr_pace_report(
+		avr_t * avr,
+		FILE * out)
+{
+	avr_pace_stats_t s;
+
+	if (avr_pace_get_stats(avr, &s))
+		return;
+	if (avr->pace->speed <= 0) {
+		fprintf(out, "Pacing: none\n");
+		return;
+	}
+	fprintf(out, "Pacing: %gx, %" PRIu64 " checks, %" PRIu64 " waited, %"
+			PRIu64 " started over\n", avr->pace->speed,
+			s.checks, s.sleeps, s.resyncs);
+	fprintf(out, "  lag: last %.3f ms, mean %.3f ms, max %.3f ms\n",
+			s.lag_ns / 1e6, s.mean_lag_ns / 1e6, s.max_lag_ns / 1e6);
+	fprintf(out, "  jitter: mean %.3f ms, max %.3f ms\n",
+			s.mean_jitter_ns / 1e6, s.max_jitter_ns / 1e6);
+}
+
+void
+avr_pace_stop(
+		avr_t * avr)
+{
+	avr_pace_t * p = avr->pace;
+
+	if (!p)
+		return;
+	avr_cycle_timer_cancel(avr, _avr_pace_timer, p);
+	avr->pace = NULL;
+	free(p);
+}
@@ -0,0 +1,118 @@
+/*
+	sim_pace.h
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Real-time pacing. Without it avr_callback_sleep_raw() only waits out
+ * sleep periods, so busy firmware runs as fast as the host can go. With
+ * avr->pace the simulated time is held to the wall clock times a speed
+ * factor, running or sleeping: a cycle timer checks it every
+ * AVR_PACE_CHECK_US of simulated time, and sleeps wait to the same
+ * absolute deadlines, with clock_nanosleep(TIMER_ABSTIME) or, with
+ * avr->post, avr_post_sleep() so that posted IRQs still wake it.
+ *
+ * A speed of 0 runs flat out, sleep periods included. When the host
+ * falls more than 'max_lag_ns' behind, pacing starts over from there
+ * rather than running flat out to catch up.
+ *
+ * Lag is how far behind its deadline the simulation is at a check, and
+ * jitter how late a sleep wakes up after its deadline.
+ */
+
+#ifndef __SIM_PACE_H__
+#define __SIM_PACE_H__
+
+#include <stdio.h>
+#include "sim_avr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AVR_PACE_CHECK_US	1000			// simulated time between checks
+#define AVR_PACE_MAX_LAG_NS	100000000		// 100ms
+
+typedef struct avr_pace_stats_t {
+	uint64_t		checks;
+	uint64_t		sleeps;			// checks and sleeps that did wait
+	uint64_t		resyncs;		// times it started over
+	int64_t			lag_ns;			// at the last check, < 0 when early
+	int64_t			max_lag_ns;
+	uint64_t		mean_lag_ns;	// of the checks that were late
+	uint64_t		mean_jitter_ns;
+	uint64_t		max_jitter_ns;
+} avr_pace_stats_t;
+
+typedef struct avr_pace_t {
+	double			speed;			// 1.0 is real time, 0 flat out
+	uint64_t		max_lag_ns;
+	// the reference, simulated time is measured from
+	uint64_t		start_ns;
+	avr_cycle_count_t start_cycle;
+
+	avr_pace_stats_t stats;
+	uint64_t		late, late_ns;	// checks that were late, and by how much
+	uint64_t		jitter_ns;		// sum, over the sleeps
+} avr_pace_t;
+
+// Start pacing avr at 'speed' times real time, 0 for flat out.
+int
+avr_pace_start(
+		avr_t * avr,
+		double speed);
+// Change the speed from now on.
+void
+avr_pace_set_speed(
+		avr_t * avr,
+		double speed);
+// Start over from the current cycle, called by avr_reset()
+void
+avr_pace_reset(
+		avr_t * avr);
+// Sleep for 'how_long' cycles, called by avr_callback_sleep_raw()
+void
+avr_pace_sleep(
+		avr_t * avr,
+		avr_cycle_count_t how_long);
+
+// The cycle the wall clock is at now, for avr_post_slept()
+avr_cycle_count_t
+avr_pace_cycle(
+		avr_t * avr);
+
+// Fill 's', returns -1 if avr is not paced.
+int
+avr_pace_get_stats(
+		avr_t * avr,
+		avr_pace_stats_t * s);
+void
+avr_pace_report(
+		avr_t * avr,
+		FILE * out);
+
+void
+avr_pace_stop(
+		avr_t * avr);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* __SIM_PACE_H__ */
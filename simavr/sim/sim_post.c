@@ -0,0 +1,287 @@
+/*
+	sim_post.c
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE		// ppoll()
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+#include "sim_avr.h"
+#include "sim_post.h"
+#include "sim_pace.h"
+
+int
+avr_post_start(
+		avr_t * avr)
+{
+	avr_post_t * p;
+
+	if (avr->post)
+		return 0;
+	p = calloc(1, sizeof(*p));
+	if (!p)
+		return -1;
+#ifdef __linux__
+	p->fd[0] = p->fd[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (p->fd[0] < 0) {
+		free(p);
+		return -1;
+	}
+#else
+	if (pipe(p->fd)) {
+		free(p);
+		return -1;
+	}
+	for (int i = 0; i < 2; i++)
+		fcntl(p->fd[i], F_SETFL, fcntl(p->fd[i], F_GETFL) | O_NONBLOCK);
+#endif
+	p->avr = avr;
+	for (uint32_t i = 0; i < AVR_POST_QUEUE; i++)
+		p->queue[i].seq = i;
+	avr->post = p;
+	return 0;
+}
+
+static avr_cycle_count_t
+_avr_post_later_timer(
+		avr_t * avr,
+		avr_cycle_count_t when,
+		void * param);
+
+void
+avr_post_stop(
+		avr_t * avr)
+{
+	avr_post_t * p = avr->post;
+
+	if (!p)
+		return;
+	avr_cycle_timer_cancel(avr, _avr_post_later_timer, p);
+	close(p->fd[0]);
+	if (p->fd[1] != p->fd[0])
+		close(p->fd[1]);
+	free(p->later);
+	free(p);
+	avr->post = NULL;
+}
+
+int
+avr_irq_post_at(
+		avr_t * avr,
+		avr_irq_t * irq,
+		uint32_t value,
+		avr_cycle_count_t when)
+{
+	avr_post_t * p = avr->post;
+	avr_post_event_t * e;
+	uint32_t pos;
+
+	if (!p || !irq)
+		return -1;
+	/*
+	 * Each slot says which turn of the queue it is free for: posting
+	 * threads race for the tail, and the winner owns the slot until it
+	 * hands it to the running thread.
+	 */
+	pos = __atomic_load_n(&p->tail, __ATOMIC_RELAXED);
+	for (;;) {
+		int32_t diff;
+
+		e = &p->queue[pos % AVR_POST_QUEUE];
+		diff = (int32_t)(__atomic_load_n(&e->seq, __ATOMIC_ACQUIRE) - pos);
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&p->tail, &pos, pos + 1, 1,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0)
+			return -1;		// full
+		else
+			pos = __atomic_load_n(&p->tail, __ATOMIC_RELAXED);
+	}
+	e->irq = irq;
+	e->value = value;
+	e->when = when;
+	__atomic_store_n(&e->seq, pos + 1, __ATOMIC_RELEASE);
+
+	// only make a system call when the AVR sleeps
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&p->sleeping, __ATOMIC_RELAXED)) {
+		uint64_t one = 1;
+
+		if (write(p->fd[1], &one, sizeof(one)) < 0) {
+			// it already has a wake-up waiting
+		}
+	}
+	return 0;
+}
+
+int
+avr_irq_post(
+		avr_t * avr,
+		avr_irq_t * irq,
+		uint32_t value)
+{
+	return avr_irq_post_at(avr, irq, value, 0);
+}
+
+static int
+_avr_post_pending(
+		avr_post_t * p)
+{
+	avr_post_event_t * e = &p->queue[p->head % AVR_POST_QUEUE];
+
+	return __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE) == p->head + 1;
+}
+
+// Keep a value for later, after the ones for the same cycle or before.
+static void
+_avr_post_keep(
+		avr_post_t * p,
+		avr_post_event_t * e)
+{
+	int i;
+
+	if (p->later_count == p->later_size) {
+		int size = p->later_size ? p->later_size * 2 : 16;
+		avr_post_event_t * l = realloc(p->later, size * sizeof(*l));
+
+		if (!l) {
+			AVR_LOG(p->avr, LOG_ERROR, "POST: out of memory\n");
+			return;
+		}
+		p->later = l;
+		p->later_size = size;
+	}
+	for (i = p->later_count; i > 0 && p->later[i - 1].when > e->when; i--)
+		p->later[i] = p->later[i - 1];
+	p->later[i] = *e;
+	p->later_count++;
+}
+
+static avr_cycle_count_t
+_avr_post_later_timer(
+		avr_t * avr,
+		avr_cycle_count_t when,
+		void * param)
+{
+	avr_post_t * p = param;
+	int n = 0;
+
+	while (n < p->later_count && p->later[n].when <= avr->cycle)
+		n++;
+	for (int i = 0; i < n; i++)
+		avr_raise_irq(p->later[i].irq, p->later[i].value);
+	p->later_count -= n;
+	memmove(p->later, p->later + n, p->later_count * sizeof(*p->later));
+	return p->later_count ? p->later[0].when : 0;
+}
+
+void
+avr_post_reset(
+		avr_t * avr,
+		avr_cycle_count_t cycle)
+{
+	avr_post_t * p = avr->post;
+
+	// the reset dropped the timer
+	for (int i = 0; i < p->later_count; i++)
+		p->later[i].when = p->later[i].when > cycle ?
+				p->later[i].when - cycle : 0;
+	if (p->later_count)
+		avr_cycle_timer_register(avr, p->later[0].when - avr->cycle,
+				_avr_post_later_timer, p);
+}
+
+void
+avr_post_drain(
+		avr_t * avr)
+{
+	avr_post_t * p = avr->post;
+	int kept = 0;
+
+	while (_avr_post_pending(p)) {
+		avr_post_event_t e = p->queue[p->head % AVR_POST_QUEUE];
+
+		// the slot is free for the next turn of the queue
+		__atomic_store_n(&p->queue[p->head % AVR_POST_QUEUE].seq,
+				p->head + AVR_POST_QUEUE, __ATOMIC_RELEASE);
+		p->head++;
+		if (e.when > avr->cycle) {
+			_avr_post_keep(p, &e);
+			kept = 1;
+		} else
+			avr_raise_irq(e.irq, e.value);
+	}
+	if (kept)
+		avr_cycle_timer_register(avr, p->later[0].when - avr->cycle,
+				_avr_post_later_timer, p);
+}
+
+void
+avr_post_sleep(
+		avr_t * avr,
+		uint64_t usec)
+{
+	avr_post_t * p = avr->post;
+	struct pollfd pfd = { .fd = p->fd[0], .events = POLLIN };
+#ifdef __linux__
+	struct timespec ts = { usec / 1000000, usec % 1000000 * 1000 };
+#endif
+	uint64_t buf;
+
+	__atomic_store_n(&p->sleeping, 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (_avr_post_pending(p))
+		p->woken = 1;
+#ifdef __linux__
+	else if (ppoll(&pfd, 1, &ts, NULL) > 0)
+#else
+	else if (poll(&pfd, 1, (usec + 999) / 1000) > 0)
+#endif
+		p->woken = 1;
+	__atomic_store_n(&p->sleeping, 0, __ATOMIC_RELAXED);
+	while (read(p->fd[0], &buf, sizeof(buf)) > 0)
+		;
+}
+
+avr_cycle_count_t
+avr_post_slept(
+		avr_t * avr,
+		avr_cycle_count_t how_long)
+{
+	avr_post_t * p = avr->post;
+	avr_cycle_count_t now;
+
+	if (!p->woken)
+		return how_long;
+	p->woken = 0;
+	if (avr->pace)
+		now = avr_pace_cycle(avr);
+	else
+		now = avr_get_time_stamp(avr) / 1000 * avr->frequency / 1000000;
+	if (now <= avr->cycle)
+		return 0;
+	return now - avr->cycle < how_long ? now - avr->cycle : how_long;
+}
@@ -0,0 +1,133 @@
+/*
+	sim_post.h
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Raising IRQs from other threads.
+ *
+ * avr_raise_irq() must be called by the thread running the AVR. Other
+ * threads, reading a pty or a GUI, can post values instead: they are
+ * queued without locks and the running thread raises them between two
+ * instructions, or at a given cycle. Posting wakes the AVR up when it is
+ * sleeping in real time, so input is seen as soon as it comes in.
+ *
+ * The queue has to be started by the running thread, before the others
+ * post to it, and the others must have stopped posting when the AVR is
+ * terminated.
+ */
+
+#ifndef __SIM_POST_H__
+#define __SIM_POST_H__
+
+#include "sim_avr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AVR_POST_QUEUE		1024	// values waiting to be raised
+
+typedef struct avr_post_event_t {
+	uint32_t			seq;		// where the queue is with this slot
+	uint32_t			value;
+	avr_irq_t *			irq;
+	avr_cycle_count_t	when;		// 0 for as soon as possible
+} avr_post_event_t;
+
+typedef struct avr_post_t {
+	avr_t *				avr;
+	// posting threads take slots here
+	uint32_t			tail;
+	// the running thread takes values here
+	uint32_t			head;
+	int					sleeping;	// in avr_post_sleep()
+	int					woken;		// and posting woke it up
+	int					fd[2];		// to wake it up, eventfd on Linux
+	// values for later cycles, in order
+	avr_post_event_t *	later;
+	int					later_count, later_size;
+	avr_post_event_t	queue[AVR_POST_QUEUE];
+} avr_post_t;
+
+// Start the queue, returns -1 on error.
+int
+avr_post_start(
+		avr_t * avr);
+
+void
+avr_post_stop(
+		avr_t * avr);
+
+/*
+ * Queue 'value' to be raised on 'irq' of 'avr' at the next instruction.
+ * Can be called from any thread. Returns -1 when the queue is full or
+ * not started.
+ */
+int
+avr_irq_post(
+		avr_t * avr,
+		avr_irq_t * irq,
+		uint32_t value);
+
+// Same as avr_irq_post(), raising it at cycle 'when' or just after.
+int
+avr_irq_post_at(
+		avr_t * avr,
+		avr_irq_t * irq,
+		uint32_t value,
+		avr_cycle_count_t when);
+
+/*
+ * Carry on from the cycle count starting over, called by avr_reset() with
+ * the cycle it was at: values for later stay as far away.
+ */
+void
+avr_post_reset(
+		avr_t * avr,
+		avr_cycle_count_t cycle);
+
+// Raise what was posted. Called by the run loops.
+void
+avr_post_drain(
+		avr_t * avr);
+
+/*
+ * Sleep up to 'usec' of real time, unless something is posted. Called by
+ * avr_callback_sleep_raw().
+ */
+void
+avr_post_sleep(
+		avr_t * avr,
+		uint64_t usec);
+
+/*
+ * Cycles to count for a sleep of 'how_long' cycles: less when it was
+ * cut short by posting, what the clock says has gone by.
+ */
+avr_cycle_count_t
+avr_post_slept(
+		avr_t * avr,
+		avr_cycle_count_t how_long);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* __SIM_POST_H__ */
@@ -0,0 +1,496 @@
+/*
+	sim_record.c
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim_avr.h"
+#include "sim_record.h"
+
+/*
+ * File format: the magic, then unsigned LEB128 numbers: version, MCU
+ * name, the slots (IRQ pool index and name), and the events as the
+ * zigzag coded cycle difference from the previous one (a reset goes back
+ * to zero), the slot and the value shifted left once, 'floating' in bit 0.
+ * A reset is logged as an event of slot AVR_RECORD_RESET.
+ * Strings are a length and the bytes.
+ */
+#define AVR_RECORD_MAGIC	"simavrRL"
+#define AVR_RECORD_VERSION	1
+
+avr_record_t *
+avr_record_start(
+		avr_t * avr)
+{
+	if (!avr->record) {
+		avr->record = calloc(1, sizeof(*avr->record));
+		if (avr->record) {
+			avr->record->avr = avr;
+			pthread_mutex_init(&avr->record->lock, NULL);
+		}
+	}
+	return avr->record;
+}
+
+void
+avr_record_input(
+		avr_irq_t * irq)
+{
+	irq->flags |= IRQ_FLAG_RECORD;
+}
+
+static avr_irq_t *
+_avr_record_slot_irq(
+		avr_record_t * r,
+		avr_record_slot_t * s)
+{
+	avr_irq_pool_t * pool = &r->avr->irq_pool;
+
+	if (s->irq || s->missing)
+		return s->irq;
+	if (s->index < pool->count && pool->irq[s->index]) {
+		const char * name = pool->irq[s->index]->name;
+
+		if (!strcmp(name ? name : "", s->name ? s->name : ""))
+			s->irq = pool->irq[s->index];
+	}
+	if (!s->irq) {
+		AVR_LOG(r->avr, LOG_WARNING, "RECORD: IRQ %u '%s' not found\n",
+				s->index, s->name ? s->name : "");
+		s->missing = 1;
+	}
+	return s->irq;
+}
+
+static inline int
+_avr_record_waiting(
+		avr_record_t * r)
+{
+	return r->next >= r->count || r->event[r->next].slot == AVR_RECORD_RESET;
+}
+
+// Raise the events that are due, in the order they were logged.
+static void
+_avr_record_inject_due(
+		avr_record_t * r)
+{
+	avr_t * avr = r->avr;
+
+	while (!_avr_record_waiting(r) && r->event[r->next].when <= avr->cycle) {
+		avr_record_event_t * e = &r->event[r->next++];
+		avr_irq_t * irq = _avr_record_slot_irq(r, &r->slot[e->slot]);
+
+		if (!irq)
+			continue;
+		r->injecting++;
+		avr_raise_irq_float(irq, e->value, e->floating);
+		r->injecting--;
+	}
+}
+
+static avr_cycle_count_t
+_avr_record_inject(
+		avr_t * avr,
+		avr_cycle_count_t when,
+		void * param)
+{
+	avr_record_t * r = param;
+
+	_avr_record_inject_due(r);
+	return _avr_record_waiting(r) ? 0 : r->event[r->next].when;
+}
+
+static void
+_avr_record_schedule(
+		avr_record_t * r)
+{
+	avr_t * avr = r->avr;
+
+	if (!_avr_record_waiting(r)) {
+		avr_cycle_count_t when = r->event[r->next].when;
+
+		avr_cycle_timer_register(avr,
+				when > avr->cycle ? when - avr->cycle : 0,
+				_avr_record_inject, r);
+	} else
+		avr_cycle_timer_cancel(avr, _avr_record_inject, r);
+}
+
+void
+avr_record_replay(
+		avr_t * avr,
+		uint32_t index)
+{
+	avr_record_t * r = avr->record;
+
+	if (!r)
+		return;
+	r->replaying = 1;
+	r->thread = pthread_self();
+	r->next = index < r->count ? index : r->count;
+	_avr_record_schedule(r);
+}
+
+void
+avr_record_resume(
+		avr_t * avr)
+{
+	avr_record_t * r = avr->record;
+
+	if (!r || !r->replaying || r->loaded)
+		return;
+	avr_cycle_timer_cancel(avr, _avr_record_inject, r);
+	r->count = r->next;
+	r->replaying = 0;
+}
+
+void
+avr_record_forget(
+		avr_t * avr)
+{
+	avr_record_t * r = avr->record;
+
+	if (!r || r->loaded)
+		return;
+	avr_record_resume(avr);
+	r->count = 0;
+}
+
+static int
+_avr_record_slot(
+		avr_record_t * r,
+		avr_irq_t * irq)
+{
+	avr_irq_pool_t * pool = &r->avr->irq_pool;
+	avr_record_slot_t * s;
+	uint32_t i;
+
+	for (i = 0; i < r->slots; i++)
+		if (r->slot[i].irq == irq)
+			return i;
+	if (r->slots == AVR_RECORD_RESET)
+		return -1;
+	s = realloc(r->slot, (r->slots + 1) * sizeof(*s));
+	if (!s)
+		return -1;
+	r->slot = s;
+	s += r->slots;
+	memset(s, 0, sizeof(*s));
+	s->irq = irq;
+	s->index = -1;
+	for (i = 0; i < pool->count; i++)
+		if (pool->irq[i] == irq)
+			s->index = i;
+	return r->slots++;
+}
+
+// Log an event for 'irq', or a reset if it is NULL.
+static void
+_avr_record_append(
+		avr_record_t * r,
+		avr_irq_t * irq,
+		uint32_t value,
+		int floating)
+{
+	avr_t * avr = r->avr;
+	int slot;
+
+	pthread_mutex_lock(&r->lock);
+	slot = irq ? _avr_record_slot(r, irq) : AVR_RECORD_RESET;
+	if (slot >= 0 && r->count == r->size) {
+		uint32_t size = r->size ? r->size * 2 : 256;
+		avr_record_event_t * e = realloc(r->event, size * sizeof(*e));
+
+		if (e) {
+			r->event = e;
+			r->size = size;
+		}
+	}
+	if (slot < 0 || r->count == r->size) {
+		pthread_mutex_unlock(&r->lock);
+		AVR_LOG(avr, LOG_ERROR, "RECORD: out of memory, event lost\n");
+		return;
+	}
+	r->event[r->count++] = (avr_record_event_t) {
+		.when = avr->cycle, .value = value,
+		.slot = slot, .floating = !!floating };
+	pthread_mutex_unlock(&r->lock);
+}
+
+int
+avr_record_raise(
+		avr_irq_t * irq,
+		uint32_t value,
+		int floating)
+{
+	avr_t * avr = irq->pool ? irq->pool->avr : NULL;
+	avr_record_t * r = avr ? avr->record : NULL;
+
+	if (!r)
+		return 0;
+	if (r->replaying) {
+		if (r->injecting)
+			return 0;
+		// raised from the simulation: logged values due now go in first
+		if (pthread_equal(pthread_self(), r->thread))
+			_avr_record_inject_due(r);
+		return 1;
+	}
+	_avr_record_append(r, irq, value, floating);
+	return 0;
+}
+
+void
+avr_record_reset(
+		avr_t * avr)
+{
+	avr_record_t * r = avr->record;
+
+	if (!r)
+		return;
+	if (!r->replaying) {
+		_avr_record_append(r, NULL, 0, 0);
+		return;
+	}
+	// go on with the events logged after the reset
+	while (r->next < r->count && r->event[r->next].slot != AVR_RECORD_RESET)
+		r->next++;
+	if (r->next < r->count)
+		r->next++;
+	_avr_record_schedule(r);
+}
+
+static void
+_avr_record_put(
+		FILE * f,
+		uint64_t v)
+{
+	while (v >= 0x80) {
+		putc((v & 0x7f) | 0x80, f);
+		v >>= 7;
+	}
+	putc(v, f);
+}
+
+static void
+_avr_record_put_string(
+		FILE * f,
+		const char * s)
+{
+	size_t len = s ? strlen(s) : 0;
+
+	_avr_record_put(f, len);
+	fwrite(s, 1, len, f);
+}
+
+static uint64_t
+_avr_record_get(
+		FILE * f,
+		int * error)
+{
+	uint64_t v = 0;
+	int shift = 0, c;
+
+	do {
+		c = getc(f);
+		if (c == EOF || shift > 63) {
+			*error = 1;
+			return 0;
+		}
+		v |= (uint64_t)(c & 0x7f) << shift;
+		shift += 7;
+	} while (c & 0x80);
+	return v;
+}
+
+static char *
+_avr_record_get_string(
+		FILE * f,
+		int * error)
+{
+	uint64_t len = _avr_record_get(f, error);
+	char * s;
+
+	if (*error || len > 1024) {
+		*error = 1;
+		return NULL;
+	}
+	s = malloc(len + 1);
+	if (!s || fread(s, 1, len, f) != len) {
+		free(s);
+		*error = 1;
+		return NULL;
+	}
+	s[len] = 0;
+	return s;
+}
+
+int
+avr_record_save(
+		avr_t * avr,
+		const char * filename)
+{
+	avr_record_t * r = avr->record;
+	avr_cycle_count_t last = 0;
+	FILE * f;
+	int res;
+
+	if (!r)
+		return -1;
+	f = fopen(filename, "wb");
+	if (!f) {
+		perror(filename);
+		return -1;
+	}
+	pthread_mutex_lock(&r->lock);
+	fwrite(AVR_RECORD_MAGIC, 1, 8, f);
+	_avr_record_put(f, AVR_RECORD_VERSION);
+	_avr_record_put_string(f, avr->mmcu);
+	_avr_record_put(f, r->slots);
+	for (uint32_t i = 0; i < r->slots; i++) {
+		avr_record_slot_t * s = &r->slot[i];
+
+		_avr_record_put(f, s->index);
+		_avr_record_put_string(f, s->irq ? s->irq->name : s->name);
+	}
+	_avr_record_put(f, r->count);
+	for (uint32_t i = 0; i < r->count; i++) {
+		avr_record_event_t * e = &r->event[i];
+		int64_t delta = e->when - last;
+
+		_avr_record_put(f, ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+		_avr_record_put(f, e->slot);
+		_avr_record_put(f, ((uint64_t)e->value << 1) | e->floating);
+		last = e->when;
+	}
+	pthread_mutex_unlock(&r->lock);
+	res = ferror(f) ? -1 : 0;
+	if (fclose(f))
+		res = -1;
+	if (res)
+		AVR_LOG(avr, LOG_ERROR, "RECORD: error writing %s\n", filename);
+	return res;
+}
+
+static void
+_avr_record_clear(
+		avr_record_t * r)
+{
+	for (uint32_t i = 0; i < r->slots; i++)
+		free(r->slot[i].name);
+	free(r->slot);
+	free(r->event);
+	r->slot = NULL;
+	r->event = NULL;
+	r->slots = r->count = r->size = r->next = 0;
+}
+
+int
+avr_record_load(
+		avr_t * avr,
+		const char * filename)
+{
+	avr_record_t * r = avr_record_start(avr);
+	avr_cycle_count_t when = 0;
+	char magic[8], * mmcu = NULL;
+	int error = 0;
+	uint64_t n;
+	FILE * f;
+
+	if (!r)
+		return -1;
+	f = fopen(filename, "rb");
+	if (!f) {
+		perror(filename);
+		return -1;
+	}
+	avr_cycle_timer_cancel(avr, _avr_record_inject, r);
+	_avr_record_clear(r);
+	if (fread(magic, 1, 8, f) != 8 || memcmp(magic, AVR_RECORD_MAGIC, 8) ||
+			_avr_record_get(f, &error) != AVR_RECORD_VERSION) {
+		AVR_LOG(avr, LOG_ERROR, "RECORD: %s is not an input log\n", filename);
+		fclose(f);
+		return -1;
+	}
+	mmcu = _avr_record_get_string(f, &error);
+	if (!error && strcmp(mmcu, avr->mmcu)) {
+		AVR_LOG(avr, LOG_ERROR, "RECORD: %s was made with %s\n",
+				filename, mmcu);
+		free(mmcu);
+		fclose(f);
+		return -1;
+	}
+	free(mmcu);
+	n = _avr_record_get(f, &error);
+	if (!error && n <= 0xffff) {
+		r->slot = calloc(n, sizeof(*r->slot));
+		error = n && !r->slot;
+		for (; !error && r->slots < n; r->slots++) {
+			r->slot[r->slots].index = _avr_record_get(f, &error);
+			r->slot[r->slots].name = _avr_record_get_string(f, &error);
+		}
+	} else
+		error = 1;
+	n = _avr_record_get(f, &error);
+	if (!error && n < 0xffffffff) {
+		r->event = malloc(n * sizeof(*r->event));
+		error = n && !r->event;
+		r->size = n;
+		for (; !error && r->count < n; r->count++) {
+			avr_record_event_t * e = &r->event[r->count];
+			uint64_t zz = _avr_record_get(f, &error);
+			uint64_t slot, v;
+
+			when += (int64_t)(zz >> 1) ^ -(int64_t)(zz & 1);
+			e->when = when;
+			slot = _avr_record_get(f, &error);
+			v = _avr_record_get(f, &error);
+			e->slot = slot;
+			e->value = v >> 1;
+			e->floating = v & 1;
+			if (slot >= r->slots && slot != AVR_RECORD_RESET)
+				error = 1;
+		}
+	} else
+		error = 1;
+	fclose(f);
+	if (error) {
+		AVR_LOG(avr, LOG_ERROR, "RECORD: %s is corrupt\n", filename);
+		_avr_record_clear(r);
+		return -1;
+	}
+	r->loaded = 1;
+	avr_record_replay(avr, 0);
+	return 0;
+}
+
+void
+avr_record_stop(
+		avr_t * avr)
+{
+	if (!avr->record)
+		return;
+	avr_cycle_timer_cancel(avr, _avr_record_inject, avr->record);
+	_avr_record_clear(avr->record);
+	pthread_mutex_destroy(&avr->record->lock);
+	free(avr->record);
+	avr->record = NULL;
+}
@@ -0,0 +1,166 @@
+/*
+	sim_record.h
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Recording of external inputs, so a run can be re-executed exactly.
+ *
+ * IRQs that bring values in from outside the simulated chip carry
+ * IRQ_FLAG_RECORD: the UART and ADC inputs and the VCD input signals are
+ * marked by their modules, the parts in examples/parts (button, rotenc)
+ * and the panel mark their outputs, other board code marks its own with
+ * avr_record_input(). Raising such an IRQ directly on a port pin would
+ * also log the port's own output, so chain it from an IRQ of the part.
+ *
+ * While avr->record exists every raise of these IRQs is logged with the
+ * cycle it happened at, from any thread. When replaying, raises from
+ * anywhere else are dropped and the logged ones are raised again at the
+ * same cycles: from a cycle timer, or at once when code in the simulator
+ * raises the IRQ (an ADC input given in reply to ADC_IRQ_OUT_TRIGGER).
+ *
+ * The log can be saved to a file and loaded into a new run of the same
+ * firmware and board, that then gets exactly the same inputs until it
+ * ends. Sources that consume their input when they raise it (uart_pty's
+ * FIFO) should hold back while avr_record_replaying() is true.
+ */
+
+#ifndef __SIM_RECORD_H__
+#define __SIM_RECORD_H__
+
+#include <pthread.h>
+#include "sim_avr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Slot of the event logged by avr_reset(), replay waits for the reset.
+#define AVR_RECORD_RESET	0xffff
+
+typedef struct avr_record_event_t {
+	avr_cycle_count_t	when;
+	uint32_t			value;
+	uint16_t			slot;		// index in avr_record_t.slot
+	uint8_t				floating;
+} avr_record_event_t;
+
+// An IRQ that appears in the log.
+typedef struct avr_record_slot_t {
+	avr_irq_t *			irq;		// looked up when first replayed, if loaded
+	uint32_t			index;		// in avr->irq_pool
+	char *				name;		// of a loaded slot, to check the lookup
+	int					missing;
+} avr_record_slot_t;
+
+typedef struct avr_record_t {
+	struct avr_t *		avr;
+	pthread_mutex_t		lock;		// raises come from board threads
+	int					replaying;
+	int					loaded;		// replay the whole run, from a file
+	int					injecting;	// raising a logged event
+	pthread_t			thread;		// the one running the simulation
+	avr_record_slot_t *	slot;
+	uint32_t			slots;
+	avr_record_event_t *event;
+	uint32_t			count, size;
+	uint32_t			next;		// next event to replay
+} avr_record_t;
+
+// Start logging the inputs of 'avr', if not already.
+avr_record_t *
+avr_record_start(
+		struct avr_t * avr);
+
+// Mark 'irq' as an external input.
+void
+avr_record_input(
+		avr_irq_t * irq);
+
+// Write the log so far to a file.
+int
+avr_record_save(
+		struct avr_t * avr,
+		const char * filename);
+
+/*
+ * Replace live inputs with those of a saved log, from now on. Call this
+ * once the board is made, before running.
+ */
+int
+avr_record_load(
+		struct avr_t * avr,
+		const char * filename);
+
+/*
+ * Replay the log from event 'index' on; the instance must have been put
+ * back to where avr_record_index() was 'index', with a checkpoint.
+ */
+void
+avr_record_replay(
+		struct avr_t * avr,
+		uint32_t index);
+
+// Leave replay, forget the events not replayed yet and log again.
+void
+avr_record_resume(
+		struct avr_t * avr);
+
+// Forget the events logged so far.
+void
+avr_record_forget(
+		struct avr_t * avr);
+
+static inline int
+avr_record_replaying(
+		struct avr_t * avr)
+{
+	return avr->record && avr->record->replaying;
+}
+
+// Where the log is: the next event to replay, or to record.
+static inline uint32_t
+avr_record_index(
+		struct avr_t * avr)
+{
+	return avr->record->replaying ? avr->record->next : avr->record->count;
+}
+
+// Private, called by avr_raise_irq(). Returns non-zero to drop the raise.
+int
+avr_record_raise(
+		avr_irq_t * irq,
+		uint32_t value,
+		int floating);
+
+// Private, called by avr_reset() that cancels the cycle timers
+void
+avr_record_reset(
+		struct avr_t * avr);
+
+// Private, called by avr_terminate()
+void
+avr_record_stop(
+		struct avr_t * avr);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* __SIM_RECORD_H__ */
@@ -0,0 +1,334 @@
+/*
+	sim_reverse.c
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include "sim_avr.h"
+#include "sim_reverse.h"
+#include "sim_checkpoint.h"
+#include "sim_record.h"
+
+int
+avr_reverse_start(
+		avr_t * avr,
+		avr_cycle_count_t interval,
+		int max)
+{
+	avr_reverse_t * r;
+
+	if (avr->reverse)
+		return 0;
+	if (!avr_record_start(avr))
+		return -1;
+	r = calloc(1, sizeof(*r));
+	if (!r)
+		return -1;
+	r->avr = avr;
+	r->interval = interval ? interval : AVR_REVERSE_INTERVAL;
+	r->max = max > 1 ? max : AVR_REVERSE_MAX;
+	r->next = r->end = avr->cycle;
+	r->state = cpu_Running;
+	avr->reverse = r;
+	return 0;
+}
+
+// Checkpoint this boundary, in the state the CPU will carry on from.
+static int
+_avr_reverse_take(
+		avr_reverse_t * r,
+		int barrier)
+{
+	avr_t * avr = r->avr;
+	int state = avr->state;
+	avr_checkpoint_t * c;
+
+	if (r->count == r->size) {
+		int size = r->size ? r->size * 2 : 32;
+		avr_reverse_point_t * p = realloc(r->point, size * sizeof(*p));
+
+		if (!p)
+			return -1;
+		r->point = p;
+		r->size = size;
+	}
+	if (state != cpu_Running && state != cpu_Sleeping)
+		avr->state = r->state == cpu_Sleeping ? cpu_Sleeping : cpu_Running;
+	c = avr_checkpoint_take(avr);
+	avr->state = state;
+	if (!c) {
+		AVR_LOG(avr, LOG_ERROR, "REVERSE: checkpoint failed\n");
+		return -1;
+	}
+	r->point[r->count++] = (avr_reverse_point_t) {
+		.checkpoint = c, .cycle = avr->cycle,
+		.event = avr_record_index(avr), .barrier = barrier };
+	r->next = avr->cycle + r->interval;
+	return 0;
+}
+
+// Drop every other checkpoint, keeping the first one and the barriers.
+static void
+_avr_reverse_thin(
+		avr_reverse_t * r)
+{
+	int n = 1, drop = 0;
+
+	for (int i = 1; i < r->count; i++) {
+		if (!r->point[i].barrier && (drop ^= 1)) {
+			avr_checkpoint_free(r->point[i].checkpoint);
+			continue;
+		}
+		r->point[n++] = r->point[i];
+	}
+	r->count = n;
+	r->interval *= 2;
+}
+
+// Index of the last checkpoint at or before 'cycle', or -1.
+static int
+_avr_reverse_find(
+		avr_reverse_t * r,
+		avr_cycle_count_t cycle)
+{
+	int i = r->count - 1;
+
+	while (i >= 0 && r->point[i].cycle > cycle)
+		i--;
+	return i;
+}
+
+static int
+_avr_reverse_seek(
+		avr_reverse_t * r,
+		int i)
+{
+	if (avr_checkpoint_restore(r->point[i].checkpoint))
+		return -1;
+	avr_record_replay(r->avr, r->point[i].event);
+	return 0;
+}
+
+// Run to the next boundary, as the gdb run loop does without gdb.
+static int
+_avr_reverse_run(
+		avr_reverse_t * r)
+{
+	avr_t * avr = r->avr;
+	avr_cycle_count_t cycle = avr->cycle;
+
+	if (avr->state == cpu_Stopped)	// BREAK or a crash, gdb went on
+		avr->state = cpu_Running;
+	if (avr->state != cpu_Running && avr->state != cpu_Sleeping)
+		return -1;
+	avr_run_gdb_step(avr);
+	return avr->cycle > cycle ? 0 : -1;
+}
+
+static int
+_avr_reverse_goto(
+		avr_reverse_t * r,
+		avr_cycle_count_t target)
+{
+	int i = _avr_reverse_find(r, target);
+
+	if (i < 0 || _avr_reverse_seek(r, i))
+		return -1;
+	while (r->avr->cycle < target)
+		if (_avr_reverse_run(r))
+			return -1;
+	return 0;
+}
+
+/*
+ * Re-execute the history one checkpoint interval at a time, newest first,
+ * and go to the last boundary before this one that 'stop' accepts. With
+ * no 'stop', that is just the previous boundary.
+ */
+static int
+_avr_reverse_search(
+		avr_t * avr,
+		avr_reverse_stop_p stop,
+		void * param)
+{
+	avr_reverse_t * r = avr->reverse;
+	avr_cycle_count_t before = avr->cycle, found = 0;
+	int res = AVR_REVERSE_BEGIN;
+
+	if (!r)
+		return AVR_REVERSE_ERROR;
+	if (!r->count || before <= r->point[0].cycle)
+		return AVR_REVERSE_BEGIN;
+	if (avr->cycle > r->end)
+		r->end = avr->cycle;
+	r->searching = 1;
+	for (int i = _avr_reverse_find(r, before - 1);
+			i >= 0 && res == AVR_REVERSE_BEGIN; i--) {
+		avr_cycle_count_t limit = before;
+
+		if (i + 1 < r->count && r->point[i + 1].cycle < before)
+			limit = r->point[i + 1].cycle;
+		if (_avr_reverse_seek(r, i)) {
+			res = AVR_REVERSE_ERROR;
+			break;
+		}
+		while (avr->cycle < limit) {
+			avr_cycle_count_t at = avr->cycle;
+
+			if (!stop || stop(avr, param)) {
+				found = at;
+				res = AVR_REVERSE_STOPPED;
+			}
+			r->hit = 0;
+			if (_avr_reverse_run(r))
+				break;
+			if (r->hit && stop) {
+				found = at;
+				res = AVR_REVERSE_WATCH;
+			}
+		}
+	}
+	if (res == AVR_REVERSE_BEGIN)
+		found = r->point[0].cycle;
+	if (res != AVR_REVERSE_ERROR && _avr_reverse_goto(r, found))
+		res = AVR_REVERSE_ERROR;
+	if (res == AVR_REVERSE_ERROR)
+		AVR_LOG(avr, LOG_ERROR, "REVERSE: re-execution failed\n");
+	r->searching = 0;
+	r->state = avr->state;
+	avr->state = cpu_Stopped;
+	return res;
+}
+
+static int
+_avr_reverse_never(
+		avr_t * avr,
+		void * param)
+{
+	return 0;
+}
+
+int
+avr_reverse_step(
+		avr_t * avr)
+{
+	return _avr_reverse_search(avr, NULL, NULL);
+}
+
+int
+avr_reverse_continue(
+		avr_t * avr,
+		avr_reverse_stop_p stop,
+		void * param)
+{
+	return _avr_reverse_search(avr, stop ? stop : _avr_reverse_never, param);
+}
+
+void
+avr_reverse_truncate(
+		avr_t * avr)
+{
+	avr_reverse_t * r = avr->reverse;
+
+	if (!r || r->searching)
+		return;
+	while (r->count && r->point[r->count - 1].cycle >= avr->cycle)
+		avr_checkpoint_free(r->point[--r->count].checkpoint);
+	avr_record_resume(avr);
+	r->end = avr->cycle;
+	_avr_reverse_take(r, 1);
+}
+
+void
+avr_reverse_forget(
+		avr_t * avr)
+{
+	avr_reverse_t * r = avr->reverse;
+
+	if (!r || r->searching)
+		return;
+	while (r->count)
+		avr_checkpoint_free(r->point[--r->count].checkpoint);
+	avr_record_forget(avr);
+	r->next = r->end = avr->cycle;
+}
+
+void
+avr_reverse_tick(
+		avr_t * avr)
+{
+	avr_reverse_t * r = avr->reverse;
+
+	// gdb stopped it while asleep, and resuming would wake it up
+	if (avr->state == cpu_Running && r->state == cpu_Sleeping)
+		avr->state = cpu_Sleeping;
+	if (avr->cycle < r->end)
+		return;		// executing the history again
+	avr_record_resume(avr);
+	r->end = avr->cycle;
+	if (avr->cycle < r->next ||
+			(avr->state != cpu_Running && avr->state != cpu_Sleeping))
+		return;
+	if (r->count >= r->max) {
+		int kept = 0;
+
+		for (int i = 0; i < r->count; i++)
+			kept += !r->point[i].barrier;
+		if (kept >= r->max)
+			_avr_reverse_thin(r);
+	}
+	_avr_reverse_take(r, 0);
+}
+
+void
+avr_reverse_stepped(
+		avr_t * avr)
+{
+	avr_reverse_t * r = avr->reverse;
+	int i;
+
+	r->state = avr->state;
+	if (avr->state != cpu_Stopped)
+		return;
+	/*
+	 * gdb stopped the CPU inside the instruction (watchpoint, BREAK, crash)
+	 * so interrupts wait for the next one; re-execution has to start here.
+	 * Re-executing, the same stop at a barrier changes nothing.
+	 */
+	i = _avr_reverse_find(r, avr->cycle);
+	if (avr->cycle <= r->end && i >= 0 &&
+			r->point[i].cycle == avr->cycle && r->point[i].barrier)
+		return;
+	avr_reverse_truncate(avr);
+}
+
+void
+avr_reverse_stop(
+		avr_t * avr)
+{
+	avr_reverse_t * r = avr->reverse;
+
+	if (!r)
+		return;
+	while (r->count)
+		avr_checkpoint_free(r->point[--r->count].checkpoint);
+	free(r->point);
+	free(r);
+	avr->reverse = NULL;
+}
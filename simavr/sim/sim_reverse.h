@@ -0,0 +1,135 @@
+/*
+	sim_reverse.h
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Reverse execution, for gdb's reverse-stepi and reverse-continue.
+ *
+ * While the gdb run loop executes, a checkpoint (sim_checkpoint.h) is
+ * taken every 'interval' cycles and the external inputs are logged
+ * (sim_record.h). Going back means restoring the nearest checkpoint
+ * before the target and executing forward again, with the logged inputs,
+ * to the instruction boundary wanted. Boundaries are identified by
+ * avr->cycle, which only goes up between them.
+ *
+ * When 'max' checkpoints are held, every other one is dropped and the
+ * interval doubled, so the whole run stays reachable at a growing cost
+ * per step back. A reset, or a change made from gdb to registers or
+ * memory, starts the history again from that point, as re-executing
+ * across it would not give the same result.
+ *
+ * Re-executed code raises its output IRQs again: uart_pty holds back
+ * while that happens, but VCD output files, timelines and counters see
+ * the same events twice.
+ */
+
+#ifndef __SIM_REVERSE_H__
+#define __SIM_REVERSE_H__
+
+#include "sim_avr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AVR_REVERSE_INTERVAL	1000000		// default cycles between checkpoints
+#define AVR_REVERSE_MAX			256			// default checkpoints held
+
+typedef struct avr_reverse_point_t {
+	struct avr_checkpoint_t *checkpoint;
+	avr_cycle_count_t	cycle;
+	uint32_t			event;		// avr_record_index() when taken
+	int					barrier;	// gdb stopped or changed things here
+} avr_reverse_point_t;
+
+typedef struct avr_reverse_t {
+	struct avr_t *		avr;
+	avr_cycle_count_t	interval;
+	avr_cycle_count_t	next;		// cycle of the next checkpoint
+	avr_cycle_count_t	end;		// furthest boundary executed
+	int					max, count, size;
+	avr_reverse_point_t *point;		// oldest first
+	int					state;		// CPU state when gdb stopped it
+	int					searching;	// re-executing for a reverse command
+	int					hit;		// a watchpoint triggered while searching
+} avr_reverse_t;
+
+enum {
+	AVR_REVERSE_STOPPED = 0,	// previous boundary, or a breakpoint
+	AVR_REVERSE_WATCH,			// the next instruction hits a watchpoint
+	AVR_REVERSE_BEGIN,			// went back as far as the history goes
+	AVR_REVERSE_ERROR,
+};
+
+/*
+ * Called while searching backwards, at each instruction boundary.
+ * Returns non-zero to stop there.
+ */
+typedef int (*avr_reverse_stop_p)(
+		struct avr_t * avr,
+		void * param);
+
+// Start keeping history. 0 for 'interval' and 'max' picks the defaults.
+int
+avr_reverse_start(
+		struct avr_t * avr,
+		avr_cycle_count_t interval,
+		int max);
+
+// Go back one instruction boundary.
+int
+avr_reverse_step(
+		struct avr_t * avr);
+
+// Go back to the last boundary where 'stop' is true or a watchpoint hit.
+int
+avr_reverse_continue(
+		struct avr_t * avr,
+		avr_reverse_stop_p stop,
+		void * param);
+
+// Registers or memory were changed: drop the history after this point.
+void
+avr_reverse_truncate(
+		struct avr_t * avr);
+
+// Drop all the history, after a reset.
+void
+avr_reverse_forget(
+		struct avr_t * avr);
+
+// Private, called by the gdb run loop before and after each instruction
+void
+avr_reverse_tick(
+		struct avr_t * avr);
+void
+avr_reverse_stepped(
+		struct avr_t * avr);
+
+// Private, called by avr_terminate()
+void
+avr_reverse_stop(
+		struct avr_t * avr);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* __SIM_REVERSE_H__ */
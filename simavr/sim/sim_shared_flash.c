@@ -0,0 +1,161 @@
+/*
+	sim_shared_flash.c
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE		// memfd_create()
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "sim_shared_flash.h"
+
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+static avr_shared_flash_t * shared_images;
+
+// An image with these contents, or NULL
+static avr_shared_flash_t *
+_avr_shared_flash_find(
+		const uint8_t * flash,
+		uint32_t len,
+		uint32_t size,
+		uint64_t hash)
+{
+	for (avr_shared_flash_t * i = shared_images; i; i = i->next) {
+		uint8_t * m;
+		int same;
+
+		if (i->size != size || i->hash != hash)
+			continue;
+		m = mmap(NULL, size, PROT_READ, MAP_SHARED, i->fd, 0);
+		if (m == MAP_FAILED)
+			continue;
+		same = !memcmp(m, flash, len);
+		munmap(m, size);
+		if (same)
+			return i;
+	}
+	return NULL;
+}
+
+static avr_shared_flash_t *
+_avr_shared_flash_new(
+		const uint8_t * flash,
+		uint32_t len,
+		uint32_t size,
+		uint64_t hash)
+{
+	avr_shared_flash_t * i;
+	int fd = memfd_create("simavr-flash", MFD_CLOEXEC);
+
+	if (fd < 0)
+		return NULL;
+	if (ftruncate(fd, size) || pwrite(fd, flash, len, 0) != len ||
+			!(i = calloc(1, sizeof(*i)))) {
+		close(fd);
+		return NULL;
+	}
+	i->fd = fd;
+	i->size = size;
+	i->hash = hash;
+	i->next = shared_images;
+	shared_images = i;
+	return i;
+}
+
+int
+avr_shared_flash_start(
+		avr_t * avr)
+{
+	// the overflow opcode is shared too, past the last word
+	uint32_t len = avr->flashend + 1 + 2;
+	uint32_t page = sysconf(_SC_PAGESIZE);
+	uint32_t size = (len + page - 1) & ~(page - 1);
+	uint64_t hash = 0xcbf29ce484222325ull;
+	avr_shared_flash_t * i;
+	uint8_t * m = MAP_FAILED;
+
+	if (avr->shared_flash)
+		return 0;
+	for (uint32_t a = 0; a < len; a++)
+		hash = (hash ^ avr->flash[a]) * 0x100000001b3ull;
+
+	pthread_mutex_lock(&shared_lock);
+	i = _avr_shared_flash_find(avr->flash, len, size, hash);
+	if (!i)
+		i = _avr_shared_flash_new(avr->flash, len, size, hash);
+	if (i)
+		m = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, i->fd, 0);
+	if (m != MAP_FAILED)
+		i->refs++;
+	pthread_mutex_unlock(&shared_lock);
+	if (m == MAP_FAILED) {
+		AVR_LOG(avr, LOG_WARNING, "FLASH: can't share the flash\n");
+		return -1;
+	}
+	free(avr->flash);
+	avr->flash = m;
+	avr->shared_flash = i;
+	return 0;
+}
+
+void
+avr_shared_flash_stop(
+		avr_t * avr)
+{
+	avr_shared_flash_t * i = avr->shared_flash;
+
+	if (!i)
+		return;
+	munmap(avr->flash, i->size);
+	avr->flash = NULL;
+	avr->shared_flash = NULL;
+
+	pthread_mutex_lock(&shared_lock);
+	if (--i->refs == 0) {
+		for (avr_shared_flash_t ** p = &shared_images; *p; p = &(*p)->next)
+			if (*p == i) {
+				*p = i->next;
+				break;
+			}
+		close(i->fd);
+		free(i);
+	}
+	pthread_mutex_unlock(&shared_lock);
+}
+
+#else
+
+int
+avr_shared_flash_start(
+		avr_t * avr)
+{
+	return -1;
+}
+
+void
+avr_shared_flash_stop(
+		avr_t * avr)
+{
+}
+
+#endif
@@ -0,0 +1,67 @@
+/*
+	sim_shared_flash.h
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Flash shared by the instances running the same firmware in a process,
+ * as sim_batch.c runs them.
+ *
+ * Once the firmware is loaded, avr_shared_flash_start() looks for an image
+ * of the same flash, and the AVR_OVERFLOW_OPCODE after it, that another
+ * instance made, or makes one, and maps it private in place of avr->flash.
+ * The pages are then those of the image until the instance writes to them,
+ * with SPM, gdb or avr_loadcode(): the kernel copies a page for that
+ * instance the first time it is written. Nothing changes for code that
+ * reads or writes avr->flash.
+ *
+ * Images are counted references, dropped by avr_terminate(). This needs
+ * memfd_create(), on other systems the flash stays the instance's own.
+ */
+
+#ifndef __SIM_SHARED_FLASH_H__
+#define __SIM_SHARED_FLASH_H__
+
+#include "sim_avr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct avr_shared_flash_t {
+	struct avr_shared_flash_t * next;
+	int				fd;
+	uint32_t		size;		// flash and overflow opcode, in whole pages
+	uint64_t		hash;		// of the contents
+	int				refs;
+} avr_shared_flash_t;
+
+// Returns -1, leaving avr->flash as it is, if it can't be shared.
+int
+avr_shared_flash_start(
+		avr_t * avr);
+void
+avr_shared_flash_stop(
+		avr_t * avr);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* __SIM_SHARED_FLASH_H__ */
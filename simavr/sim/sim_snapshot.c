@@ -0,0 +1,626 @@
+/*
+	sim_snapshot.c
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE		// dl_iterate_phdr()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__linux__) || defined(__FreeBSD__) || \
+		defined(__NetBSD__) || defined(__OpenBSD__)
+#include <link.h>
+#define SNAPSHOT_LINK_MAP	1
+#endif
+#include "sim_avr.h"
+#include "sim_io.h"
+#include "sim_snapshot.h"
+#include "sim_stack.h"
+#include "sim_checkpoint.h"
+
+#define SNAPSHOT_MAGIC		"simavrSS"
+#define SNAPSHOT_VERSION	2
+
+// Pointer tags
+enum {
+	SNAP_PTR_NULL = 0,
+	SNAP_PTR_CORE,		// offset in the core allocation
+	SNAP_PTR_IRQ,		// index in the IRQ pool
+	SNAP_PTR_RAW,		// as is, same process only
+};
+
+// Callback tags
+enum {
+	SNAP_FN_RAW = 0,	// as is, same process only
+	SNAP_FN_MODULE,		// offset in the executable or a shared library
+};
+
+void
+avr_snapshot_bytes(
+		avr_snapshot_t * s,
+		void * data,
+		size_t len)
+{
+	if (s->error)
+		return;
+	if (s->restore) {
+		if (s->pos + len > s->len) {
+			s->error = 1;
+			return;
+		}
+		memcpy(data, s->buf + s->pos, len);
+		s->pos += len;
+		return;
+	}
+	if (s->len + len > s->size) {
+		size_t size = s->size ? s->size : 4096;
+		uint8_t * b;
+
+		while (size < s->len + len)
+			size *= 2;
+		b = realloc(s->buf, size);
+		if (!b) {
+			s->error = 1;
+			return;
+		}
+		s->buf = b;
+		s->size = size;
+	}
+	memcpy(s->buf + s->len, data, len);
+	s->len += len;
+}
+
+// A value that must match on restore, rather than be restored.
+static void
+_avr_snapshot_check(
+		avr_snapshot_t * s,
+		uint32_t value)
+{
+	uint32_t v = value;
+
+	AVR_SNAPSHOT_FIELD(s, v);
+	if (v != value)
+		s->error = 1;
+}
+
+static void
+_avr_snapshot_check_string(
+		avr_snapshot_t * s,
+		const char * str)
+{
+	uint32_t l = str ? strlen(str) : 0;
+	char b[64];
+
+	_avr_snapshot_check(s, l);
+	if (s->error || l >= sizeof(b))
+		return;
+	if (s->restore) {
+		avr_snapshot_bytes(s, b, l);
+		if (l && memcmp(b, str, l))
+			s->error = 1;
+	} else
+		avr_snapshot_bytes(s, (void *)str, l);
+}
+
+void
+avr_snapshot_pointer(
+		avr_snapshot_t * s,
+		void ** p)
+{
+	avr_t * avr = s->avr;
+	uint8_t tag = SNAP_PTR_RAW;
+	uint64_t v = 0;
+
+	if (!s->restore) {
+		uintptr_t a = (uintptr_t)*p;
+
+		if (!a)
+			tag = SNAP_PTR_NULL;
+		else if (a >= (uintptr_t)avr &&
+				a < (uintptr_t)avr + avr->core_size) {
+			tag = SNAP_PTR_CORE;
+			v = a - (uintptr_t)avr;
+		} else {
+			for (int i = 0; i < avr->irq_pool.count; i++)
+				if (*p == (void *)avr->irq_pool.irq[i]) {
+					tag = SNAP_PTR_IRQ;
+					v = i;
+					break;
+				}
+		}
+		if (tag == SNAP_PTR_RAW)
+			v = a;
+		if (tag == SNAP_PTR_RAW && s->file) {
+			AVR_LOG(avr, LOG_ERROR, "SNAPSHOT: a pointer to %p can't be "
+					"saved to a file, only in memory\n", *p);
+			s->error = 1;
+		}
+	}
+	AVR_SNAPSHOT_FIELD(s, tag);
+	AVR_SNAPSHOT_FIELD(s, v);
+	if (!s->restore || s->error)
+		return;
+	switch (tag) {
+		case SNAP_PTR_NULL:
+			*p = NULL;
+			break;
+		case SNAP_PTR_CORE:
+			if (v >= avr->core_size)
+				s->error = 1;
+			else
+				*p = (uint8_t *)avr + v;
+			break;
+		case SNAP_PTR_IRQ:
+			if (v >= (uint64_t)avr->irq_pool.count)
+				s->error = 1;
+			else
+				*p = avr->irq_pool.irq[v];
+			break;
+		case SNAP_PTR_RAW:
+			if (s->file)
+				s->error = 1;
+			else
+				*p = (void *)(uintptr_t)v;
+			break;
+		default:
+			s->error = 1;
+	}
+}
+
+#ifdef SNAPSHOT_LINK_MAP
+/*
+ * Callbacks in a file are stored as an offset in the module holding them,
+ * the main program or a shared library, which each move on their own with
+ * address space randomisation. The module is known by its file name, and
+ * the size of the segment checked, but it has to be the same build.
+ */
+typedef struct _avr_snapshot_module_t {
+	uintptr_t		addr;		// to find, or found
+	const char *	name;		// "" for the main program
+	uint64_t		offset;		// in the module
+	uint64_t		size;		// of its segment
+	int				found;
+} _avr_snapshot_module_t;
+
+static const char *
+_avr_snapshot_module_name(
+		const char * path)
+{
+	const char * base = strrchr(path, '/');
+
+	return base ? base + 1 : path;
+}
+
+static int
+_avr_snapshot_module_find(
+		struct dl_phdr_info * info,
+		size_t size,
+		void * param)
+{
+	_avr_snapshot_module_t * m = param;
+	const char * name = _avr_snapshot_module_name(
+			info->dlpi_name ? info->dlpi_name : "");
+
+	// saving looks for the address, restoring for the name
+	if (!m->addr && strcmp(name, m->name))
+		return 0;
+	for (int i = 0; i < info->dlpi_phnum; i++) {
+		const ElfW(Phdr) * ph = &info->dlpi_phdr[i];
+		uintptr_t start = info->dlpi_addr + ph->p_vaddr;
+
+		if (ph->p_type != PT_LOAD || !(ph->p_flags & PF_X))
+			continue;
+		if (m->addr) {
+			if (m->addr < start || m->addr >= start + ph->p_memsz)
+				continue;
+			m->name = name;
+			m->offset = m->addr - info->dlpi_addr;
+		} else {
+			if (m->size != ph->p_memsz ||
+					m->offset < ph->p_vaddr ||
+					m->offset >= ph->p_vaddr + ph->p_memsz)
+				continue;
+			m->addr = info->dlpi_addr + m->offset;
+		}
+		m->size = ph->p_memsz;
+		m->found = 1;
+		return 1;
+	}
+	return 0;
+}
+#endif
+
+static void
+_avr_snapshot_function(
+		avr_snapshot_t * s,
+		avr_cycle_timer_t * f)
+{
+	uint8_t tag = s->file ? SNAP_FN_MODULE : SNAP_FN_RAW;
+	uint64_t v = (uintptr_t)*f;
+
+	AVR_SNAPSHOT_FIELD(s, tag);
+	if (tag == SNAP_FN_RAW || s->error) {
+		AVR_SNAPSHOT_FIELD(s, v);
+		if (s->restore && !s->error) {
+			if (s->file)
+				s->error = 1;
+			else
+				*f = (avr_cycle_timer_t)(uintptr_t)v;
+		}
+		return;
+	}
+#ifdef SNAPSHOT_LINK_MAP
+	_avr_snapshot_module_t m = { .addr = s->restore ? 0 : (uintptr_t)*f };
+	char name[256];
+	uint32_t len = 0;
+
+	if (!s->restore) {
+		if (m.addr)
+			dl_iterate_phdr(_avr_snapshot_module_find, &m);
+		if (!m.found || (len = strlen(m.name)) >= sizeof(name)) {
+			AVR_LOG(s->avr, LOG_ERROR, "SNAPSHOT: timer callback %p is not "
+					"in a module, it can't be saved to a file\n", *f);
+			s->error = 1;
+			return;
+		}
+		memcpy(name, m.name, len);
+	}
+	AVR_SNAPSHOT_FIELD(s, len);
+	if (s->error || len >= sizeof(name)) {
+		s->error = 1;
+		return;
+	}
+	avr_snapshot_bytes(s, name, len);
+	AVR_SNAPSHOT_FIELD(s, m.offset);
+	AVR_SNAPSHOT_FIELD(s, m.size);
+	if (!s->restore || s->error)
+		return;
+	name[len] = 0;
+	m.name = name;
+	dl_iterate_phdr(_avr_snapshot_module_find, &m);
+	if (!m.found) {
+		AVR_LOG(s->avr, LOG_ERROR, "SNAPSHOT: timer callback in %s "
+				"not found, or not the same build\n",
+				len ? name : "the program");
+		s->error = 1;
+		return;
+	}
+	*f = (avr_cycle_timer_t)m.addr;
+#else
+	AVR_LOG(s->avr, LOG_ERROR,
+			"SNAPSHOT: timer callbacks can't be saved to a file here\n");
+	s->error = 1;
+#endif
+}
+
+static void
+_avr_snapshot_header(
+		avr_snapshot_t * s)
+{
+	avr_t * avr = s->avr;
+	char magic[8];
+	uint32_t modules = 0;
+
+	memcpy(magic, SNAPSHOT_MAGIC, sizeof(magic));
+	AVR_SNAPSHOT_FIELD(s, magic);
+	if (memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)))
+		s->error = 1;
+	_avr_snapshot_check(s, SNAPSHOT_VERSION);
+	_avr_snapshot_check_string(s, avr->mmcu);
+	_avr_snapshot_check(s, avr->ramend);
+	_avr_snapshot_check(s, avr->flashend);
+	_avr_snapshot_check(s, avr->core_size);
+	for (avr_io_t * io = avr->io_port; io; io = io->next)
+		modules++;
+	_avr_snapshot_check(s, modules);
+}
+
+static void
+_avr_snapshot_core(
+		avr_snapshot_t * s)
+{
+	avr_t * avr = s->avr;
+
+	AVR_SNAPSHOT_FIELD(s, avr->state);
+	AVR_SNAPSHOT_FIELD(s, avr->saved_state);
+	AVR_SNAPSHOT_FIELD(s, avr->cycle);
+	AVR_SNAPSHOT_FIELD(s, avr->timer_cycle);
+	AVR_SNAPSHOT_FIELD(s, avr->pc);
+	AVR_SNAPSHOT_FIELD(s, avr->reset_pc);
+	AVR_SNAPSHOT_FIELD(s, avr->sreg);
+	AVR_SNAPSHOT_FIELD(s, avr->interrupt_state);
+	AVR_SNAPSHOT_FIELD(s, avr->fuse);
+	AVR_SNAPSHOT_FIELD(s, avr->lockbits);
+	AVR_SNAPSHOT_FIELD(s, avr->codeend);
+	AVR_SNAPSHOT_FIELD(s, avr->frequency);
+	AVR_SNAPSHOT_FIELD(s, avr->vcc);
+	AVR_SNAPSHOT_FIELD(s, avr->avcc);
+	AVR_SNAPSHOT_FIELD(s, avr->aref);
+
+	if (s->no_memory)
+		return;
+	// registers, IO and SRAM are in the same buffer
+	avr_snapshot_bytes(s, avr->data, avr->ramend + 1);
+	avr_snapshot_bytes(s, avr->flash, avr->flashend + 1);
+}
+
+static void
+_avr_snapshot_interrupts(
+		avr_snapshot_t * s)
+{
+	avr_int_table_p table = &s->avr->interrupts;
+
+	AVR_SNAPSHOT_FIELD(s, table->pending_count);
+	AVR_SNAPSHOT_FIELD(s, table->next_vector);
+	AVR_SNAPSHOT_FIELD(s, table->running_ptr);
+	AVR_SNAPSHOT_FIELD(s, table->running);
+	for (int i = 1; i <= table->max_vector; i++) {
+		avr_int_vector_t * vector = table->vectors[i];
+		uint8_t bits;
+
+		if (!vector)
+			continue;
+		bits = vector->pending | (vector->level << 1);
+		AVR_SNAPSHOT_FIELD(s, bits);
+		vector->pending = bits & 1;
+		vector->level = (bits >> 1) & 1;
+	}
+}
+
+/*
+ * IRQ values, without calling the hooks: whatever they drive is part of
+ * the snapshot too. IRQs allocated after the snapshot was taken keep
+ * their current value.
+ */
+static void
+_avr_snapshot_irqs(
+		avr_snapshot_t * s)
+{
+	avr_irq_pool_t * pool = &s->avr->irq_pool;
+	uint32_t count = pool->count;
+
+	AVR_SNAPSHOT_FIELD(s, count);
+	for (uint32_t i = 0; i < count && !s->error; i++) {
+		avr_irq_t dummy = {0};
+		avr_irq_t * irq = i < pool->count ? pool->irq[i] : &dummy;
+
+		AVR_SNAPSHOT_FIELD(s, irq->value);
+		AVR_SNAPSHOT_FIELD(s, irq->flags);
+	}
+	if (s->restore && count != (uint32_t)pool->count)
+		AVR_LOG(s->avr, LOG_WARNING,
+				"SNAPSHOT: %u IRQs saved, %d present\n", count, pool->count);
+}
+
+// Each module's state is prefixed by its kind and size, to catch mismatches.
+static void
+_avr_snapshot_modules(
+		avr_snapshot_t * s)
+{
+	for (avr_io_t * io = s->avr->io_port; io && !s->error; io = io->next) {
+		uint32_t size = 0;
+		size_t start;
+
+		_avr_snapshot_check_string(s, io->kind);
+		if (s->restore) {
+			AVR_SNAPSHOT_FIELD(s, size);
+			start = s->pos;
+			if (io->snapshot)
+				io->snapshot(io, s);
+			if (!s->error && s->pos != start + size) {
+				AVR_LOG(s->avr, LOG_ERROR,
+						"SNAPSHOT: %s state size mismatch\n", io->kind);
+				s->error = 1;
+			}
+		} else {
+			start = s->len;
+			AVR_SNAPSHOT_FIELD(s, size);
+			if (io->snapshot)
+				io->snapshot(io, s);
+			if (!s->error) {
+				size = s->len - start - sizeof(size);
+				memcpy(s->buf + start, &size, sizeof(size));
+			}
+		}
+	}
+}
+
+// Pending timers, soonest first. Restoring rebuilds the queue in order.
+static void
+_avr_snapshot_cycle_timers(
+		avr_snapshot_t * s)
+{
+	avr_cycle_timer_pool_t * pool = &s->avr->cycle_timers;
+	uint32_t count = 0;
+
+	for (avr_cycle_timer_slot_p t = pool->timer; t; t = t->next)
+		count++;
+	AVR_SNAPSHOT_FIELD(s, count);
+	if (s->error || count > MAX_CYCLE_TIMERS) {
+		s->error = 1;
+		return;
+	}
+	if (!s->restore) {
+		for (avr_cycle_timer_slot_p t = pool->timer; t; t = t->next) {
+			AVR_SNAPSHOT_FIELD(s, t->when);
+			_avr_snapshot_function(s, &t->timer);
+			avr_snapshot_pointer(s, &t->param);
+		}
+		return;
+	}
+	avr_cycle_timer_slot_p last = NULL;
+
+	memset(pool, 0, sizeof(*pool));
+	for (uint32_t i = 0; i < MAX_CYCLE_TIMERS; i++) {
+		avr_cycle_timer_slot_p t = &pool->timer_slots[i];
+
+		if (i < count) {
+			AVR_SNAPSHOT_FIELD(s, t->when);
+			_avr_snapshot_function(s, &t->timer);
+			avr_snapshot_pointer(s, &t->param);
+		}
+		// a timer that could not be rebound is not queued
+		if (i < count && !s->error) {
+			if (last)
+				last->next = t;
+			else
+				pool->timer = t;
+			last = t;
+		} else {
+			t->next = pool->timer_free;
+			pool->timer_free = t;
+		}
+	}
+}
+
+void
+avr_snapshot_state(
+		avr_snapshot_t * s)
+{
+	avr_t * avr = s->avr;
+
+	_avr_snapshot_header(s);
+	_avr_snapshot_core(s);
+	_avr_snapshot_interrupts(s);
+	_avr_snapshot_irqs(s);
+	_avr_snapshot_modules(s);
+	_avr_snapshot_cycle_timers(s);
+	// after the timers, as rebuilding the queue does not set them
+	AVR_SNAPSHOT_FIELD(s, avr->run_cycle_count);
+	AVR_SNAPSHOT_FIELD(s, avr->run_cycle_limit);
+}
+
+static int
+_avr_snapshot_save(
+		avr_t * avr,
+		uint8_t ** blob,
+		size_t * len,
+		int file)
+{
+	avr_snapshot_t s = { .avr = avr, .file = file };
+
+	avr_snapshot_state(&s);
+	if (s.error) {
+		free(s.buf);
+		return -1;
+	}
+	*blob = s.buf;
+	*len = s.len;
+	return 0;
+}
+
+static int
+_avr_snapshot_restore(
+		avr_t * avr,
+		const uint8_t * blob,
+		size_t len,
+		int file)
+{
+	avr_snapshot_t s = { .avr = avr, .restore = 1, .file = file,
+			.buf = (uint8_t *)blob, .len = len };
+
+	// check it's for us before touching anything
+	_avr_snapshot_header(&s);
+	if (s.error) {
+		AVR_LOG(avr, LOG_ERROR,
+				"SNAPSHOT: not a snapshot of this %s\n", avr->mmcu);
+		return -1;
+	}
+	s.pos = 0;
+	avr_snapshot_state(&s);
+	if (s.error) {
+		AVR_LOG(avr, LOG_ERROR, "SNAPSHOT: corrupt snapshot\n");
+		return -1;
+	}
+	// the shadow call stack can't be trusted across a restore
+	if (avr->stack)
+		avr_stack_reset(avr);
+	// nor the dirty blocks, all of memory was written
+	if (avr->dirty)
+		avr->dirty->base = NULL;
+	return 0;
+}
+
+int
+avr_snapshot_save(
+		avr_t * avr,
+		uint8_t ** blob,
+		size_t * len)
+{
+	return _avr_snapshot_save(avr, blob, len, 0);
+}
+
+int
+avr_snapshot_restore(
+		avr_t * avr,
+		const uint8_t * blob,
+		size_t len)
+{
+	return _avr_snapshot_restore(avr, blob, len, 0);
+}
+
+int
+avr_snapshot_save_file(
+		avr_t * avr,
+		const char * filename)
+{
+	uint8_t * blob;
+	size_t len;
+	FILE * f;
+	int res = 0;
+
+	if (_avr_snapshot_save(avr, &blob, &len, 1))
+		return -1;
+	f = fopen(filename, "wb");
+	if (!f) {
+		AVR_LOG(avr, LOG_ERROR, "SNAPSHOT: Can't create %s\n", filename);
+		free(blob);
+		return -1;
+	}
+	if (fwrite(blob, 1, len, f) != len)
+		res = -1;
+	if (fclose(f))
+		res = -1;
+	free(blob);
+	return res;
+}
+
+int
+avr_snapshot_restore_file(
+		avr_t * avr,
+		const char * filename)
+{
+	uint8_t * blob = NULL;
+	long len;
+	FILE * f;
+	int res = -1;
+
+	f = fopen(filename, "rb");
+	if (!f) {
+		AVR_LOG(avr, LOG_ERROR, "SNAPSHOT: Can't open %s\n", filename);
+		return -1;
+	}
+	if (!fseek(f, 0, SEEK_END) && (len = ftell(f)) > 0 &&
+			!fseek(f, 0, SEEK_SET) && (blob = malloc(len)) &&
+			fread(blob, 1, len, f) == (size_t)len)
+		res = _avr_snapshot_restore(avr, blob, len, 1);
+	fclose(f);
+	free(blob);
+	return res;
+}
@@ -0,0 +1,124 @@
+/*
+	sim_snapshot.h
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Save and restore the complete runtime state of a simulated AVR: CPU,
+ * SRAM, IO registers, flash, interrupt table, IRQ values, pending cycle
+ * timers and the private state of each IO module.
+ *
+ * A snapshot is restored into an instance of the same core, made the same
+ * way (same firmware loaded, same IO modules and external parts created),
+ * as IRQ connections and notify hooks are wiring, not state, and are not
+ * saved.  Cycle timer callbacks are rebound by identity: a parameter that
+ * points inside the core is stored as an offset and relocated, one that
+ * is an IRQ of the pool is stored as its index. Anything else is stored
+ * as is, and so are the callbacks, so a snapshot in memory is only valid
+ * in the process that made it.
+ *
+ * The file versions store each callback as an offset in the program or
+ * shared library it is in, so it can be restored by another process
+ * running the same build; they fail when a pointer only valid in this
+ * process is met (the parameter of a part's timer, say), rather than
+ * write a file that can't be restored. They need dl_iterate_phdr(), so
+ * elsewhere than on Linux and the BSDs, there can be no pending cycle
+ * timers. Either way, a snapshot file is not portable between builds.
+ */
+
+#ifndef __SIM_SNAPSHOT_H__
+#define __SIM_SNAPSHOT_H__
+
+#include "sim_avr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Serialisation stream. The same function describes the state for both
+ * directions, so IO modules only write one 'snapshot' callback.
+ */
+typedef struct avr_snapshot_t {
+	struct avr_t *	avr;
+	int				restore;	// reading back from 'buf'
+	int				error;
+	uint8_t *		buf;
+	size_t			len;		// bytes in buf
+	size_t			size;		// allocated, when saving
+	size_t			pos;		// read cursor, when restoring
+	int				no_memory;	// leave data space and flash out
+	int				file;		// refuse pointers only valid in this process
+} avr_snapshot_t;
+
+// Save avr's state into a malloc()ed blob, that the caller free()s.
+int
+avr_snapshot_save(
+		struct avr_t * avr,
+		uint8_t ** blob,
+		size_t * len);
+
+/*
+ * Restore from a blob made by avr_snapshot_save(). The header is checked
+ * before anything is changed, but if the stream turns out to be corrupt
+ * past that, the instance is left half restored and should be reset.
+ */
+int
+avr_snapshot_restore(
+		struct avr_t * avr,
+		const uint8_t * blob,
+		size_t len);
+
+int
+avr_snapshot_save_file(
+		struct avr_t * avr,
+		const char * filename);
+int
+avr_snapshot_restore_file(
+		struct avr_t * avr,
+		const char * filename);
+
+// Helpers for the IO module 'snapshot' callbacks.
+
+// Copy 'len' bytes to or from the stream.
+void
+avr_snapshot_bytes(
+		avr_snapshot_t * s,
+		void * data,
+		size_t len);
+
+// Copy a variable or structure field (not a bitfield).
+#define AVR_SNAPSHOT_FIELD(_s, _f) avr_snapshot_bytes((_s), &(_f), sizeof(_f))
+
+// Copy a pointer, relocated as for cycle timer parameters.
+void
+avr_snapshot_pointer(
+		avr_snapshot_t * s,
+		void ** p);
+
+// Private, for sim_checkpoint.c: run the whole stream in either direction.
+void
+avr_snapshot_state(
+		avr_snapshot_t * s);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* __SIM_SNAPSHOT_H__ */
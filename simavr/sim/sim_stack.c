@@ -0,0 +1,311 @@
+/*
+	sim_stack.c
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "sim_avr.h"
+#include "sim_core.h"
+#include "sim_stack.h"
+#include "sim_symbols.h"
+
+#define FUNC_TABLE_MIN	64
+
+static avr_stack_func_t *
+_avr_stack_func_slot(
+		avr_stack_func_t * table,
+		uint32_t size,
+		avr_flashaddr_t pc)
+{
+	uint32_t i = ((pc >> 1) * 2654435761u) & (size - 1);
+
+	while (table[i].calls && table[i].pc != pc)
+		i = (i + 1) & (size - 1);
+	return table + i;
+}
+
+static avr_stack_func_t *
+_avr_stack_func_get(
+		avr_stack_t * s,
+		avr_flashaddr_t pc)
+{
+	avr_stack_func_t * f;
+
+	// keep the table under 3/4 full
+	if ((s->func_count + 1) * 4 > s->func_size * 3) {
+		uint32_t size = s->func_size ? s->func_size * 2 : FUNC_TABLE_MIN;
+		avr_stack_func_t * table = calloc(size, sizeof(*table));
+
+		for (uint32_t i = 0; i < s->func_size; i++)
+			if (s->func[i].calls)
+				*_avr_stack_func_slot(table, size, s->func[i].pc) = s->func[i];
+		free(s->func);
+		s->func = table;
+		s->func_size = size;
+	}
+	f = _avr_stack_func_slot(s->func, s->func_size, pc);
+	if (!f->calls) {
+		f->pc = pc;
+		s->func_count++;
+	}
+	return f;
+}
+
+/*
+ * Pop frames whose entry SP is at or below 'sp' (above, if !inclusive),
+ * charging their usage to the function or vector and folding their
+ * low water mark into the caller.
+ */
+static void
+_avr_stack_unwind(
+		avr_t * avr,
+		uint16_t sp,
+		int inclusive)
+{
+	avr_stack_t * s = avr->stack;
+
+	while (s->depth > 0) {
+		avr_stack_frame_t * f = &s->frame[s->depth - 1];
+		uint16_t usage;
+
+		if (f->sp > sp || (f->sp == sp && !inclusive))
+			break;
+		usage = f->sp - f->min_sp;
+		if (f->vector) {
+			if (usage > s->vector_max_usage[f->vector])
+				s->vector_max_usage[f->vector] = usage;
+		} else {
+			avr_stack_func_t * fn = _avr_stack_func_get(s, f->target);
+
+			if (usage > fn->max_usage)
+				fn->max_usage = usage;
+		}
+		if (--s->depth > 0 && f->min_sp < f[-1].min_sp)
+			f[-1].min_sp = f->min_sp;
+	}
+}
+
+void
+avr_stack_sp_changed(
+		avr_t * avr)
+{
+	avr_stack_t * s = avr->stack;
+	uint16_t sp = _avr_sp_get(avr);
+
+	if (s->depth > 0) {
+		avr_stack_frame_t * f = &s->frame[s->depth - 1];
+
+		if (sp > f->sp)		// longjmp() or similar
+			_avr_stack_unwind(avr, sp, 0);
+		else if (sp < f->min_sp)
+			f->min_sp = sp;
+	}
+	if (sp < s->min_sp) {
+		s->min_sp = sp;
+		s->min_sp_pc = avr->pc;
+		s->min_sp_cycle = avr->cycle;
+		s->worst_depth = s->depth;
+		memcpy(s->worst, s->frame, s->depth * sizeof(s->frame[0]));
+	}
+}
+
+void
+avr_stack_call(
+		avr_t * avr,
+		avr_flashaddr_t caller,
+		avr_flashaddr_t target,
+		uint8_t vector)
+{
+	avr_stack_t * s = avr->stack;
+	uint16_t sp = _avr_sp_get(avr);
+	avr_stack_frame_t * f;
+
+	if (vector)
+		s->vector_count[vector]++;
+	else
+		_avr_stack_func_get(s, target)->calls++;
+	if (s->depth >= AVR_STACK_MAX_DEPTH) {
+		s->lost++;
+		return;
+	}
+	f = &s->frame[s->depth++];
+	f->target = target;
+	f->caller = caller;
+	f->sp = sp + avr->address_size;
+	f->min_sp = sp;
+	f->vector = vector;
+
+	// the push that made the new low was seen before this frame existed
+	if (sp == s->min_sp) {
+		s->worst_depth = s->depth;
+		memcpy(s->worst, s->frame, s->depth * sizeof(s->frame[0]));
+	}
+}
+
+void
+avr_stack_return(
+		avr_t * avr)
+{
+	_avr_stack_unwind(avr, _avr_sp_get(avr), 1);
+}
+
+void
+avr_stack_reset(
+		avr_t * avr)
+{
+	avr->stack->depth = 0;
+}
+
+int
+avr_stack_watch_start(
+		avr_t * avr)
+{
+	if (avr->stack)
+		return 0;
+	avr->stack = calloc(1, sizeof(avr_stack_t));
+	if (!avr->stack)
+		return -1;
+	avr->stack->min_sp = _avr_sp_get(avr);
+	avr->stack->min_sp_pc = avr->pc;
+	avr->stack->min_sp_cycle = avr->cycle;
+	return 0;
+}
+
+void
+avr_stack_watch_stop(
+		avr_t * avr)
+{
+	if (!avr->stack)
+		return;
+	free(avr->stack->func);
+	free(avr->stack);
+	avr->stack = NULL;
+}
+
+const avr_stack_func_t *
+avr_stack_watch_get_function(
+		avr_t * avr,
+		avr_flashaddr_t pc)
+{
+	avr_stack_t * s = avr->stack;
+	avr_stack_func_t * f;
+
+	if (!s || !s->func)
+		return NULL;
+	f = _avr_stack_func_slot(s->func, s->func_size, pc);
+	return f->calls ? f : NULL;
+}
+
+static int
+_avr_stack_func_cmp(
+		const void * a,
+		const void * b)
+{
+	const avr_stack_func_t * fa = a, * fb = b;
+
+	if (fa->max_usage != fb->max_usage)
+		return fb->max_usage - fa->max_usage;
+	return fa->pc < fb->pc ? -1 : fa->pc > fb->pc;
+}
+
+void
+avr_stack_watch_report(
+		avr_t * avr,
+		FILE * out)
+{
+	avr_stack_t * s = avr->stack;
+	avr_stack_func_t * table = NULL;
+	uint16_t vector_usage[MAX_VECTOR_COUNT];
+	uint16_t min_sp = 0xffff;
+	char where[128], from[128];
+	uint32_t n = 0;
+
+	if (!s)
+		return;
+	/*
+	 * Frames still open (main never returns) count as well. They are
+	 * folded into copies, so the report can be made again later on.
+	 */
+	memcpy(vector_usage, s->vector_max_usage, sizeof(vector_usage));
+	if (s->func_count) {
+		table = malloc(s->func_size * sizeof(*table));
+		memcpy(table, s->func, s->func_size * sizeof(*table));
+	}
+	for (int i = s->depth - 1; i >= 0; i--) {
+		avr_stack_frame_t * f = &s->frame[i];
+		uint16_t usage;
+
+		if (f->min_sp < min_sp)
+			min_sp = f->min_sp;
+		usage = f->sp - min_sp;
+		if (f->vector) {
+			if (usage > vector_usage[f->vector])
+				vector_usage[f->vector] = usage;
+		} else if (table) {
+			avr_stack_func_t * fn = table +
+				(_avr_stack_func_slot(s->func, s->func_size, f->target) -
+						s->func);
+
+			if (fn->calls && usage > fn->max_usage)
+				fn->max_usage = usage;
+		}
+	}
+
+	fprintf(out, "Stack: lowest SP %04x, %d bytes below RAMEND, "
+			"PC %s cycle %" PRI_avr_cycle_count "\n",
+			s->min_sp, avr->ramend - s->min_sp,
+			avr_symbols_format(avr, s->min_sp_pc, where, sizeof(where)),
+			s->min_sp_cycle);
+	if (s->worst_depth) {
+		fprintf(out, "  call chain at lowest SP:\n");
+		for (int i = s->worst_depth - 1; i >= 0; i--) {
+			avr_stack_frame_t * f = &s->worst[i];
+
+			avr_symbols_format(avr, f->target, where, sizeof(where));
+			avr_symbols_format(avr, f->caller, from, sizeof(from));
+			if (f->vector)
+				fprintf(out, "    #%-2d vector %d (%s) "
+						"interrupting %s, sp %04x\n",
+						i, f->vector, where, from, f->sp);
+			else
+				fprintf(out, "    #%-2d %s called from %s, sp %04x\n",
+						i, where, from, f->sp);
+		}
+	}
+	if (s->lost)
+		fprintf(out, "  %u calls deeper than %d not tracked\n",
+				s->lost, AVR_STACK_MAX_DEPTH);
+	for (int v = 1; v < MAX_VECTOR_COUNT; v++) {
+		if (s->vector_count[v])
+			fprintf(out, "  vector %2d: %8u entries, max %4u bytes\n",
+					v, s->vector_count[v], vector_usage[v]);
+	}
+	if (!table)
+		return;
+	for (uint32_t i = 0; i < s->func_size; i++)
+		if (table[i].calls)
+			table[n++] = table[i];
+	qsort(table, n, sizeof(*table), _avr_stack_func_cmp);
+	for (uint32_t i = 0; i < n; i++)
+		fprintf(out, "  function %s: %8u calls, max %4u bytes\n",
+				avr_symbols_format(avr, table[i].pc, where, sizeof(where)),
+				table[i].calls, table[i].max_usage);
+	free(table);
+}
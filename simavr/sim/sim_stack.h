@@ -0,0 +1,132 @@
+/*
+	sim_stack.h
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Stack usage tracking.  Unlike AVR_STACK_WATCH this does not need
+ * CONFIG_SIMAVR_TRACE: it is enabled per instance by avr_stack_watch_start()
+ * and costs one pointer test per call, return and SP write when off.
+ *
+ * The core keeps a shadow call stack from CALL/RCALL/ICALL/EICALL and
+ * interrupt entry, unwound by comparing the SP on return, so unbalanced
+ * code (longjmp, coroutines) does not confuse it.  All usage figures are
+ * bytes below the SP of the caller, including the return address.
+ */
+
+#ifndef __SIM_STACK_H__
+#define __SIM_STACK_H__
+
+#include <stdio.h>
+#include "sim_avr_types.h"
+#include "sim_interrupts.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AVR_STACK_MAX_DEPTH	64
+
+typedef struct avr_stack_frame_t {
+	avr_flashaddr_t	target;		// function entry or vector address (bytes)
+	avr_flashaddr_t	caller;		// PC of the call instruction
+	uint16_t		sp;			// SP before the return address was pushed
+	uint16_t		min_sp;		// lowest SP seen inside this frame
+	uint8_t			vector;		// non-zero for an interrupt frame
+} avr_stack_frame_t;
+
+typedef struct avr_stack_func_t {
+	avr_flashaddr_t	pc;			// entry address
+	uint32_t		calls;		// zero for an empty slot
+	uint16_t		max_usage;	// worst case, callees included
+} avr_stack_func_t;
+
+typedef struct avr_stack_t {
+	uint16_t			min_sp;		// lowest SP since start
+	avr_flashaddr_t		min_sp_pc;
+	avr_cycle_count_t	min_sp_cycle;
+
+	// per interrupt vector, indexed by vector number
+	uint32_t			vector_count[MAX_VECTOR_COUNT];
+	uint16_t			vector_max_usage[MAX_VECTOR_COUNT];
+
+	// the shadow call stack
+	int					depth;
+	uint32_t			lost;		// frames not recorded, too deep
+	avr_stack_frame_t	frame[AVR_STACK_MAX_DEPTH];
+
+	// copy of the shadow stack when min_sp was reached
+	int					worst_depth;
+	avr_stack_frame_t	worst[AVR_STACK_MAX_DEPTH];
+
+	// per function, open addressed hash table on the entry address
+	uint32_t			func_count;
+	uint32_t			func_size;
+	avr_stack_func_t *	func;
+} avr_stack_t;
+
+// Allocate avr->stack and start tracking from the current SP.
+int
+avr_stack_watch_start(
+		struct avr_t * avr);
+
+// Stop tracking and release avr->stack.
+void
+avr_stack_watch_stop(
+		struct avr_t * avr);
+
+// Look up the record for the function at 'pc', NULL if never called.
+const avr_stack_func_t *
+avr_stack_watch_get_function(
+		struct avr_t * avr,
+		avr_flashaddr_t pc);
+
+/*
+ * Print a summary: high water mark, call chain, vectors, top functions,
+ * named from the firmware symbols. The state is left as it is, so this
+ * can be called again later.
+ */
+void
+avr_stack_watch_report(
+		struct avr_t * avr,
+		FILE * out);
+
+// Private, called by the core with avr->stack set.
+
+void
+avr_stack_sp_changed(
+		struct avr_t * avr);
+void
+avr_stack_call(
+		struct avr_t * avr,
+		avr_flashaddr_t caller,
+		avr_flashaddr_t target,
+		uint8_t vector);
+void
+avr_stack_return(
+		struct avr_t * avr);
+void
+avr_stack_reset(
+		struct avr_t * avr);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* __SIM_STACK_H__ */
@@ -0,0 +1,411 @@
+/*
+	sim_stats.c
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE		// dladdr()
+#include <stdlib.h>
+#include <string.h>
+#ifndef __MINGW32__
+#include <dlfcn.h>
+#endif
+#include "sim_avr.h"
+#include "sim_stats.h"
+
+static const char * op_names[AVR_STATS_OP_COUNT] = {
+	[AVR_STATS_OP_ALU] = "alu",
+	[AVR_STATS_OP_MUL] = "mul",
+	[AVR_STATS_OP_MOVE] = "move",
+	[AVR_STATS_OP_LOAD] = "load",
+	[AVR_STATS_OP_STORE] = "store",
+	[AVR_STATS_OP_BRANCH] = "branch",
+	[AVR_STATS_OP_JUMP] = "jump",
+	[AVR_STATS_OP_CALL] = "call",
+	[AVR_STATS_OP_RETURN] = "return",
+	[AVR_STATS_OP_BIT] = "bit",
+	[AVR_STATS_OP_FLASH] = "flash",
+	[AVR_STATS_OP_CONTROL] = "control",
+};
+
+const char *
+avr_stats_op_name(
+		int op_class)
+{
+	if (op_class < 0 || op_class >= AVR_STATS_OP_COUNT)
+		return "?";
+	return op_names[op_class];
+}
+
+/*
+ * Coarse decode, following the layout of the switch in avr_run_one().
+ * Invalid opcodes end up in whichever class their bit pattern is nearest.
+ */
+static int
+_avr_stats_classify(
+		uint16_t o)
+{
+	switch (o & 0xf000) {
+		case 0x0000:
+			if (o == 0)
+				return AVR_STATS_OP_CONTROL;
+			if ((o & 0xff00) == 0x0100)
+				return AVR_STATS_OP_MOVE;			// movw
+			if ((o & 0xfe00) == 0x0200)
+				return AVR_STATS_OP_MUL;			// muls, mulsu, fmul*
+			return AVR_STATS_OP_ALU;
+		case 0x1000:
+			if ((o & 0xfc00) == 0x1000)
+				return AVR_STATS_OP_BRANCH;			// cpse
+			return AVR_STATS_OP_ALU;
+		case 0x2000:
+			if ((o & 0xfc00) == 0x2c00)
+				return AVR_STATS_OP_MOVE;			// mov
+			return AVR_STATS_OP_ALU;
+		case 0x8000:
+		case 0xa000:
+			return (o & 0x0200) ? AVR_STATS_OP_STORE : AVR_STATS_OP_LOAD;
+		case 0x9000:
+			switch (o & 0xfe00) {
+				case 0x9000:
+					if ((o & 0xe) == 0x4 || (o & 0xe) == 0x6)
+						return AVR_STATS_OP_FLASH;	// lpm, elpm
+					return AVR_STATS_OP_LOAD;
+				case 0x9200:
+					return AVR_STATS_OP_STORE;
+				case 0x9400:
+					switch (o) {
+						case 0x9409: case 0x9419:
+							return AVR_STATS_OP_JUMP;
+						case 0x9509: case 0x9519:
+							return AVR_STATS_OP_CALL;
+						case 0x9508: case 0x9518:
+							return AVR_STATS_OP_RETURN;
+						case 0x9588: case 0x9598: case 0x95a8:
+							return AVR_STATS_OP_CONTROL;
+						case 0x95c8: case 0x95d8: case 0x95e8: case 0x95f8:
+							return AVR_STATS_OP_FLASH;
+					}
+					if ((o & 0xff0f) == 0x9408)
+						return AVR_STATS_OP_BIT;	// bset, bclr
+					if ((o & 0x000e) == 0x000c)
+						return AVR_STATS_OP_JUMP;	// jmp
+					if ((o & 0x000e) == 0x000e)
+						return AVR_STATS_OP_CALL;	// call
+					return AVR_STATS_OP_ALU;
+				case 0x9600:
+					return AVR_STATS_OP_ALU;		// adiw, sbiw
+				case 0x9800:
+				case 0x9a00:
+					return (o & 0x0100) ?
+							AVR_STATS_OP_BRANCH : AVR_STATS_OP_BIT;
+				default:
+					return AVR_STATS_OP_MUL;
+			}
+		case 0xb000:
+			return (o & 0x0800) ? AVR_STATS_OP_STORE : AVR_STATS_OP_LOAD;
+		case 0xc000:
+			return AVR_STATS_OP_JUMP;
+		case 0xd000:
+			return AVR_STATS_OP_CALL;
+		case 0xe000:
+			return AVR_STATS_OP_MOVE;
+		case 0xf000:
+			if ((o & 0x0c00) == 0x0800)
+				return AVR_STATS_OP_BIT;			// bld, bst
+			return AVR_STATS_OP_BRANCH;
+		default:
+			return AVR_STATS_OP_ALU;	// cpi, sbci, subi, ori, andi
+	}
+}
+
+void
+avr_stats_instruction(
+		avr_t * avr,
+		uint16_t opcode,
+		int cycles)
+{
+	avr_stats_t * s = avr->stats;
+	int c = _avr_stats_classify(opcode);
+
+	s->instructions++;
+	s->op_count[c]++;
+	s->op_cycles[c] += cycles;
+}
+
+static avr_stats_counter_t *
+_avr_stats_slot(
+		avr_stats_counter_t * slot,
+		uint32_t size,
+		const void * key)
+{
+	uint32_t i = ((uintptr_t)key >> 3) * 2654435761u & (size - 1);
+
+	while (slot[i].key && slot[i].key != key)
+		i = (i + 1) & (size - 1);
+	return slot + i;
+}
+
+void
+avr_stats_count(
+		avr_stats_table_t * t,
+		const void * key,
+		const char * name)
+{
+	avr_stats_counter_t * c;
+
+	if ((t->count + 1) * 4 > t->size * 3) {
+		uint32_t size = t->size ? t->size * 2 : 64;
+		avr_stats_counter_t * slot = calloc(size, sizeof(*slot));
+
+		for (uint32_t i = 0; i < t->size; i++)
+			if (t->slot[i].key)
+				*_avr_stats_slot(slot, size, t->slot[i].key) = t->slot[i];
+		free(t->slot);
+		t->slot = slot;
+		t->size = size;
+	}
+	c = _avr_stats_slot(t->slot, t->size, key);
+	if (!c->key) {
+		c->key = key;
+		c->name = name ? strdup(name) : NULL;
+		t->count++;
+	}
+	c->count++;
+}
+
+static uint64_t
+_avr_stats_get(
+		avr_stats_table_t * t,
+		const void * key)
+{
+	if (!t->size)
+		return 0;
+	return _avr_stats_slot(t->slot, t->size, key)->count;
+}
+
+uint64_t
+avr_stats_get_irq(
+		avr_t * avr,
+		avr_irq_t * irq)
+{
+	return avr->stats ? _avr_stats_get(&avr->stats->irqs, irq) : 0;
+}
+
+uint64_t
+avr_stats_get_timer(
+		avr_t * avr,
+		avr_cycle_timer_t timer)
+{
+	return avr->stats ?
+			_avr_stats_get(&avr->stats->timers, (const void *)timer) : 0;
+}
+
+static void
+_avr_stats_empty(
+		avr_stats_table_t * t)
+{
+	for (uint32_t i = 0; i < t->size; i++)
+		free(t->slot[i].name);
+	if (t->slot)
+		memset(t->slot, 0, t->size * sizeof(*t->slot));
+	t->count = 0;
+}
+
+int
+avr_stats_start(
+		avr_t * avr)
+{
+	avr_stats_t * s;
+
+	if (avr->stats)
+		return 0;
+	s = calloc(1, sizeof(*s));
+	if (!s)
+		return -1;
+	s->io_count = avr->ioend - avr->io_offset + 1;
+	s->io_reads = calloc(s->io_count, sizeof(uint64_t));
+	s->io_writes = calloc(s->io_count, sizeof(uint64_t));
+	s->start_cycle = avr->cycle;
+	avr->stats = s;
+	return 0;
+}
+
+void
+avr_stats_stop(
+		avr_t * avr)
+{
+	avr_stats_t * s = avr->stats;
+
+	if (!s)
+		return;
+	avr->stats = NULL;
+	free(s->io_reads);
+	free(s->io_writes);
+	_avr_stats_empty(&s->timers);
+	_avr_stats_empty(&s->irqs);
+	free(s->timers.slot);
+	free(s->irqs.slot);
+	free(s);
+}
+
+void
+avr_stats_clear(
+		avr_t * avr)
+{
+	avr_stats_t * s = avr->stats;
+
+	if (!s)
+		return;
+	s->start_cycle = avr->cycle;
+	s->sleep_cycles = 0;
+	s->instructions = 0;
+	memset(s->op_count, 0, sizeof(s->op_count));
+	memset(s->op_cycles, 0, sizeof(s->op_cycles));
+	memset(s->interrupts, 0, sizeof(s->interrupts));
+	memset(s->io_reads, 0, s->io_count * sizeof(uint64_t));
+	memset(s->io_writes, 0, s->io_count * sizeof(uint64_t));
+	_avr_stats_empty(&s->timers);
+	_avr_stats_empty(&s->irqs);
+}
+
+static int
+_avr_stats_counter_cmp(
+		const void * a,
+		const void * b)
+{
+	const avr_stats_counter_t * ca = a, * cb = b;
+
+	return ca->count < cb->count ? 1 : ca->count > cb->count ? -1 : 0;
+}
+
+/*
+ * Cycle timer callbacks are in the host program, not the firmware: name
+ * them from the dynamic symbols, or as an offset in their module, which
+ * addr2line can make sense of.
+ */
+static const char *
+_avr_stats_timer_name(
+		const void * timer,
+		char * buf,
+		size_t len)
+{
+#ifndef __MINGW32__
+	Dl_info info;
+
+	if (dladdr(timer, &info) && info.dli_fname) {
+		const char * base = strrchr(info.dli_fname, '/');
+
+		if (info.dli_sname && info.dli_saddr == timer)
+			return info.dli_sname;
+		snprintf(buf, len, "%s+0x%lx", base ? base + 1 : info.dli_fname,
+				(unsigned long)((uintptr_t)timer - (uintptr_t)info.dli_fbase));
+		return buf;
+	}
+#endif
+	snprintf(buf, len, "%p", timer);
+	return buf;
+}
+
+// Returns a sorted copy of the used slots, caller frees.
+static avr_stats_counter_t *
+_avr_stats_sorted(
+		avr_stats_table_t * t)
+{
+	avr_stats_counter_t * sorted;
+	uint32_t n = 0;
+
+	sorted = malloc((t->count + 1) * sizeof(*sorted));
+	for (uint32_t i = 0; i < t->size; i++)
+		if (t->slot[i].key)
+			sorted[n++] = t->slot[i];
+	qsort(sorted, n, sizeof(*sorted), _avr_stats_counter_cmp);
+	return sorted;
+}
+
+void
+avr_stats_report(
+		avr_t * avr,
+		FILE * out,
+		int top)
+{
+	avr_stats_t * s = avr->stats;
+	avr_cycle_count_t total;
+	avr_stats_counter_t * sorted;
+	int n;
+
+	if (!s)
+		return;
+	total = avr->cycle - s->start_cycle;
+	fprintf(out, "Cycles: %" PRI_avr_cycle_count " running %"
+			PRI_avr_cycle_count " sleeping %" PRI_avr_cycle_count
+			" (%.1f%%)\n",
+			total, total - s->sleep_cycles, s->sleep_cycles,
+			total ? 100.0 * s->sleep_cycles / total : 0.0);
+	fprintf(out, "Instructions: %" PRIu64 "\n", s->instructions);
+	for (int i = 0; i < AVR_STATS_OP_COUNT; i++) {
+		if (!s->op_count[i])
+			continue;
+		fprintf(out, "  %-8s %12" PRIu64 " %5.1f%% %12" PRIu64 " cycles\n",
+				op_names[i], s->op_count[i],
+				100.0 * s->op_count[i] / s->instructions, s->op_cycles[i]);
+	}
+	for (int i = 1; i < MAX_VECTOR_COUNT; i++) {
+		if (s->interrupts[i])
+			fprintf(out, "Interrupt vector %2d: %" PRIu64 "\n",
+					i, s->interrupts[i]);
+	}
+
+	// IO registers, busiest first
+	sorted = malloc(s->io_count * sizeof(*sorted));
+	for (int i = 0; i < s->io_count; i++) {
+		sorted[i].key = (const void *)(uintptr_t)i;
+		sorted[i].count = s->io_reads[i] + s->io_writes[i];
+	}
+	qsort(sorted, s->io_count, sizeof(*sorted), _avr_stats_counter_cmp);
+	if (s->io_count && sorted[0].count)
+		fprintf(out, "IO registers (reads/writes):\n");
+	for (n = 0; n < top && n < s->io_count && sorted[n].count; n++) {
+		int i = (uintptr_t)sorted[n].key;
+
+		fprintf(out, "  %-8s %12" PRIu64 " %12" PRIu64 "\n",
+				avr_regname(avr, i + 32), s->io_reads[i], s->io_writes[i]);
+	}
+	free(sorted);
+
+	if (s->timers.count) {
+		fprintf(out, "Cycle timers fired:\n");
+		sorted = _avr_stats_sorted(&s->timers);
+		for (n = 0; n < top && n < s->timers.count; n++) {
+			char name[64];
+
+			fprintf(out, "  %-24s %12" PRIu64 "\n",
+					_avr_stats_timer_name(sorted[n].key, name, sizeof(name)),
+					sorted[n].count);
+		}
+		free(sorted);
+	}
+	if (s->irqs.count) {
+		fprintf(out, "IRQs raised:\n");
+		sorted = _avr_stats_sorted(&s->irqs);
+		for (n = 0; n < top && n < s->irqs.count; n++)
+			fprintf(out, "  %-24s %12" PRIu64 "\n",
+					sorted[n].name ? sorted[n].name : "?", sorted[n].count);
+		free(sorted);
+	}
+}
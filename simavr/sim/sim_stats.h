@@ -0,0 +1,150 @@
+/*
+	sim_stats.h
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Optional performance counters.  When avr->stats is NULL (the default)
+ * the only cost is a pointer test at each hook.  Counters cover both the
+ * firmware (instruction mix, IO register traffic, interrupts) and the
+ * simulator itself (cycle timers fired, IRQs raised).
+ */
+
+#ifndef __SIM_STATS_H__
+#define __SIM_STATS_H__
+
+#include <stdio.h>
+#include "sim_avr_types.h"
+#include "sim_irq.h"
+#include "sim_interrupts.h"
+#include "sim_cycle_timers.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Instruction classes for the opcode histogram.
+enum {
+	AVR_STATS_OP_ALU = 0,	// arithmetic, logic, compare, shift
+	AVR_STATS_OP_MUL,
+	AVR_STATS_OP_MOVE,		// mov, movw, ldi
+	AVR_STATS_OP_LOAD,		// ld, ldd, lds, pop, in
+	AVR_STATS_OP_STORE,		// st, std, sts, push, out, xch...
+	AVR_STATS_OP_BRANCH,	// conditional branches and skips
+	AVR_STATS_OP_JUMP,		// rjmp, jmp, ijmp, eijmp
+	AVR_STATS_OP_CALL,		// rcall, call, icall, eicall
+	AVR_STATS_OP_RETURN,	// ret, reti
+	AVR_STATS_OP_BIT,		// sbi, cbi, bset, bclr, bst, bld
+	AVR_STATS_OP_FLASH,		// lpm, elpm, spm
+	AVR_STATS_OP_CONTROL,	// nop, sleep, wdr, break
+	AVR_STATS_OP_COUNT,
+};
+
+/*
+ * Counter keyed by an IRQ or cycle timer callback. The name of an IRQ is
+ * copied when it is first counted, as it may be freed before the report.
+ */
+typedef struct avr_stats_counter_t {
+	const void *	key;		// NULL for an empty slot
+	char *			name;		// IRQs only
+	uint64_t		count;
+} avr_stats_counter_t;
+
+typedef struct avr_stats_table_t {
+	uint32_t				count;
+	uint32_t				size;
+	avr_stats_counter_t *	slot;
+} avr_stats_table_t;
+
+typedef struct avr_stats_t {
+	avr_cycle_count_t	start_cycle;	// avr->cycle when started or cleared
+	avr_cycle_count_t	sleep_cycles;
+
+	uint64_t			instructions;
+	uint64_t			op_count[AVR_STATS_OP_COUNT];
+	uint64_t			op_cycles[AVR_STATS_OP_COUNT];
+
+	uint64_t			interrupts[MAX_VECTOR_COUNT];
+
+	// indexed by IO register number, as avr->io[]
+	uint32_t			io_count;
+	uint64_t *			io_reads;
+	uint64_t *			io_writes;
+
+	avr_stats_table_t	timers;		// keyed by avr_cycle_timer_t
+	avr_stats_table_t	irqs;		// keyed by avr_irq_t *
+} avr_stats_t;
+
+// Allocate avr->stats and start counting.
+int
+avr_stats_start(
+		struct avr_t * avr);
+
+// Stop counting and release avr->stats.
+void
+avr_stats_stop(
+		struct avr_t * avr);
+
+// Zero all counters.
+void
+avr_stats_clear(
+		struct avr_t * avr);
+
+// Name of an AVR_STATS_OP_* class.
+const char *
+avr_stats_op_name(
+		int op_class);
+
+// Number of times 'irq' was raised (and not filtered out).
+uint64_t
+avr_stats_get_irq(
+		struct avr_t * avr,
+		avr_irq_t * irq);
+
+// Number of times cycle timer callback 'timer' was called.
+uint64_t
+avr_stats_get_timer(
+		struct avr_t * avr,
+		avr_cycle_timer_t timer);
+
+// Print all counters, busiest first, at most 'top' lines per table.
+void
+avr_stats_report(
+		struct avr_t * avr,
+		FILE * out,
+		int top);
+
+// Private, called by the core with avr->stats set.
+
+void
+avr_stats_instruction(
+		struct avr_t * avr,
+		uint16_t opcode,
+		int cycles);
+void
+avr_stats_count(
+		avr_stats_table_t * table,
+		const void * key,
+		const char * name);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* __SIM_STATS_H__ */
@@ -0,0 +1,318 @@
+/*
+	sim_symbols.c
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim_symbols.h"
+#include "sim_elf.h"
+
+static uint32_t
+_avr_symbols_hash(
+		const char * s)
+{
+	uint32_t h = 2166136261u;
+
+	while (*s)
+		h = (h ^ (uint8_t)*s++) * 16777619u;
+	return h;
+}
+
+static int
+_avr_symbols_rehash(
+		avr_symbols_t * s)
+{
+	uint32_t size = s->hash_size ? s->hash_size * 2 : 256;
+	uint32_t * h = calloc(size, sizeof(*h));
+
+	if (!h)
+		return -1;
+	for (uint32_t i = 0; i < s->hash_size; i++) {
+		uint32_t o = s->hash[i], b;
+
+		if (!o)
+			continue;
+		b = _avr_symbols_hash(s->pool + o - 1) & (size - 1);
+		while (h[b])
+			b = (b + 1) & (size - 1);
+		h[b] = o;
+	}
+	free(s->hash);
+	s->hash = h;
+	s->hash_size = size;
+	return 0;
+}
+
+// Offset of 'name' in the pool, added if it is not there. Or -1.
+static int64_t
+_avr_symbols_intern(
+		avr_symbols_t * s,
+		const char * name)
+{
+	uint32_t len = strlen(name) + 1, b;
+
+	if (s->hash_count * 2 >= s->hash_size && _avr_symbols_rehash(s))
+		return -1;
+	b = _avr_symbols_hash(name) & (s->hash_size - 1);
+	for (; s->hash[b]; b = (b + 1) & (s->hash_size - 1))
+		if (!strcmp(s->pool + s->hash[b] - 1, name))
+			return s->hash[b] - 1;
+	if (s->pool_len + len > s->pool_size) {
+		uint32_t size = s->pool_size ? s->pool_size : 4096;
+		char * p;
+
+		while (size < s->pool_len + len)
+			size *= 2;
+		if (!(p = realloc(s->pool, size)))
+			return -1;
+		s->pool = p;
+		s->pool_size = size;
+	}
+	memcpy(s->pool + s->pool_len, name, len);
+	s->hash[b] = s->pool_len + 1;
+	s->hash_count++;
+	s->pool_len += len;
+	return s->pool_len - len;
+}
+
+int
+avr_symbols_add(
+		avr_t * avr,
+		int kind,
+		uint32_t addr,
+		uint32_t size,
+		const char * name,
+		uint32_t line)
+{
+	avr_symbols_t * s = avr->symbols;
+	avr_symbols_table_t * t;
+	int64_t o;
+
+	if (kind < 0 || kind >= AVR_SYMBOLS_KINDS || !name)
+		return -1;
+	if (!s && !(s = avr->symbols = calloc(1, sizeof(*s))))
+		return -1;
+	if ((o = _avr_symbols_intern(s, name)) < 0)
+		return -1;
+	t = &s->table[kind];
+	if (t->count == t->size) {
+		uint32_t n = t->size ? t->size * 2 : 256;
+		avr_symbols_range_t * r = realloc(t->r, n * sizeof(*r));
+
+		if (!r)
+			return -1;
+		t->r = r;
+		t->size = n;
+	}
+	if (kind != AVR_SYMBOLS_LINE)
+		line = name[0] == '_';
+	t->r[t->count++] = (avr_symbols_range_t) {
+		.addr = addr, .size = size, .name = o, .line = line };
+	t->sorted = 0;
+	return 0;
+}
+
+void
+avr_symbols_set_dwarf(
+		avr_t * avr,
+		const char * filename)
+{
+	avr_symbols_t * s = avr->symbols;
+
+	if (!s && !(s = avr->symbols = calloc(1, sizeof(*s))))
+		return;
+	free(s->dwarf_file);
+	s->dwarf_file = filename ? strdup(filename) : NULL;
+}
+
+/*
+ * By address, then for names at the same one, as avr_load_firmware()
+ * does: no leading '_' first, then the largest.
+ */
+static int
+_avr_symbols_cmp(
+		const void * a,
+		const void * b)
+{
+	const avr_symbols_range_t * ra = a, * rb = b;
+
+	if (ra->addr != rb->addr)
+		return ra->addr < rb->addr ? -1 : 1;
+	if (ra->line != rb->line)
+		return ra->line < rb->line ? -1 : 1;
+	return ra->size > rb->size ? -1 : ra->size < rb->size;
+}
+
+// Sort, keep one per address, and give the unsized ones their size.
+static void
+_avr_symbols_sort(
+		avr_symbols_table_t * t)
+{
+	uint32_t n = 0;
+
+	qsort(t->r, t->count, sizeof(t->r[0]), _avr_symbols_cmp);
+	for (uint32_t i = 0; i < t->count; i++)
+		if (!n || t->r[i].addr != t->r[n - 1].addr)
+			t->r[n++] = t->r[i];
+	t->count = n;
+	for (uint32_t i = 0; i + 1 < n; i++)
+		if (!t->r[i].size)
+			t->r[i].size = t->r[i + 1].addr - t->r[i].addr;
+	t->sorted = 1;
+}
+
+// Read the DWARF, the first time, and sort what was added since.
+static avr_symbols_t *
+_avr_symbols_ready(
+		avr_t * avr)
+{
+	avr_symbols_t * s = avr->symbols;
+
+	if (!s)
+		return NULL;
+	if (s->dwarf_file) {
+		char * f = s->dwarf_file;
+
+		s->dwarf_file = NULL;
+		avr_read_dwarf_symbols(avr, f);
+		free(f);
+	}
+	for (int k = 0; k < AVR_SYMBOLS_KINDS; k++)
+		if (!s->table[k].sorted)
+			_avr_symbols_sort(&s->table[k]);
+	return s;
+}
+
+static const avr_symbols_range_t *
+_avr_symbols_find(
+		avr_symbols_table_t * t,
+		uint32_t addr)
+{
+	uint32_t lo = 0, hi = t->count;
+	const avr_symbols_range_t * r;
+
+	// the last one starting at or before 'addr'
+	while (lo < hi) {
+		uint32_t mid = (lo + hi) / 2;
+
+		if (t->r[mid].addr <= addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (!lo)
+		return NULL;
+	r = &t->r[lo - 1];
+	if (r->size && addr - r->addr >= r->size)
+		return NULL;
+	return r;
+}
+
+static const char *
+_avr_symbols_lookup(
+		avr_t * avr,
+		int kind,
+		uint32_t addr,
+		uint32_t * offset)
+{
+	avr_symbols_t * s = _avr_symbols_ready(avr);
+	const avr_symbols_range_t * r;
+
+	if (!s || !(r = _avr_symbols_find(&s->table[kind], addr)))
+		return NULL;
+	if (offset)
+		*offset = addr - r->addr;
+	return s->pool + r->name;
+}
+
+const char *
+avr_symbols_code(
+		avr_t * avr,
+		uint32_t addr,
+		uint32_t * offset)
+{
+	return _avr_symbols_lookup(avr, AVR_SYMBOLS_CODE, addr, offset);
+}
+
+const char *
+avr_symbols_data(
+		avr_t * avr,
+		uint32_t addr,
+		uint32_t * offset)
+{
+	return _avr_symbols_lookup(avr, AVR_SYMBOLS_DATA, addr, offset);
+}
+
+const char *
+avr_symbols_line(
+		avr_t * avr,
+		uint32_t addr,
+		uint32_t * line)
+{
+	avr_symbols_t * s = _avr_symbols_ready(avr);
+	const avr_symbols_range_t * r;
+
+	if (!s || !(r = _avr_symbols_find(&s->table[AVR_SYMBOLS_LINE], addr)))
+		return NULL;
+	if (line)
+		*line = r->line;
+	return s->pool + r->name;
+}
+
+const char *
+avr_symbols_format(
+		avr_t * avr,
+		uint32_t addr,
+		char * buf,
+		size_t len)
+{
+	uint32_t offset = 0, line = 0;
+	const char * name = avr_symbols_code(avr, addr, &offset);
+	const char * file = avr_symbols_line(avr, addr, &line);
+	int n;
+
+	if (!name)
+		n = snprintf(buf, len, "0x%04x", addr);
+	else if (offset)
+		n = snprintf(buf, len, "%s+0x%x", name, offset);
+	else
+		n = snprintf(buf, len, "%s", name);
+	if (file && n >= 0 && n < len)
+		snprintf(buf + n, len - n, " (%s:%u)", file, line);
+	return buf;
+}
+
+void
+avr_symbols_stop(
+		avr_t * avr)
+{
+	avr_symbols_t * s = avr->symbols;
+
+	if (!s)
+		return;
+	avr->symbols = NULL;
+	for (int k = 0; k < AVR_SYMBOLS_KINDS; k++)
+		free(s->table[k].r);
+	free(s->dwarf_file);
+	free(s->pool);
+	free(s->hash);
+	free(s);
+}
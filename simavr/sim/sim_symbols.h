@@ -0,0 +1,131 @@
+/*
+	sim_symbols.h
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Addresses to names: the function or variable an address is in, and the
+ * source file and line of a flash address. This works in any build,
+ * unlike the per-word trace_data->codeline table of trace builds.
+ *
+ * avr_load_firmware() adds the ELF symbols, and gives the file to read
+ * DWARF debug information from. Nothing more is done until the first
+ * lookup: the DWARF is read then, and each table sorted once, to be
+ * searched. Names are kept once each in a string pool.
+ *
+ * A symbol of size 0 runs to the next one.
+ */
+
+#ifndef __SIM_SYMBOLS_H__
+#define __SIM_SYMBOLS_H__
+
+#include "sim_avr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+	AVR_SYMBOLS_CODE = 0,	// flash byte addresses
+	AVR_SYMBOLS_DATA,		// data space addresses
+	AVR_SYMBOLS_LINE,		// flash byte addresses, to file and line
+	AVR_SYMBOLS_KINDS
+};
+
+typedef struct avr_symbols_range_t {
+	uint32_t		addr;
+	uint32_t		size;
+	uint32_t		name;		// in the pool, the file for a line
+	uint32_t		line;		// or 1 for a name starting with '_'
+} avr_symbols_range_t;
+
+typedef struct avr_symbols_table_t {
+	avr_symbols_range_t * r;
+	uint32_t		count, size;
+	int				sorted;
+} avr_symbols_table_t;
+
+typedef struct avr_symbols_t {
+	avr_symbols_table_t	table[AVR_SYMBOLS_KINDS];
+	char *			dwarf_file;	// to read at the first lookup
+	char *			pool;
+	uint32_t		pool_len, pool_size;
+	uint32_t *		hash;		// pool offsets, to share names
+	uint32_t		hash_size, hash_count;
+} avr_symbols_t;
+
+/*
+ * Add a name, 'line' is only for AVR_SYMBOLS_LINE. The index is made if
+ * there was none. Returns -1 if out of memory.
+ */
+int
+avr_symbols_add(
+		avr_t * avr,
+		int kind,
+		uint32_t addr,
+		uint32_t size,
+		const char * name,
+		uint32_t line);
+// Read the DWARF of 'filename' when it is needed.
+void
+avr_symbols_set_dwarf(
+		avr_t * avr,
+		const char * filename);
+
+/*
+ * The function (or other flash symbol) 'addr' is in, or NULL. 'offset'
+ * can be NULL, or gets the distance from its start.
+ */
+const char *
+avr_symbols_code(
+		avr_t * avr,
+		uint32_t addr,
+		uint32_t * offset);
+// The variable at data address 'addr', as avr_symbols_code().
+const char *
+avr_symbols_data(
+		avr_t * avr,
+		uint32_t addr,
+		uint32_t * offset);
+// The source file of flash address 'addr', and its line, or NULL.
+const char *
+avr_symbols_line(
+		avr_t * avr,
+		uint32_t addr,
+		uint32_t * line);
+/*
+ * Write "main+0x12 (main.c:40)", or as much as is known, down to
+ * "0x1234", in 'buf', and return it.
+ */
+const char *
+avr_symbols_format(
+		avr_t * avr,
+		uint32_t addr,
+		char * buf,
+		size_t len);
+
+void
+avr_symbols_stop(
+		avr_t * avr);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* __SIM_SYMBOLS_H__ */
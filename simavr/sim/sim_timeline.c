@@ -0,0 +1,399 @@
+/*
+	sim_timeline.c
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim_avr.h"
+#include "sim_core.h"
+#include "sim_timeline.h"
+#include "sim_symbols.h"
+#include "avr_uart.h"
+#include "avr_adc.h"
+#include "avr_timer.h"
+
+// Track numbers in the output, one per kind of activity.
+enum {
+	TID_CPU = 1,
+	TID_SLEEP,
+	TID_UART,
+	TID_ADC,
+	TID_TIMERS,
+};
+
+static avr_timeline_event_t *
+_avr_timeline_add(
+		avr_timeline_t * t,
+		uint8_t kind)
+{
+	avr_timeline_event_t * e;
+
+	if (t->count == t->size) {
+		uint32_t size = t->size ? t->size * 2 : 4096;
+
+		if (t->max_events && size > t->max_events)
+			size = t->max_events;
+		if (size <= t->count) {
+			t->dropped++;
+			return NULL;
+		}
+		e = realloc(t->event, size * sizeof(*e));
+		if (!e) {
+			t->dropped++;
+			return NULL;
+		}
+		t->event = e;
+		t->size = size;
+	}
+	e = t->event + t->count++;
+	e->when = t->avr->cycle;
+	e->dur = 0;
+	e->arg = 0;
+	e->kind = kind;
+	e->source = 0;
+	return e;
+}
+
+void
+avr_timeline_call(
+		avr_t * avr,
+		avr_flashaddr_t target,
+		uint8_t vector)
+{
+	avr_timeline_t * t = avr->timeline;
+	avr_timeline_event_t * e;
+
+	if (!(t->flags & (vector ? AVR_TIMELINE_INTERRUPTS : AVR_TIMELINE_CALLS)))
+		return;
+	if (t->depth == AVR_TIMELINE_DEPTH)
+		return;			// too deep, the matching return is ignored too
+	e = _avr_timeline_add(t, vector ? AVR_TL_VECTOR : AVR_TL_CALL);
+	if (!e)
+		return;
+	e->arg = vector ? vector : target;
+	t->frame_sp[t->depth++] = _avr_sp_get(avr) + avr->address_size;
+}
+
+void
+avr_timeline_return(
+		avr_t * avr)
+{
+	avr_timeline_t * t = avr->timeline;
+	uint16_t sp = _avr_sp_get(avr);
+
+	while (t->depth > 0 && t->frame_sp[t->depth - 1] <= sp) {
+		if (!_avr_timeline_add(t, AVR_TL_RETURN))
+			break;
+		t->depth--;
+	}
+}
+
+void
+avr_timeline_sleep(
+		avr_t * avr,
+		avr_cycle_count_t howLong)
+{
+	avr_timeline_t * t = avr->timeline;
+	avr_timeline_event_t * e;
+
+	if (!(t->flags & AVR_TIMELINE_SLEEP))
+		return;
+	// the sleep callback is called once per timer, merge them
+	if (t->count) {
+		e = t->event + t->count - 1;
+		if (e->kind == AVR_TL_SLEEP && e->when + e->dur == avr->cycle &&
+			e->dur + howLong <= UINT32_MAX) {
+			e->dur += howLong;
+			return;
+		}
+	}
+	e = _avr_timeline_add(t, AVR_TL_SLEEP);
+	if (e)
+		e->dur = howLong;
+}
+
+// IRQ param is the event kind in the high byte, source name in the low.
+
+static void
+_avr_timeline_irq_notify(
+		struct avr_irq_t * irq,
+		uint32_t value,
+		void * param)
+{
+	avr_timeline_t * t = irq->pool->avr->timeline;
+	uintptr_t p = (uintptr_t)param;
+	avr_timeline_event_t * e;
+
+	if (!t || ((p >> 8) == AVR_TL_TOV && !value))
+		return;
+	e = _avr_timeline_add(t, p >> 8);
+	if (e) {
+		e->source = p & 0xff;
+		e->arg = value;
+	}
+}
+
+static void
+_avr_timeline_hook(
+		avr_t * avr,
+		uint32_t flags,
+		int connect)
+{
+	struct {
+		uint32_t	flag;
+		uint32_t	ioctl;
+		int			irq;
+		uint8_t		kind;
+		char		source;
+	} hooks[] = {
+		{ AVR_TIMELINE_ADC, AVR_IOCTL_ADC_GETIRQ, ADC_IRQ_OUT_TRIGGER,
+				AVR_TL_ADC, '0' },
+	};
+	int n = sizeof(hooks) / sizeof(hooks[0]);
+
+	for (int i = 0; i < n + 4 * 2 + 6; i++) {
+		uint32_t ioctl, flag;
+		int irqn, kind;
+		char src;
+
+		if (i < n) {
+			flag = hooks[i].flag; ioctl = hooks[i].ioctl;
+			irqn = hooks[i].irq; kind = hooks[i].kind; src = hooks[i].source;
+		} else if (i < n + 8) {		// UARTs 0 to 3, both directions
+			src = '0' + (i - n) / 2;
+			flag = AVR_TIMELINE_UART;
+			ioctl = AVR_IOCTL_UART_GETIRQ(src);
+			irqn = ((i - n) & 1) ? UART_IRQ_INPUT : UART_IRQ_OUTPUT;
+			kind = ((i - n) & 1) ? AVR_TL_UART_RX : AVR_TL_UART_TX;
+		} else {					// timers 0 to 5
+			src = '0' + i - n - 8;
+			flag = AVR_TIMELINE_TIMERS;
+			ioctl = AVR_IOCTL_TIMER_GETIRQ(src);
+			irqn = TIMER_IRQ_OUT_TOV;
+			kind = AVR_TL_TOV;
+		}
+		if (!(flags & flag))
+			continue;
+
+		avr_irq_t * irq = avr_io_getirq(avr, ioctl, irqn);
+		void * param = (void *)(uintptr_t)((kind << 8) | (uint8_t)src);
+
+		if (!irq)
+			continue;
+		if (connect)
+			avr_irq_register_notify(irq, _avr_timeline_irq_notify, param);
+		else
+			avr_irq_unregister_notify(irq, _avr_timeline_irq_notify, param);
+	}
+}
+
+int
+avr_timeline_start(
+		avr_t * avr,
+		const char * filename,
+		uint32_t flags)
+{
+	avr_timeline_t * t;
+
+	if (avr->timeline)
+		return -1;
+	t = calloc(1, sizeof(*t));
+	if (!t)
+		return -1;
+	t->avr = avr;
+	t->filename = strdup(filename);
+	t->flags = flags;
+	avr->timeline = t;
+	_avr_timeline_hook(avr, flags, 1);
+	return 0;
+}
+
+void
+avr_timeline_set_symbols(
+		avr_t * avr,
+		avr_symbol_t ** symbols,
+		uint32_t count)
+{
+	for (uint32_t i = 0; i < count; i++) {
+		if (symbols[i]->addr > avr->flashend)
+			continue;		// data or eeprom
+		avr_symbols_add(avr, AVR_SYMBOLS_CODE, symbols[i]->addr,
+				symbols[i]->size, symbols[i]->symbol, 0);
+	}
+}
+
+// The function 'addr' is in, from sim_symbols.h, or the address.
+static const char *
+_avr_timeline_symbol(
+		avr_timeline_t * t,
+		avr_flashaddr_t addr,
+		char * buf,
+		size_t len)
+{
+	uint32_t offset;
+	const char * name = avr_symbols_code(t->avr, addr, &offset);
+
+	if (!name)
+		snprintf(buf, len, "0x%04x", addr);
+	else if (offset)
+		snprintf(buf, len, "%s+0x%x", name, offset);
+	else
+		return name;
+	return buf;
+}
+
+// 's' as a JSON string, symbol names can have about anything in them
+static void
+_avr_timeline_string(
+		FILE * o,
+		const char * s)
+{
+	fputc('"', o);
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			fprintf(o, "\\%c", *s);
+		else if ((unsigned char)*s < ' ')
+			fprintf(o, "\\u%04x", (unsigned char)*s);
+		else
+			fputc(*s, o);
+	}
+	fputc('"', o);
+}
+
+static void
+_avr_timeline_write(
+		avr_timeline_t * t,
+		FILE * o)
+{
+	avr_t * avr = t->avr;
+	double us = 1000000.0 / avr->frequency;
+	static const char * threads[] = {
+		[TID_CPU] = "cpu", [TID_SLEEP] = "sleep", [TID_UART] = "uart",
+		[TID_ADC] = "adc", [TID_TIMERS] = "timers",
+	};
+
+	fprintf(o, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	fprintf(o, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+			"\"args\":{\"name\":");
+	_avr_timeline_string(o, avr->mmcu);
+	fprintf(o, "}}");
+	for (int i = TID_CPU; i <= TID_TIMERS; i++)
+		fprintf(o, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+				"\"tid\":%d,\"args\":{\"name\":\"%s\"}}", i, threads[i]);
+
+	for (uint32_t i = 0; i < t->count; i++) {
+		avr_timeline_event_t * e = t->event + i;
+		double ts = e->when * us;
+		const char * name;
+		char buf[80];
+
+		switch (e->kind) {
+			case AVR_TL_CALL:
+				name = _avr_timeline_symbol(t, e->arg, buf, sizeof(buf));
+				fprintf(o, ",\n{\"name\":");
+				_avr_timeline_string(o, name);
+				fprintf(o, ",\"cat\":\"call\",\"ph\":\"B\",\"ts\":%.3f,"
+						"\"pid\":1,\"tid\":%d}", ts, TID_CPU);
+				break;
+			case AVR_TL_VECTOR:
+				fprintf(o, ",\n{\"name\":\"vector %u\",\"cat\":\"interrupt\","
+						"\"ph\":\"B\",\"ts\":%.3f,\"pid\":1,\"tid\":%d}",
+						e->arg, ts, TID_CPU);
+				break;
+			case AVR_TL_RETURN:
+				fprintf(o, ",\n{\"ph\":\"E\",\"ts\":%.3f,\"pid\":1,\"tid\":%d}",
+						ts, TID_CPU);
+				break;
+			case AVR_TL_SLEEP:
+				fprintf(o, ",\n{\"name\":\"sleep\",\"ph\":\"X\",\"ts\":%.3f,"
+						"\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+						ts, e->dur * us, TID_SLEEP);
+				break;
+			case AVR_TL_UART_TX:
+			case AVR_TL_UART_RX:
+				fprintf(o, ",\n{\"name\":\"uart%c %s\",\"ph\":\"i\",\"s\":\"t\","
+						"\"ts\":%.3f,\"pid\":1,\"tid\":%d,"
+						"\"args\":{\"byte\":%u}}",
+						e->source, e->kind == AVR_TL_UART_TX ? "tx" : "rx",
+						ts, TID_UART, e->arg & 0xff);
+				break;
+			case AVR_TL_ADC: {
+				union {
+					avr_adc_mux_t	mux;
+					uint32_t		v;
+				} m = { .v = e->arg };
+
+				fprintf(o, ",\n{\"name\":\"adc\",\"ph\":\"i\",\"s\":\"t\","
+						"\"ts\":%.3f,\"pid\":1,\"tid\":%d,"
+						"\"args\":{\"kind\":%u,\"src\":%u,\"diff\":%u}}",
+						ts, TID_ADC, (unsigned)m.mux.kind,
+						(unsigned)m.mux.src, (unsigned)m.mux.diff);
+			}	break;
+			case AVR_TL_TOV:
+				fprintf(o, ",\n{\"name\":\"timer%c overflow\",\"ph\":\"i\","
+						"\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":%d}",
+						e->source, ts, TID_TIMERS);
+				break;
+		}
+	}
+	fprintf(o, "\n]}\n");
+}
+
+int
+avr_timeline_stop(
+		avr_t * avr)
+{
+	avr_timeline_t * t = avr->timeline;
+	FILE * o;
+	int res = 0;
+
+	if (!t)
+		return -1;
+	_avr_timeline_hook(avr, t->flags, 0);
+
+	// close slices still open, or the viewer drops them
+	t->max_events = 0;
+	while (t->depth > 0 && _avr_timeline_add(t, AVR_TL_RETURN))
+		t->depth--;
+
+	o = fopen(t->filename, "w");
+	if (o) {
+		char * buf = malloc(1 << 20);
+
+		if (buf)
+			setvbuf(o, buf, _IOFBF, 1 << 20);
+		_avr_timeline_write(t, o);
+		if (fclose(o))
+			res = -1;
+		free(buf);
+	} else {
+		AVR_LOG(avr, LOG_ERROR, "TIMELINE: Can't create %s\n", t->filename);
+		res = -1;
+	}
+	if (t->dropped)
+		AVR_LOG(avr, LOG_WARNING, "TIMELINE: %u events dropped\n", t->dropped);
+
+	avr->timeline = NULL;
+	free(t->event);
+	free(t->filename);
+	free(t);
+	return res;
+}
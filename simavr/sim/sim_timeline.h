@@ -0,0 +1,133 @@
+/*
+	sim_timeline.h
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Timeline recorder: software activity on simulated time, written as
+ * Chrome trace-event JSON that chrome://tracing or ui.perfetto.dev can open.
+ *
+ * Events are appended to an in-memory array while running and only
+ * formatted when the timeline is stopped.  Function calls and interrupt
+ * handlers share one track, as they share the AVR stack, and are unwound
+ * by stack pointer so longjmp() and friends do not break the nesting.
+ */
+
+#ifndef __SIM_TIMELINE_H__
+#define __SIM_TIMELINE_H__
+
+#include "sim_avr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// What to record, for avr_timeline_start()
+enum {
+	AVR_TIMELINE_CALLS		= (1 << 0),	// function calls, the costly one
+	AVR_TIMELINE_INTERRUPTS	= (1 << 1),
+	AVR_TIMELINE_SLEEP		= (1 << 2),
+	AVR_TIMELINE_UART		= (1 << 3),
+	AVR_TIMELINE_ADC		= (1 << 4),
+	AVR_TIMELINE_TIMERS		= (1 << 5),	// timer overflows
+	AVR_TIMELINE_ALL		= 0x3f,
+};
+
+enum {
+	AVR_TL_CALL = 0,		// arg: target address
+	AVR_TL_VECTOR,			// arg: vector number
+	AVR_TL_RETURN,
+	AVR_TL_SLEEP,			// duration in 'dur'
+	AVR_TL_UART_TX,			// arg: byte, source: UART name
+	AVR_TL_UART_RX,
+	AVR_TL_ADC,				// arg: avr_adc_mux_t as uint32_t
+	AVR_TL_TOV,				// source: timer name
+};
+
+typedef struct avr_timeline_event_t {
+	avr_cycle_count_t	when;
+	uint32_t			dur;
+	uint32_t			arg;
+	uint8_t				kind;
+	char				source;
+} avr_timeline_event_t;
+
+#define AVR_TIMELINE_DEPTH	64
+
+typedef struct avr_timeline_t {
+	struct avr_t *		avr;
+	char *				filename;
+	uint32_t			flags;
+
+	uint32_t			count, size;
+	uint32_t			max_events;	// zero for no limit
+	uint32_t			dropped;
+	avr_timeline_event_t *	event;
+
+	// open call/interrupt slices, by entry SP
+	int					depth;
+	uint16_t			frame_sp[AVR_TIMELINE_DEPTH];
+} avr_timeline_t;
+
+/*
+ * Start recording to avr->timeline. 'filename' is written at stop.
+ * IO module IRQs are hooked here, so call it after the firmware is loaded.
+ */
+int
+avr_timeline_start(
+		struct avr_t * avr,
+		const char * filename,
+		uint32_t flags);
+
+/*
+ * Name function entry points, from elf_firmware_t symbol and symbolcount.
+ * Calls are named from avr->symbols (sim_symbols.h), which
+ * avr_load_firmware() fills already, this adds to it.
+ */
+void
+avr_timeline_set_symbols(
+		struct avr_t * avr,
+		avr_symbol_t ** symbols,
+		uint32_t count);
+
+// Close open slices, write the file and release avr->timeline.
+int
+avr_timeline_stop(
+		struct avr_t * avr);
+
+// Private, called by the core with avr->timeline set.
+
+void
+avr_timeline_call(
+		struct avr_t * avr,
+		avr_flashaddr_t target,
+		uint8_t vector);
+void
+avr_timeline_return(
+		struct avr_t * avr);
+void
+avr_timeline_sleep(
+		struct avr_t * avr,
+		avr_cycle_count_t howLong);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* __SIM_TIMELINE_H__ */
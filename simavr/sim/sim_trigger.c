@@ -0,0 +1,224 @@
+/*
+	sim_trigger.c
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "sim_trigger.h"
+#include "sim_vcd_file.h"
+#include "sim_io.h"
+#include "avr_uart.h"
+
+static avr_trigger_t *
+_avr_trigger_get(
+		avr_t * avr)
+{
+	if (!avr->trigger)
+		avr->trigger = calloc(1, sizeof(avr_trigger_t));
+	return avr->trigger;
+}
+
+int
+avr_trigger_pc(
+		avr_t * avr,
+		avr_flashaddr_t pc)
+{
+	avr_trigger_t * t = _avr_trigger_get(avr);
+
+	if (!t || t->pc_count == AVR_TRIGGER_PC)
+		return -1;
+	t->pc[t->pc_count++] = pc;
+	return 0;
+}
+
+static void
+_avr_trigger_notify(
+		struct avr_irq_t * irq,
+		uint32_t value,
+		void * param)
+{
+	avr_trigger_irq_t * ti = param;
+
+	if (!ti->len) {
+		if ((value & ti->mask) == ti->value)
+			avr_trigger_fire(ti->avr, irq->name ? irq->name : "irq");
+		return;
+	}
+	memmove(ti->last, ti->last + 1, (ti->len - 1) * sizeof(ti->last[0]));
+	ti->last[ti->len - 1] = value;
+	if (!memcmp(ti->last, ti->pattern, ti->len * sizeof(ti->last[0])))
+		avr_trigger_fire(ti->avr, irq->name ? irq->name : "sequence");
+}
+
+static avr_trigger_irq_t *
+_avr_trigger_add_irq(
+		avr_t * avr,
+		avr_irq_t * irq)
+{
+	avr_trigger_t * t = _avr_trigger_get(avr);
+	avr_trigger_irq_t * ti;
+
+	if (!t || !irq || !(ti = calloc(1, sizeof(*ti))))
+		return NULL;
+	ti->avr = avr;
+	ti->irq = irq;
+	ti->next = t->irq;
+	t->irq = ti;
+	avr_irq_register_notify(irq, _avr_trigger_notify, ti);
+	return ti;
+}
+
+int
+avr_trigger_irq(
+		avr_t * avr,
+		avr_irq_t * irq,
+		uint32_t value,
+		uint32_t mask)
+{
+	avr_trigger_irq_t * ti = _avr_trigger_add_irq(avr, irq);
+
+	if (!ti)
+		return -1;
+	ti->value = value & mask;
+	ti->mask = mask;
+	return 0;
+}
+
+int
+avr_trigger_sequence(
+		avr_t * avr,
+		avr_irq_t * irq,
+		const uint32_t * values,
+		int len)
+{
+	avr_trigger_irq_t * ti;
+
+	if (len < 1 || len > AVR_TRIGGER_PATTERN ||
+			!(ti = _avr_trigger_add_irq(avr, irq)))
+		return -1;
+	ti->len = len;
+	memcpy(ti->pattern, values, len * sizeof(values[0]));
+	// nothing seen yet, that can't match a pattern
+	for (int i = 0; i < len; i++)
+		ti->last[i] = ~values[i];
+	return 0;
+}
+
+// UART bytes, with C escapes. Returns the count, or -1.
+static int
+_avr_trigger_text(
+		const char * text,
+		uint32_t * values)
+{
+	int len = 0;
+
+	while (*text) {
+		char * end;
+
+		if (len == AVR_TRIGGER_PATTERN)
+			return -1;
+		if (*text != '\\') {
+			values[len++] = (uint8_t)*text++;
+			continue;
+		}
+		switch (*++text) {
+			case 'n': values[len++] = '\n'; text++; break;
+			case 'r': values[len++] = '\r'; text++; break;
+			case '\\': values[len++] = '\\'; text++; break;
+			case 'x':
+				values[len++] = strtoul(text + 1, &end, 16) & 0xff;
+				if (end == text + 1)
+					return -1;
+				text = end;
+				break;
+			default:
+				return -1;
+		}
+	}
+	return len;
+}
+
+int
+avr_trigger_parse(
+		avr_t * avr,
+		const char * spec)
+{
+	const char * eq = strchr(spec, '=');
+	uint32_t values[AVR_TRIGGER_PATTERN];
+	unsigned long value, mask = ~0UL;
+	char * end;
+	int len;
+
+	if (!eq || !eq[1])
+		return -1;
+	if (!strncmp(spec, "pc=", 3)) {
+		value = strtoul(eq + 1, &end, 0);
+		if (*end || value > avr->flashend)
+			return -1;
+		return avr_trigger_pc(avr, value);
+	}
+	if (!strncmp(spec, "uart", 4) && eq == spec + 5) {
+		len = _avr_trigger_text(eq + 1, values);
+		if (len < 1)
+			return -1;
+		return avr_trigger_sequence(avr, avr_io_getirq(avr,
+				AVR_IOCTL_UART_GETIRQ(spec[4]), UART_IRQ_OUTPUT),
+				values, len);
+	}
+	/* format is <four-character ioctl>[_<IRQ index>], as VCD input */
+	if (eq - spec < 4 || (eq - spec > 4 && spec[4] != '_'))
+		return -1;
+	value = strtoul(eq + 1, &end, 0);
+	if (*end == '/')
+		mask = strtoul(end + 1, &end, 0);
+	if (*end)
+		return -1;
+	return avr_trigger_irq(avr, avr_io_getirq(avr,
+			AVR_IOCTL_DEF(spec[0], spec[1], spec[2], spec[3]),
+			eq - spec > 4 ? atoi(spec + 5) : 0), value, mask);
+}
+
+void
+avr_trigger_fire(
+		avr_t * avr,
+		const char * reason)
+{
+	if (avr->vcd)
+		avr_vcd_trigger(avr->vcd, reason);
+}
+
+void
+avr_trigger_stop(
+		avr_t * avr)
+{
+	avr_trigger_t * t = avr->trigger;
+
+	if (!t)
+		return;
+	while (t->irq) {
+		avr_trigger_irq_t * ti = t->irq;
+
+		t->irq = ti->next;
+		avr_irq_unregister_notify(ti->irq, _avr_trigger_notify, ti);
+		free(ti);
+	}
+	free(t);
+	avr->trigger = NULL;
+}
@@ -0,0 +1,120 @@
+/*
+	sim_trigger.h
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Triggers for a VCD capture, as on a logic analyser: the VCD file only
+ * gets the changes around them (see avr_vcd_set_capture()).
+ *
+ * The firmware reaching a PC, an IRQ taking a value, or a sequence of
+ * values, bytes out of a UART for example, fire avr->vcd's trigger. So do
+ * a crash and the SIMAVR_CMD_VCD_TRIGGER command, whether avr->trigger is
+ * there or not. When it is NULL (the default) the only cost is a pointer
+ * test per instruction.
+ */
+
+#ifndef __SIM_TRIGGER_H__
+#define __SIM_TRIGGER_H__
+
+#include "sim_avr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AVR_TRIGGER_PC		8		// addresses, at most
+#define AVR_TRIGGER_PATTERN	32		// values in a sequence, at most
+
+typedef struct avr_trigger_irq_t {
+	struct avr_trigger_irq_t * next;
+	avr_t *			avr;
+	avr_irq_t *		irq;		// notifying us
+	uint32_t		value, mask;
+	int				len;		// of the sequence, 0 for a value
+	uint32_t		pattern[AVR_TRIGGER_PATTERN];
+	uint32_t		last[AVR_TRIGGER_PATTERN];	// values seen, latest at the end
+} avr_trigger_irq_t;
+
+typedef struct avr_trigger_t {
+	int					pc_count;
+	avr_flashaddr_t		pc[AVR_TRIGGER_PC];
+	avr_trigger_irq_t *	irq;
+} avr_trigger_t;
+
+// Fire when the firmware gets to 'pc', a byte address.
+int
+avr_trigger_pc(
+		avr_t * avr,
+		avr_flashaddr_t pc);
+// Fire when 'irq' is raised with (value & mask) == 'value'.
+int
+avr_trigger_irq(
+		avr_t * avr,
+		avr_irq_t * irq,
+		uint32_t value,
+		uint32_t mask);
+// Fire when 'irq' is raised with 'len' values in a row, a UART's output.
+int
+avr_trigger_sequence(
+		avr_t * avr,
+		avr_irq_t * irq,
+		const uint32_t * values,
+		int len);
+/*
+ * Add a trigger from text, for run_avr:
+ *	pc=<address>
+ *	uart<n>=<text>			bytes out of a UART, with \n \r \\ \xNN
+ *	<ioctl>[_<index>]=<value>[/<mask>]	an IRQ, named as for VCD input
+ * Returns -1 if it is not one of those.
+ */
+int
+avr_trigger_parse(
+		avr_t * avr,
+		const char * spec);
+
+// Write avr->vcd's capture, if one is waiting for a trigger.
+void
+avr_trigger_fire(
+		avr_t * avr,
+		const char * reason);
+
+// Remove the triggers, and release avr->trigger.
+void
+avr_trigger_stop(
+		avr_t * avr);
+
+// Private, called by the core with avr->trigger set.
+static inline void
+avr_trigger_check_pc(
+		avr_t * avr,
+		avr_flashaddr_t pc)
+{
+	avr_trigger_t * t = avr->trigger;
+
+	for (int i = 0; i < t->pc_count; i++)
+		if (t->pc[i] == pc)
+			avr_trigger_fire(avr, "pc");
+}
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* __SIM_TRIGGER_H__ */
@@ -22,21 +22,29 @@
 	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define _GNU_SOURCE		// pipe2()
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <inttypes.h>
 #include <ctype.h>
 #include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "sim_vcd_file.h"
+#include "sim_wave.h"
 #include "sim_avr.h"
 #include "sim_time.h"
 #include "sim_utils.h"
+#include "sim_record.h"
 #include "sim_core_config.h"
 
-DEFINE_FIFO(avr_vcd_log_t, avr_vcd_fifo);
-
+#ifndef strdupa
 #define strdupa(__s) strcpy(alloca(strlen(__s)+1), __s)
+#endif
 
 static void
 _avr_vcd_notify(
@@ -44,6 +52,36 @@ _avr_vcd_notify(
 		uint32_t value,
 		void * param);
 
+static int
+_avr_vcd_suffix(
+		avr_vcd_t * vcd,
+		const char * suffix)
+{
+	size_t l = strlen(vcd->filename), sl = strlen(suffix);
+
+	return l >= sl && !strcmp(vcd->filename + l - sl, suffix);
+}
+
+// Add a zeroed signal to the table, returns NULL if out of memory.
+static avr_vcd_signal_t *
+_avr_vcd_new_signal(
+		avr_vcd_t * vcd)
+{
+	avr_vcd_signal_t ** table;
+	avr_vcd_signal_t * s;
+
+	// signals are not moved: their IRQs are connected to others
+	table = realloc(vcd->signal, (vcd->signal_count + 1) * sizeof(*table));
+	if (!table)
+		return NULL;
+	vcd->signal = table;
+	s = calloc(1, sizeof(*s));
+	if (!s)
+		return NULL;
+	table[vcd->signal_count++] = s;
+	return s;
+}
+
 int
 avr_vcd_init(
 		struct avr_t * avr,
@@ -59,138 +97,409 @@ avr_vcd_init(
 }
 
 /*
- * Parse a VCD 'timing' line. The lines are assumed to be:
- * #<absolute timestamp>[\n][<value x/z/0/1><signal alias character>|
- * 		b[x/z/0/1]?<space><signal alias character|
- *		r<real value><space><signal alias character]+
- * For example:
- * #1234 1' 0$
- * Or:
- * #1234
- * b1101x1 '
- * 0$
- *
- * This function tries to handle this transparently, and pushes the
- * signal/values into the FIFO for processing by the timer when
- * convenient.
- * NOTE: Add 'floating' support here. Also, FIX THE TIMING.
+ * VCD input. The file is mapped, or read in memory if it can't be, and
+ * tokenised where it is, one change ahead of the AVR.
  */
-static avr_cycle_count_t
-avr_vcd_input_parse_line(
+
+// Next token, and its length, or NULL at the end of the file.
+static const char *
+_avr_vcd_token(
+		avr_vcd_t * vcd,
+		size_t * len)
+{
+	const char * m = vcd->map;
+	size_t p = vcd->pos, start;
+
+	while (p < vcd->map_size && isspace((uint8_t)m[p]))
+		p++;
+	start = p;
+	while (p < vcd->map_size && !isspace((uint8_t)m[p]))
+		p++;
+	vcd->pos = p;
+	*len = p - start;
+	return p > start ? m + start : NULL;
+}
+
+static int
+_avr_vcd_is(
+		const char * t,
+		size_t len,
+		const char * word)
+{
+	return len == strlen(word) && !memcmp(t, word, len);
+}
+
+// Skip to the $end of a section.
+static void
+_avr_vcd_skip(
+		avr_vcd_t * vcd)
+{
+	const char * t;
+	size_t len;
+
+	while ((t = _avr_vcd_token(vcd, &len)) && !_avr_vcd_is(t, len, "$end"))
+		;
+}
+
+static uint64_t
+_avr_vcd_number(
+		const char * t,
+		size_t len,
+		size_t * used)
+{
+	uint64_t v = 0;
+	size_t i;
+
+	for (i = 0; i < len && isdigit((uint8_t)t[i]); i++)
+		v = v * 10 + t[i] - '0';
+	if (used)
+		*used = i;
+	return v;
+}
+
+// Time in the file's units, or a .swav file's, to nS.
+static uint64_t
+_avr_vcd_ns(
+		avr_vcd_t * vcd,
+		uint64_t t)
+{
+	return (t / vcd->vcd_ns_div) * vcd->vcd_to_ns +
+			(t % vcd->vcd_ns_div) * vcd->vcd_to_ns / vcd->vcd_ns_div;
+}
+
+static uint64_t
+_avr_vcd_alias_key(
+		const char * t,
+		size_t len)
+{
+	uint64_t key = 0;
+
+	memcpy(&key, t, len);
+	return key;
+}
+
+static uint32_t
+_avr_vcd_alias_hash(
 		avr_vcd_t * vcd,
-		argv_p v )
+		uint64_t key)
 {
-	uint64_t res = 0;
-	int vi = 0;
+	return ((key * 0x9e3779b97f4a7c15ull) >> 32) & (vcd->alias_hash_size - 1);
+}
 
-	if (v->argc == 0)
-		return res;
+// Signal with that identifier, or -1.
+static int
+_avr_vcd_find(
+		avr_vcd_t * vcd,
+		const char * t,
+		size_t len)
+{
+	uint64_t key;
 
-	if (v->argv[0][0] == '#') {
-		res = atoll(v->argv[0] + 1) * vcd->vcd_to_ns;
-		vcd->start = vcd->period;
-		vcd->period = res;
-		vi++;
+	if (!len || len >= sizeof(vcd->signal[0]->alias) || !vcd->alias_hash_size)
+		return -1;
+	key = _avr_vcd_alias_key(t, len);
+	for (uint32_t h = _avr_vcd_alias_hash(vcd, key);;
+			h = (h + 1) & (vcd->alias_hash_size - 1)) {
+		uint32_t s = vcd->alias_hash[h];
+		const char * a;
+
+		if (!s)
+			return -1;
+		a = vcd->signal[s - 1]->alias;
+		if (_avr_vcd_alias_key(a, strlen(a)) == key)
+			return s - 1;
 	}
-	for (int i = vi; i < v->argc; i++) {
-		char * a = v->argv[i];
-		uint32_t val = 0;
-		int floating = 0;
-		char name = 0;
-		int sigindex;
-
-		if (*a == 'b' || *a == 'B') {	// Binary string
-			a++;
-			while (*a) {
-				if (*a == 'x' || *a == 'z') {
-					val <<= 1;
-					floating |= (floating << 1) | 1;
-				} else if (*a == '0' || *a == '1') {
-					val = (val << 1) | (*a - '0');
-					floating <<= 1;
-				} else {
-					name = *a;
-					break;
-				}
-				a++;
-			}
-		} else if (*a == '0' || *a == '1' || *a == 'x' || *a == 'z') {
-			if (*a == 'x')
-				continue;	// Schmidt trigger on input preserves state.
-			if (*a == 'z')
-				floating = 1;
-			else
-				val = *a++ - '0';
-			if (*a && *a > ' ')
-				name = *a;
-		} else if (*a == 'r' || *a == 'R') {
-			val = (uint32_t)strtod(++a, NULL);
-		}
+}
 
-		if (!name && (i < v->argc - 1)) {
-			const char *n = v->argv[i+1];
-			if (strlen(n) == 1) {
-				// we've got a name, it was not attached
-				name = *n;
-				i++;	// skip that one
-			}
+static int
+_avr_vcd_hash_aliases(
+		avr_vcd_t * vcd)
+{
+	vcd->alias_hash_size = 16;
+	while (vcd->alias_hash_size < 2 * (uint32_t)vcd->signal_count)
+		vcd->alias_hash_size *= 2;
+	vcd->alias_hash = calloc(vcd->alias_hash_size, sizeof(*vcd->alias_hash));
+	if (!vcd->alias_hash)
+		return -1;
+	for (int i = 0; i < vcd->signal_count; i++) {
+		const char * a = vcd->signal[i]->alias;
+		uint32_t h;
+
+		if (_avr_vcd_find(vcd, a, strlen(a)) >= 0)
+			continue;	// the same identifier in another scope
+		h = _avr_vcd_alias_hash(vcd, _avr_vcd_alias_key(a, strlen(a)));
+		while (vcd->alias_hash[h])
+			h = (h + 1) & (vcd->alias_hash_size - 1);
+		vcd->alias_hash[h] = i + 1;
+	}
+	return 0;
+}
+
+/*
+ * sim_vcd header allows only integer factors of ns: 1ns, 2us, 3ms, 10s,
+ * and 1/10/100 ps or fs as fractions of them.
+ */
+static void
+_avr_vcd_timescale(
+		avr_vcd_t * vcd)
+{
+	static const struct {
+		const char * unit;
+		uint64_t ns, div;
+	} units[] = {
+		{ "s", 1000000000, 1 }, { "ms", 1000000, 1 }, { "us", 1000, 1 },
+		{ "ns", 1, 1 }, { "ps", 1, 1000 }, { "fs", 1, 1000000 },
+	};
+	const char * t, * unit;
+	size_t len, used, ulen;
+	uint64_t cnt;
+
+	if (!(t = _avr_vcd_token(vcd, &len)))
+		return;
+	cnt = _avr_vcd_number(t, len, &used);
+	unit = t + used;
+	ulen = len - used;
+	if (!ulen && !(unit = _avr_vcd_token(vcd, &ulen)))
+		return;
+	for (int i = 0; i < 6 && cnt; i++)
+		if (_avr_vcd_is(unit, ulen, units[i].unit)) {
+			vcd->vcd_to_ns = units[i].div > 1 ? 1 : cnt * units[i].ns;
+			vcd->vcd_ns_div = units[i].div > cnt ? units[i].div / cnt : 1;
 		}
-		sigindex = -1;
-		if (name) {
-			for (int si = 0;
-						si < vcd->signal_count &&
-						sigindex == -1; si++) {
-				if (vcd->signal[si].alias == name)
-					sigindex = si;
-			}
+	if (!_avr_vcd_is(unit, ulen, "$end"))
+		_avr_vcd_skip(vcd);
+}
+
+// $var <type> <size> <identifier> <name> [<bits>] $end
+static void
+_avr_vcd_var(
+		avr_vcd_t * vcd)
+{
+	const char * t[4];
+	size_t len[4];
+	avr_vcd_signal_t * s;
+
+	for (int i = 0; i < 4; i++)
+		if (!(t[i] = _avr_vcd_token(vcd, &len[i])) ||
+				_avr_vcd_is(t[i], len[i], "$end"))
+			return;
+	_avr_vcd_skip(vcd);
+	if (len[2] >= sizeof(s->alias)) {
+		AVR_LOG(vcd->avr, LOG_WARNING, "VCD: %s: identifier %.*s too long\n",
+				vcd->filename, (int)len[2], t[2]);
+		return;
+	}
+	if (!(s = _avr_vcd_new_signal(vcd)))
+		return;
+	memcpy(s->alias, t[2], len[2]);
+	s->size = _avr_vcd_number(t[1], len[1], NULL);
+	snprintf(s->name, sizeof(s->name), "%.*s", (int)len[3], t[3]);
+}
+
+static int
+_avr_vcd_parse_header(
+		avr_vcd_t * vcd)
+{
+	const char * t;
+	size_t len;
+
+	vcd->vcd_to_ns = vcd->vcd_ns_div = 1;
+	while ((t = _avr_vcd_token(vcd, &len))) {
+		if (_avr_vcd_is(t, len, "$enddefinitions")) {
+			_avr_vcd_skip(vcd);
+			break;
+		} else if (*t == '#') {
+			// no $enddefinitions, the changes start here
+			vcd->pos = t - vcd->map;
+			break;
+		} else if (_avr_vcd_is(t, len, "$timescale"))
+			_avr_vcd_timescale(vcd);
+		else if (_avr_vcd_is(t, len, "$var"))
+			_avr_vcd_var(vcd);
+		else if (*t == '$' && !_avr_vcd_is(t, len, "$end"))
+			_avr_vcd_skip(vcd);	// $date, $comment, $scope...
+	}
+	vcd->body = vcd->pos;
+	return _avr_vcd_hash_aliases(vcd);
+}
+
+static int
+_avr_vcd_map(
+		avr_vcd_t * vcd)
+{
+	int fd = fileno(vcd->input);
+	struct stat st;
+	char * m = NULL;
+	size_t size = 0, got;
+
+	if (!fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0) {
+		m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (m != MAP_FAILED) {
+			madvise(m, st.st_size, MADV_SEQUENTIAL);
+			vcd->map = m;
+			vcd->map_size = st.st_size;
+			vcd->mapped = 1;
+			return 0;
 		}
-		if (sigindex == -1) {
-			printf("Signal name '%c' value %x not found\n",
-					name? name : '?', val);
-			continue;
+		m = NULL;
+	}
+	// a pipe perhaps, read it all
+	do {
+		char * n = realloc(m, size + 65536);
+
+		if (!n) {
+			free(m);
+			return -1;
 		}
-		avr_vcd_log_t e = {
-				.when = vcd->period,
-				.sigindex = sigindex,
-				.floating = !!floating,
-				.value = val,
-		};
-	//	printf("%10u %d\n", e.when, e.value);
-		avr_vcd_fifo_write(&vcd->log, e);
+		m = n;
+		got = fread(m + size, 1, 65536, vcd->input);
+		size += got;
+	} while (got);
+	vcd->map = m;
+	vcd->map_size = size;
+	return 0;
+}
+
+// Play the file again from its start, if it is to loop.
+static int
+_avr_vcd_input_loop(
+		avr_vcd_t * vcd)
+{
+	/*
+	 * and if it took any time at all, and changed something: a file of
+	 * signals that are not ours would otherwise be read for ever.
+	 */
+	if (!vcd->loop || vcd->now <= vcd->base || !vcd->played)
+		return -1;
+	if (vcd->loop > 0)
+		vcd->loop--;
+	vcd->played = 0;
+	vcd->base = vcd->now;
+	vcd->pos = vcd->body;
+	vcd->wave_pos = vcd->wave_count = 0;
+	if (vcd->wave)
+		return avr_wave_seek(vcd->wave, 0);
+	return 0;
+}
+
+// Next change from a .swav file.
+static int
+_avr_vcd_wave_next(
+		avr_vcd_t * vcd)
+{
+	while (vcd->wave_pos == vcd->wave_count) {
+		int n = avr_wave_read(vcd->wave, &vcd->wave_log);
+
+		if (n < 0 || (n == 0 && _avr_vcd_input_loop(vcd)))
+			return -1;
+		vcd->wave_count = n;
+		vcd->wave_pos = 0;
 	}
-	return res;
+	vcd->next = vcd->wave_log[vcd->wave_pos++];
+	vcd->next.when = vcd->now = vcd->base + _avr_vcd_ns(vcd, vcd->next.when);
+	vcd->played++;
+	return 0;
 }
 
 /*
- * Read some signals from the file and fill the FIFO with it, we read
- * a completely arbitrary amount of stuff to fill the FIFO reasonably well
+ * Parse up to the next change into 'next'. The lines are assumed to be:
+ * #<absolute timestamp>[\n][<value x/z/0/1><signal identifier>|
+ * 		b[x/z/0/1]?<space><signal identifier>|
+ *		r<real value><space><signal identifier>]+
+ * For example:
+ * #1234 1' 0$
+ * Or:
+ * #1234
+ * b1101x1 '
+ * 0$
+ * Returns -1 at the end of the file.
  */
 static int
-avr_vcd_input_read(
-		avr_vcd_t * vcd )
+_avr_vcd_input_next(
+		avr_vcd_t * vcd)
 {
-	char line[1024];
+	if (vcd->wave)
+		return _avr_vcd_wave_next(vcd);
+	for (;;) {
+		size_t len, id_len;
+		const char * t = _avr_vcd_token(vcd, &len), * id;
+		uint32_t val = 0;
+		int floating = 0, sigindex;
 
-	while (fgets(line, sizeof(line), vcd->input)) {
-	//	printf("%s", line);
-		if (!line[0])	// technically can't happen, but make sure next line works
+		if (!t) {
+			if (_avr_vcd_input_loop(vcd))
+				return -1;
 			continue;
-		vcd->input_line = argv_parse(vcd->input_line, line);
-		avr_vcd_input_parse_line(vcd, vcd->input_line);
-		/* stop once the fifo is full enough */
-		if (avr_vcd_fifo_get_read_size(&vcd->log) >= 128)
-			break;
+		}
+		id = t + 1;
+		id_len = len - 1;
+		switch (*t) {
+			case '#':
+				vcd->now = vcd->base + _avr_vcd_ns(vcd,
+						_avr_vcd_number(t + 1, len - 1, NULL));
+				continue;
+			case '$':	// $dumpvars, $end...
+				if (_avr_vcd_is(t, len, "$comment"))
+					_avr_vcd_skip(vcd);
+				continue;
+			case 'b': case 'B':	// Binary string
+				for (id_len = 0; --len; ) {
+					char c = *++t;
+
+					if (c == 'x' || c == 'X' || c == 'z' || c == 'Z') {
+						val <<= 1;
+						floating = 1;
+					} else if (c == '0' || c == '1') {
+						val = (val << 1) | (c - '0');
+					} else {
+						id = t;
+						id_len = len;
+						break;
+					}
+				}
+				break;
+			case 'r': case 'R': {
+				char real[32];
+
+				snprintf(real, sizeof(real), "%.*s", (int)len - 1, t + 1);
+				val = (uint32_t)strtod(real, NULL);
+				id_len = 0;
+			}	break;
+			case 'x': case 'X':
+				continue;	// Schmidt trigger on input preserves state.
+			case 'z': case 'Z':
+				floating = 1;
+				break;
+			case '0': case '1':
+				val = *t - '0';
+				break;
+			default:
+				continue;
+		}
+		// we've got a value, the identifier was not attached
+		if (!id_len && !(id = _avr_vcd_token(vcd, &id_len)))
+			continue;
+		sigindex = _avr_vcd_find(vcd, id, id_len);
+		if (sigindex < 0) {
+			AVR_LOG(vcd->avr, LOG_TRACE, "VCD: signal '%.*s' not found\n",
+					(int)id_len, id);
+			continue;
+		}
+		vcd->next = (avr_vcd_log_t) {
+				.when = vcd->now,
+				.sigindex = sigindex,
+				.floating = !!floating,
+				.value = val,
+		};
+		vcd->played++;
+		return 0;
 	}
-	return avr_vcd_fifo_isempty(&vcd->log);
 }
 
 /*
- * This is called when we need to change the state of one or more IRQ,
- * so look in the FIFO to know 'our' stamp time, read as much as we can
- * that is still on that same timestamp.
- * When when the FIFO content has too far in the future, re-schedule the
- * timer for that time and shoot off.
- * Also try to top up the FIFO with new read stuff when it's drained
+ * This is called when we need to change the state of one or more IRQ:
+ * play the changes that are due, then re-schedule the timer for the
+ * next one.
  */
 static avr_cycle_count_t
 _avr_vcd_input_timer(
@@ -198,44 +507,62 @@ _avr_vcd_input_timer(
 		avr_cycle_count_t when,
 		void * param)
 {
-	avr_cycle_count_t next;
 	avr_vcd_t * vcd = param;
+	avr_cycle_count_t next;
 
-again:
-	// get some more if needed
-	if (avr_vcd_fifo_get_read_size(&vcd->log) < (vcd->signal_count * 16))
-		avr_vcd_input_read(vcd);
-
-	if (avr_vcd_fifo_isempty(&vcd->log)) {
-		printf("%s DONE but why are we here?\n", __func__);
-		return 0;
+	for (;;) {
+		if (!vcd->has_next && _avr_vcd_input_next(vcd)) {
+			AVR_LOG(vcd->avr, LOG_TRACE,
+					"%s Finished reading, ending simavr\n",
+					vcd->filename);
+			avr->state = cpu_Done;
+			return 0;
+		}
+		vcd->has_next = 1;
+		/*
+		 * A checkpoint took us back in time (see sim_reverse.h), but the
+		 * file is not rewound: the values up to here are replayed from the
+		 * log.
+		 */
+		next = (vcd->next.when * avr->frequency) / (1000*1000*1000);
+		if (next > avr->cycle)
+			return next;
+		vcd->has_next = 0;
+		avr_vcd_signal_p signal = vcd->signal[vcd->next.sigindex];
+		avr_raise_irq_float(&signal->irq, vcd->next.value,
+				vcd->next.floating);
 	}
+}
 
-	avr_vcd_log_t log = avr_vcd_fifo_read_at(&vcd->log, 0);
-	uint64_t stamp = log.when;
-	while (!avr_vcd_fifo_isempty(&vcd->log)) {
-		log = avr_vcd_fifo_read_at(&vcd->log, 0);
-		if (log.when != stamp)	// leave those in the FIFO
-			break;
-		// we already have it
-		avr_vcd_fifo_read_offset(&vcd->log, 1);
-		avr_vcd_signal_p signal = &vcd->signal[log.sigindex];
-		avr_raise_irq_float(&signal->irq, log.value, log.floating);
-	}
+// Signals, and the time unit, of a .swav input.
+static int
+_avr_vcd_open_wave(
+		avr_vcd_t * vcd)
+{
+	uint64_t a = 1000000000, b;
 
-	if (avr_vcd_fifo_isempty(&vcd->log)) {
-		AVR_LOG(vcd->avr, LOG_TRACE,
-				"%s Finished reading, ending simavr\n",
-				vcd->filename);
-		avr->state = cpu_Done;
-		return 0;
+	if (!(vcd->wave = calloc(1, sizeof(*vcd->wave))) ||
+			avr_wave_open(vcd->wave, vcd->input))
+		return -1;
+	for (int i = 0; i < vcd->wave->signal_count; i++) {
+		avr_vcd_signal_t * s = _avr_vcd_new_signal(vcd);
+
+		if (!s)
+			return -1;
+		s->size = vcd->wave->signal[i].size;
+		snprintf(s->name, sizeof(s->name), "%s", vcd->wave->signal[i].name);
 	}
-	log = avr_vcd_fifo_read_at(&vcd->log, 0);
+	// nS per time unit, as a fraction
+	b = vcd->wave->rate;
+	while (b) {
+		uint64_t r = a % b;
 
-	next = (log.when * avr->frequency) / (1000*1000*1000);
-	if (next <= when)
-		goto again;
-	return next;
+		a = b;
+		b = r;
+	}
+	vcd->vcd_to_ns = 1000000000 / a;
+	vcd->vcd_ns_div = vcd->wave->rate / a;
+	return 0;
 }
 
 int
@@ -253,87 +580,22 @@ avr_vcd_init_input(
 		perror(filename);
 		return -1;
 	}
-	char line[1024];
-	argv_p v = NULL;
-
-	while (fgets(line, sizeof(line), vcd->input)) {
-		if (!line[0])	// technically can't happen, but make sure next line works
-			continue;
-		v = argv_parse(v, line);
-
-		// we are done reading headers, got our first timestamp
-		if (v->line[0] == '#') {
-			uint64_t when;
-
-			vcd->start = 0;
-			avr_vcd_input_parse_line(vcd, v);
-			when = (vcd->period * vcd->avr->frequency) /
-				(1000*1000*1000);
-			avr_cycle_timer_register(vcd->avr, when,
-						 _avr_vcd_input_timer, vcd);
-			break;
-		}
-		// ignore multiline stuff
-		if (v->line[0] != '$')
-			continue;
-
-		const char * end = !strcmp(v->argv[v->argc - 1], "$end") ?
-								v->argv[v->argc - 1] : NULL;
-		const char *keyword = v->argv[0];
-
-		if (keyword == end)
-			keyword = NULL;
-		if (!keyword)
-			continue;
-
-		if (!strcmp(keyword, "$timescale")) {
-			// sim_vcd header allows only integer factors of ns: 1ns, 2us, 3ms, 10s, ...
-			uint64_t cnt = 0;
-			char *si = v->argv[1];
-
-			vcd->vcd_to_ns = 1;
-			while (si && *si && isdigit(*si))
-				cnt = (cnt * 10) + (*si++ - '0');
-			while (si && *si == ' ')
-				si++;
-			if (si && !*si)
-				si = v->argv[2];
-			if (!strcmp(si, "ns")) {
-				// no calculation here
-				vcd->vcd_to_ns = cnt;
-			} else if (!strcmp(si, "us")) {
-				cnt*=1000;
-				vcd->vcd_to_ns = cnt;
-			} else if (!strcmp(si, "ms")) {
-				cnt*=1000*1000;
-				vcd->vcd_to_ns = cnt;
-			} else if (!strcmp(si, "s")) {
-				cnt*=1000*1000*1000;
-				vcd->vcd_to_ns = cnt;
-			}
-			// printf("cnt %dus; unit %s\n", (int)cnt, si);
-		} else if (!strcmp(keyword, "$var")) {
-			const char *name = v->argv[4];
-
-			vcd->signal[vcd->signal_count].alias = v->argv[3][0];
-			vcd->signal[vcd->signal_count].size = atoi(v->argv[2]);
-			strncpy(vcd->signal[vcd->signal_count].name, name,
-						sizeof(vcd->signal[0].name));
-
-			vcd->signal_count++;
-		}
+	if (_avr_vcd_suffix(vcd, ".swav") ? _avr_vcd_open_wave(vcd) :
+			(_avr_vcd_map(vcd) || _avr_vcd_parse_header(vcd))) {
+		AVR_LOG(vcd->avr, LOG_ERROR, "VCD: %s: can't read it\n",
+				vcd->filename);
+		avr_vcd_stop(vcd);
+		return -1;
 	}
-	// reuse this one
-	vcd->input_line = v;
 
 	for (int i = 0; i < vcd->signal_count; i++) {
-		AVR_LOG(vcd->avr, LOG_TRACE, "%s %2d '%c' %s : size %d\n",
+		AVR_LOG(vcd->avr, LOG_TRACE, "%s %2d '%s' %s : size %d\n",
 				__func__, i,
-				vcd->signal[i].alias, vcd->signal[i].name,
-				vcd->signal[i].size);
+				vcd->signal[i]->alias, vcd->signal[i]->name,
+				vcd->signal[i]->size);
 		/* format is <four-character ioctl>[_<IRQ index>] */
-		if (strlen(vcd->signal[i].name) >= 4) {
-			char *dup = strdupa(vcd->signal[i].name);
+		if (strlen(vcd->signal[i]->name) >= 4) {
+			char *dup = strdupa(vcd->signal[i]->name);
 			char *ioctl = strsep(&dup, "_");
 			int index = 0;
 			if (dup)
@@ -343,23 +605,44 @@ avr_vcd_init_input(
 						ioctl[0], ioctl[1], ioctl[2], ioctl[3]);
 				avr_irq_t * irq = avr_io_getirq(vcd->avr, ioc, index);
 				if (irq) {
-					vcd->signal[i].irq.flags = IRQ_FLAG_INIT;
-					avr_connect_irq(&vcd->signal[i].irq, irq);
+					char iname[10 + strlen(vcd->signal[i]->name) + 1];
+					const char * names[1] = { iname };
+
+					sprintf(iname, "<vcd.%s", vcd->signal[i]->name);
+					avr_init_irq(&vcd->avr->irq_pool, &vcd->signal[i]->irq,
+								 i, 1, names);
+					// The file is an external input, log it for replay
+					avr_record_input(&vcd->signal[i]->irq);
+					avr_connect_irq(&vcd->signal[i]->irq, irq);
 				} else {
 					AVR_LOG(vcd->avr, LOG_WARNING,
 							"%s IRQ was not found\n",
-							vcd->signal[i].name);
+							vcd->signal[i]->name);
                                 }
 				continue;
 			}
 			AVR_LOG(vcd->avr, LOG_WARNING,
 					"%s is an invalid IRQ format\n",
-					vcd->signal[i].name);
+					vcd->signal[i]->name);
 		}
 	}
+	// the first change tells when it is due
+	avr_cycle_timer_register(vcd->avr, 1, _avr_vcd_input_timer, vcd);
 	return 0;
 }
 
+static void
+_avr_vcd_free_chunks(
+		avr_vcd_chunk_t * c)
+{
+	while (c) {
+		avr_vcd_chunk_t * next = c->next;
+
+		free(c);
+		c = next;
+	}
+}
+
 void
 avr_vcd_close(
 		avr_vcd_t * vcd)
@@ -368,10 +651,19 @@ avr_vcd_close(
 
 	/* dispose of any link and hooks */
 	for (int i = 0; i < vcd->signal_count; i++) {
-		avr_vcd_signal_t * s = &vcd->signal[i];
+		avr_vcd_signal_t * s = vcd->signal[i];
 
 		avr_free_irq(&s->irq, 1);
+		free(s);
 	}
+	free(vcd->signal);
+	vcd->signal = NULL;
+	vcd->signal_count = 0;
+	_avr_vcd_free_chunks(vcd->head);
+	_avr_vcd_free_chunks(vcd->spare);
+	vcd->head = vcd->tail = vcd->spare = NULL;
+	free(vcd->buf);
+	vcd->buf = NULL;
 
 	if (vcd->filename) {
 		free(vcd->filename);
@@ -379,67 +671,89 @@ avr_vcd_close(
 	}
 }
 
+/*
+ * Value of a signal as VCD text, the bits from the top one then the
+ * alias. Returns the end of the text.
+ */
 static char *
-_avr_vcd_get_float_signal_text(
+_avr_vcd_put_value(
+		char * dst,
 		avr_vcd_signal_t * s,
-		char * out)
+		uint32_t value,
+		int floating)
 {
-	char * dst = out;
-
 	if (s->size > 1)
 		*dst++ = 'b';
-
-	for (int i = s->size; i > 0; i--)
-		*dst++ = 'z';
+	if (floating) {
+		memset(dst, 'z', s->size);
+		dst += s->size;
+	} else
+		for (int i = s->size - 1; i >= 0; i--)
+			*dst++ = '0' + ((value >> i) & 1);
 	if (s->size > 1)
 		*dst++ = ' ';
-	*dst++ = s->alias;
-	*dst = 0;
-	return out;
+	for (const char * a = s->alias; *a; a++)
+		*dst++ = *a;
+	*dst++ = '\n';
+	return dst;
 }
 
 static char *
-_avr_vcd_get_signal_text(
-		avr_vcd_signal_t * s,
-		char * out,
-		uint32_t value)
+_avr_vcd_put_stamp(
+		char * dst,
+		uint64_t stamp)
 {
-	char * dst = out;
-
-	if (s->size > 1)
-		*dst++ = 'b';
-
-	for (int i = s->size; i > 0; i--)
-		*dst++ = value & (1 << (i-1)) ? '1' : '0';
-	if (s->size > 1)
-		*dst++ = ' ';
-	*dst++ = s->alias;
-	*dst = 0;
-	return out;
+	char digits[20];
+	int n = 0;
+
+	do {
+		digits[n++] = '0' + stamp % 10;
+		stamp /= 10;
+	} while (stamp);
+	*dst++ = '#';
+	while (n)
+		*dst++ = digits[--n];
+	*dst++ = '\n';
+	return dst;
 }
 
-/* Write queued output to the VCD file. */
-
 static void
-avr_vcd_flush_log(
+_avr_vcd_write_buf(
 		avr_vcd_t * vcd)
 {
-#if AVR_VCD_MAX_SIGNALS > 32
-	uint64_t seen = 0;
-#else
-	uint32_t seen = 0;
-#endif
-	uint64_t oldbase = 0;	// make sure it's different
-	char out[48];
+	if (vcd->buf_len && fwrite(vcd->buf, vcd->buf_len, 1, vcd->output) != 1)
+		AVR_LOG(vcd->avr, LOG_ERROR, "VCD: %s: write error\n", vcd->filename);
+	vcd->buf_len = 0;
+}
 
-	if (avr_vcd_fifo_isempty(&vcd->log) || !vcd->output)
+// Format one chunk of changes, writing the buffer out when it fills up.
+static void
+_avr_vcd_write_chunk(
+		avr_vcd_t * vcd,
+		avr_vcd_chunk_t * c)
+{
+	if (vcd->wave) {
+		for (uint32_t i = 0; i < c->count; i++)
+			c->log[i].when -= vcd->start;
+		if (avr_wave_write(vcd->wave, c->log, c->count))
+			AVR_LOG(vcd->avr, LOG_ERROR, "VCD: %s: write error\n",
+					vcd->filename);
+		c->count = 0;
 		return;
-
-	while (!avr_vcd_fifo_isempty(&vcd->log)) {
-		avr_vcd_log_t l = avr_vcd_fifo_read(&vcd->log);
+	}
+	for (uint32_t i = 0; i < c->count; i++) {
+		avr_vcd_log_t * l = &c->log[i];
+		avr_vcd_signal_t * s = vcd->signal[l->sigindex];
 		// 10ns base -- 100MHz should be enough
-		uint64_t base = avr_cycles_to_nsec(vcd->avr, l.when - vcd->start) / 10;
-
+		uint64_t base = avr_cycles_to_nsec(vcd->avr,
+				l->when - vcd->start) / 10;
+
+		// room for a time stamp, and a value of up to 32 bits
+		if (vcd->buf_len > AVR_VCD_BUFFER - 96)
+			_avr_vcd_write_buf(vcd);
+		// a snapshot may have taken the AVR back in time
+		if (vcd->stamp && base < vcd->stamp - 1)
+			base = vcd->stamp - 1;
 		/*
 		 * if that trace was seen in this nsec already, we fudge the
 		 * base time to make sure the new value is offset by one nsec,
@@ -448,28 +762,370 @@ avr_vcd_flush_log(
 		 * This is a bit of a fudge, but it is the only way to represent
 		 * very short "pulses" that are still visible on the waveform.
 		 */
-		if (base == oldbase &&
-				(seen & (1 << l.sigindex)))
+		if (s->seen == base + 1)
 			base++;	// this forces a new timestamp
-
-		if (base > oldbase || !seen) {
-			seen = 0;
-			fprintf(vcd->output, "#%" PRIu64  "\n", base);
-			oldbase = base;
+		if (vcd->stamp != base + 1) {
+			vcd->stamp = base + 1;
+			vcd->buf_len = _avr_vcd_put_stamp(vcd->buf + vcd->buf_len,
+					base) - vcd->buf;
 		}
 		// mark this trace as seen for this timestamp
-		seen |= (1 << l.sigindex);
-		fprintf(vcd->output, "%s\n",
-				l.floating ?
-					_avr_vcd_get_float_signal_text(
-							&vcd->signal[l.sigindex],
-							out) :
-					_avr_vcd_get_signal_text(
-							&vcd->signal[l.sigindex],
-							out, l.value));
+		s->seen = base + 1;
+		vcd->buf_len = _avr_vcd_put_value(vcd->buf + vcd->buf_len, s,
+				l->value, l->floating) - vcd->buf;
 	}
+	c->count = 0;
+}
+
+static void
+_avr_vcd_apply(
+		avr_vcd_t * vcd,
+		avr_vcd_chunk_t * c,
+		uint32_t count);
 
-   fflush(vcd->output);
+/* Write queued output to the VCD file. */
+
+static void
+avr_vcd_flush_log(
+		avr_vcd_t * vcd)
+{
+	avr_vcd_chunk_t * c;
+
+	if (!vcd->head || !vcd->output)
+		return;
+
+	while ((c = vcd->head)) {
+		if (vcd->capture)
+			_avr_vcd_apply(vcd, c, c->count);
+		_avr_vcd_write_chunk(vcd, c);
+		vcd->head = c->next;
+		c->next = vcd->spare;
+		vcd->spare = c;
+	}
+	vcd->tail = NULL;
+	vcd->logged = 0;
+	_avr_vcd_write_buf(vcd);
+}
+
+/*
+ * Triggered capture. The values before the log are kept up to date as
+ * chunks are dropped or written, to start each capture with.
+ */
+
+static void
+_avr_vcd_apply(
+		avr_vcd_t * vcd,
+		avr_vcd_chunk_t * c,
+		uint32_t count)
+{
+	for (uint32_t i = 0; i < count; i++) {
+		avr_vcd_signal_t * s = vcd->signal[c->log[i].sigindex];
+
+		s->value = c->log[i].value;
+		s->floating = c->log[i].floating;
+	}
+}
+
+static void
+_avr_vcd_drop_head(
+		avr_vcd_t * vcd)
+{
+	avr_vcd_chunk_t * c = vcd->head;
+
+	_avr_vcd_apply(vcd, c, c->count);
+	vcd->logged -= c->count;
+	vcd->head = c->next;
+	if (!vcd->head)
+		vcd->tail = NULL;
+	c->next = vcd->spare;
+	vcd->spare = c;
+}
+
+// The pre-trigger window is in cycles, unless only changes are counted.
+static int
+_avr_vcd_pre_timed(
+		avr_vcd_t * vcd)
+{
+	return vcd->pre || !vcd->pre_changes;
+}
+
+/*
+ * Drop the chunks that are all before the pre-trigger window, but the
+ * one being filled.
+ */
+static void
+_avr_vcd_trim(
+		avr_vcd_t * vcd)
+{
+	avr_vcd_chunk_t * c;
+
+	while ((c = vcd->head) && c != vcd->tail) {
+		int old = _avr_vcd_pre_timed(vcd) &&
+				c->log[c->count - 1].when + vcd->pre < vcd->avr->cycle;
+		int many = vcd->pre_changes &&
+				vcd->logged - c->count >= vcd->pre_changes;
+
+		if (!old && !many)
+			break;
+		_avr_vcd_drop_head(vcd);
+	}
+}
+
+// Write the values at the start of a capture, then the log.
+static void
+_avr_vcd_capture_write(
+		avr_vcd_t * vcd)
+{
+	uint64_t limit = vcd->pre_changes ? vcd->pre_changes : UINT64_MAX;
+	uint64_t from = 0;
+	avr_vcd_chunk_t * c, * values;
+
+	if (_avr_vcd_pre_timed(vcd) && vcd->trigger > vcd->pre)
+		from = vcd->trigger - vcd->pre;
+	_avr_vcd_trim(vcd);
+	// and the changes before the window in the chunk it starts in
+	while ((c = vcd->head)) {
+		uint32_t n = 0;
+
+		while (n < c->count && (c->log[n].when < from ||
+				vcd->logged - n > limit))
+			n++;
+		if (n == c->count && c != vcd->tail) {
+			_avr_vcd_drop_head(vcd);
+			continue;
+		}
+		_avr_vcd_apply(vcd, c, n);
+		memmove(c->log, c->log + n, (c->count - n) * sizeof(c->log[0]));
+		c->count -= n;
+		vcd->logged -= n;
+		break;
+	}
+	// just before the first change kept, if the window is a count
+	if (!_avr_vcd_pre_timed(vcd))
+		from = (c && c->count ? c->log[0].when : vcd->trigger) - 1;
+	if (from < vcd->start)
+		from = vcd->start;
+
+	if ((values = vcd->spare))
+		vcd->spare = values->next;
+	else if (!(values = malloc(sizeof(*values)))) {
+		avr_vcd_flush_log(vcd);
+		return;
+	}
+	values->count = 0;
+	for (int i = 0; i < vcd->signal_count; i++) {
+		values->log[values->count++] = (avr_vcd_log_t) {
+			.sigindex = i,
+			.when = from,
+			.value = vcd->signal[i]->value,
+			.floating = vcd->signal[i]->floating,
+		};
+		if (values->count == AVR_VCD_LOG_CHUNK || i == vcd->signal_count - 1)
+			_avr_vcd_write_chunk(vcd, values);
+	}
+	values->next = vcd->spare;
+	vcd->spare = values;
+	avr_vcd_flush_log(vcd);
+}
+
+void
+avr_vcd_set_capture(
+		avr_vcd_t * vcd,
+		uint64_t pre,
+		uint32_t pre_changes,
+		uint64_t post )
+{
+	avr_vcd_set_writer(vcd, AVR_VCD_WRITER_NONE);
+	vcd->pre = pre;
+	vcd->pre_changes = pre_changes;
+	vcd->post = post;
+	vcd->capture = AVR_VCD_CAPTURE_ARMED;
+}
+
+void
+avr_vcd_trigger(
+		avr_vcd_t * vcd,
+		const char * reason )
+{
+	if (!vcd || vcd->capture != AVR_VCD_CAPTURE_ARMED || !vcd->output)
+		return;
+	AVR_LOG(vcd->avr, LOG_WARNING, "VCD: %s: %s trigger at cycle %" PRIu64
+			"\n", vcd->filename, reason, (uint64_t)vcd->avr->cycle);
+	vcd->trigger = vcd->avr->cycle;
+	vcd->captures++;
+	_avr_vcd_capture_write(vcd);
+	vcd->capture = AVR_VCD_CAPTURE_TRIGGERED;
+}
+
+// The post-trigger window is over, back to waiting for a trigger.
+static void
+_avr_vcd_rearm(
+		avr_vcd_t * vcd)
+{
+	avr_vcd_flush_log(vcd);
+	vcd->capture = AVR_VCD_CAPTURE_ARMED;
+}
+
+static void
+_avr_vcd_queue_push(
+		avr_vcd_queue_t * q,
+		avr_vcd_chunk_t * c)
+{
+	// never full, there are no more chunks than it has room for
+	q->c[q->head % AVR_VCD_QUEUE] = c;
+	__atomic_store_n(&q->head, q->head + 1, __ATOMIC_RELEASE);
+}
+
+static int
+_avr_vcd_queue_empty(
+		avr_vcd_queue_t * q)
+{
+	return __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) == q->tail;
+}
+
+static avr_vcd_chunk_t *
+_avr_vcd_queue_pop(
+		avr_vcd_queue_t * q)
+{
+	avr_vcd_chunk_t * c;
+
+	if (_avr_vcd_queue_empty(q))
+		return NULL;
+	c = q->c[q->tail % AVR_VCD_QUEUE];
+	__atomic_store_n(&q->tail, q->tail + 1, __ATOMIC_RELEASE);
+	return c;
+}
+
+static void
+_avr_vcd_wake(
+		avr_vcd_t * vcd)
+{
+	pthread_mutex_lock(&vcd->lock);
+	pthread_cond_broadcast(&vcd->wake);
+	pthread_mutex_unlock(&vcd->lock);
+}
+
+// Hand the chunk being filled to the writer.
+static void
+_avr_vcd_hand_over(
+		avr_vcd_t * vcd)
+{
+	if (!vcd->tail || !vcd->tail->count)
+		return;
+	_avr_vcd_queue_push(&vcd->full, vcd->tail);
+	vcd->head = vcd->tail = NULL;
+	_avr_vcd_wake(vcd);
+}
+
+static void *
+_avr_vcd_writer(
+		void * param)
+{
+	avr_vcd_t * vcd = param;
+	avr_vcd_chunk_t * c;
+	int quit;
+
+	for (;;) {
+		if ((c = _avr_vcd_queue_pop(&vcd->full))) {
+			_avr_vcd_write_chunk(vcd, c);
+			_avr_vcd_queue_push(&vcd->empty, c);
+			_avr_vcd_wake(vcd);
+			continue;
+		}
+		// the file is up to date while we wait
+		_avr_vcd_write_buf(vcd);
+		pthread_mutex_lock(&vcd->lock);
+		while (_avr_vcd_queue_empty(&vcd->full) && !vcd->quit)
+			pthread_cond_wait(&vcd->wake, &vcd->lock);
+		quit = vcd->quit && _avr_vcd_queue_empty(&vcd->full);
+		pthread_mutex_unlock(&vcd->lock);
+		if (quit)
+			break;
+	}
+	_avr_vcd_write_buf(vcd);
+	return NULL;
+}
+
+static int
+_avr_vcd_start_writer(
+		avr_vcd_t * vcd)
+{
+	avr_vcd_chunk_t * c;
+
+	avr_vcd_flush_log(vcd);
+	memset(&vcd->full, 0, sizeof(vcd->full));
+	memset(&vcd->empty, 0, sizeof(vcd->empty));
+	vcd->chunks = 0;
+	// the spare chunks are the first ones the AVR gets back
+	while ((c = vcd->spare) && vcd->chunks < AVR_VCD_QUEUE) {
+		vcd->spare = c->next;
+		_avr_vcd_queue_push(&vcd->empty, c);
+		vcd->chunks++;
+	}
+	vcd->quit = 0;
+	pthread_mutex_init(&vcd->lock, NULL);
+	pthread_cond_init(&vcd->wake, NULL);
+	if (pthread_create(&vcd->thread, NULL, _avr_vcd_writer, vcd)) {
+		AVR_LOG(vcd->avr, LOG_ERROR, "VCD: %s: can't start the writer\n",
+				vcd->filename);
+		pthread_cond_destroy(&vcd->wake);
+		pthread_mutex_destroy(&vcd->lock);
+		while ((c = _avr_vcd_queue_pop(&vcd->empty))) {
+			c->next = vcd->spare;
+			vcd->spare = c;
+		}
+		return -1;
+	}
+	vcd->running = 1;
+	return 0;
+}
+
+static void
+_avr_vcd_stop_writer(
+		avr_vcd_t * vcd)
+{
+	avr_vcd_chunk_t * c;
+
+	if (!vcd->running)
+		return;
+	_avr_vcd_hand_over(vcd);
+	pthread_mutex_lock(&vcd->lock);
+	vcd->quit = 1;
+	pthread_cond_broadcast(&vcd->wake);
+	pthread_mutex_unlock(&vcd->lock);
+	pthread_join(vcd->thread, NULL);
+	pthread_cond_destroy(&vcd->wake);
+	pthread_mutex_destroy(&vcd->lock);
+	vcd->running = 0;
+
+	// the writer has written them all
+	if (vcd->tail) {
+		vcd->tail->next = vcd->spare;
+		vcd->spare = vcd->tail;
+		vcd->head = vcd->tail = NULL;
+	}
+	while ((c = _avr_vcd_queue_pop(&vcd->empty))) {
+		c->next = vcd->spare;
+		vcd->spare = c;
+	}
+}
+
+int
+avr_vcd_set_writer(
+		avr_vcd_t * vcd,
+		int writer )
+{
+	if (vcd->capture && writer != AVR_VCD_WRITER_NONE) {
+		AVR_LOG(vcd->avr, LOG_ERROR,
+				"VCD: %s: no writer thread for a triggered capture\n",
+				vcd->filename);
+		return -1;
+	}
+	_avr_vcd_stop_writer(vcd);
+	vcd->writer = writer;
+	if (vcd->output && writer != AVR_VCD_WRITER_NONE)
+		return _avr_vcd_start_writer(vcd);
+	return 0;
 }
 
 /* Cycle timer for writing queued output. */
@@ -481,10 +1137,44 @@ _avr_vcd_timer(
 		void * param)
 {
 	avr_vcd_t * vcd = param;
-	avr_vcd_flush_log(vcd);
+
+	if (vcd->capture == AVR_VCD_CAPTURE_ARMED)
+		_avr_vcd_trim(vcd);
+	else if (vcd->capture == AVR_VCD_CAPTURE_TRIGGERED &&
+			avr->cycle > vcd->trigger + vcd->post)
+		_avr_vcd_rearm(vcd);
+	else if (vcd->running)
+		_avr_vcd_hand_over(vcd);
+	else
+		avr_vcd_flush_log(vcd);
 	return when + vcd->period;
 }
 
+/*
+ * Get an empty chunk for the writer thread to fill, waiting for the
+ * writer to give one back if they are all in use and it's set to block.
+ */
+static avr_vcd_chunk_t *
+_avr_vcd_get_chunk(
+		avr_vcd_t * vcd)
+{
+	avr_vcd_chunk_t * c;
+
+	if ((c = _avr_vcd_queue_pop(&vcd->empty)))
+		return c;
+	if (vcd->chunks < AVR_VCD_QUEUE && (c = malloc(sizeof(*c)))) {
+		vcd->chunks++;
+		return c;
+	}
+	if (vcd->writer != AVR_VCD_WRITER_BLOCK)
+		return NULL;
+	pthread_mutex_lock(&vcd->lock);
+	while (!(c = _avr_vcd_queue_pop(&vcd->empty)))
+		pthread_cond_wait(&vcd->wake, &vcd->lock);
+	pthread_mutex_unlock(&vcd->lock);
+	return c;
+}
+
 /* Called for an IRQ that is being recorded. */
 
 static void
@@ -494,6 +1184,7 @@ _avr_vcd_notify(
 		void * param)
 {
 	avr_vcd_t * vcd = (avr_vcd_t *)param;
+	avr_vcd_chunk_t * c = vcd->tail;
 
 	if (!vcd->output) {
 		AVR_LOG(vcd->avr, LOG_WARNING,
@@ -501,23 +1192,46 @@ _avr_vcd_notify(
 				__FUNCTION__);
 		return;
 	}
+	if (vcd->capture == AVR_VCD_CAPTURE_TRIGGERED &&
+			vcd->avr->cycle > vcd->trigger + vcd->post) {
+		_avr_vcd_rearm(vcd);
+		c = NULL;
+	}
+	// the log grows until the next flush, rather than flushing now
+	if (!c || c->count == AVR_VCD_LOG_CHUNK) {
+		if (vcd->capture == AVR_VCD_CAPTURE_ARMED)
+			_avr_vcd_trim(vcd);
+		if (vcd->running) {
+			_avr_vcd_hand_over(vcd);
+			c = _avr_vcd_get_chunk(vcd);
+		} else if ((c = vcd->spare))
+			vcd->spare = c->next;
+		else
+			c = malloc(sizeof(*c));
+		if (!c) {
+			if (!vcd->dropped++)
+				AVR_LOG(vcd->avr, LOG_WARNING,
+						"VCD: %s: %s, losing changes\n", vcd->filename,
+						vcd->running ? "writer behind" : "out of memory");
+			return;
+		}
+		c->next = NULL;
+		c->count = 0;
+		if (vcd->tail)
+			vcd->tail->next = c;
+		else
+			vcd->head = c;
+		vcd->tail = c;
+	}
 
 	avr_vcd_signal_t * s = (avr_vcd_signal_t*)irq;
-	avr_vcd_log_t l = {
+	vcd->logged++;
+	c->log[c->count++] = (avr_vcd_log_t) {
 		.sigindex = s->irq.irq,
 		.when = vcd->avr->cycle,
 		.value = value,
 		.floating = !!(avr_irq_get_flags(irq) & IRQ_FLAG_FLOATING),
 	};
-	if (avr_vcd_fifo_isfull(&vcd->log)) {
-		AVR_LOG(vcd->avr, LOG_WARNING,
-				"%s FIFO Overload, flushing!\n",
-				__func__);
-		/* Decrease period by a quarter, for next time */
-		vcd->period -= vcd->period >> 2;
-		avr_vcd_flush_log(vcd);
-	}
-	avr_vcd_fifo_write(&vcd->log, l);
 }
 
 /* Register an IRQ whose value is to be logged. */
@@ -529,17 +1243,21 @@ avr_vcd_add_signal(
 		int signal_bit_size,
 		const char * name )
 {
-	if (vcd->signal_count == AVR_VCD_MAX_SIGNALS) {
+	int index = vcd->signal_count;
+	avr_vcd_signal_t * s;
+
+	if (signal_bit_size < 1 || signal_bit_size > 32 ||
+			!(s = _avr_vcd_new_signal(vcd))) {
 		AVR_LOG(vcd->avr, LOG_ERROR,
 			" %s: unable add signal '%s'\n",
 			__FUNCTION__, name);
 		return -1;
 	}
-	int index = vcd->signal_count++;
-	avr_vcd_signal_t * s = &vcd->signal[index];
-	strncpy(s->name, name, sizeof(s->name));
+	strncpy(s->name, name, sizeof(s->name) - 1);
 	s->size = signal_bit_size;
-	s->alias = ' ' + vcd->signal_count ;
+	// as many printable characters as needed, '!' to '~'
+	for (int i = 0, n = index; i == 0 || n; i++, n /= 94)
+		s->alias[i] = '!' + n % 94;
 
 	/* manufacture a nice IRQ name */
 	int l = strlen(name);
@@ -557,16 +1275,117 @@ avr_vcd_add_signal(
 	return 0;
 }
 
+// A pipe closed on exec.
+static int
+_avr_vcd_pipe(
+		int p[2])
+{
+#ifdef __APPLE__
+	// no pipe2() there
+	if (pipe(p))
+		return -1;
+	fcntl(p[0], F_SETFD, FD_CLOEXEC);
+	fcntl(p[1], F_SETFD, FD_CLOEXEC);
+	return 0;
+#else
+	return pipe2(p, O_CLOEXEC);
+#endif
+}
+
+/*
+ * Open the output file, or a pipe to gzip writing it if the name ends in
+ * ".gz". Both ends of the pipe are closed on exec: the gzip of another
+ * trace must not keep this one's open, or closing this one waits for ever.
+ */
+static FILE *
+_avr_vcd_open(
+		avr_vcd_t * vcd)
+{
+	int fd, p[2];
+
+	vcd->gzip = 0;
+	if (!_avr_vcd_suffix(vcd, ".gz"))
+		return fopen(vcd->filename, "w");
+	fd = open(vcd->filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if (fd < 0)
+		return NULL;
+	if (_avr_vcd_pipe(p)) {
+		close(fd);
+		return NULL;
+	}
+	vcd->gzip = fork();
+	if (vcd->gzip == 0) {
+		dup2(p[0], 0);
+		dup2(fd, 1);
+		close(p[0]);
+		close(p[1]);
+		close(fd);
+		execlp("gzip", "gzip", "-c", NULL);
+		_exit(127);
+	}
+	close(p[0]);
+	close(fd);
+	if (vcd->gzip < 0) {
+		vcd->gzip = 0;
+		close(p[1]);
+		return NULL;
+	}
+	return fdopen(p[1], "w");
+}
+
+static void
+_avr_vcd_write_header(
+		avr_vcd_t * vcd)
+{
+	time_t now;
+
+	time(&now);
+	fprintf(vcd->output, "$date %s$end\n", ctime(&now));
+	fprintf(vcd->output,
+		"$version Simavr " CONFIG_SIMAVR_VERSION " $end\n");
+	fprintf(vcd->output, "$timescale 10ns $end\n");	// 10ns base, aka 100MHz
+	fprintf(vcd->output, "$scope module logic $end\n");
+
+	for (int i = 0; i < vcd->signal_count; i++) {
+		fprintf(vcd->output, "$var wire %d %s %s $end\n",
+			vcd->signal[i]->size, vcd->signal[i]->alias,
+			vcd->signal[i]->name);
+	}
+
+	fprintf(vcd->output, "$upscope $end\n");
+	fprintf(vcd->output, "$enddefinitions $end\n");
+
+	fprintf(vcd->output, "$dumpvars\n");
+	for (int i = 0; i < vcd->signal_count; i++) {
+		vcd->buf_len = _avr_vcd_put_value(vcd->buf, vcd->signal[i],
+				0, 1) - vcd->buf;
+		_avr_vcd_write_buf(vcd);
+	}
+	fprintf(vcd->output, "$end\n");
+}
+
+// Header of a binary file, times in there are in AVR cycles
+static int
+_avr_vcd_write_wave_header(
+		avr_vcd_t * vcd)
+{
+	if (!(vcd->wave = malloc(sizeof(*vcd->wave))))
+		return -1;
+	avr_wave_create(vcd->wave, vcd->output, vcd->avr->frequency);
+	for (int i = 0; i < vcd->signal_count; i++)
+		if (avr_wave_add_signal(vcd->wave, vcd->signal[i]->size,
+				vcd->signal[i]->name) < 0)
+			return -1;
+	return avr_wave_write_header(vcd->wave);
+}
+
 /* Open the VCD output file and write header.  Does nothing for input. */
 
 int
 avr_vcd_start(
 		avr_vcd_t * vcd)
 {
-	time_t now;
-
 	vcd->start = vcd->avr->cycle;
-	avr_vcd_fifo_reset(&vcd->log);
 
 	if (vcd->input) {
 		/*
@@ -577,35 +1396,33 @@ avr_vcd_start(
 	}
 	if (vcd->output)
 		avr_vcd_stop(vcd);
-	vcd->output = fopen(vcd->filename, "w");
+	if (!vcd->buf && !(vcd->buf = malloc(AVR_VCD_BUFFER)))
+		return -1;
+	vcd->output = _avr_vcd_open(vcd);
 	if (vcd->output == NULL) {
 		perror(vcd->filename);
 		return -1;
 	}
-
-	time(&now);
-	fprintf(vcd->output, "$date %s$end\n", ctime(&now));
-	fprintf(vcd->output,
-		"$version Simavr " CONFIG_SIMAVR_VERSION " $end\n");
-	fprintf(vcd->output, "$timescale 10ns $end\n");	// 10ns base, aka 100MHz
-	fprintf(vcd->output, "$scope module logic $end\n");
-
+	vcd->stamp = 0;
 	for (int i = 0; i < vcd->signal_count; i++) {
-		fprintf(vcd->output, "$var wire %d %c %s $end\n",
-			vcd->signal[i].size, vcd->signal[i].alias, vcd->signal[i].name);
+		vcd->signal[i]->seen = 0;
+		vcd->signal[i]->value = 0;
+		vcd->signal[i]->floating = 1;
 	}
-
-	fprintf(vcd->output, "$upscope $end\n");
-	fprintf(vcd->output, "$enddefinitions $end\n");
-
-	fprintf(vcd->output, "$dumpvars\n");
-	for (int i = 0; i < vcd->signal_count; i++) {
-		avr_vcd_signal_t * s = &vcd->signal[i];
-		char out[48];
-		fprintf(vcd->output, "%s\n",
-				_avr_vcd_get_float_signal_text(s, out));
+	vcd->logged = 0;
+	if (vcd->capture)
+		vcd->capture = AVR_VCD_CAPTURE_ARMED;
+
+	if (!_avr_vcd_suffix(vcd, ".swav"))
+		_avr_vcd_write_header(vcd);
+	else if (_avr_vcd_write_wave_header(vcd)) {
+		AVR_LOG(vcd->avr, LOG_ERROR, "VCD: %s: can't write header\n",
+				vcd->filename);
+		avr_vcd_stop(vcd);
+		return -1;
 	}
-	fprintf(vcd->output, "$end\n");
+	if (vcd->writer != AVR_VCD_WRITER_NONE && !vcd->capture)
+		_avr_vcd_start_writer(vcd);
 	avr_cycle_timer_register(vcd->avr, vcd->period, _avr_vcd_timer, vcd);
 	return 0;
 }
@@ -617,18 +1434,43 @@ avr_vcd_stop(
 	avr_cycle_timer_cancel(vcd->avr, _avr_vcd_timer, vcd);
 	avr_cycle_timer_cancel(vcd->avr, _avr_vcd_input_timer, vcd);
 
+	_avr_vcd_stop_writer(vcd);
+	// no trigger came, the ring is not written
+	while (vcd->capture == AVR_VCD_CAPTURE_ARMED && vcd->head)
+		_avr_vcd_drop_head(vcd);
 	avr_vcd_flush_log(vcd);
+	if (vcd->wave) {
+		if (vcd->output && vcd->wave->state && avr_wave_finish(vcd->wave))
+			AVR_LOG(vcd->avr, LOG_ERROR, "VCD: %s: write error\n",
+					vcd->filename);
+		avr_wave_free(vcd->wave);
+		free(vcd->wave);
+		vcd->wave = NULL;
+	}
 
-	if (vcd->input_line)
-		free(vcd->input_line);
-	vcd->input_line = NULL;
+	if (vcd->map) {
+		if (vcd->mapped)
+			munmap((void *)vcd->map, vcd->map_size);
+		else
+			free((void *)vcd->map);
+	}
+	vcd->map = NULL;
+	free(vcd->alias_hash);
+	vcd->alias_hash = NULL;
+	vcd->alias_hash_size = 0;
+	vcd->has_next = 0;
 	if (vcd->input)
 		fclose(vcd->input);
 	vcd->input = NULL;
 	if (vcd->output)
 		fclose(vcd->output);
 	vcd->output = NULL;
+	if (vcd->gzip > 0)
+		waitpid(vcd->gzip, NULL, 0);
+	vcd->gzip = 0;
+	if (vcd->dropped)
+		AVR_LOG(vcd->avr, LOG_ERROR, "VCD: %s: %" PRIu64 " changes lost\n",
+				vcd->filename, vcd->dropped);
+	vcd->dropped = 0;
 	return 0;
 }
-
-
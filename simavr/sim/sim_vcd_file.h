@@ -26,8 +26,9 @@
 #define __SIM_VCD_FILE_H__
 
 #include <stdio.h>
+#include <pthread.h>
+#include <sys/types.h>
 #include "sim_irq.h"
-#include "fifo_declare.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -42,12 +43,49 @@ extern "C" {
  *
  * It can also do the reverse, load a VCD file generated by for example
  * sigrock signal analyzer, and 'replay' digital input with the proper
- * timing.
+ * timing. The file is mapped, and parsed as it is replayed, so large
+ * captures start at once; identifiers can be several characters long.
+ * A ".swav" file, converted once by simavr-wave, is read in its place
+ * with no parsing at all. It can be played again and again, for periodic
+ * stimuli, each time starting at the last time stamp of the file.
  *
- * TODO: Add support for 'looping' a VCD input.
+ * Output changes are appended to a log of fixed size chunks, which grows
+ * as needed between two flushes, and are formatted into a large buffer
+ * for writing. There is no limit on the number of signals: aliases are
+ * as many characters as needed.
+ *
+ * With a writer thread (avr_vcd_set_writer()) the AVR's thread only fills
+ * chunks, and hands the full ones to the writer over a lock free queue;
+ * the writer formats and writes them and hands them back. There are at
+ * most AVR_VCD_QUEUE chunks then, and when they are all in use the AVR
+ * either waits for the writer or counts the changes it could not log.
+ *
+ * A filename ending in ".gz" is compressed, by piping it to gzip. One
+ * ending in ".swav" gets the compact binary format of sim_wave.h instead
+ * of VCD text.
+ *
+ * For a triggered capture (avr_vcd_set_capture()) the log is not written
+ * but kept as a ring, its oldest chunks going back to the spares as the
+ * AVR runs. A trigger (avr_vcd_trigger(), see also sim_trigger.h) writes
+ * the values before it, and the changes for a while after it, then the
+ * log goes back to being a ring until the next one.
  */
 
-#define AVR_VCD_MAX_SIGNALS 64
+#define AVR_VCD_LOG_CHUNK	4096			// changes per chunk of the log
+#define AVR_VCD_BUFFER		(64 * 1024)		// output formatting buffer
+#define AVR_VCD_QUEUE		64				// chunks, with a writer thread
+
+enum {
+	AVR_VCD_WRITER_NONE = 0,	// written from a cycle timer, on the AVR's thread
+	AVR_VCD_WRITER_BLOCK,		// writer thread, wait for it when it is behind
+	AVR_VCD_WRITER_DROP,		// writer thread, lose changes when it is behind
+};
+
+enum {
+	AVR_VCD_CAPTURE_OFF = 0,	// every change is written
+	AVR_VCD_CAPTURE_ARMED,		// waiting for a trigger
+	AVR_VCD_CAPTURE_TRIGGERED,	// writing until the end of the post window
+};
 
 typedef struct avr_vcd_signal_t {
 	/*
@@ -55,22 +93,33 @@ typedef struct avr_vcd_signal_t {
 	 * For VCD input, this is the IRQ we broadcast the values to
 	 */
 	avr_irq_t 		irq;
-	char 			alias;			// vcd one character alias
+	char 			alias[8];		// vcd identifier
 	uint8_t			size;			// in bits
 	char 			name[32];		// full human name
+	uint64_t		seen;			// output time stamp it changed at, + 1
+	uint32_t		value;			// before the log, for a capture
+	uint8_t			floating;
 } avr_vcd_signal_t, *avr_vcd_signal_p;
 
 typedef struct avr_vcd_log_t {
 	uint64_t 		when;			// Cycles for output,
 							//     nS for input.
-	uint64_t			sigindex : 8,	// index in signal table
-					floating : 1,
-					value : 32;
+	uint32_t		sigindex : 31,	// index in signal table
+					floating : 1;
+	uint32_t		value;
 } avr_vcd_log_t, *avr_vcd_log_p;
 
-DECLARE_FIFO(avr_vcd_log_t, avr_vcd_fifo, 256);
+typedef struct avr_vcd_chunk_t {
+	struct avr_vcd_chunk_t *	next;
+	uint32_t					count;
+	avr_vcd_log_t				log[AVR_VCD_LOG_CHUNK];
+} avr_vcd_chunk_t;
 
-struct argv_t;
+// single producer, single consumer
+typedef struct avr_vcd_queue_t {
+	avr_vcd_chunk_t *	c[AVR_VCD_QUEUE];
+	uint32_t			head, tail;
+} avr_vcd_queue_t;
 
 typedef struct avr_vcd_t {
 	struct avr_t *	avr;	// AVR we are attaching timers to..
@@ -79,16 +128,58 @@ typedef struct avr_vcd_t {
 	/* can be input OR output, not both */
 	FILE * 			output;
 	FILE * 			input;
-	struct argv_t	* input_line;
 
 	int 				signal_count;
-	avr_vcd_signal_t	signal[AVR_VCD_MAX_SIGNALS];
+	avr_vcd_signal_t **	signal;
 
 	uint64_t 		start;
 	uint64_t 		period;		// for output cycles
 	uint64_t 		vcd_to_ns;	// for input unit mapping
-
-	avr_vcd_fifo_t	log;
+	uint64_t		vcd_ns_div;	// for ps and fs
+
+	// for input
+	const char *	map;		// the file
+	size_t			map_size, pos;
+	size_t			body;		// where the changes start
+	int				mapped;		// or read in memory
+	uint32_t *		alias_hash;	// signal + 1, by alias
+	uint32_t		alias_hash_size;
+	uint64_t		now;		// last time stamp, in ns
+	uint64_t		base;		// added to the time stamps, looping
+	int				loop;		// play it again that many times, -1 for ever
+	int				played;		// changes read since it was last started
+	avr_vcd_log_t	next;		// change to play next
+	int				has_next;
+	const avr_vcd_log_t * wave_log;	// a block read from a .swav input
+	int				wave_count, wave_pos;
+
+	// for output
+	avr_vcd_chunk_t *	head, * tail;	// changes not written yet
+	avr_vcd_chunk_t *	spare;			// written, for reuse
+	char *			buf;
+	uint32_t		buf_len;
+	uint64_t		stamp;		// last time stamp written, + 1
+	uint64_t		dropped;	// changes lost, out of memory or writer behind
+	pid_t			gzip;		// compressing the output
+	struct avr_wave_t * wave;	// binary format output, or input
+
+	// writer thread, the AVR's thread only uses 'tail' then
+	int				writer;		// AVR_VCD_WRITER_*
+	int				running, quit;
+	pthread_t		thread;
+	pthread_mutex_t	lock;
+	pthread_cond_t	wake;		// a queue is no longer empty, or quit
+	uint32_t		chunks;		// allocated, up to AVR_VCD_QUEUE
+	avr_vcd_queue_t	full;		// to the writer
+	avr_vcd_queue_t	empty;		// back from it
+
+	// triggered capture, there is no writer thread then
+	int				capture;	// AVR_VCD_CAPTURE_*
+	uint64_t		pre, post;	// cycles kept before a trigger, written after
+	uint32_t		pre_changes;	// changes kept before, 0 for no limit
+	uint64_t		logged;		// changes in the log
+	uint64_t		trigger;	// cycle of the last one
+	uint32_t		captures;
 } avr_vcd_t;
 
 // initializes a new VCD trace file, and returns zero if all is well
@@ -98,6 +189,7 @@ avr_vcd_init(
 		const char * filename, 	// filename to write
 		avr_vcd_t * vcd,		// vcd struct to initialize
 		uint32_t	period );	// file flushing period is in usec
+// Set 'loop' after this to play the file more than once.
 int
 avr_vcd_init_input(
 		struct avr_t * avr,
@@ -115,6 +207,36 @@ avr_vcd_add_signal(
 		int signal_bit_size,
 		const char * name );
 
+/*
+ * Format and write the file on a thread of its own, AVR_VCD_WRITER_BLOCK
+ * or _DROP, or go back to AVR_VCD_WRITER_NONE. Can be called at any time.
+ * Returns -1 if the thread could not be started.
+ */
+int
+avr_vcd_set_writer(
+		avr_vcd_t * vcd,
+		int writer );
+
+/*
+ * Only write the changes around a trigger: 'pre' cycles before it, or at
+ * most 'pre_changes' changes if that is not zero, and 'post' cycles after
+ * it. Stops the writer thread.
+ */
+void
+avr_vcd_set_capture(
+		avr_vcd_t * vcd,
+		uint64_t pre,
+		uint32_t pre_changes,
+		uint64_t post );
+/*
+ * Write the capture around now, 'reason' is logged. Does nothing unless
+ * one is armed, waiting for a trigger.
+ */
+void
+avr_vcd_trigger(
+		avr_vcd_t * vcd,
+		const char * reason );
+
 // Starts recording the signal value into the file
 int
 avr_vcd_start(
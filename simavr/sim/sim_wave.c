@@ -0,0 +1,559 @@
+/*
+	sim_wave.c
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "sim_wave.h"
+
+#define AVR_WAVE_MAGIC		"SIMAVRW1"
+#define AVR_WAVE_TRAILER	"SIMAVRIX"
+
+static uint8_t *
+_avr_wave_put(
+		uint8_t * dst,
+		uint64_t v)
+{
+	while (v >= 0x80) {
+		*dst++ = v | 0x80;
+		v >>= 7;
+	}
+	*dst++ = v;
+	return dst;
+}
+
+static int
+_avr_wave_get(
+		const uint8_t ** src,
+		const uint8_t * end,
+		uint64_t * v)
+{
+	const uint8_t * s = *src;
+
+	*v = 0;
+	for (int shift = 0; s < end && shift < 64; shift += 7) {
+		*v |= (uint64_t)(*s & 0x7f) << shift;
+		if (!(*s++ & 0x80)) {
+			*src = s;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static int
+_avr_wave_fget(
+		FILE * f,
+		uint64_t * v)
+{
+	int c;
+
+	*v = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		if ((c = fgetc(f)) == EOF)
+			return -1;
+		*v |= (uint64_t)(c & 0x7f) << shift;
+		if (!(c & 0x80))
+			return 0;
+	}
+	return -1;
+}
+
+static int
+_avr_wave_reserve(
+		avr_wave_t * w,
+		size_t size)
+{
+	uint8_t * b;
+
+	if (size <= w->buf_size)
+		return 0;
+	if (!(b = realloc(w->buf, size)))
+		return -1;
+	w->buf = b;
+	w->buf_size = size;
+	return 0;
+}
+
+static int
+_avr_wave_out(
+		avr_wave_t * w,
+		const void * data,
+		size_t size)
+{
+	if (size && fwrite(data, size, 1, w->f) != 1)
+		return -1;
+	w->offset += size;
+	return 0;
+}
+
+// Buffers needed once the signals are known, to write or read blocks.
+static int
+_avr_wave_alloc(
+		avr_wave_t * w)
+{
+	w->state = malloc(w->signal_count * sizeof(*w->state) + 1);
+	w->count = malloc(2 * w->signal_count * sizeof(*w->count) + 1);
+	w->log = malloc(2 * AVR_WAVE_BLOCK * sizeof(*w->log));
+	if (!w->state || !w->count || !w->log)
+		return -1;
+	// everything is floating to start with, as the VCD $dumpvars say
+	for (int i = 0; i < w->signal_count; i++)
+		w->state[i] = 1;
+	return 0;
+}
+
+static int
+_avr_wave_add_index(
+		avr_wave_t * w,
+		uint64_t start,
+		uint64_t offset)
+{
+	if (w->index_count == w->index_size) {
+		uint32_t size = w->index_size ? w->index_size * 2 : 256;
+		uint64_t * index = realloc(w->index, 2 * size * sizeof(*index));
+
+		if (!index)
+			return -1;
+		w->index = index;
+		w->index_size = size;
+	}
+	w->index[2 * w->index_count] = start;
+	w->index[2 * w->index_count + 1] = offset;
+	w->index_count++;
+	return 0;
+}
+
+int
+avr_wave_create(
+		avr_wave_t * w,
+		FILE * f,
+		uint64_t rate)
+{
+	memset(w, 0, sizeof(*w));
+	w->f = f;
+	w->rate = rate;
+	return 0;
+}
+
+int
+avr_wave_add_signal(
+		avr_wave_t * w,
+		int size,
+		const char * name)
+{
+	avr_wave_signal_t * s;
+
+	if (size < 1 || size > 32)
+		return -1;
+	s = realloc(w->signal, (w->signal_count + 1) * sizeof(*s));
+	if (!s)
+		return -1;
+	w->signal = s;
+	s += w->signal_count;
+	s->size = size;
+	if (!(s->name = strdup(name)))
+		return -1;
+	return w->signal_count++;
+}
+
+int
+avr_wave_write_header(
+		avr_wave_t * w)
+{
+	uint8_t * d;
+
+	if (_avr_wave_alloc(w))
+		return -1;
+	if (_avr_wave_out(w, AVR_WAVE_MAGIC, 8))
+		return -1;
+	if (_avr_wave_reserve(w, 20))
+		return -1;
+	d = _avr_wave_put(w->buf, w->rate);
+	d = _avr_wave_put(d, w->signal_count);
+	if (_avr_wave_out(w, w->buf, d - w->buf))
+		return -1;
+	for (int i = 0; i < w->signal_count; i++) {
+		size_t l = strlen(w->signal[i].name);
+
+		if (_avr_wave_reserve(w, 20 + l))
+			return -1;
+		d = _avr_wave_put(w->buf, w->signal[i].size);
+		d = _avr_wave_put(d, l);
+		memcpy(d, w->signal[i].name, l);
+		if (_avr_wave_out(w, w->buf, d + l - w->buf))
+			return -1;
+	}
+	return 0;
+}
+
+static int
+_avr_wave_write_block(
+		avr_wave_t * w,
+		const avr_vcd_log_t * log,
+		uint32_t n)
+{
+	uint32_t * count = w->count, * pos = w->count + w->signal_count;
+	int key = !(w->blocks % AVR_WAVE_KEY);
+	uint8_t head[12], * d;
+	uint64_t start;
+	int used = 0;
+
+	// group the changes by signal, keeping them in order
+	memset(count, 0, w->signal_count * sizeof(*count));
+	for (uint32_t i = 0; i < n; i++)
+		count[log[i].sigindex]++;
+	for (int i = 0, p = 0; i < w->signal_count; p += count[i++]) {
+		pos[i] = p;
+		used += !!count[i];
+	}
+	start = log[0].when > w->last ? log[0].when : w->last;
+	for (uint32_t i = 0; i < n; i++) {
+		avr_vcd_log_t * l = &w->log[pos[log[i].sigindex]++];
+
+		*l = log[i];
+		if (l->when < w->last)
+			l->when = w->last;
+		w->last = l->when;
+	}
+
+	// worst case is 10 bytes for a time and 5 for a value
+	if (_avr_wave_reserve(w, 20 + 15 * (w->signal_count + n) +
+			5 * w->signal_count))
+		return -1;
+	d = _avr_wave_put(w->buf, key ? AVR_WAVE_KEY_BLOCK : 0);
+	d = _avr_wave_put(d, key ? start : start - w->start);
+	if (key)
+		for (int i = 0; i < w->signal_count; i++)
+			d = _avr_wave_put(d, w->state[i]);
+	d = _avr_wave_put(d, used);
+	for (int i = 0, p = 0; i < w->signal_count; p += count[i++]) {
+		uint64_t when = start;
+
+		if (!count[i])
+			continue;
+		d = _avr_wave_put(d, i);
+		d = _avr_wave_put(d, count[i]);
+		for (uint32_t c = 0; c < count[i]; c++) {
+			avr_vcd_log_t * l = &w->log[p + c];
+
+			d = _avr_wave_put(d, l->when - when);
+			when = l->when;
+			w->state[i] = ((uint64_t)l->value << 1) | l->floating;
+			d = _avr_wave_put(d, w->state[i]);
+		}
+	}
+
+	if (key && _avr_wave_add_index(w, start, w->offset))
+		return -1;
+	head[0] = 'B';
+	if (_avr_wave_out(w, head, _avr_wave_put(head + 1, d - w->buf) - head) ||
+			_avr_wave_out(w, w->buf, d - w->buf))
+		return -1;
+	w->start = start;
+	w->blocks++;
+	return 0;
+}
+
+int
+avr_wave_write(
+		avr_wave_t * w,
+		const avr_vcd_log_t * log,
+		uint32_t count)
+{
+	while (count) {
+		uint32_t n = count > AVR_WAVE_BLOCK ? AVR_WAVE_BLOCK : count;
+
+		if (_avr_wave_write_block(w, log, n))
+			return -1;
+		log += n;
+		count -= n;
+	}
+	return 0;
+}
+
+int
+avr_wave_finish(
+		avr_wave_t * w)
+{
+	uint64_t index = w->offset, start = 0, offset = 0;
+	uint8_t trailer[16], * d;
+
+	if (_avr_wave_reserve(w, 20 + 20 * w->index_count))
+		return -1;
+	d = w->buf;
+	*d++ = 'I';
+	d = _avr_wave_put(d, w->index_count);
+	for (uint32_t i = 0; i < w->index_count; i++) {
+		d = _avr_wave_put(d, w->index[2 * i] - start);
+		d = _avr_wave_put(d, w->index[2 * i + 1] - offset);
+		start = w->index[2 * i];
+		offset = w->index[2 * i + 1];
+	}
+	for (int i = 0; i < 8; i++)
+		trailer[i] = index >> (8 * i);
+	memcpy(trailer + 8, AVR_WAVE_TRAILER, 8);
+	if (_avr_wave_out(w, w->buf, d - w->buf) ||
+			_avr_wave_out(w, trailer, sizeof(trailer)))
+		return -1;
+	return fflush(w->f) ? -1 : 0;
+}
+
+/*
+ * Read the payload of the block at the current position into 'buf'.
+ * Returns its length, 0 if there is no block there, or -1.
+ */
+static int64_t
+_avr_wave_load(
+		avr_wave_t * w)
+{
+	uint64_t len;
+
+	if (fgetc(w->f) != 'B')
+		return 0;
+	if (_avr_wave_fget(w->f, &len) || _avr_wave_reserve(w, len) ||
+			fread(w->buf, 1, len, w->f) != len)
+		return -1;
+	return len;
+}
+
+// Find the key blocks of a file with no index.
+static int
+_avr_wave_scan(
+		avr_wave_t * w)
+{
+	uint64_t start = 0, offset = w->first;
+	int64_t len;
+
+	fseek(w->f, w->first, SEEK_SET);
+	while ((len = _avr_wave_load(w)) > 0) {
+		const uint8_t * p = w->buf, * end = w->buf + len;
+		uint64_t flags, delta;
+
+		if (_avr_wave_get(&p, end, &flags) || _avr_wave_get(&p, end, &delta))
+			break;
+		start = (flags & AVR_WAVE_KEY_BLOCK) ? delta : start + delta;
+		if ((flags & AVR_WAVE_KEY_BLOCK) &&
+				_avr_wave_add_index(w, start, offset))
+			return -1;
+		offset = ftell(w->f);
+	}
+	// a block cut short is left out
+	w->end = offset;
+	return 0;
+}
+
+static int
+_avr_wave_read_index(
+		avr_wave_t * w)
+{
+	uint8_t trailer[16];
+	uint64_t index = 0, count, start = 0, offset = 0;
+
+	if (fseek(w->f, -16, SEEK_END) || fread(trailer, 16, 1, w->f) != 1 ||
+			memcmp(trailer + 8, AVR_WAVE_TRAILER, 8))
+		return -1;
+	for (int i = 0; i < 8; i++)
+		index |= (uint64_t)trailer[i] << (8 * i);
+	if (fseek(w->f, index, SEEK_SET) || fgetc(w->f) != 'I' ||
+			_avr_wave_fget(w->f, &count))
+		return -1;
+	for (uint64_t i = 0; i < count; i++) {
+		uint64_t s, o;
+
+		if (_avr_wave_fget(w->f, &s) || _avr_wave_fget(w->f, &o) ||
+				_avr_wave_add_index(w, start += s, offset += o))
+			return -1;
+	}
+	w->end = index;
+	return 0;
+}
+
+int
+avr_wave_open(
+		avr_wave_t * w,
+		FILE * f)
+{
+	char magic[8];
+	uint64_t count;
+
+	memset(w, 0, sizeof(*w));
+	w->f = f;
+	if (fread(magic, 8, 1, f) != 1 || memcmp(magic, AVR_WAVE_MAGIC, 8) ||
+			_avr_wave_fget(f, &w->rate) || _avr_wave_fget(f, &count) ||
+			count > 1000000)
+		return -1;
+	for (uint64_t i = 0; i < count; i++) {
+		uint64_t size, len;
+		char * name;
+
+		if (_avr_wave_fget(f, &size) || _avr_wave_fget(f, &len) ||
+				len > 4096 || !(name = calloc(1, len + 1)))
+			return -1;
+		if (fread(name, 1, len, f) != len ||
+				avr_wave_add_signal(w, size, name) < 0) {
+			free(name);
+			return -1;
+		}
+		free(name);
+	}
+	if (_avr_wave_alloc(w))
+		return -1;
+	w->first = ftell(f);
+	if (_avr_wave_read_index(w)) {
+		w->index_count = 0;
+		if (_avr_wave_scan(w))
+			return -1;
+	}
+	return avr_wave_seek(w, 0);
+}
+
+int
+avr_wave_seek(
+		avr_wave_t * w,
+		uint64_t when)
+{
+	uint32_t lo = 0, hi = w->index_count;
+	uint64_t offset = w->first;
+
+	// last key block starting at or before 'when'
+	while (lo < hi) {
+		uint32_t mid = (lo + hi) / 2;
+
+		if (w->index[2 * mid] <= when)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (int i = 0; i < w->signal_count; i++)
+		w->state[i] = 1;
+	w->start = 0;
+	if (lo) {
+		const uint8_t * p, * end;
+		uint64_t flags, start;
+		int64_t len;
+
+		offset = w->index[2 * (lo - 1) + 1];
+		if (fseek(w->f, offset, SEEK_SET) || (len = _avr_wave_load(w)) <= 0)
+			return -1;
+		p = w->buf;
+		end = w->buf + len;
+		if (_avr_wave_get(&p, end, &flags) || _avr_wave_get(&p, end, &start) ||
+				!(flags & AVR_WAVE_KEY_BLOCK))
+			return -1;
+		for (int i = 0; i < w->signal_count; i++)
+			if (_avr_wave_get(&p, end, &w->state[i]))
+				return -1;
+		w->start = start;
+	}
+	return fseek(w->f, offset, SEEK_SET);
+}
+
+// Stable merge sort on time, the changes of a signal are in order already.
+static void
+_avr_wave_sort(
+		avr_vcd_log_t * log,
+		avr_vcd_log_t * tmp,
+		uint32_t n)
+{
+	for (uint32_t width = 1; width < n; width *= 2) {
+		for (uint32_t lo = 0; lo < n; lo += 2 * width) {
+			uint32_t mid = lo + width < n ? lo + width : n;
+			uint32_t hi = lo + 2 * width < n ? lo + 2 * width : n;
+			uint32_t a = lo, b = mid, o = lo;
+
+			while (a < mid && b < hi)
+				tmp[o++] = log[b].when < log[a].when ? log[b++] : log[a++];
+			while (a < mid)
+				tmp[o++] = log[a++];
+			while (b < hi)
+				tmp[o++] = log[b++];
+		}
+		memcpy(log, tmp, n * sizeof(*log));
+	}
+}
+
+int
+avr_wave_read(
+		avr_wave_t * w,
+		const avr_vcd_log_t ** log)
+{
+	const uint8_t * p, * end;
+	uint64_t flags, start, used;
+	uint32_t n = 0;
+	int64_t len;
+
+	if ((uint64_t)ftell(w->f) >= w->end)
+		return 0;
+	if ((len = _avr_wave_load(w)) <= 0)
+		return len;
+	p = w->buf;
+	end = w->buf + len;
+	if (_avr_wave_get(&p, end, &flags) || _avr_wave_get(&p, end, &start))
+		return -1;
+	start = (flags & AVR_WAVE_KEY_BLOCK) ? start : w->start + start;
+	if (flags & AVR_WAVE_KEY_BLOCK)
+		for (int i = 0; i < w->signal_count; i++)
+			if (_avr_wave_get(&p, end, &w->state[i]))
+				return -1;
+	if (_avr_wave_get(&p, end, &used))
+		return -1;
+	for (uint64_t s = 0; s < used; s++) {
+		uint64_t index, count, when = start;
+
+		if (_avr_wave_get(&p, end, &index) || index >= w->signal_count ||
+				_avr_wave_get(&p, end, &count) ||
+				count > AVR_WAVE_BLOCK - n)
+			return -1;
+		for (uint64_t c = 0; c < count; c++) {
+			uint64_t delta, v;
+
+			if (_avr_wave_get(&p, end, &delta) || _avr_wave_get(&p, end, &v))
+				return -1;
+			when += delta;
+			w->log[n++] = (avr_vcd_log_t) {
+				.when = when,
+				.sigindex = index,
+				.floating = v & 1,
+				.value = v >> 1,
+			};
+			w->state[index] = v;
+		}
+	}
+	w->start = start;
+	_avr_wave_sort(w->log, w->log + AVR_WAVE_BLOCK, n);
+	*log = w->log;
+	return n;
+}
+
+void
+avr_wave_free(
+		avr_wave_t * w)
+{
+	for (int i = 0; i < w->signal_count; i++)
+		free(w->signal[i].name);
+	free(w->signal);
+	free(w->state);
+	free(w->count);
+	free(w->log);
+	free(w->buf);
+	free(w->index);
+	memset(w, 0, sizeof(*w));
+}
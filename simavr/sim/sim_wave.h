@@ -0,0 +1,155 @@
+/*
+	sim_wave.h
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Compact binary waveforms, written instead of VCD text by sim_vcd_file.c
+ * for a file name ending in ".swav", and converted from and to VCD by
+ * the simavr-wave tool.
+ *
+ * Numbers are unsigned LEB128 varints unless noted. A file is:
+ *
+ *	"SIMAVRW1"
+ *	rate				time units per second, the AVR's clock
+ *	signal count		then for each: size in bits, name length, name
+ *	blocks				'B', payload length, payload
+ *	index				'I', count, then for each: start, offset
+ *	trailer				offset of the index, 8 bytes little endian,
+ *						and "SIMAVRIX"
+ *
+ * A block holds up to AVR_WAVE_BLOCK changes, grouped by signal:
+ *
+ *	flags				AVR_WAVE_KEY_BLOCK
+ *	start				time of its first change, less the previous one's,
+ *						or as it is for a key block
+ *	state				for a key block: every signal's value before it
+ *	signal count		then for each: index, change count, and changes
+ *						as time less the previous one (the block start
+ *						for the first), and value << 1 | floating.
+ *
+ * Every AVR_WAVE_KEY blocks is a key block, and those are in the index,
+ * delta encoded as well, for a reader to seek to a time and know all the
+ * values there. A file whose writer did not finish has no index, and is
+ * scanned instead.
+ */
+
+#ifndef __SIM_WAVE_H__
+#define __SIM_WAVE_H__
+
+#include <stdio.h>
+#include "sim_vcd_file.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AVR_WAVE_BLOCK		4096	// changes per block, at most
+#define AVR_WAVE_KEY		16		// blocks from one key block to the next
+#define AVR_WAVE_KEY_BLOCK	1		// block flag
+
+typedef struct avr_wave_signal_t {
+	uint8_t			size;		// in bits, up to 32
+	char *			name;
+} avr_wave_signal_t;
+
+typedef struct avr_wave_t {
+	FILE *			f;
+	uint64_t		rate;		// time units per second
+	int				signal_count;
+	avr_wave_signal_t * signal;
+	uint64_t *		state;		// value << 1 | floating, per signal
+
+	// private
+	uint64_t		offset;		// in the file
+	uint64_t		start;		// of the last block
+	uint64_t		last;		// time of the last change written
+	uint32_t		blocks;
+	uint8_t *		buf;
+	size_t			buf_size;
+	uint32_t *		count;		// changes per signal in a block
+	avr_vcd_log_t *	log;		// a block in time order, or by signal
+	uint64_t *		index;		// start and offset of each key block
+	uint32_t		index_count, index_size;
+	uint64_t		first;		// offset of the first block, reading
+	uint64_t		end;		// of the blocks, reading
+} avr_wave_t;
+
+// Start writing a file, add the signals then write the header.
+int
+avr_wave_create(
+		avr_wave_t * w,
+		FILE * f,
+		uint64_t rate);
+// Returns the signal index, or -1
+int
+avr_wave_add_signal(
+		avr_wave_t * w,
+		int size,
+		const char * name);
+int
+avr_wave_write_header(
+		avr_wave_t * w);
+/*
+ * Write changes, in time order, as blocks. A change before the last one
+ * written is moved to its time.
+ */
+int
+avr_wave_write(
+		avr_wave_t * w,
+		const avr_vcd_log_t * log,
+		uint32_t count);
+// Write the index, the file is complete.
+int
+avr_wave_finish(
+		avr_wave_t * w);
+
+// Read the header and index of a file. Returns -1 if it is not one.
+int
+avr_wave_open(
+		avr_wave_t * w,
+		FILE * f);
+/*
+ * Go to the last key block starting at or before 'when', with 'state'
+ * set to the values there.
+ */
+int
+avr_wave_seek(
+		avr_wave_t * w,
+		uint64_t when);
+/*
+ * Read the next block, in time order, into 'log', valid until the next
+ * call. 'state' is then the values after it. Returns the number of
+ * changes, 0 at the end of the file, or -1.
+ */
+int
+avr_wave_read(
+		avr_wave_t * w,
+		const avr_vcd_log_t ** log);
+
+// Free it all, the FILE is left open.
+void
+avr_wave_free(
+		avr_wave_t * w);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* __SIM_WAVE_H__ */
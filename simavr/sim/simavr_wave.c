@@ -0,0 +1,641 @@
+/*
+	simavr_wave.c
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * simavr-wave converts waveforms between VCD text and the binary format
+ * of sim_wave.h, either way, and can keep only a time window or some of
+ * the signals. Files ending in ".swav" are binary, others are VCD, and
+ * "-" is VCD on stdin or stdout.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <libgen.h>
+#include "sim_wave.h"
+
+#define WAVE_NEVER	(~0ULL)
+
+typedef struct wave_in_t {
+	avr_wave_t		w;			// header, and the reader for binary files
+	int				binary;
+	FILE *			f;
+	// VCD
+	char **			alias;		// per signal
+	int *			hash;		// alias to signal + 1, 0 empty
+	uint32_t		hash_size;
+	uint64_t		now;
+	char *			line;
+	size_t			line_size;
+	char *			tok;		// next token on the line
+	int				dump;		// in $dumpvars
+	avr_vcd_log_t	log[AVR_WAVE_BLOCK];
+} wave_in_t;
+
+typedef struct wave_out_t {
+	avr_wave_t		w;
+	int				binary;
+	FILE *			f;
+	int *			map;		// input signal to output signal + 1
+	avr_vcd_log_t	log[AVR_WAVE_BLOCK];
+	uint32_t		count;
+	// VCD
+	uint64_t		mul, div;	// input time to VCD time
+	int				fudge;		// keep pulses visible, as sim_vcd_file.c
+	uint64_t		stamp;		// last one written, + 1
+	uint64_t *		seen;
+	char (*alias)[8];
+} wave_out_t;
+
+static void
+usage(
+		const char * app)
+{
+	printf("Usage: %s [...] <input> [<output>]\n", app);
+	printf(
+	 "       [--start|-s <time>]   Leave out what is before <time>\n"
+	 "       [--end|-e <time>]     Leave out what is from <time> on\n"
+	 "       [--signals|-n <a,b>]  Keep only the signals named a and b\n"
+	 "       [--list|-l]           List the signals of <input>\n"
+	 "       Times are in time units of the input, or in s, ms, us or ns\n"
+	 "       as in 10ms. Files ending in .swav are simavr's binary format,\n"
+	 "       others are VCD, - is VCD on stdin or stdout.\n");
+	exit(1);
+}
+
+static int
+is_binary(
+		const char * name)
+{
+	size_t l = strlen(name);
+
+	return l >= 5 && !strcmp(name + l - 5, ".swav");
+}
+
+static uint32_t
+hash_name(
+		const char * s)
+{
+	uint32_t h = 2166136261u;
+
+	while (*s)
+		h = (h ^ (uint8_t)*s++) * 16777619u;
+	return h;
+}
+
+// Signal index of a VCD identifier, -1 if unknown or not kept.
+static int
+vcd_find(
+		wave_in_t * in,
+		const char * alias)
+{
+	if (!in->hash_size)
+		return -1;
+	for (uint32_t h = hash_name(alias);; h++) {
+		int s = in->hash[h & (in->hash_size - 1)] - 1;
+
+		if (s < 0)
+			return -1;
+		if (!strcmp(in->alias[s], alias))
+			return s;
+	}
+}
+
+static int
+vcd_index(
+		wave_in_t * in)
+{
+	in->hash_size = 16;
+	while (in->hash_size < 2 * (uint32_t)in->w.signal_count)
+		in->hash_size *= 2;
+	if (!(in->hash = calloc(in->hash_size, sizeof(*in->hash))))
+		return -1;
+	for (int s = 0; s < in->w.signal_count; s++) {
+		uint32_t h = hash_name(in->alias[s]);
+
+		if (vcd_find(in, in->alias[s]) >= 0)
+			continue;	// the same signal twice, under another scope
+		while (in->hash[h & (in->hash_size - 1)])
+			h++;
+		in->hash[h & (in->hash_size - 1)] = s + 1;
+	}
+	return 0;
+}
+
+// Next whitespace separated token of the VCD file, NULL at its end.
+static char *
+vcd_token(
+		wave_in_t * in)
+{
+	for (;;) {
+		char * t;
+
+		while (in->tok && isspace((uint8_t)*in->tok))
+			in->tok++;
+		if (in->tok && *in->tok) {
+			t = in->tok;
+			while (*in->tok && !isspace((uint8_t)*in->tok))
+				in->tok++;
+			if (*in->tok)
+				*in->tok++ = 0;
+			return t;
+		}
+		if (getline(&in->line, &in->line_size, in->f) < 0)
+			return NULL;
+		in->tok = in->line;
+	}
+}
+
+// Skip to the $end of a section.
+static void
+vcd_skip(
+		wave_in_t * in)
+{
+	char * t;
+
+	while ((t = vcd_token(in)) && strcmp(t, "$end"))
+		;
+}
+
+static int
+vcd_open(
+		wave_in_t * in)
+{
+	uint64_t fs = 0;
+	char * t;
+
+	avr_wave_create(&in->w, in->f, 0);
+	while ((t = vcd_token(in))) {
+		if (!strcmp(t, "$enddefinitions")) {
+			vcd_skip(in);
+			break;
+		} else if (!strcmp(t, "$timescale")) {
+			static const struct { const char * unit; uint64_t fs; } units[] = {
+				{ "s", 1000000000000000ULL }, { "ms", 1000000000000ULL },
+				{ "us", 1000000000ULL }, { "ns", 1000000 }, { "ps", 1000 },
+				{ "fs", 1 },
+			};
+			char * n = vcd_token(in), * unit;
+			uint64_t count;
+
+			if (!n)
+				break;
+			count = strtoull(n, &unit, 10);
+			if (!*unit && !(unit = vcd_token(in)))
+				break;
+			for (int i = 0; i < 6; i++)
+				if (!strcmp(unit, units[i].unit))
+					fs = count * units[i].fs;
+			if (strcmp(unit, "$end"))
+				vcd_skip(in);
+		} else if (!strcmp(t, "$var")) {
+			char * type = vcd_token(in), * size = vcd_token(in);
+			char * alias = vcd_token(in), * name = vcd_token(in);
+			char ** a;
+
+			if (!name)
+				break;
+			vcd_skip(in);
+			if (!strcmp(type, "real") ||
+					avr_wave_add_signal(&in->w, atoi(size), name) < 0) {
+				fprintf(stderr, "simavr-wave: %s: %s signal left out\n",
+						name, size);
+				continue;
+			}
+			a = realloc(in->alias, in->w.signal_count * sizeof(*a));
+			if (!a || !(a[in->w.signal_count - 1] = strdup(alias)))
+				return -1;
+			in->alias = a;
+		} else if (t[0] == '$' && strcmp(t, "$end")) {
+			// $date, $version, $comment, $scope, $upscope
+			vcd_skip(in);
+		}
+	}
+	if (!fs || 1000000000000000ULL % fs) {
+		fprintf(stderr, "simavr-wave: no timescale, or not one we know\n");
+		return -1;
+	}
+	in->w.rate = 1000000000000000ULL / fs;
+	in->w.state = malloc(in->w.signal_count * sizeof(*in->w.state) + 1);
+	if (!in->w.state)
+		return -1;
+	for (int i = 0; i < in->w.signal_count; i++)
+		in->w.state[i] = 1;
+	return vcd_index(in);
+}
+
+// Read up to a block of changes from the VCD file.
+static int
+vcd_read(
+		wave_in_t * in,
+		const avr_vcd_log_t ** log)
+{
+	int n = 0;
+	char * t;
+
+	*log = in->log;
+	while (n < AVR_WAVE_BLOCK && (t = vcd_token(in))) {
+		uint32_t value = 0, floating = 0;
+		char * alias = t + 1;
+		int s;
+
+		switch (t[0]) {
+			case '#':
+				in->now = strtoull(t + 1, NULL, 10);
+				continue;
+			case '$':
+				if (!strcmp(t, "$comment"))
+					vcd_skip(in);
+				else if (!strcmp(t, "$dumpvars"))
+					in->dump = 1;
+				else if (!strcmp(t, "$end"))
+					in->dump = 0;
+				continue;
+			case 'r': case 'R':
+				vcd_token(in);
+				continue;
+			case 'b': case 'B':
+				for (char * b = t + 1; *b; b++) {
+					value = (value << 1) | (*b == '1');
+					floating |= !(*b == '0' || *b == '1');
+				}
+				if (!(alias = vcd_token(in)))
+					return n;
+				break;
+			case '0': case '1':
+				value = t[0] - '0';
+				break;
+			default:	// x and z
+				floating = 1;
+				break;
+		}
+		if ((s = vcd_find(in, alias)) < 0)
+			continue;
+		// values dumped as they are already are not changes
+		if (in->dump && in->w.state[s] == (((uint64_t)value << 1) | floating))
+			continue;
+		in->w.state[s] = ((uint64_t)value << 1) | floating;
+		in->log[n++] = (avr_vcd_log_t) {
+			.when = in->now,
+			.sigindex = s,
+			.floating = floating,
+			.value = value,
+		};
+	}
+	return n;
+}
+
+static int
+in_read(
+		wave_in_t * in,
+		const avr_vcd_log_t ** log)
+{
+	return in->binary ? avr_wave_read(&in->w, log) : vcd_read(in, log);
+}
+
+static uint64_t
+gcd(
+		uint64_t a,
+		uint64_t b)
+{
+	while (b) {
+		uint64_t t = a % b;
+
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+static uint64_t
+out_time(
+		wave_out_t * out,
+		uint64_t t)
+{
+	return (t / out->div) * out->mul + (t % out->div) * out->mul / out->div;
+}
+
+static void
+out_vcd_value(
+		wave_out_t * out,
+		int s,
+		uint64_t v)
+{
+	int size = out->w.signal[s].size;
+	char line[48], * d = line;
+
+	if (size > 1)
+		*d++ = 'b';
+	for (int i = size - 1; i >= 0; i--)
+		*d++ = (v & 1) ? 'z' : '0' + ((v >> (i + 1)) & 1);
+	if (size > 1)
+		*d++ = ' ';
+	for (const char * a = out->alias[s]; *a; a++)
+		*d++ = *a;
+	*d++ = '\n';
+	fwrite(line, d - line, 1, out->f);
+}
+
+static int
+out_start(
+		wave_out_t * out,
+		wave_in_t * in,
+		uint64_t from,
+		const uint64_t * state)
+{
+	uint64_t rate = in->w.rate;
+	const char * unit = "10ns";
+
+	for (int i = 0; i < in->w.signal_count; i++)
+		if (out->map[i] && avr_wave_add_signal(&out->w, in->w.signal[i].size,
+				in->w.signal[i].name) < 0)
+			return -1;
+	if (out->binary) {
+		out->w.f = out->f;
+		out->w.rate = rate;
+		if (avr_wave_write_header(&out->w))
+			return -1;
+		// the values at the start of the window
+		for (int i = 0; from && i < in->w.signal_count; i++)
+			if (out->map[i])
+				out->log[out->count++] = (avr_vcd_log_t) {
+					.when = from,
+					.sigindex = out->map[i] - 1,
+					.floating = state[i] & 1,
+					.value = state[i] >> 1,
+				};
+		return 0;
+	}
+
+	/*
+	 * The AVR's cycles go to 10ns units, as sim_vcd_file.c does; a faster
+	 * rate that is a VCD timescale is kept as it is.
+	 */
+	out->mul = 100000000;
+	out->div = rate;
+	out->fudge = 1;
+	if (rate > 100000000) {
+		static const char * units[] = {
+			"1s", "100ms", "10ms", "1ms", "100us", "10us", "1us", "100ns",
+			"10ns", "1ns", "100ps", "10ps", "1ps", "100fs", "10fs", "1fs" };
+		uint64_t r = 1;
+
+		unit = "1fs";
+		out->mul = 1000000000000000ULL;
+		for (int i = 0; i < 16; i++, r *= 10)
+			if (r == rate) {
+				unit = units[i];
+				out->mul = rate;
+				break;
+			}
+		out->fudge = 0;
+	}
+	uint64_t g = gcd(out->mul, out->div);
+	out->mul /= g;
+	out->div /= g;
+	out->seen = calloc(out->w.signal_count + 1, sizeof(*out->seen));
+	out->alias = calloc(out->w.signal_count + 1, sizeof(*out->alias));
+	if (!out->seen || !out->alias)
+		return -1;
+	// as sim_vcd_file.c names them
+	for (int i = 0; i < out->w.signal_count; i++)
+		for (int a = 0, n = i; a == 0 || n; n /= 94)
+			out->alias[i][a++] = '!' + n % 94;
+	fprintf(out->f, "$version simavr-wave $end\n");
+	fprintf(out->f, "$timescale %s $end\n", unit);
+	fprintf(out->f, "$scope module logic $end\n");
+	for (int i = 0; i < out->w.signal_count; i++)
+		fprintf(out->f, "$var wire %d %s %s $end\n",
+				out->w.signal[i].size, out->alias[i], out->w.signal[i].name);
+	fprintf(out->f, "$upscope $end\n");
+	fprintf(out->f, "$enddefinitions $end\n");
+	if (from) {
+		out->stamp = out_time(out, from) + 1;
+		fprintf(out->f, "#%llu\n", (unsigned long long)out->stamp - 1);
+	}
+	fprintf(out->f, "$dumpvars\n");
+	for (int i = 0; i < in->w.signal_count; i++)
+		if (out->map[i])
+			out_vcd_value(out, out->map[i] - 1, state[i]);
+	fprintf(out->f, "$end\n");
+	return 0;
+}
+
+static int
+out_flush(
+		wave_out_t * out)
+{
+	int res = 0;
+
+	if (out->binary && out->count)
+		res = avr_wave_write(&out->w, out->log, out->count);
+	out->count = 0;
+	return res;
+}
+
+static int
+out_change(
+		wave_out_t * out,
+		const avr_vcd_log_t * l)
+{
+	int s = out->map[l->sigindex] - 1;
+
+	if (out->binary) {
+		out->log[out->count] = *l;
+		out->log[out->count++].sigindex = s;
+		return out->count == AVR_WAVE_BLOCK ? out_flush(out) : 0;
+	} else {
+		uint64_t base = out_time(out, l->when);
+
+		// the same as avr_vcd_flush_log()
+		if (out->stamp && base < out->stamp - 1)
+			base = out->stamp - 1;
+		if (out->fudge && out->seen[s] == base + 1)
+			base++;
+		if (out->stamp != base + 1) {
+			out->stamp = base + 1;
+			fprintf(out->f, "#%llu\n", (unsigned long long)base);
+		}
+		out->seen[s] = base + 1;
+		out_vcd_value(out, s, ((uint64_t)l->value << 1) | l->floating);
+	}
+	return ferror(out->f) ? -1 : 0;
+}
+
+// Time as input units, or with a unit.
+static int
+parse_time(
+		const char * s,
+		uint64_t rate,
+		uint64_t * t)
+{
+	static const struct { const char * unit; uint64_t div; } units[] = {
+		{ "s", 1 }, { "ms", 1000 }, { "us", 1000000 }, { "ns", 1000000000 },
+	};
+	char * end;
+	double v = strtod(s, &end);
+
+	if (end == s || v < 0)
+		return -1;
+	if (!*end) {
+		*t = v;
+		return 0;
+	}
+	for (int i = 0; i < 4; i++)
+		if (!strcmp(end, units[i].unit)) {
+			*t = v * rate / units[i].div;
+			return 0;
+		}
+	return -1;
+}
+
+int
+main(
+		int argc,
+		char * argv[])
+{
+	const char * start = NULL, * end = NULL, * signals = NULL;
+	const char * input = NULL, * output = NULL;
+	uint64_t from = 0, to = WAVE_NEVER;
+	static wave_in_t in;
+	static wave_out_t out;
+	const avr_vcd_log_t * log;
+	uint64_t * state;
+	int list = 0, started = 0, n;
+
+	for (int pi = 1; pi < argc; pi++) {
+		if ((!strcmp(argv[pi], "-s") || !strcmp(argv[pi], "--start")) &&
+				pi < argc - 1)
+			start = argv[++pi];
+		else if ((!strcmp(argv[pi], "-e") || !strcmp(argv[pi], "--end")) &&
+				pi < argc - 1)
+			end = argv[++pi];
+		else if ((!strcmp(argv[pi], "-n") || !strcmp(argv[pi], "--signals")) &&
+				pi < argc - 1)
+			signals = argv[++pi];
+		else if (!strcmp(argv[pi], "-l") || !strcmp(argv[pi], "--list"))
+			list = 1;
+		else if (argv[pi][0] == '-' && argv[pi][1])
+			usage(basename(argv[0]));
+		else if (!input)
+			input = argv[pi];
+		else if (!output)
+			output = argv[pi];
+		else
+			usage(basename(argv[0]));
+	}
+	if (!input || (!output && !list))
+		usage(basename(argv[0]));
+
+	in.binary = is_binary(input);
+	in.f = strcmp(input, "-") ? fopen(input, "r") : stdin;
+	if (!in.f) {
+		perror(input);
+		exit(1);
+	}
+	if (in.binary ? avr_wave_open(&in.w, in.f) : vcd_open(&in)) {
+		fprintf(stderr, "simavr-wave: %s: can't read it\n", input);
+		exit(1);
+	}
+	if (list) {
+		printf("%d signals, %llu time units per second\n",
+				in.w.signal_count, (unsigned long long)in.w.rate);
+		for (int i = 0; i < in.w.signal_count; i++)
+			printf("%4d %2d %s\n", i, in.w.signal[i].size, in.w.signal[i].name);
+		if (in.binary && in.w.index_count)
+			printf("%u key blocks, the last one at %llu\n", in.w.index_count,
+					(unsigned long long)in.w.index[2 * (in.w.index_count - 1)]);
+		exit(0);
+	}
+	if ((start && parse_time(start, in.w.rate, &from)) ||
+			(end && parse_time(end, in.w.rate, &to))) {
+		fprintf(stderr, "simavr-wave: bad time\n");
+		exit(1);
+	}
+
+	out.map = calloc(in.w.signal_count + 1, sizeof(*out.map));
+	state = malloc((in.w.signal_count + 1) * sizeof(*state));
+	if (!out.map || !state)
+		exit(1);
+	for (int i = 0; i < in.w.signal_count; i++)
+		out.map[i] = !signals;
+	for (char * s = signals ? strdup(signals) : NULL, * name;
+			s && (name = strsep(&s, ","));) {
+		int i;
+
+		for (i = 0; i < in.w.signal_count; i++)
+			if (!strcmp(in.w.signal[i].name, name))
+				break;
+		if (i == in.w.signal_count) {
+			fprintf(stderr, "simavr-wave: no signal '%s'\n", name);
+			exit(1);
+		}
+		out.map[i] = 1;
+	}
+	for (int i = 0, o = 0; i < in.w.signal_count; i++)
+		if (out.map[i])
+			out.map[i] = ++o;
+
+	if (in.binary && avr_wave_seek(&in.w, from)) {
+		fprintf(stderr, "simavr-wave: %s: can't seek\n", input);
+		exit(1);
+	}
+	memcpy(state, in.w.state, in.w.signal_count * sizeof(*state));
+
+	out.binary = is_binary(output);
+	out.f = strcmp(output, "-") ? fopen(output, "w") : stdout;
+	if (!out.f) {
+		perror(output);
+		exit(1);
+	}
+	while ((n = in_read(&in, &log)) > 0) {
+		for (int i = 0; i < n; i++) {
+			const avr_vcd_log_t * l = &log[i];
+
+			if (l->when >= to)
+				goto done;
+			if (l->when < from) {
+				state[l->sigindex] = ((uint64_t)l->value << 1) | l->floating;
+				continue;
+			}
+			if (!started++ && out_start(&out, &in, from, state))
+				goto error;
+			if (out.map[l->sigindex] && out_change(&out, l))
+				goto error;
+		}
+	}
+	if (n < 0) {
+		fprintf(stderr, "simavr-wave: %s: bad block\n", input);
+		exit(1);
+	}
+done:
+	if (!started && out_start(&out, &in, from, state))
+		goto error;
+	if (out_flush(&out) || (out.binary && avr_wave_finish(&out.w)) ||
+			fflush(out.f))
+		goto error;
+	fclose(out.f);
+	exit(0);
+error:
+	fprintf(stderr, "simavr-wave: %s: write error\n", output);
+	exit(1);
+}
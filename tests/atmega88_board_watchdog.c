@@ -0,0 +1,60 @@
+/*
+	atmega88_board_watchdog.c
+
+	Copyright 2026 simavr contributors
+
+ 	This file is part of simavr.
+
+	simavr is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	simavr is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with simavr.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <avr/io.h>
+#include <stdio.h>
+#include <avr/wdt.h>
+
+/*
+ * Let the watchdog reset the AVR once, then spin for ever: only a time
+ * limit stops it.
+ */
+#include "avr_mcu_section.h"
+AVR_MCU(F_CPU, "atmega88");
+
+static int uart_putchar(char c, FILE *stream) {
+	if (c == '\n')
+		uart_putchar('\r', stream);
+	loop_until_bit_is_set(UCSR0A, UDRE0);
+	UDR0 = c;
+	return 0;
+}
+
+static FILE mystdout = FDEV_SETUP_STREAM(uart_putchar, NULL,
+                                         _FDEV_SETUP_WRITE);
+
+int main()
+{
+	uint8_t reset = MCUSR & (1 << WDRF);
+
+	MCUSR = 0;
+	wdt_disable();
+	stdout = &mystdout;
+
+	if (reset)
+		printf("Reset by the watchdog\n");
+	else {
+		printf("Waiting for the watchdog\n");
+		wdt_enable(WDTO_15MS);
+	}
+	for (;;)
+		;
+}
@@ -0,0 +1,95 @@
+#include <stdlib.h>
+#include <time.h>
+#include "tests.h"
+#include "sim_time.h"
+#include "sim_cycle_timers.h"
+#include "sim_pace.h"
+
+/*
+ * The disabled timer firmware sleeps for ever with interrupts on, so that
+ * simulated time only moves on by sleeps, to the cycle timers. Paced at
+ * speed 0 it must not wait for them at all, at 1 and 4 take about as long
+ * as the simulated time over the speed, and never less. Without pacing
+ * there are no statistics. The bounds are coarse, for loaded hosts.
+ */
+
+#define FLAT_OUT_USEC	1000000		// simulated, at speed 0
+#define PACED_USEC		100000		// simulated, at 1 and 4
+#define SLOW_USEC		2000000		// far too long, in real time
+
+static int stopped;
+
+static uint64_t now_usec(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static avr_cycle_count_t stop_cb(avr_t *avr, avr_cycle_count_t when,
+								 void *param) {
+	stopped = 1;
+	return 0;
+}
+
+// Run for 'usec' of simulated time, return how long that really took.
+static uint64_t run(avr_t *avr, uint32_t usec) {
+	uint64_t start = now_usec();
+	int state;
+
+	stopped = 0;
+	avr_cycle_timer_register_usec(avr, usec, stop_cb, NULL);
+	while (!stopped) {
+		state = avr_run(avr);
+		if (state == cpu_Done || state == cpu_Crashed)
+			fail("Firmware stopped at cycle %" PRI_avr_cycle_count,
+				 avr->cycle);
+	}
+	return now_usec() - start;
+}
+
+static void paced(avr_t *avr, double speed) {
+	uint64_t took, expected = PACED_USEC / speed;
+	avr_pace_stats_t s;
+
+	avr_pace_set_speed(avr, speed);
+	took = run(avr, PACED_USEC);
+	// it can't be early by more than a check
+	if (took + AVR_PACE_CHECK_US / speed < expected || took > SLOW_USEC)
+		fail("%gx: %uus of simulated time took %lluus", speed, PACED_USEC,
+			 (unsigned long long)took);
+	if (avr_pace_get_stats(avr, &s) || !s.checks || !s.sleeps)
+		fail("%gx: no checks or waits counted", speed);
+}
+
+int main(int argc, char **argv) {
+	avr_pace_stats_t s;
+	uint64_t took;
+	avr_t *avr;
+
+	tests_init(argc, argv);
+	avr = tests_init_avr("atmega48_disabled_timer.axf");
+	if (avr_pace_get_stats(avr, &s) != -1)
+		fail("Statistics without pacing");
+
+	// flat out, sleeps included
+	if (avr_pace_start(avr, 0))
+		fail("avr_pace_start() failed");
+	took = run(avr, FLAT_OUT_USEC);
+	if (took > FLAT_OUT_USEC / 4)
+		fail("Speed 0: %uus of simulated time took %lluus", FLAT_OUT_USEC,
+			 (unsigned long long)took);
+	if (avr_pace_get_stats(avr, &s) || s.checks || s.sleeps)
+		fail("Speed 0: %llu checks, %llu waits",
+			 (unsigned long long)s.checks, (unsigned long long)s.sleeps);
+
+	paced(avr, 1.0);
+	paced(avr, 4.0);
+
+	avr_pace_stop(avr);
+	if (avr_pace_get_stats(avr, &s) != -1)
+		fail("Statistics once stopped");
+	avr_terminate(avr);
+	tests_success();
+	return 0;
+}
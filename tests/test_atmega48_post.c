@@ -0,0 +1,165 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "tests.h"
+#include "sim_time.h"
+#include "sim_cycle_timers.h"
+#include "sim_post.h"
+
+/*
+ * The disabled timer firmware sleeps for ever with interrupts on. Keep a
+ * cycle timer far away so that it sleeps in real time for that long, and
+ * post values to it from another thread while it does: each one must wake
+ * it up well before then, be raised on the thread running the AVR, in
+ * order, and the simulated time must only have moved on by what really
+ * went by. A value posted for a later cycle then has to come as far after
+ * a reset as it was from the cycle the reset happened at.
+ */
+
+#define POSTS		8
+#define FAR_USEC	10000000	// how long it would sleep
+#define LATE_USEC	200000		// far too long to wake up
+#define LATER_USEC	1000		// posted for that far ahead
+
+struct seen {
+	uint64_t			usec;		// when it was raised
+	avr_cycle_count_t	cycle;
+	uint64_t			sim_nsec, real_nsec;
+	int					on_avr_thread;
+};
+
+static pthread_t avr_thread;
+static avr_irq_t *irq;
+static struct seen seen[POSTS];
+static uint64_t posted[POSTS];
+static int seen_count;
+static avr_cycle_count_t later_cycle;
+
+static uint64_t now_usec(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void posted_cb(avr_irq_t *irq, uint32_t value, void *param) {
+	avr_t *avr = param;
+	int n = seen_count;
+
+	if (n == POSTS || value != (uint32_t)n)
+		fail("Got %u as value %d", value, n);
+	seen[n].usec = now_usec();
+	seen[n].cycle = avr->cycle;
+	seen[n].sim_nsec = avr_cycles_to_nsec(avr, avr->cycle);
+	seen[n].real_nsec = avr_get_time_stamp(avr);
+	seen[n].on_avr_thread = pthread_equal(pthread_self(), avr_thread);
+	__atomic_store_n(&seen_count, n + 1, __ATOMIC_RELEASE);
+	// the last one: stop before it goes back to sleep
+	if (n + 1 == POSTS)
+		avr->state = cpu_Done;
+}
+
+static void later_cb(avr_irq_t *irq, uint32_t value, void *param) {
+	avr_t *avr = param;
+
+	later_cycle = avr->cycle;
+}
+
+static avr_cycle_count_t far_cb(avr_t *avr, avr_cycle_count_t when,
+								void *param) {
+	fail("Slept until cycle %" PRI_avr_cycle_count, when);
+	return 0;
+}
+
+static void *poster(void *param) {
+	avr_t *avr = param;
+
+	for (int i = 0; i < POSTS; i++) {
+		// well into a sleep
+		while (!__atomic_load_n(&avr->post->sleeping, __ATOMIC_ACQUIRE))
+			usleep(100);
+		usleep(2000);
+		posted[i] = now_usec();
+		if (avr_irq_post(avr, irq, i))
+			fail("avr_irq_post() failed");
+		while (__atomic_load_n(&seen_count, __ATOMIC_ACQUIRE) == i)
+			usleep(100);
+	}
+	return NULL;
+}
+
+int main(int argc, char **argv) {
+	static const char *names[] = { ">posted", ">later" };
+	avr_cycle_count_t far, at, reset_at;
+	pthread_t thread;
+	avr_t *avr;
+
+	tests_init(argc, argv);
+	avr = tests_init_avr("atmega48_disabled_timer.axf");
+	avr_thread = pthread_self();
+	irq = avr_alloc_irq(&avr->irq_pool, 0, 2, names);
+	avr_irq_register_notify(irq, posted_cb, avr);
+	avr_irq_register_notify(irq + 1, later_cb, avr);
+	if (avr_post_start(avr))
+		fail("avr_post_start() failed");
+	far = avr_usec_to_cycles(avr, FAR_USEC);
+	avr_cycle_timer_register(avr, far, far_cb, NULL);
+
+	if (pthread_create(&thread, NULL, poster, avr))
+		fail("Can't start the posting thread");
+	while (__atomic_load_n(&seen_count, __ATOMIC_ACQUIRE) < POSTS) {
+		int state = avr_run(avr);
+
+		if ((state == cpu_Done || state == cpu_Crashed) &&
+				__atomic_load_n(&seen_count, __ATOMIC_ACQUIRE) < POSTS)
+			fail("Firmware stopped at cycle %" PRI_avr_cycle_count,
+				 avr->cycle);
+	}
+	pthread_join(thread, NULL);
+
+	for (int i = 0; i < POSTS; i++) {
+		if (!seen[i].on_avr_thread)
+			fail("Value %d raised on the posting thread", i);
+		if (seen[i].usec - posted[i] > LATE_USEC)
+			fail("Value %d took %lluus to wake the AVR up", i,
+				 (unsigned long long)(seen[i].usec - posted[i]));
+		if (i && seen[i].cycle <= seen[i - 1].cycle)
+			fail("Value %d at cycle %" PRI_avr_cycle_count ", before %d",
+				 i, seen[i].cycle, i - 1);
+		// the sleep counts what went by, not what was asked for
+		if (seen[i].sim_nsec > seen[i].real_nsec + LATE_USEC * 1000ULL)
+			fail("Value %d at %lluns of simulated time, after %lluns", i,
+				 (unsigned long long)seen[i].sim_nsec,
+				 (unsigned long long)seen[i].real_nsec);
+	}
+	if (seen[POSTS - 1].cycle >= far)
+		fail("Slept through to cycle %" PRI_avr_cycle_count,
+			 seen[POSTS - 1].cycle);
+
+	// kept for later, then the cycle timers go with a reset
+	at = avr->cycle + avr_usec_to_cycles(avr, LATER_USEC);
+	if (avr_irq_post_at(avr, irq + 1, 1, at))
+		fail("avr_irq_post_at() failed");
+	avr_post_drain(avr);
+	if (later_cycle || avr->post->later_count != 1)
+		fail("The value for later was not kept");
+	reset_at = avr->cycle;
+	avr_reset(avr);
+	while (!later_cycle) {
+		int state = avr_run(avr);
+
+		if (state == cpu_Done || state == cpu_Crashed ||
+				avr->cycle > 2 * (at - reset_at))
+			fail("The value for later was lost with the reset, at cycle %"
+				 PRI_avr_cycle_count, avr->cycle);
+	}
+	if (later_cycle < at - reset_at)
+		fail("The value for later came at cycle %" PRI_avr_cycle_count
+			 ", before %" PRI_avr_cycle_count, later_cycle, at - reset_at);
+
+	avr_terminate(avr);
+	tests_success();
+	return 0;
+}
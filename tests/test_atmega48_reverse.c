@@ -0,0 +1,123 @@
+#include <stdlib.h>
+#include <string.h>
+#include "tests.h"
+#include "sim_reverse.h"
+
+/*
+ * Run the timer firmware forward once, noting each instruction boundary.
+ * Then run it again keeping history, step back through it and check each
+ * boundary reached against the forward run: PC, cycle and registers.
+ * The firmware sleeps and takes a timer interrupt, so re-execution has
+ * cycle timers and interrupts to get right as well.
+ */
+
+#define MAX_STEPS	32768
+#define BACK		40
+
+struct boundary {
+	avr_cycle_count_t	cycle;
+	avr_flashaddr_t		pc;
+	uint8_t				regs[32];
+	uint8_t				sreg[8];
+	uint8_t				sp[2];
+};
+
+static struct boundary trace[MAX_STEPS];
+
+static void note(avr_t *avr, struct boundary *b) {
+	b->cycle = avr->cycle;
+	b->pc = avr->pc;
+	memcpy(b->regs, avr->data, sizeof(b->regs));
+	memcpy(b->sreg, avr->sreg, sizeof(b->sreg));
+	memcpy(b->sp, avr->iobase + R_SPL, sizeof(b->sp));
+}
+
+static void check(avr_t *avr, int step) {
+	struct boundary b;
+
+	memset(&b, 0, sizeof(b));
+	note(avr, &b);
+	if (b.cycle != trace[step].cycle || b.pc != trace[step].pc)
+		fail("Step %d: cycle %" PRI_avr_cycle_count " pc %04x, expected "
+			 "%" PRI_avr_cycle_count " %04x", step, b.cycle, b.pc,
+			 trace[step].cycle, trace[step].pc);
+	if (memcmp(&b, &trace[step], sizeof(b)))
+		fail("Step %d: registers differ", step);
+}
+
+// One instruction, as the gdb run loop does.
+static int step(avr_t *avr) {
+	if (avr->reverse)
+		avr_reverse_tick(avr);
+	if (!avr_run_gdb_step(avr))
+		return 0;
+	if (avr->reverse)
+		avr_reverse_stepped(avr);
+	return 1;
+}
+
+static int stop_at_pc(avr_t *avr, void *param) {
+	return avr->pc == *(avr_flashaddr_t *)param;
+}
+
+int main(int argc, char **argv) {
+	avr_flashaddr_t pc;
+	int steps = 0, n, i, want;
+	avr_t *avr;
+
+	tests_init(argc, argv);
+
+	// forward, to the end
+	avr = tests_init_avr("atmega48_enabled_timer.axf");
+	note(avr, &trace[0]);
+	while (step(avr)) {
+		if (++steps == MAX_STEPS)
+			fail("Firmware did not finish in %d steps", MAX_STEPS);
+		note(avr, &trace[steps]);
+	}
+	avr_terminate(avr);
+	if (steps < 4 * BACK)
+		fail("Only %d steps", steps);
+
+	// again with history, a few checkpoints along the way
+	n = steps - 10;
+	avr = tests_init_avr("atmega48_enabled_timer.axf");
+	if (avr_reverse_start(avr, 500, 0))
+		fail("avr_reverse_start() failed");
+	for (i = 0; i < n; i++)
+		if (!step(avr))
+			fail("Firmware stopped at step %d", i);
+	check(avr, n);
+
+	for (i = 1; i <= BACK; i++) {
+		if (avr_reverse_step(avr) != AVR_REVERSE_STOPPED)
+			fail("avr_reverse_step() failed at %d", n - i);
+		check(avr, n - i);
+	}
+	n -= BACK;
+
+	// back to the last time the PC was where it was a while before
+	pc = trace[n - BACK].pc;
+	for (want = n - 1; want >= 0 && trace[want].pc != pc; want--)
+		;
+	if (avr_reverse_continue(avr, stop_at_pc, &pc) != AVR_REVERSE_STOPPED)
+		fail("avr_reverse_continue() failed");
+	check(avr, want);
+
+	// forward again from there, through the history and past its end
+	avr->state = cpu_Running;
+	for (i = want; i < steps; i++) {
+		if (!step(avr))
+			fail("Firmware stopped at step %d", i);
+		check(avr, i + 1);
+	}
+
+	// and back to the start
+	if (avr_reverse_continue(avr, NULL, NULL) != AVR_REVERSE_BEGIN)
+		fail("avr_reverse_continue() did not go back to the start");
+	check(avr, 0);
+
+	avr_terminate(avr);
+	tests_success();
+	return 0;
+}
@@ -0,0 +1,54 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "tests.h"
+#include "sim_batch.h"
+
+/*
+ * Sweep the ADC test firmware over two AREF voltages, check that each
+ * point reads the bandgap against its own AREF, and the CSV results.
+ */
+
+static const char *sweep =
+	"firmware=atmega644_adc_test.axf\n"
+	"aref=2200,3300 probe=uart\n";
+
+static const char *csv_start =
+	"job,firmware,freq,vcc,avcc,aref,status,pass,cycles,uart\n"
+	"0,\"atmega644_adc_test.axf\",0,0,0,2200,done,1,";
+
+int main(int argc, char **argv) {
+	char name[] = "/tmp/simavr_sweep_XXXXXX";
+	avr_batch_t b = {0};
+	char *csv;
+	size_t size;
+	FILE *f;
+	int fd;
+
+	tests_init(argc, argv);
+	fd = mkstemp(name);
+	if (fd < 0 || write(fd, sweep, strlen(sweep)) != (ssize_t)strlen(sweep))
+		fail("Can't write %s", name);
+	close(fd);
+	if (avr_batch_sweep_load(&b, name))
+		fail("avr_batch_sweep_load() failed");
+	unlink(name);
+	if (b.count != 2 || b.job[0].aref != 2200 || b.job[1].aref != 3300)
+		fail("Sweep made %d jobs", b.count);
+	if (avr_batch_run(&b, 2))
+		fail("Jobs failed: %s", avr_batch_status_name(b.job[0].status));
+	if (!b.job[0].output || !strstr(b.job[0].output, "0x1ff -- "))
+		fail("AREF 2200: \"%s\"", b.job[0].output ? b.job[0].output : "");
+	if (!b.job[1].output || !strstr(b.job[1].output, "0x155 -- "))
+		fail("AREF 3300: \"%s\"", b.job[1].output ? b.job[1].output : "");
+
+	f = open_memstream(&csv, &size);
+	avr_batch_report_csv(&b, f);
+	fclose(f);
+	if (strncmp(csv, csv_start, strlen(csv_start)))
+		fail("Bad CSV: %s", csv);
+	free(csv);
+	avr_batch_free(&b);
+	tests_success();
+	return 0;
+}
@@ -0,0 +1,47 @@
+#include <string.h>
+#include "tests.h"
+#include "sim_batch.h"
+
+/*
+ * Run a firmware as several batch jobs on a few threads, one of them
+ * expecting the wrong output, and check the results.
+ */
+
+#define JOBS 6
+
+static const char *expected =
+	"Read from eeprom 0xdeadbeef -- should be 0xdeadbeef\r\n"
+	"Read from eeprom 0xcafef00d -- should be 0xcafef00d\r\n";
+
+int main(int argc, char **argv) {
+	avr_batch_t b = {0};
+	int failed;
+
+	tests_init(argc, argv);
+	for (int i = 0; i < JOBS; i++) {
+		avr_batch_job_t *j = avr_batch_add(&b, "atmega88_example.axf");
+
+		if (!j)
+			fail("avr_batch_add() failed");
+		j->timeout = 100000;
+		j->expect = strdup(i == JOBS - 1 ? "Read from flash" : expected);
+	}
+	failed = avr_batch_run(&b, 3);
+	if (failed != 1)
+		fail("%d jobs failed, expected 1", failed);
+	for (int i = 0; i < JOBS - 1; i++) {
+		if (b.job[i].status != AVR_BATCH_DONE || !b.job[i].pass)
+			fail("Job %d: %s \"%s\"", i,
+				 avr_batch_status_name(b.job[i].status),
+				 b.job[i].output ? b.job[i].output : "");
+		if (b.job[i].cycles != b.job[0].cycles)
+			fail("Job %d ran %" PRI_avr_cycle_count " cycles, job 0 %"
+				 PRI_avr_cycle_count, i, b.job[i].cycles, b.job[0].cycles);
+	}
+	if (b.job[JOBS - 1].status != AVR_BATCH_MISMATCH)
+		fail("Wrong output not caught: %s",
+			 avr_batch_status_name(b.job[JOBS - 1].status));
+	avr_batch_free(&b);
+	tests_success();
+	return 0;
+}
@@ -0,0 +1,89 @@
+#include <string.h>
+#include "tests.h"
+#include "sim_hex.h"
+#include "sim_board.h"
+#include "avr_uart.h"
+
+/*
+ * Two AVRs on a board, each one on its own thread, with the UART output
+ * of each one wired to the input of the other. The echo firmware then
+ * gets the other one's greeting instead of its own, and two runs must
+ * end at the same cycles whatever the threads did.
+ */
+
+static const char *expected =
+	"Hey there, this should be received back\r\n"
+	"Received: Hey there, this should be received back\r\r\n";
+
+struct chip {
+	avr_t *					avr;
+	struct output_buffer	buf;
+};
+
+static int no_loopback(avr_t *avr, uint8_t v, void *param) {
+	return 0;
+}
+
+static void run_board(struct chip *chip, const char *argv0) {
+	avr_board_t b = {0};
+	elf_firmware_t fw;
+
+	for (int i = 0; i < 2; i++) {
+		sim_setup_firmware("atmega88_uart_echo.axf", 0, &fw, argv0);
+		// the firmware starts a VCD trace: do not share the file
+		strcpy(fw.tracename, "/dev/null");
+		chip[i].avr = avr_make_mcu_by_name(fw.mmcu);
+		if (!chip[i].avr)
+			fail("Creating AVR failed.");
+		avr_init(chip[i].avr);
+		avr_load_firmware(chip[i].avr, &fw);
+		// the other chip is on the other end of the UART
+		avr_cmd_unregister(chip[i].avr, SIMAVR_CMD_UART_LOOPBACK);
+		avr_cmd_register(chip[i].avr, SIMAVR_CMD_UART_LOOPBACK,
+						 no_loopback, NULL);
+		init_output_buffer(&chip[i].buf);
+		avr_irq_register_notify(
+			avr_io_getirq(chip[i].avr, AVR_IOCTL_UART_GETIRQ('0'),
+						  UART_IRQ_OUTPUT), buf_output_cb, &chip[i].buf);
+		if (avr_board_add(&b, chip[i].avr) < 0)
+			fail("avr_board_add() failed");
+	}
+	for (int i = 0; i < 2; i++) {
+		avr_t *src = chip[i].avr, *dst = chip[!i].avr;
+
+		if (avr_board_connect(&b, src,
+				avr_io_getirq(src, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT),
+				dst,
+				avr_io_getirq(dst, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_INPUT),
+				AVR_BOARD_UART_NSEC(38400)))
+			fail("avr_board_connect() failed");
+	}
+	if (avr_board_run(&b, 100000))
+		fail("An AVR crashed");
+	for (int i = 0; i < 2; i++) {
+		if (b.mcu[i]->state != cpu_Done)
+			fail("AVR %d did not finish", i);
+		if (!chip[i].buf.str || strcmp(chip[i].buf.str, expected))
+			fail("AVR %d output differs: \"%s\"", i,
+				 chip[i].buf.str ? chip[i].buf.str : "");
+	}
+	avr_board_free(&b);
+}
+
+int main(int argc, char **argv) {
+	struct chip first[2], second[2];
+
+	tests_init(argc, argv);
+	run_board(first, argv[0]);
+	run_board(second, argv[0]);
+	for (int i = 0; i < 2; i++) {
+		if (first[i].avr->cycle != second[i].avr->cycle)
+			fail("AVR %d ran %" PRI_avr_cycle_count " cycles, then %"
+				 PRI_avr_cycle_count, i,
+				 first[i].avr->cycle, second[i].avr->cycle);
+		avr_terminate(first[i].avr);
+		avr_terminate(second[i].avr);
+	}
+	tests_success();
+	return 0;
+}
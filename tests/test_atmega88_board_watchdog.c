@@ -0,0 +1,80 @@
+#include <string.h>
+#include <unistd.h>
+#include "tests.h"
+#include "sim_time.h"
+#include "sim_hex.h"
+#include "sim_board.h"
+#include "avr_uart.h"
+
+/*
+ * Two AVRs on a board, wired UART to UART, each one reset by its
+ * watchdog then spinning for ever. The reset drops every cycle timer:
+ * the board must still see them get to the time limit, rather than wait
+ * for ever on one that no longer says how far it has got.
+ */
+
+#define LIMIT_USEC	100000
+
+static const char *expected =
+	"Waiting for the watchdog\r\n"
+	"Reset by the watchdog\r\n";
+
+static int no_loopback(avr_t *avr, uint8_t v, void *param) {
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	struct output_buffer buf[2];
+	avr_board_t b = {0};
+	elf_firmware_t fw;
+	avr_t *avr[2];
+
+	tests_init(argc, argv);
+	// a board waiting for ever would be the failure
+	alarm(60);
+	for (int i = 0; i < 2; i++) {
+		sim_setup_firmware("atmega88_board_watchdog.axf", 0, &fw, argv[0]);
+		avr[i] = avr_make_mcu_by_name(fw.mmcu);
+		if (!avr[i])
+			fail("Creating AVR failed.");
+		avr_init(avr[i]);
+		avr_load_firmware(avr[i], &fw);
+		avr_cmd_unregister(avr[i], SIMAVR_CMD_UART_LOOPBACK);
+		avr_cmd_register(avr[i], SIMAVR_CMD_UART_LOOPBACK, no_loopback, NULL);
+		init_output_buffer(&buf[i]);
+		avr_irq_register_notify(
+			avr_io_getirq(avr[i], AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT),
+			buf_output_cb, &buf[i]);
+		if (avr_board_add(&b, avr[i]) < 0)
+			fail("avr_board_add() failed");
+	}
+	for (int i = 0; i < 2; i++)
+		if (avr_board_connect(&b, avr[i],
+				avr_io_getirq(avr[i], AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT),
+				avr[!i],
+				avr_io_getirq(avr[!i], AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_INPUT),
+				AVR_BOARD_UART_NSEC(38400)))
+			fail("avr_board_connect() failed");
+	if (avr_board_run(&b, LIMIT_USEC))
+		fail("An AVR crashed");
+	alarm(0);
+
+	for (int i = 0; i < 2; i++) {
+		avr_board_mcu_t *m = b.mcu[i];
+		uint64_t ran = m->base + avr_cycles_to_nsec(avr[i], avr[i]->cycle);
+
+		if (!buf[i].str || strcmp(buf[i].str, expected))
+			fail("AVR %d output differs: \"%s\"", i,
+				 buf[i].str ? buf[i].str : "");
+		if (!m->base)
+			fail("AVR %d was not reset", i);
+		// to the limit, from before the reset
+		if (ran / 1000 < LIMIT_USEC || ran / 1000 > LIMIT_USEC + 1000)
+			fail("AVR %d ran for %lluns", i, (unsigned long long)ran);
+	}
+	avr_board_free(&b);
+	for (int i = 0; i < 2; i++)
+		avr_terminate(avr[i]);
+	tests_success();
+	return 0;
+}
@@ -0,0 +1,71 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "tests.h"
+#include "avr_uart.h"
+#include "sim_vcd_file.h"
+#include "sim_trigger.h"
+#include "sim_time.h"
+#include "sim_wave.h"
+
+/*
+ * Capture the UART output of the example firmware around the first time
+ * it prints a pattern, and check the text in the file is only that.
+ */
+
+int main(int argc, char **argv) {
+	static const char *expected =
+		"Read from eeprom 0xdeadbeef -- should be 0xdeadbeef\r\n"
+		"Read from eeprom 0xcafef00d -- should be 0xcafef00d\r\n";
+	/*
+	 * The value before the 8 changes kept, those, then from the 'd' that
+	 * triggered, the rest.
+	 */
+	static const char *captured = "0xcafef00d -- should be 0xcafef00d\r\n";
+	char name[] = "/tmp/simavr_capture_XXXXXX.swav";
+	char text[256];
+	const avr_vcd_log_t *log;
+	avr_vcd_t vcd;
+	avr_wave_t w;
+	int fd, n, len = 0;
+	FILE *f;
+
+	tests_init(argc, argv);
+	fd = mkstemps(name, 5);
+	if (fd < 0)
+		fail("Can't create %s", name);
+	close(fd);
+
+	avr_t *avr = tests_init_avr("atmega88_example.axf");
+	avr_vcd_init(avr, name, &vcd, 1000);
+	avr_vcd_add_signal(&vcd, avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'),
+			UART_IRQ_OUTPUT), 8, "uart");
+	avr_vcd_set_capture(&vcd, 0, 8, avr_usec_to_cycles(avr, 1000000));
+	avr_vcd_start(&vcd);
+	// in place of the firmware's own, avr_terminate() closes it
+	if (avr->vcd) {
+		avr_vcd_close(avr->vcd);
+		free(avr->vcd);
+	}
+	avr->vcd = &vcd;
+	if (avr_trigger_parse(avr, "uart0=cafef00d"))
+		fail("Can't set the trigger");
+	tests_assert_uart_receive_avr(avr, 100000, expected, '0');
+	if (vcd.captures != 1)
+		fail("%u captures", vcd.captures);
+
+	f = fopen(name, "r");
+	if (!f || avr_wave_open(&w, f))
+		fail("Can't read %s", name);
+	while ((n = avr_wave_read(&w, &log)) > 0)
+		for (int i = 0; i < n && len < (int)sizeof(text) - 1; i++)
+			text[len++] = log[i].value;
+	text[len] = 0;
+	if (n < 0 || strcmp(text, captured))
+		fail("Read back \"%s\"", text);
+	avr_wave_free(&w);
+	fclose(f);
+	unlink(name);
+	tests_success();
+	return 0;
+}
@@ -0,0 +1,96 @@
+#include <stdlib.h>
+#include <string.h>
+#include "tests.h"
+#include "sim_fuzz.h"
+
+/*
+ * Feed fixed inputs to the UART echo firmware through the fuzzing harness.
+ * It reads up to a newline, prints what it got and ends, so each input
+ * must be handled; the same input must run the same way every time,
+ * counting the same edges, and a different one must count others. A
+ * budget too small for the firmware to get anywhere must be reported.
+ */
+
+static const char *inputs[] = { "hello\n", "", "\n\n\n", "a longer line\n" };
+#define INPUTS	(sizeof(inputs) / sizeof(inputs[0]))
+
+static uint8_t maps[INPUTS][AVR_FUZZ_MAP];
+
+static int edges(const uint8_t *map) {
+	int n = 0;
+
+	for (int i = 0; i < AVR_FUZZ_MAP; i++)
+		n += map[i] != 0;
+	return n;
+}
+
+static int run(avr_fuzz_t *f, const char *input) {
+	return avr_fuzz_run(f, (const uint8_t *)input, strlen(input));
+}
+
+int main(int argc, char **argv) {
+	avr_fuzz_t f, small;
+	avr_cycle_count_t start;
+	avr_t *avr;
+	int res;
+
+	tests_init(argc, argv);
+
+	memset(&f, 0, sizeof(f));
+	if (avr_fuzz_parse_input(&f, "twi0@0x10") || f.input != AVR_FUZZ_TWI ||
+			f.name != '0' || f.twi_addr != 0x10)
+		fail("twi0@0x10 misread");
+	if (!avr_fuzz_parse_input(&f, "twi0@0x80") ||
+			!avr_fuzz_parse_input(&f, "uart") ||
+			!avr_fuzz_parse_input(&f, "spi0"))
+		fail("Bad input names accepted");
+	if (avr_fuzz_parse_input(&f, "uart0") || f.input != AVR_FUZZ_UART)
+		fail("uart0 misread");
+
+	avr = tests_init_avr("atmega88_uart_echo.axf");
+	if (avr_fuzz_init(&f, avr))
+		fail("avr_fuzz_init() failed");
+	start = avr->cycle;
+
+	for (int i = 0; i < INPUTS; i++) {
+		res = run(&f, inputs[i]);
+		if (res != AVR_FUZZ_IDLE)
+			fail("Input %d: %s", i, avr_fuzz_result_name(res));
+		if (avr->cycle != start)
+			fail("Input %d: back at cycle %" PRI_avr_cycle_count
+				 ", not %" PRI_avr_cycle_count, i, avr->cycle, start);
+		if (!edges(f.map))
+			fail("Input %d: no edges counted", i);
+		memcpy(maps[i], f.map, AVR_FUZZ_MAP);
+	}
+	// again, the other way round
+	for (int i = INPUTS - 1; i >= 0; i--) {
+		res = run(&f, inputs[i]);
+		if (res != AVR_FUZZ_IDLE)
+			fail("Input %d again: %s", i, avr_fuzz_result_name(res));
+		if (memcmp(maps[i], f.map, AVR_FUZZ_MAP))
+			fail("Input %d again: the edges differ", i);
+	}
+	if (!memcmp(maps[0], maps[2], AVR_FUZZ_MAP))
+		fail("Different inputs counted the same edges");
+
+	// the firmware can't even print in that long
+	memset(&small, 0, sizeof(small));
+	avr_fuzz_parse_input(&small, "uart0");
+	small.budget = 100;
+	avr_fuzz_free(&f);
+	if (avr_fuzz_init(&small, avr))
+		fail("avr_fuzz_init() failed with a small budget");
+	res = run(&small, inputs[0]);
+	if (res != AVR_FUZZ_BUDGET_HIT)
+		fail("Small budget: %s", avr_fuzz_result_name(res));
+	avr_fuzz_free(&small);
+
+	if (strcmp(avr_fuzz_result_name(AVR_FUZZ_STACK), "stack") ||
+			strcmp(avr_fuzz_result_name(-1), "?"))
+		fail("Bad result names");
+
+	avr_terminate(avr);
+	tests_success();
+	return 0;
+}
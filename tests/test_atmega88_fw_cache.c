@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include "tests.h"
+#include "sim_hex.h"
+#include "sim_fw_cache.h"
+
+/*
+ * The firmware cache, in a directory of its own, with a .hex file written
+ * here: flash in two records, and EEPROM. Read once, it is parsed and an
+ * entry written, read again, the entry gives the same elf_firmware_t.
+ * Cut short, the entry is not used, the file is parsed again and the
+ * entry written again. Only the file and the entry are left in the
+ * directory, no temporary file.
+ */
+
+static const char *hex =
+	":100000000C9434000C9446000C9446000C9446006A\n"
+	":040010000C94460006\n"
+	":02000004008179\n"
+	":04000000DEADBEEFC4\n"
+	":00000001FF\n";
+
+static char dir[] = "/tmp/simavr_fw_cache_XXXXXX";
+static char file[64], entry[128];
+
+static void read_fw(elf_firmware_t *fw) {
+	memset(fw, 0, sizeof(*fw));
+	strcpy(fw->mmcu, "atmega88");
+	fw->frequency = 8000000;
+	if (sim_read_firmware(file, 0, fw))
+		fail("Can't read %s", file);
+}
+
+static void free_fw(elf_firmware_t *fw) {
+	while (fw->chunks) {
+		fw_chunk_t *next = fw->chunks->next;
+
+		free(fw->chunks);
+		fw->chunks = next;
+	}
+#if ELF_SYMBOLS
+	free(fw->symbol);
+	free(fw->dwarf_file);
+	free(fw->dwarf);
+	free(fw->cache);
+#endif
+	avr_fw_cache_unmap(fw);
+}
+
+// 'fw' has the same settings and chunks as 'parsed'.
+static void compare(const char *what, elf_firmware_t *fw,
+					elf_firmware_t *parsed) {
+	fw_chunk_t *c = fw->chunks, *p = parsed->chunks;
+	int n = 0;
+
+	if (strcmp(fw->mmcu, parsed->mmcu) ||
+			fw->frequency != parsed->frequency ||
+			fw->flashbase != parsed->flashbase)
+		fail("%s: %s at %u, expected %s at %u", what, fw->mmcu,
+			 fw->frequency, parsed->mmcu, parsed->frequency);
+	for (; c && p; c = c->next, p = p->next, n++)
+		if (c->type != p->type || c->addr != p->addr ||
+				c->size != p->size || c->fill_size != p->fill_size ||
+				memcmp(c->data, p->data, c->size))
+			fail("%s: chunk %d, %u bytes at %#x, expected %u at %#x", what,
+				 n, c->size, c->addr, p->size, p->addr);
+	if (c || p)
+		fail("%s: %s chunks than parsed", what, c ? "more" : "fewer");
+}
+
+// The entry, or -1 if it can't be read.
+static int cached(elf_firmware_t *fw) {
+	uint64_t key;
+
+	memset(fw, 0, sizeof(*fw));
+	strcpy(fw->mmcu, "atmega88");
+	fw->frequency = 8000000;
+	if (avr_fw_cache_key(file, 0, fw, &key))
+		fail("No key for %s", file);
+	snprintf(entry, sizeof(entry), "%s/%016llx.fwc", dir,
+			 (unsigned long long)key);
+	return avr_fw_cache_read(key, file, fw);
+}
+
+static int files(void) {
+	DIR *d = opendir(dir);
+	struct dirent *e;
+	int n = 0;
+
+	if (!d)
+		fail("Can't list %s", dir);
+	while ((e = readdir(d)))
+		if (strcmp(e->d_name, ".") && strcmp(e->d_name, ".."))
+			n++;
+	closedir(d);
+	return n;
+}
+
+int main(int argc, char **argv) {
+	elf_firmware_t parsed, fw;
+	FILE *f;
+
+	tests_init(argc, argv);
+	if (!mkdtemp(dir))
+		fail("Can't create %s", dir);
+	snprintf(file, sizeof(file), "%s/fw.hex", dir);
+	f = fopen(file, "w");
+	if (!f || fputs(hex, f) < 0 || fclose(f))
+		fail("Can't write %s", file);
+	avr_fw_cache_set_dir(dir);
+
+	read_fw(&parsed);
+	if (!parsed.chunks || !parsed.chunks->next)
+		fail("%s is not in flash and EEPROM chunks", file);
+	if (cached(&fw))
+		fail("No entry in %s after reading %s", dir, file);
+	compare("Cached", &fw, &parsed);
+	free_fw(&fw);
+	read_fw(&fw);
+	compare("Read again", &fw, &parsed);
+	free_fw(&fw);
+	if (files() != 2)
+		fail("%d files in %s", files(), dir);
+
+	// cut short, it is parsed again and replaced
+	if (truncate(entry, 64))
+		fail("Can't cut %s short", entry);
+	if (!cached(&fw))
+		fail("The damaged %s was used", entry);
+	read_fw(&fw);
+	compare("Parsed again", &fw, &parsed);
+	free_fw(&fw);
+	if (cached(&fw))
+		fail("%s was not written again", entry);
+	compare("Cached again", &fw, &parsed);
+	free_fw(&fw);
+	if (files() != 2)
+		fail("%d files in %s", files(), dir);
+
+	free_fw(&parsed);
+	avr_fw_cache_set_dir(NULL);
+	unlink(entry);
+	unlink(file);
+	rmdir(dir);
+	tests_success();
+	return 0;
+}
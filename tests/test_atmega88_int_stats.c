@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tests.h"
+#include "sim_core.h"
+#include "sim_interrupts.h"
+#include "sim_int_stats.h"
+
+/*
+ * Interrupt timing with a handler of eight nops loaded by hand, raised
+ * from here: the timer 0 overflow vector, edge triggered, is serviced at
+ * once, then raised twice with interrupts off, which misses one, and
+ * serviced late. INT0 raised twice as a level is not missed, and cleared
+ * without being serviced it is cancelled. Each latency and duration lands
+ * in its power of two bucket.
+ */
+
+#define INT0_VECT	1
+#define TOV0_VECT	16
+#define LOOP		(27 * 2)	// main's loop, in bytes
+#define LATE		200			// cycles with interrupts off
+
+// The bucket of 'v', as in sim_int_stats.h.
+static int bucket(uint32_t v) {
+	int b = 0;
+
+	while (v >> b)
+		b++;
+	return b;
+}
+
+// 'count' values from 'min' to 'max', in their buckets.
+static void histogram(const char *what, avr_int_histogram_t *h,
+					  uint64_t count, uint32_t min, uint32_t max) {
+	uint64_t total = 0;
+
+	if (h->count != count || h->min < min || h->max > max)
+		fail("%s: %llu from %u to %u, expected %llu from %u to %u", what,
+			 (unsigned long long)h->count, h->min, h->max,
+			 (unsigned long long)count, min, max);
+	for (int b = 0; b < AVR_INT_STATS_BUCKETS; b++)
+		total += h->bucket[b];
+	if (total != h->count || !h->bucket[bucket(h->min)] ||
+			!h->bucket[bucket(h->max)])
+		fail("%s: %llu in the buckets, not in those of %u and %u", what,
+			 (unsigned long long)total, h->min, h->max);
+}
+
+static void counts(avr_t *avr, int vector, uint64_t raised,
+				   uint64_t serviced, uint64_t missed, uint64_t cancelled) {
+	avr_int_vector_stats_t *v = &avr->interrupts.stats->vector[vector];
+
+	if (v->raised != raised || v->serviced != serviced ||
+			v->missed != missed || v->cancelled != cancelled)
+		fail("Vector %d: raised %llu serviced %llu missed %llu cancelled %llu"
+			 ", expected %llu, %llu, %llu and %llu", vector,
+			 (unsigned long long)v->raised, (unsigned long long)v->serviced,
+			 (unsigned long long)v->missed, (unsigned long long)v->cancelled,
+			 (unsigned long long)raised, (unsigned long long)serviced,
+			 (unsigned long long)missed, (unsigned long long)cancelled);
+}
+
+// Run until the handler is done with the vector 'serviced' times.
+static void run_handler(avr_t *avr, uint64_t serviced) {
+	avr_int_vector_stats_t *v = &avr->interrupts.stats->vector[TOV0_VECT];
+	avr_cycle_count_t end = avr->cycle + 1000;
+
+	while (v->duration.count < serviced)
+		if (avr_run(avr) != cpu_Running || avr->cycle > end)
+			fail("Handler not done at cycle %" PRI_avr_cycle_count,
+				 avr->cycle);
+}
+
+int main(int argc, char **argv) {
+	static uint16_t code[37] = {
+		[0] = 0xc019,			// rjmp main
+		[INT0_VECT] = 0xc01a,	// rjmp handler
+		[TOV0_VECT] = 0xc00b,	// rjmp handler
+		[26] = 0x9478,			// main: sei
+		[27] = 0xcfff,			//		 rjmp .-2
+		// handler: eight nops
+		[36] = 0x9518,			//		 reti
+	};
+	avr_int_vector_t *int0, *tov0;
+	char *text = NULL;
+	size_t len = 0;
+	FILE *f;
+	avr_t *avr;
+
+	tests_init(argc, argv);
+	avr = avr_make_mcu_by_name("atmega88");
+	if (!avr)
+		fail("Creating AVR failed.");
+	avr_init(avr);
+	avr_loadcode(avr, (uint8_t *)code, sizeof(code), 0);
+	avr->frequency = 8000000;
+	int0 = avr->interrupts.vectors[INT0_VECT];
+	tov0 = avr->interrupts.vectors[TOV0_VECT];
+	if (!int0 || !tov0)
+		fail("No INT0 or timer 0 overflow vector");
+	if (avr_int_stats_start(avr))
+		fail("avr_int_stats_start() failed");
+	while (avr->pc != LOOP)
+		avr_run(avr);
+
+	// serviced at once: the vector's rjmp, the nops and reti
+	avr_regbit_set(avr, tov0->enable);
+	avr_raise_interrupt(avr, tov0);
+	run_handler(avr, 1);
+	counts(avr, TOV0_VECT, 1, 1, 0, 0);
+	histogram("Latency", &avr->interrupts.stats->vector[TOV0_VECT].latency,
+			  1, 0, 7);
+	histogram("Duration", &avr->interrupts.stats->vector[TOV0_VECT].duration,
+			  1, 10, 15);
+
+	// interrupts off: an edge raised again is missed, a level is not
+	avr_sreg_set(avr, S_I, 0);
+	avr_raise_interrupt(avr, tov0);
+	avr_raise_interrupt(avr, tov0);
+	avr_regbit_set(avr, int0->enable);
+	avr_raise_level(avr, int0);
+	avr_raise_level(avr, int0);
+	counts(avr, TOV0_VECT, 2, 1, 1, 0);
+	counts(avr, INT0_VECT, 1, 0, 0, 0);
+	avr_clear_level(avr, int0);
+	counts(avr, INT0_VECT, 1, 0, 0, 1);
+
+	// and serviced late
+	for (avr_cycle_count_t end = avr->cycle + LATE; avr->cycle < end; )
+		avr_run(avr);
+	avr_sreg_set(avr, S_I, 1);
+	run_handler(avr, 2);
+	counts(avr, TOV0_VECT, 2, 2, 1, 0);
+	histogram("Latencies", &avr->interrupts.stats->vector[TOV0_VECT].latency,
+			  2, 0, LATE + 16);
+	if (avr->interrupts.stats->vector[TOV0_VECT].latency.max < LATE)
+		fail("Serviced after %u cycles",
+			 avr->interrupts.stats->vector[TOV0_VECT].latency.max);
+	histogram("Durations", &avr->interrupts.stats->vector[TOV0_VECT].duration,
+			  2, 10, 15);
+
+	f = open_memstream(&text, &len);
+	if (!f)
+		fail("Can't open a memory stream");
+	avr_int_stats_report(avr, f);
+	fclose(f);
+	if (!strstr(text, "vector 16: raised 2 serviced 2 missed 1 cancelled 0") ||
+			!strstr(text, "vector  1: raised 1 serviced 0 missed 0 cancelled 1"))
+		fail("Report:\n%s", text);
+	free(text);
+
+	avr_terminate(avr);
+	tests_success();
+	return 0;
+}
@@ -0,0 +1,45 @@
+#include <stdlib.h>
+#include <string.h>
+#include "tests.h"
+#include "sim_log.h"
+
+/*
+ * Log the UART output of the example firmware through the asynchronous
+ * logger, and check it comes out in order, with the cycles.
+ */
+
+int main(int argc, char **argv) {
+	static const char *expected =
+		"Read from eeprom 0xdeadbeef -- should be 0xdeadbeef\r\n"
+		"Read from eeprom 0xcafef00d -- should be 0xcafef00d\r\n";
+	char line[256];
+	unsigned long long cycle, last = 0;
+	int lines = 0, n;
+	FILE *f;
+
+	tests_init(argc, argv);
+	f = tmpfile();
+	if (!f)
+		fail("Can't create a log file");
+
+	avr_t *avr = tests_init_avr("atmega88_example.axf");
+	avr->log = LOG_OUTPUT;
+	if (avr_log_start(avr, f, 0))
+		fail("Can't start the logger");
+	// terminates the AVR, which writes out the log
+	tests_assert_uart_receive_avr(avr, 100000, expected, '0');
+
+	rewind(f);
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "[%llu] %n", &cycle, &n) != 1 || cycle < last)
+			fail("Bad line \"%s\"", line);
+		if (strstr(line + n, "Read from eeprom"))
+			lines++;
+		last = cycle;
+	}
+	if (lines != 2)
+		fail("Logged %d of the 2 lines", lines);
+	fclose(f);
+	tests_success();
+	return 0;
+}
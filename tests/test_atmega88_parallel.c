@@ -0,0 +1,72 @@
+#include <pthread.h>
+#include <string.h>
+#include "tests.h"
+#include "sim_hex.h"
+#include "avr_uart.h"
+
+/*
+ * Run several instances of the same firmware at once, one per thread,
+ * and check that each one behaves as if it were alone in the process.
+ */
+
+#define INSTANCES 4
+
+static const char *expected =
+	"Read from eeprom 0xdeadbeef -- should be 0xdeadbeef\r\n"
+	"Read from eeprom 0xcafef00d -- should be 0xcafef00d\r\n";
+
+struct instance {
+	elf_firmware_t			fw;
+	struct output_buffer	buf;
+	int						reason;
+	avr_cycle_count_t		cycles;
+};
+
+static void *run_instance(void *param) {
+	struct instance *in = param;
+	avr_t *avr = avr_make_mcu_by_name(in->fw.mmcu);
+
+	if (!avr)
+		return NULL;
+	avr_init(avr);
+	avr_load_firmware(avr, &in->fw);
+	init_output_buffer(&in->buf);
+	avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'),
+										  UART_IRQ_OUTPUT),
+							buf_output_cb, &in->buf);
+	in->reason = tests_run_avr(avr, 100000);
+	in->cycles = tests_cycle_count;
+	return NULL;
+}
+
+int main(int argc, char **argv) {
+	static struct instance in[INSTANCES];
+	pthread_t thread[INSTANCES];
+
+	tests_init(argc, argv);
+	for (int i = 0; i < INSTANCES; i++) {
+		sim_setup_firmware("atmega88_example.axf", 0, &in[i].fw, argv[0]);
+		// the firmware starts a VCD trace: do not share the file
+		strcpy(in[i].fw.tracename, "/dev/null");
+	}
+	for (int i = 0; i < INSTANCES; i++) {
+		if (pthread_create(&thread[i], NULL, run_instance, &in[i]))
+			fail("pthread_create() failed");
+	}
+	for (int i = 0; i < INSTANCES; i++)
+		pthread_join(thread[i], NULL);
+
+	for (int i = 0; i < INSTANCES; i++) {
+		if (in[i].reason != LJR_SPECIAL_DEINIT)
+			fail("Instance %d did not finish (%d)", i, in[i].reason);
+		if (!in[i].buf.str || strcmp(in[i].buf.str, expected))
+			fail("Instance %d output differs: \"%s\"", i,
+				 in[i].buf.str ? in[i].buf.str : "");
+		if (in[i].cycles != in[0].cycles)
+			fail("Instance %d ran %" PRI_avr_cycle_count " cycles, "
+				 "instance 0 %" PRI_avr_cycle_count, i,
+				 in[i].cycles, in[0].cycles);
+	}
+	tests_success();
+	return 0;
+}
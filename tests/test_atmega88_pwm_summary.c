@@ -0,0 +1,192 @@
+#include <stdlib.h>
+#include <string.h>
+#include "tests.h"
+#include "sim_io.h"
+#include "avr_timer.h"
+
+/*
+ * Timer 0 of an ATmega88, set up from here, with nothing but a loop of
+ * nops running. In fast PWM then phase correct, the PWM summary is turned
+ * on, the compare A interrupt enabled and disabled again while it is on,
+ * and the summary turned off: the count must carry on across each change,
+ * within the one count the exact timer is off by, and the DUTY and PERIOD
+ * IRQs follow what is summarized, as do the compare match flags.
+ */
+
+enum {
+	TIFR0 = 0x35, TCCR0A = 0x44, TCCR0B = 0x45, TCNT0 = 0x46,
+	OCR0A = 0x47, OCR0B = 0x48, TIMSK0 = 0x6e,
+};
+#define OCIE0A	(1 << 1)
+#define OCF0A	(1 << 1)
+#define OCF0B	(1 << 2)
+#define DIV		8			// the prescaler, CS0 = 2
+
+static uint32_t duty[2], period;
+static avr_cycle_count_t start;
+static int phase_correct;
+
+static void duty_cb(avr_irq_t *irq, uint32_t value, void *param) {
+	duty[(intptr_t)param] = value;
+}
+
+static void period_cb(avr_irq_t *irq, uint32_t value, void *param) {
+	period = value;
+}
+
+// As the firmware would, through the IO callbacks.
+static void io_write(avr_t *avr, uint16_t addr, uint8_t v) {
+	avr_io_addr_t io = AVR_DATA_TO_IO(addr);
+
+	if (avr->io[io].w.c)
+		avr->io[io].w.c(avr, addr, v, avr->io[io].w.param);
+	else
+		avr->data[addr] = v;
+}
+
+static uint8_t io_read(avr_t *avr, uint16_t addr) {
+	avr_io_addr_t io = AVR_DATA_TO_IO(addr);
+
+	if (avr->io[io].r.c)
+		return avr->io[io].r.c(avr, addr, avr->io[io].r.param);
+	return avr->data[addr];
+}
+
+// Where the counter should be, counting from when it was started.
+static int expected(avr_t *avr) {
+	uint64_t count = (avr->cycle - start) / DIV;
+
+	if (!phase_correct)
+		return count % 256;
+	count %= 2 * 255;
+	return count <= 255 ? count : 2 * 255 - count;
+}
+
+// Run, checking the count at each instruction.
+static void run(avr_t *avr, int cycles, const char *when) {
+	avr_cycle_count_t end = avr->cycle + cycles;
+
+	while (avr->cycle < end) {
+		int tcnt = io_read(avr, TCNT0), e = expected(avr);
+		int off = abs(tcnt - e);
+
+		if (!phase_correct && off > 128)	// either side of the overflow
+			off = 256 - off;
+		if (off > 1)
+			fail("%s, %s: TCNT0 %d at cycle %" PRI_avr_cycle_count
+				 ", expected %d", phase_correct ? "phase correct" : "fast",
+				 when, tcnt, avr->cycle - start, e);
+		avr_run(avr);
+	}
+}
+
+static void set_summary(avr_t *avr, uint32_t mask) {
+	uint8_t before = io_read(avr, TCNT0), after;
+
+	if (avr_ioctl(avr, AVR_IOCTL_TIMER_SET_SUMMARY('0'), &mask))
+		fail("Can't set the summary to %u", mask);
+	after = io_read(avr, TCNT0);
+	if (after != before)
+		fail("Setting the summary to %u moved TCNT0 from %d to %d", mask,
+			 before, after);
+}
+
+// The compare match flags set in a whole PWM period from now.
+static uint8_t flags(avr_t *avr, const char *when) {
+	io_write(avr, TIFR0, OCF0A | OCF0B);
+	if (avr->data[TIFR0] & (OCF0A | OCF0B))
+		fail("Can't clear the flags");
+	run(avr, 2 * 256 * DIV + 16, when);
+	return avr->data[TIFR0] & (OCF0A | OCF0B);
+}
+
+static void check(const char *when, uint32_t duty_a, uint32_t duty_b,
+				  uint32_t period_cycles) {
+	if (duty[0] != duty_a || duty[1] != duty_b || period != period_cycles)
+		fail("%s, %s: duty %x and %x, period %u, expected %x, %x and %u",
+			 phase_correct ? "phase correct" : "fast", when, duty[0],
+			 duty[1], period, duty_a, duty_b, period_cycles);
+}
+
+static void pwm(avr_t *avr, uint8_t wgm) {
+	uint32_t period_cycles, duty_a, duty_b;
+	uint8_t f;
+
+	phase_correct = wgm == 1;
+	if (phase_correct) {
+		period_cycles = 2 * 255 * DIV;
+		duty_a = (uint64_t)64 * AVR_TIMER_DUTY_MAX / 255;
+		duty_b = AVR_TIMER_DUTY_MAX - (uint64_t)192 * AVR_TIMER_DUTY_MAX / 255;
+	} else {
+		period_cycles = 256 * DIV;
+		duty_a = (uint64_t)65 * AVR_TIMER_DUTY_MAX / 256;
+		duty_b = AVR_TIMER_DUTY_MAX - (uint64_t)193 * AVR_TIMER_DUTY_MAX / 256;
+	}
+	io_write(avr, TCCR0B, 0);
+	io_write(avr, TCNT0, 0);
+	io_write(avr, OCR0A, 64);
+	io_write(avr, OCR0B, 192);
+	// A not inverted, B inverted
+	io_write(avr, TCCR0A, (2 << 6) | (3 << 4) | wgm);
+	start = avr->cycle;
+	io_write(avr, TCCR0B, 2);
+	duty[0] = duty[1] = period = 0;
+	run(avr, 3001, "exact");
+	if ((f = flags(avr, "exact")) != (OCF0A | OCF0B))
+		fail("Exact: flags %02x", f);
+
+	set_summary(avr, 3);
+	check("summary on", duty_a, duty_b, period_cycles);
+	run(avr, 2503, "summary on");
+	if ((f = flags(avr, "summary on")))
+		fail("Summary on: flags %02x", f);
+
+	// A is exact again, B still summarized: a new OCR0A is not reported
+	io_write(avr, TIMSK0, OCIE0A);
+	io_write(avr, OCR0A, 100);
+	check("interrupt on", duty_a, duty_b, period_cycles);
+	run(avr, 1999, "interrupt on");
+	if ((f = flags(avr, "interrupt on")) != OCF0A)
+		fail("Interrupt on: flags %02x", f);
+
+	// until A is summarized again
+	duty_a = phase_correct ? (uint64_t)100 * AVR_TIMER_DUTY_MAX / 255 :
+			(uint64_t)101 * AVR_TIMER_DUTY_MAX / 256;
+	io_write(avr, TIMSK0, 0);
+	check("interrupt off", duty_a, duty_b, period_cycles);
+	run(avr, 2711, "interrupt off");
+
+	set_summary(avr, 0);
+	check("summary off", duty_a, duty_b, 0);
+	run(avr, 3001, "summary off");
+	if ((f = flags(avr, "summary off")) != (OCF0A | OCF0B))
+		fail("Summary off: flags %02x", f);
+}
+
+int main(int argc, char **argv) {
+	// nop, rjmp .-4
+	static uint8_t code[] = { 0x00, 0x00, 0xfe, 0xcf };
+	avr_t *avr;
+
+	tests_init(argc, argv);
+	avr = avr_make_mcu_by_name("atmega88");
+	if (!avr)
+		fail("Creating AVR failed.");
+	avr_init(avr);
+	avr_loadcode(avr, code, sizeof(code), 0);
+	avr->frequency = 8000000;
+	for (intptr_t i = 0; i < 2; i++)
+		avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_TIMER_GETIRQ('0'),
+											  TIMER_IRQ_OUT_DUTY + i),
+								duty_cb, (void *)i);
+	avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_TIMER_GETIRQ('0'),
+										  TIMER_IRQ_OUT_PERIOD),
+							period_cb, NULL);
+
+	pwm(avr, 3);
+	pwm(avr, 1);
+
+	avr_terminate(avr);
+	tests_success();
+	return 0;
+}
@@ -0,0 +1,76 @@
+#include <stdlib.h>
+#include "tests.h"
+#include "sim_io.h"
+#include "avr_timer.h"
+
+/*
+ * Timer 0 of an ATmega88 in phase correct PWM, set up from here with no
+ * PWM summary and no prescaler, and nothing but a loop of nops running,
+ * four cycles long so that reading TCNT0 at each instruction gets to all
+ * the cycles of a period in two of them. It follows the count up to TOP
+ * and back down to BOTTOM, within the one count the timer is off by, and
+ * reads TOP at TOP and BOTTOM at BOTTOM rather than what is one past them.
+ */
+
+enum {
+	TCCR0A = 0x44, TCCR0B = 0x45, TCNT0 = 0x46,
+};
+#define PERIODS	4
+
+// As the firmware would, through the IO callbacks.
+static void io_write(avr_t *avr, uint16_t addr, uint8_t v) {
+	avr_io_addr_t io = AVR_DATA_TO_IO(addr);
+
+	if (avr->io[io].w.c)
+		avr->io[io].w.c(avr, addr, v, avr->io[io].w.param);
+	else
+		avr->data[addr] = v;
+}
+
+static uint8_t io_read(avr_t *avr, uint16_t addr) {
+	avr_io_addr_t io = AVR_DATA_TO_IO(addr);
+
+	if (avr->io[io].r.c)
+		return avr->io[io].r.c(avr, addr, avr->io[io].r.param);
+	return avr->data[addr];
+}
+
+int main(int argc, char **argv) {
+	// nop, nop, rjmp .-6
+	static uint8_t code[] = { 0x00, 0x00, 0x00, 0x00, 0xfd, 0xcf };
+	avr_cycle_count_t start, end;
+	int top = 0, bottom = 0;
+	avr_t *avr;
+
+	tests_init(argc, argv);
+	avr = avr_make_mcu_by_name("atmega88");
+	if (!avr)
+		fail("Creating AVR failed.");
+	avr_init(avr);
+	avr_loadcode(avr, code, sizeof(code), 0);
+	avr->frequency = 8000000;
+
+	// WGM 1, the outputs off
+	io_write(avr, TCCR0A, 1);
+	start = avr->cycle;
+	io_write(avr, TCCR0B, 1);
+	end = start + PERIODS * 2 * 255;
+	while (avr->cycle < end) {
+		uint64_t count = (avr->cycle - start) % (2 * 255);
+		int tcnt = io_read(avr, TCNT0);
+		int e = count <= 255 ? count : 2 * 255 - count;
+
+		if (abs(tcnt - e) > 1)
+			fail("TCNT0 %d at cycle %" PRI_avr_cycle_count ", expected %d",
+				 tcnt, avr->cycle - start, e);
+		top += tcnt == 255;
+		bottom += tcnt == 0 && avr->cycle - start > 255;
+		avr_run(avr);
+	}
+	if (!top || !bottom)
+		fail("TCNT0 read at TOP %d times, at BOTTOM %d times", top, bottom);
+
+	avr_terminate(avr);
+	tests_success();
+	return 0;
+}
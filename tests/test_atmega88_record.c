@@ -0,0 +1,91 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "tests.h"
+#include "avr_uart.h"
+#include "sim_record.h"
+
+/*
+ * The UART echo firmware prints back what it receives. Besides its own
+ * loopback, send it a few bytes from outside at odd cycles, recording the
+ * inputs, then run it again from the log with nothing sent: the output
+ * and the cycle it ends at must be the same. A run with neither shows the
+ * bytes sent made a difference.
+ */
+
+#define RUN_CYCLES	2000000
+
+static const char sent[] = "<ab>";
+
+static avr_cycle_count_t send_cb(avr_t *avr, avr_cycle_count_t when,
+								 void *param) {
+	const char *c = param;
+
+	avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'),
+								UART_IRQ_INPUT), *c);
+	return 0;
+}
+
+static avr_cycle_count_t run(const char *log, int mode,
+							 struct output_buffer *buf) {
+	avr_t *avr = tests_init_avr("atmega88_uart_echo.axf");
+	avr_cycle_count_t cycle;
+	int state;
+
+	init_output_buffer(buf);
+	avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'),
+										  UART_IRQ_OUTPUT),
+							buf_output_cb, buf);
+	if (mode && !avr_record_start(avr))
+		fail("avr_record_start() failed");
+	if (mode == 'p' && avr_record_load(avr, log))
+		fail("avr_record_load() failed");
+	if (mode != 'p') {
+		// in the middle of the firmware's line, at odd cycles
+		for (int i = 0; sent[i]; i++)
+			avr_cycle_timer_register(avr, 20011 + i * 9973, send_cb,
+									 (void *)(sent + i));
+	}
+	do {
+		state = avr_run(avr);
+	} while (state != cpu_Done && state != cpu_Crashed &&
+			 avr->cycle < RUN_CYCLES);
+	if (state != cpu_Done)
+		fail("Firmware did not finish (%d)", state);
+	if (mode == 'r' && avr_record_save(avr, log))
+		fail("avr_record_save() failed");
+	cycle = avr->cycle;
+	avr_terminate(avr);
+	return cycle;
+}
+
+int main(int argc, char **argv) {
+	char name[] = "/tmp/simavr_record_XXXXXX";
+	struct output_buffer live, replay, none;
+	avr_cycle_count_t live_end, replay_end;
+	int fd;
+
+	tests_init(argc, argv);
+	fd = mkstemp(name);
+	if (fd < 0)
+		fail("Can't create %s", name);
+	close(fd);
+
+	live_end = run(name, 'r', &live);
+	if (!strstr(live.str, "<") || !strstr(live.str, ">"))
+		fail("Bytes sent not echoed: \"%s\"", live.str);
+	replay_end = run(name, 'p', &replay);
+	if (strcmp(replay.str, live.str))
+		fail("Replay output differs: \"%s\", recorded \"%s\"",
+			 replay.str, live.str);
+	if (replay_end != live_end)
+		fail("Replay ended at cycle %" PRI_avr_cycle_count ", recorded run "
+			 "at %" PRI_avr_cycle_count, replay_end, live_end);
+	run(name, 0, &none);
+	if (!strcmp(none.str, live.str))
+		fail("The bytes sent made no difference");
+
+	unlink(name);
+	tests_success();
+	return 0;
+}
@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tests.h"
+#include "sim_stack.h"
+#include "sim_symbols.h"
+
+/*
+ * Stack tracking of a few calls loaded by hand: main calls a, which calls
+ * c, which pushes a byte, then calls b, which pushes two. The lowest SP
+ * is in c, with a and c on the call chain. The report, made twice in a
+ * row while c is running then again at the end, must be the same each
+ * time, and leave the figures as they were.
+ */
+
+#define MAIN	0x0000
+#define A		0x0008
+#define C		0x000c
+#define B		0x0012
+#define IN_C	(C + 2)		// after the push
+
+static char *report(avr_t *avr) {
+	char *text = NULL;
+	size_t len = 0;
+	FILE *f = open_memstream(&text, &len);
+
+	if (!f)
+		fail("Can't open a memory stream");
+	avr_stack_watch_report(avr, f);
+	fclose(f);
+	return text;
+}
+
+// Two reports in a row are the same, and have 'expected' in them.
+static void check_report(avr_t *avr, const char *when,
+						 const char **expected) {
+	char *first = report(avr), *second = report(avr);
+
+	if (strcmp(first, second))
+		fail("%s, the report changed:\n%s\nthen\n%s", when, first, second);
+	for (; *expected; expected++)
+		if (!strstr(first, *expected))
+			fail("%s, no \"%s\" in:\n%s", when, *expected, first);
+	free(first);
+	free(second);
+}
+
+static void check_function(avr_t *avr, const char *name, avr_flashaddr_t pc,
+						   uint32_t calls, uint16_t usage) {
+	const avr_stack_func_t *f = avr_stack_watch_get_function(avr, pc);
+
+	if (!f || f->calls != calls || f->max_usage != usage)
+		fail("Function %s: %u calls, %u bytes, expected %u and %u", name,
+			 f ? f->calls : 0, f ? f->max_usage : 0, calls, usage);
+}
+
+int main(int argc, char **argv) {
+	static const uint16_t code[] = {
+		0xd003,			// main: rcall a
+		0xd007,			//		 rcall b
+		0x94f8,			//		 cli
+		0x9588,			//		 sleep
+		0xd001,			// a:	 rcall c
+		0x9508,			//		 ret
+		0x920f,			// c:	 push r0
+		0x900f,			//		 pop r0
+		0x9508,			//		 ret
+		0x920f,			// b:	 push r0
+		0x921f,			//		 push r1
+		0x901f,			//		 pop r1
+		0x900f,			//		 pop r0
+		0x9508,			//		 ret
+	};
+	static const char *in_c[] = {
+		"lowest SP 04fa, 5 bytes below RAMEND, PC c cycle",
+		"#1  c called from a, sp 04fd",
+		"#0  a called from main, sp 04ff",
+		"function a:        1 calls, max    5 bytes",
+		"function c:        1 calls, max    3 bytes",
+		NULL
+	};
+	static const char *done[] = {
+		"lowest SP 04fa, 5 bytes below RAMEND, PC c cycle",
+		"#1  c called from a, sp 04fd",
+		"#0  a called from main, sp 04ff",
+		"function a:        1 calls, max    5 bytes",
+		"function b:        1 calls, max    4 bytes",
+		"function c:        1 calls, max    3 bytes",
+		NULL
+	};
+	avr_t *avr;
+	int state;
+
+	tests_init(argc, argv);
+	avr = avr_make_mcu_by_name("atmega88");
+	if (!avr)
+		fail("Creating AVR failed.");
+	avr_init(avr);
+	avr_loadcode(avr, (uint8_t *)code, sizeof(code), 0);
+	avr->frequency = 8000000;
+	avr_symbols_add(avr, AVR_SYMBOLS_CODE, MAIN, A - MAIN, "main", 0);
+	avr_symbols_add(avr, AVR_SYMBOLS_CODE, A, C - A, "a", 0);
+	avr_symbols_add(avr, AVR_SYMBOLS_CODE, C, B - C, "c", 0);
+	avr_symbols_add(avr, AVR_SYMBOLS_CODE, B, sizeof(code) - B, "b", 0);
+	if (avr_stack_watch_start(avr))
+		fail("avr_stack_watch_start() failed");
+
+	// a and c are still running
+	while (avr->pc != IN_C)
+		if (avr_run(avr) != cpu_Running)
+			fail("Stopped before c at cycle %" PRI_avr_cycle_count,
+				 avr->cycle);
+	if (avr->stack->depth != 2 || avr->stack->min_sp != 0x04fa)
+		fail("In c: depth %d, lowest SP %04x", avr->stack->depth,
+			 avr->stack->min_sp);
+	check_report(avr, "In c", in_c);
+	// the open frames are only folded into the report's copy
+	check_function(avr, "a", A, 1, 0);
+	check_function(avr, "c", C, 1, 0);
+	if (avr_stack_watch_get_function(avr, B))
+		fail("b called before it was");
+
+	do {
+		state = avr_run(avr);
+	} while (state != cpu_Done && state != cpu_Crashed);
+	if (state == cpu_Crashed)
+		fail("Crashed at cycle %" PRI_avr_cycle_count, avr->cycle);
+	check_report(avr, "At the end", done);
+	check_function(avr, "a", A, 1, 5);
+	check_function(avr, "b", B, 1, 4);
+	check_function(avr, "c", C, 1, 3);
+	if (avr->stack->worst_depth != 2 ||
+			avr->stack->worst[1].target != C ||
+			avr->stack->worst[0].target != A)
+		fail("Worst call chain of %d frames", avr->stack->worst_depth);
+
+	avr_terminate(avr);
+	tests_success();
+	return 0;
+}
@@ -0,0 +1,132 @@
+#include <stdlib.h>
+#include <string.h>
+#include "tests.h"
+#include "sim_io.h"
+#include "sim_stats.h"
+
+/*
+ * The performance counters over a few instructions loaded by hand, one
+ * or more of each class: GPIOR0 is written three times and read twice,
+ * its IRQs raised on each write for the whole register, on a change for
+ * each bit, and a cycle timer of this test fires once. Cleared, they all
+ * start again from zero.
+ */
+
+#define GPIOR0	0x3e
+
+static const struct {
+	int			op;
+	uint64_t	count, cycles;
+} expected[] = {
+	{ AVR_STATS_OP_ALU, 1, 1 },
+	{ AVR_STATS_OP_MUL, 1, 2 },
+	{ AVR_STATS_OP_MOVE, 2, 2 },
+	{ AVR_STATS_OP_LOAD, 2, 2 },
+	{ AVR_STATS_OP_STORE, 3, 3 },
+	{ AVR_STATS_OP_BRANCH, 1, 1 },
+	{ AVR_STATS_OP_JUMP, 1, 2 },
+	{ AVR_STATS_OP_CALL, 1, 3 },
+	{ AVR_STATS_OP_RETURN, 1, 4 },
+	{ AVR_STATS_OP_BIT, 1, 1 },
+	{ AVR_STATS_OP_FLASH, 1, 3 },
+	{ AVR_STATS_OP_CONTROL, 2, 2 },
+};
+
+static avr_cycle_count_t timer_cb(avr_t *avr, avr_cycle_count_t when,
+								  void *param) {
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	static const uint16_t code[] = {
+		0xe001,			// ldi r16, 0x01
+		0xe013,			// ldi r17, 0x03
+		0xbb0e,			// out GPIOR0, r16
+		0xbb1e,			// out GPIOR0, r17
+		0xbb1e,			// out GPIOR0, r17
+		0xb32e,			// in r18, GPIOR0
+		0xb33e,			// in r19, GPIOR0
+		0x0f23,			// add r18, r19
+		0x9f23,			// mul r18, r19
+		0xf001,			// breq .+0, not taken
+		0xc000,			// rjmp .+0
+		0x95c8,			// lpm
+		0xd002,			// rcall f
+		0x94f8,			// cli
+		0x9588,			// sleep
+		0x0000,			// f: nop
+		0x9508,			//	  ret
+	};
+	uint64_t instructions = 0;
+	avr_irq_t *irq[9];
+	avr_stats_t *s;
+	avr_t *avr;
+	int state;
+
+	tests_init(argc, argv);
+	avr = avr_make_mcu_by_name("atmega88");
+	if (!avr)
+		fail("Creating AVR failed.");
+	avr_init(avr);
+	avr_loadcode(avr, (uint8_t *)code, sizeof(code), 0);
+	avr->frequency = 8000000;
+	for (int i = 0; i < 9; i++)
+		irq[i] = avr_iomem_getirq(avr, GPIOR0, NULL, i);
+	if (avr_stats_start(avr))
+		fail("avr_stats_start() failed");
+	s = avr->stats;
+	avr_cycle_timer_register(avr, 10, timer_cb, NULL);
+
+	do {
+		state = avr_run(avr);
+	} while (state != cpu_Done && state != cpu_Crashed);
+	if (state == cpu_Crashed)
+		fail("Crashed at cycle %" PRI_avr_cycle_count, avr->cycle);
+
+	for (int i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+		int op = expected[i].op;
+
+		if (s->op_count[op] != expected[i].count ||
+				s->op_cycles[op] != expected[i].cycles)
+			fail("%s: %llu instructions in %llu cycles, expected %llu in %llu",
+				 avr_stats_op_name(op),
+				 (unsigned long long)s->op_count[op],
+				 (unsigned long long)s->op_cycles[op],
+				 (unsigned long long)expected[i].count,
+				 (unsigned long long)expected[i].cycles);
+		instructions += expected[i].count;
+	}
+	if (s->instructions != instructions)
+		fail("%llu instructions, expected %llu",
+			 (unsigned long long)s->instructions,
+			 (unsigned long long)instructions);
+	if (s->io_writes[GPIOR0 - 0x20] != 3 || s->io_reads[GPIOR0 - 0x20] != 2)
+		fail("GPIOR0 written %llu times and read %llu",
+			 (unsigned long long)s->io_writes[GPIOR0 - 0x20],
+			 (unsigned long long)s->io_reads[GPIOR0 - 0x20]);
+	// 1 then 3 then 3 again
+	if (avr_stats_get_irq(avr, irq[AVR_IOMEM_IRQ_ALL]) != 3 ||
+			avr_stats_get_irq(avr, irq[0]) != 1 ||
+			avr_stats_get_irq(avr, irq[1]) != 2 ||
+			avr_stats_get_irq(avr, irq[7]) != 1)
+		fail("GPIOR0 IRQs raised %llu, %llu, %llu and %llu times",
+			 (unsigned long long)avr_stats_get_irq(avr,
+					irq[AVR_IOMEM_IRQ_ALL]),
+			 (unsigned long long)avr_stats_get_irq(avr, irq[0]),
+			 (unsigned long long)avr_stats_get_irq(avr, irq[1]),
+			 (unsigned long long)avr_stats_get_irq(avr, irq[7]));
+	if (avr_stats_get_timer(avr, timer_cb) != 1)
+		fail("The timer fired %llu times",
+			 (unsigned long long)avr_stats_get_timer(avr, timer_cb));
+
+	avr_stats_clear(avr);
+	if (s->instructions || s->op_count[AVR_STATS_OP_STORE] ||
+			s->io_writes[GPIOR0 - 0x20] ||
+			avr_stats_get_irq(avr, irq[AVR_IOMEM_IRQ_ALL]) ||
+			avr_stats_get_timer(avr, timer_cb))
+		fail("Counters left after avr_stats_clear()");
+
+	avr_terminate(avr);
+	tests_success();
+	return 0;
+}
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tests.h"
+#include "sim_symbols.h"
+
+/*
+ * The symbol index on its own, with names added by hand to an AVR with no
+ * firmware: symbols of size 0 running to the next one, names with and
+ * without a leading '_' at one address, whichever is added first, gaps
+ * and addresses past the last symbol, and what avr_symbols_format() makes
+ * of it all, in a short buffer too.
+ */
+
+static void add(avr_t *avr, int kind, uint32_t addr, uint32_t size,
+				const char *name, uint32_t line) {
+	if (avr_symbols_add(avr, kind, addr, size, name, line))
+		fail("Can't add %s", name);
+}
+
+static void expect(const char *what, uint32_t addr, const char *got,
+				   uint32_t offset, const char *name, uint32_t at) {
+	if (!name ? got != NULL : !got || strcmp(got, name) || offset != at)
+		fail("%s 0x%04x: got %s+0x%x, expected %s+0x%x", what, addr,
+			 got ? got : "NULL", got ? offset : 0, name ? name : "NULL", at);
+}
+
+static void code(avr_t *avr, uint32_t addr, const char *name, uint32_t at) {
+	uint32_t offset = 0;
+	const char *got = avr_symbols_code(avr, addr, &offset);
+
+	expect("Code", addr, got, offset, name, at);
+}
+
+static void data(avr_t *avr, uint32_t addr, const char *name, uint32_t at) {
+	uint32_t offset = 0;
+	const char *got = avr_symbols_data(avr, addr, &offset);
+
+	expect("Data", addr, got, offset, name, at);
+}
+
+static void format(avr_t *avr, uint32_t addr, size_t len,
+				   const char *expected) {
+	char buf[65];
+
+	memset(buf, '#', sizeof(buf));
+	avr_symbols_format(avr, addr, buf, len);
+	if (strcmp(buf, expected))
+		fail("Format 0x%04x in %zu: \"%s\", expected \"%s\"", addr, len,
+			 buf, expected);
+	if (buf[len] != '#')
+		fail("Format 0x%04x wrote past %zu bytes", addr, len);
+}
+
+int main(int argc, char **argv) {
+	uint32_t line;
+	avr_t *avr;
+
+	tests_init(argc, argv);
+	avr = avr_make_mcu_by_name("atmega88");
+	if (!avr)
+		fail("Creating AVR failed.");
+	avr_init(avr);
+
+	// nothing known yet
+	code(avr, 0, NULL, 0);
+	if (avr_symbols_line(avr, 0, &line))
+		fail("A line with no symbols");
+	format(avr, 0x1234, 64, "0x1234");
+
+	// the same address, with '_' first then without, and the other way
+	add(avr, AVR_SYMBOLS_CODE, 0x0000, 0, "__vectors", 0);
+	add(avr, AVR_SYMBOLS_CODE, 0x0000, 0, "vectors", 0);
+	add(avr, AVR_SYMBOLS_CODE, 0x0100, 0x40, "main", 0);
+	add(avr, AVR_SYMBOLS_CODE, 0x0100, 0x40, "_main", 0);
+	// of size 0, up to the next one
+	add(avr, AVR_SYMBOLS_CODE, 0x0200, 0, "loop", 0);
+	add(avr, AVR_SYMBOLS_CODE, 0x0300, 4, "end", 0);
+	// without '_' wins over the size
+	add(avr, AVR_SYMBOLS_CODE, 0x0400, 0x10, "_helper", 0);
+	add(avr, AVR_SYMBOLS_CODE, 0x0400, 0x08, "helper", 0);
+	add(avr, AVR_SYMBOLS_DATA, 0x0100, 2, "counter", 0);
+	add(avr, AVR_SYMBOLS_DATA, 0x0102, 0, "buffer", 0);
+	add(avr, AVR_SYMBOLS_DATA, 0x0140, 1, "flag", 0);
+	add(avr, AVR_SYMBOLS_LINE, 0x0100, 0x20, "main.c", 40);
+	add(avr, AVR_SYMBOLS_LINE, 0x0120, 0x20, "main.c", 41);
+
+	code(avr, 0x0000, "vectors", 0);
+	code(avr, 0x00fe, "vectors", 0xfe);
+	code(avr, 0x0100, "main", 0);
+	code(avr, 0x013f, "main", 0x3f);
+	code(avr, 0x0140, NULL, 0);			// between main and loop
+	code(avr, 0x01ff, NULL, 0);
+	code(avr, 0x0200, "loop", 0);
+	code(avr, 0x02ff, "loop", 0xff);
+	code(avr, 0x0303, "end", 3);
+	code(avr, 0x0304, NULL, 0);
+	code(avr, 0x0407, "helper", 7);
+	code(avr, 0x0408, NULL, 0);			// the size of the one kept
+	code(avr, 0xffffffff, NULL, 0);
+	data(avr, 0x00ff, NULL, 0);			// before the first
+	data(avr, 0x0101, "counter", 1);
+	data(avr, 0x013f, "buffer", 0x3d);
+	data(avr, 0x0141, NULL, 0);
+
+	if (!avr_symbols_line(avr, 0x0125, &line) || line != 41)
+		fail("Line of 0x0125");
+	if (avr_symbols_line(avr, 0x0140, &line))
+		fail("A line past the last");
+	format(avr, 0x0100, 64, "main (main.c:40)");
+	format(avr, 0x0112, 64, "main+0x12 (main.c:40)");
+	format(avr, 0x0202, 64, "loop+0x2");
+	format(avr, 0x0140, 64, "0x0140");
+	// cut short, and no room for the line
+	format(avr, 0x0112, 6, "main+");
+	format(avr, 0x0112, 10, "main+0x12");
+	format(avr, 0x0112, 14, "main+0x12 (ma");
+
+	// added after a lookup, sorted again
+	add(avr, AVR_SYMBOLS_CODE, 0x0180, 0x10, "late", 0);
+	code(avr, 0x0184, "late", 4);
+	code(avr, 0x0200, "loop", 0);
+
+	avr_terminate(avr);
+	tests_success();
+	return 0;
+}
@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include "tests.h"
+#include "sim_interrupts.h"
+#include "sim_symbols.h"
+#include "sim_timeline.h"
+
+/*
+ * The timeline of a few instructions loaded by hand: main calls f, then
+ * a function whose name has a quote and a backslash in it, and sleeps
+ * until this test raises the timer 0 overflow vector. The file written
+ * must parse as JSON, with the calls, the interrupt and the sleep in it,
+ * and the odd name escaped.
+ */
+
+#define TOV0_VECT	16
+#define MAIN		26
+#define F			32
+#define ODD			34
+#define WAKE		100		// cycle the vector is raised at
+#define ODD_NAME	"odd\"name\\"
+
+static avr_cycle_count_t wake_cb(avr_t *avr, avr_cycle_count_t when,
+								 void *param) {
+	avr_raise_interrupt(avr, param);
+	return 0;
+}
+
+/*
+ * Just enough JSON to tell it is: each returns past what it parsed, or
+ * NULL.
+ */
+static const char *json_value(const char *p);
+
+static const char *json_space(const char *p) {
+	while (*p && isspace((unsigned char)*p))
+		p++;
+	return p;
+}
+
+static const char *json_string(const char *p) {
+	if (*p++ != '"')
+		return NULL;
+	for (; *p != '"'; p++) {
+		if ((unsigned char)*p < ' ')
+			return NULL;
+		if (*p != '\\')
+			continue;
+		p++;
+		if (*p == 'u') {
+			for (int i = 1; i <= 4; i++)
+				if (!isxdigit((unsigned char)p[i]))
+					return NULL;
+			p += 4;
+		} else if (!*p || !strchr("\"\\/bfnrt", *p))
+			return NULL;
+	}
+	return p + 1;
+}
+
+// a list of values, or of "name":value pairs, up to 'end'
+static const char *json_list(const char *p, char end, int pairs) {
+	p = json_space(p + 1);
+	if (*p == end)
+		return p + 1;
+	for (;;) {
+		if (pairs) {
+			p = json_string(p);
+			if (!p || *(p = json_space(p)) != ':')
+				return NULL;
+			p++;
+		}
+		p = json_value(p);
+		if (!p)
+			return NULL;
+		if (*p == end)
+			return p + 1;
+		if (*p++ != ',')
+			return NULL;
+		p = json_space(p);
+	}
+}
+
+static const char *json_value(const char *p) {
+	char *end;
+
+	p = json_space(p);
+	if (*p == '{')
+		p = json_list(p, '}', 1);
+	else if (*p == '[')
+		p = json_list(p, ']', 0);
+	else if (*p == '"')
+		p = json_string(p);
+	else if (!strncmp(p, "true", 4) || !strncmp(p, "null", 4))
+		p += 4;
+	else if (!strncmp(p, "false", 5))
+		p += 5;
+	else {
+		strtod(p, &end);
+		p = end == p ? NULL : end;
+	}
+	return p ? json_space(p) : NULL;
+}
+
+int main(int argc, char **argv) {
+	static const uint16_t code[] = {
+		[0] = 0xc019,			// rjmp main
+		[TOV0_VECT] = 0xc012,	// rjmp handler
+		[MAIN] = 0xd005,		// main: rcall f
+		0xd006,					//		 rcall odd
+		0x9478,					//		 sei
+		0x9588,					//		 sleep
+		0x94f8,					//		 cli
+		0x9588,					//		 sleep
+		[F] = 0x0000,			// f:	 nop
+		0x9508,					//		 ret
+		[ODD] = 0x9508,			// odd:	 ret
+		0x9518,					// handler: reti
+	};
+	static const char *expected[] = {
+		"\"name\":\"f\",\"cat\":\"call\"",
+		"\"name\":\"" "odd\\\"name\\\\" "\",\"cat\":\"call\"",
+		"\"name\":\"vector 16\",\"cat\":\"interrupt\"",
+		"\"name\":\"sleep\"",
+		NULL
+	};
+	char name[] = "/tmp/simavr_timeline_XXXXXX";
+	avr_int_vector_t *tov0;
+	const char *end;
+	char *text;
+	long len;
+	FILE *f;
+	avr_t *avr;
+	int fd, state;
+
+	tests_init(argc, argv);
+	fd = mkstemp(name);
+	if (fd < 0)
+		fail("Can't create %s", name);
+	close(fd);
+
+	avr = avr_make_mcu_by_name("atmega88");
+	if (!avr)
+		fail("Creating AVR failed.");
+	avr_init(avr);
+	avr_loadcode(avr, (uint8_t *)code, sizeof(code), 0);
+	avr->frequency = 8000000;
+	avr_symbols_add(avr, AVR_SYMBOLS_CODE, F * 2, 4, "f", 0);
+	avr_symbols_add(avr, AVR_SYMBOLS_CODE, ODD * 2, 2, ODD_NAME, 0);
+	tov0 = avr->interrupts.vectors[TOV0_VECT];
+	if (!tov0)
+		fail("No timer 0 overflow vector");
+	avr_regbit_set(avr, tov0->enable);
+	avr_cycle_timer_register(avr, WAKE, wake_cb, tov0);
+	if (avr_timeline_start(avr, name, AVR_TIMELINE_ALL))
+		fail("avr_timeline_start() failed");
+
+	do {
+		state = avr_run(avr);
+	} while (state != cpu_Done && state != cpu_Crashed);
+	if (state == cpu_Crashed)
+		fail("Crashed at cycle %" PRI_avr_cycle_count, avr->cycle);
+	if (avr_timeline_stop(avr))
+		fail("avr_timeline_stop() failed");
+	avr_terminate(avr);
+
+	f = fopen(name, "r");
+	if (!f)
+		fail("Can't open %s", name);
+	fseek(f, 0, SEEK_END);
+	len = ftell(f);
+	rewind(f);
+	text = malloc(len + 1);
+	if (!text || fread(text, 1, len, f) != len)
+		fail("Can't read %s", name);
+	text[len] = 0;
+	fclose(f);
+	unlink(name);
+
+	end = json_value(text);
+	if (!end || *end)
+		fail("Not JSON at offset %ld:\n%s", end ? (long)(end - text) : -1L,
+			 text);
+	for (const char **e = expected; *e; e++)
+		if (!strstr(text, *e))
+			fail("No %s in:\n%s", *e, text);
+	free(text);
+
+	tests_success();
+	return 0;
+}
@@ -0,0 +1,210 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "tests.h"
+#include "sim_time.h"
+#include "sim_cycle_timers.h"
+#include "sim_vcd_file.h"
+
+/*
+ * Trace more signals than there are one character VCD identifiers, so
+ * that some need two, and change them all at a few time stamps. Read the
+ * file back as text, checking the identifiers and the values written at
+ * each time stamp, then play it as input into another AVR and check each
+ * signal gets the same values at the same cycles.
+ */
+
+#define SIGNALS		200
+#define STEPS		5
+#define STEP_CYCLES	1000
+
+static avr_irq_t *irqs;
+static int sizes[SIGNALS];
+static uint32_t expected[STEPS + 1][SIGNALS];
+
+static uint32_t value(int i, int step) {
+	return sizes[i] == 1 ? (i + step) & 1 : (i * 7 + step) & 0xff;
+}
+
+static int find(char aliases[SIGNALS][8], const char *alias) {
+	for (int i = 0; i < SIGNALS; i++)
+		if (!strcmp(aliases[i], alias))
+			return i;
+	return -1;
+}
+
+static void check_step(const uint32_t *current, int step) {
+	for (int i = 0; i < SIGNALS; i++)
+		if (current[i] != expected[step][i])
+			fail("Step %d: s%03d is %x, expected %x", step, i,
+				 current[i], expected[step][i]);
+}
+
+// Read the file as text.
+static void read_back(avr_t *avr, const char *name) {
+	static char aliases[SIGNALS][8];
+	static uint32_t current[SIGNALS];
+	char line[256], alias[16], bits[40], vname[32];
+	int size, i, step = 0, two = 0, dumped = 0, body = 0;
+	unsigned long long stamp, last = 0;
+	FILE *f = fopen(name, "r");
+
+	if (!f)
+		fail("Can't read %s", name);
+	while (fgets(line, sizeof(line), f)) {
+		if (!body) {
+			if (sscanf(line, "$var wire %d %15s %31s $end", &size, alias,
+					   vname) == 3) {
+				if (sscanf(vname, "s%d", &i) != 1 || i < 0 || i >= SIGNALS)
+					fail("Unknown signal %s", vname);
+				if (size != sizes[i])
+					fail("%s has size %d", vname, size);
+				for (char *c = alias; *c; c++)
+					if (*c < '!' || *c > '~')
+						fail("%s has alias \"%s\"", vname, alias);
+				if (find(aliases, alias) >= 0)
+					fail("Alias \"%s\" used twice", alias);
+				two += strlen(alias) > 1;
+				strcpy(aliases[i], alias);
+			} else if (!strncmp(line, "$dumpvars", 9))
+				body = 1;
+			continue;
+		}
+		if (line[0] == '$')
+			continue;
+		if (line[0] == '#') {
+			if (sscanf(line + 1, "%llu", &stamp) != 1 || stamp <= last)
+				fail("Bad time stamp %s", line);
+			if (step)
+				check_step(current, step);
+			last = stamp;
+			step++;
+			// 10ns units
+			if (stamp * 10 != avr_cycles_to_nsec(avr, step * STEP_CYCLES))
+				fail("Time stamp %llu for step %d", stamp, step);
+			continue;
+		}
+		if (line[0] == 'b') {
+			if (sscanf(line, "b%39s %15s", bits, alias) != 2)
+				fail("Bad change %s", line);
+		} else {
+			bits[0] = line[0];
+			bits[1] = 0;
+			if (sscanf(line + 1, "%15s", alias) != 1)
+				fail("Bad change %s", line);
+		}
+		if ((i = find(aliases, alias)) < 0)
+			fail("Unknown alias \"%s\"", alias);
+		if (!step) {
+			// the initial values, all floating
+			if (bits[0] != 'z' && bits[0] != 'x')
+				fail("s%03d starts at %s", i, bits);
+			dumped++;
+			continue;
+		}
+		current[i] = strtoul(bits, NULL, 2);
+	}
+	fclose(f);
+	if (dumped != SIGNALS || !two)
+		fail("%d initial values, %d aliases of two characters", dumped, two);
+	if (step != STEPS)
+		fail("%d time stamps, expected %d", step, STEPS);
+	check_step(current, step);
+}
+
+struct replayed {
+	avr_t *				avr;
+	uint32_t			value;
+	int					changes;
+	avr_cycle_count_t	cycle;
+};
+
+static void replay_cb(avr_irq_t *irq, uint32_t value, void *param) {
+	struct replayed *r = param;
+
+	if (irq->flags & IRQ_FLAG_FLOATING)
+		return;
+	r->value = value;
+	r->changes++;
+	r->cycle = r->avr->cycle;
+}
+
+// Play it as input, driving the cycle timers by hand.
+static void replay(const char *name) {
+	static struct replayed r[SIGNALS];
+	avr_t *avr = tests_init_avr("atmega88_example.axf");
+	avr_vcd_t in;
+
+	if (avr_vcd_init_input(avr, name, &in))
+		fail("Can't read %s as input", name);
+	if (in.signal_count != SIGNALS)
+		fail("%d signals read back", in.signal_count);
+	for (int i = 0; i < SIGNALS; i++) {
+		int n;
+
+		if (sscanf(in.signal[i]->name, "s%d", &n) != 1 || n != i ||
+				in.signal[i]->size != sizes[i])
+			fail("Signal %d read back as %s", i, in.signal[i]->name);
+		r[i].avr = avr;
+		avr_irq_register_notify(&in.signal[i]->irq, replay_cb, &r[i]);
+	}
+	while (avr->state != cpu_Done && avr->cycle < 10 * STEPS * STEP_CYCLES) {
+		avr->cycle += STEP_CYCLES / 20;
+		avr_cycle_timer_process(avr);
+	}
+	for (int i = 0; i < SIGNALS; i++) {
+		if (r[i].value != expected[STEPS][i] || r[i].changes != STEPS ||
+				r[i].cycle != STEPS * STEP_CYCLES)
+			fail("s%03d replayed %d changes, to %x at cycle %"
+				 PRI_avr_cycle_count, i, r[i].changes, r[i].value,
+				 r[i].cycle);
+	}
+	avr_vcd_close(&in);
+	avr_terminate(avr);
+}
+
+int main(int argc, char **argv) {
+	char name[] = "/tmp/simavr_alias_XXXXXX.vcd";
+	const char *names[SIGNALS];
+	char buf[SIGNALS][8];
+	avr_vcd_t vcd;
+	avr_t *avr;
+	int fd;
+
+	tests_init(argc, argv);
+	fd = mkstemps(name, 4);
+	if (fd < 0)
+		fail("Can't create %s", name);
+	close(fd);
+
+	avr = tests_init_avr("atmega88_example.axf");
+	for (int i = 0; i < SIGNALS; i++) {
+		snprintf(buf[i], sizeof(buf[i]), "s%03d", i);
+		names[i] = buf[i];
+		sizes[i] = i % 10 == 9 ? 8 : 1;
+	}
+	irqs = avr_alloc_irq(&avr->irq_pool, 0, SIGNALS, names);
+	if (avr_vcd_init(avr, name, &vcd, 100000))
+		fail("avr_vcd_init() failed");
+	for (int i = 0; i < SIGNALS; i++)
+		if (avr_vcd_add_signal(&vcd, irqs + i, sizes[i], names[i]))
+			fail("Can't add signal %d", i);
+	avr->cycle = 0;
+	if (avr_vcd_start(&vcd))
+		fail("avr_vcd_start() failed");
+	for (int step = 1; step <= STEPS; step++) {
+		avr->cycle = step * STEP_CYCLES;
+		for (int i = 0; i < SIGNALS; i++) {
+			expected[step][i] = value(i, step);
+			avr_raise_irq(irqs + i, expected[step][i]);
+		}
+	}
+	avr_vcd_close(&vcd);
+
+	read_back(avr, name);
+	replay(name);
+	unlink(name);
+	avr_terminate(avr);
+	tests_success();
+	return 0;
+}
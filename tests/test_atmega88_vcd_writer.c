@@ -0,0 +1,131 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "tests.h"
+#include "sim_cycle_timers.h"
+#include "sim_vcd_file.h"
+
+/*
+ * Trace the same changes to several files at once: written on the AVR's
+ * thread, by a writer thread waiting for it, and by one dropping changes
+ * when behind, which it never is with this few. Two are compressed, one
+ * of them with a writer thread, and the first of those is closed while
+ * the gzip of the second runs. The files must be the same byte for byte,
+ * but for the date in the header.
+ */
+
+#define SIGNALS		8
+#define CHANGES		200000
+
+enum { SYNC = 0, BLOCK, DROP, GZ_SYNC, GZ_BLOCK, FILES };
+
+static const int writer[FILES] = {
+	[SYNC] = AVR_VCD_WRITER_NONE,
+	[BLOCK] = AVR_VCD_WRITER_BLOCK,
+	[DROP] = AVR_VCD_WRITER_DROP,
+	[GZ_SYNC] = AVR_VCD_WRITER_NONE,
+	[GZ_BLOCK] = AVR_VCD_WRITER_BLOCK,
+};
+
+// The file without its $date section, decompressed.
+static char *slurp(const char *name, size_t *len) {
+	char cmd[128], *text = NULL;
+	size_t size = 0;
+	int dated = 0, c;
+	FILE *f;
+
+	if (strstr(name, ".gz")) {
+		snprintf(cmd, sizeof(cmd), "gzip -dc %s", name);
+		f = popen(cmd, "r");
+	} else
+		f = fopen(name, "r");
+	if (!f)
+		fail("Can't read %s", name);
+	*len = 0;
+	while ((c = fgetc(f)) != EOF) {
+		if (*len + 1 >= size && !(text = realloc(text, size += 1 << 20)))
+			fail("Out of memory");
+		text[(*len)++] = c;
+		// drop everything up to the end of the date
+		if (!dated && *len >= 4 && !memcmp(text + *len - 4, "$end", 4)) {
+			dated = 1;
+			*len = 0;
+		}
+	}
+	if (strstr(name, ".gz") ? pclose(f) : fclose(f))
+		fail("Error reading %s", name);
+	if (!dated || !*len)
+		fail("%s is empty", name);
+	return text;
+}
+
+int main(int argc, char **argv) {
+	static char names[FILES][40];
+	static avr_vcd_t vcd[FILES];
+	const char *inames[SIGNALS];
+	char ibuf[SIGNALS][8];
+	avr_irq_t *irqs;
+	avr_t *avr;
+	size_t len[FILES];
+	char *text[FILES];
+
+	tests_init(argc, argv);
+	// a hang in avr_vcd_close() would be the failure
+	alarm(60);
+	avr = tests_init_avr("atmega88_example.axf");
+	for (int i = 0; i < SIGNALS; i++) {
+		snprintf(ibuf[i], sizeof(ibuf[i]), "w%d", i);
+		inames[i] = ibuf[i];
+	}
+	irqs = avr_alloc_irq(&avr->irq_pool, 0, SIGNALS, inames);
+
+	for (int f = 0; f < FILES; f++) {
+		int fd;
+
+		strcpy(names[f], f >= GZ_SYNC ? "/tmp/simavr_writer_XXXXXX.vcd.gz" :
+			   "/tmp/simavr_writer_XXXXXX.vcd");
+		fd = mkstemps(names[f], f >= GZ_SYNC ? 7 : 4);
+		if (fd < 0)
+			fail("Can't create %s", names[f]);
+		close(fd);
+		if (avr_vcd_init(avr, names[f], &vcd[f], 1000))
+			fail("avr_vcd_init() failed for %s", names[f]);
+		for (int i = 0; i < SIGNALS; i++)
+			avr_vcd_add_signal(&vcd[f], irqs + i, i < 4 ? 1 : 8, inames[i]);
+		if (avr_vcd_set_writer(&vcd[f], writer[f]) ||
+				avr_vcd_start(&vcd[f]))
+			fail("Can't start %s", names[f]);
+	}
+
+	for (uint32_t c = 1; c <= CHANGES; c++) {
+		avr->cycle += 1 + c % 7;
+		avr_raise_irq(irqs + c % SIGNALS, c >> 3);
+		if (c % 256 == 0)
+			avr_cycle_timer_process(avr);
+	}
+	for (int f = 0; f < FILES; f++) {
+		if (vcd[f].dropped)
+			fail("%s dropped %llu changes", names[f],
+				 (unsigned long long)vcd[f].dropped);
+		avr_vcd_close(&vcd[f]);
+	}
+	alarm(0);
+
+	for (int f = 0; f < FILES; f++) {
+		text[f] = slurp(names[f], &len[f]);
+		if (f != SYNC && (len[f] != len[SYNC] ||
+						  memcmp(text[f], text[SYNC], len[f])))
+			fail("%s differs from %s", names[f], names[SYNC]);
+	}
+	// and it has all the changes
+	if (len[SYNC] < CHANGES * 3)
+		fail("Only %zu bytes written", len[SYNC]);
+
+	for (int f = 0; f < FILES; f++) {
+		free(text[f]);
+		unlink(names[f]);
+	}
+	avr_terminate(avr);
+	tests_success();
+	return 0;
+}
@@ -0,0 +1,129 @@
+#include <stdlib.h>
+#include <string.h>
+#include "tests.h"
+#include "sim_checkpoint.h"
+
+/*
+ * Checkpoint the SPM firmware before it writes its flash page, run it past
+ * that, and check that both ways of restoring put SRAM and flash back:
+ * copying the dirty blocks when going back to the last checkpoint, and
+ * everything for another one. Writes made behind the core's back, with
+ * avr_loadcode() or as gdb does, must be undone as well.
+ */
+
+#define PAGE	0x1000
+
+struct state {
+	uint8_t				*data;
+	uint8_t				*flash;
+	avr_cycle_count_t	cycle;
+	avr_flashaddr_t		pc;
+};
+
+static void save(avr_t *avr, struct state *s) {
+	s->data = malloc(avr->ramend + 1);
+	s->flash = malloc(avr->flashend + 1);
+	memcpy(s->data, avr->data, avr->ramend + 1);
+	memcpy(s->flash, avr->flash, avr->flashend + 1);
+	s->cycle = avr->cycle;
+	s->pc = avr->pc;
+}
+
+static void check(avr_t *avr, struct state *s, const char *what) {
+	if (avr->cycle != s->cycle || avr->pc != s->pc)
+		fail("%s: cycle %" PRI_avr_cycle_count " pc %04x, expected "
+			 "%" PRI_avr_cycle_count " %04x", what,
+			 avr->cycle, avr->pc, s->cycle, s->pc);
+	for (uint32_t i = 0; i <= avr->ramend; i++)
+		if (avr->data[i] != s->data[i])
+			fail("%s: data %04x is %02x, expected %02x", what, i,
+				 avr->data[i], s->data[i]);
+	for (uint32_t i = 0; i <= avr->flashend; i++)
+		if (avr->flash[i] != s->flash[i])
+			fail("%s: flash %04x is %02x, expected %02x", what, i,
+				 avr->flash[i], s->flash[i]);
+}
+
+static void run_until(avr_t *avr, avr_cycle_count_t cycle) {
+	while (avr->cycle < cycle) {
+		int state = avr_run(avr);
+
+		if (state == cpu_Done || state == cpu_Crashed)
+			fail("Firmware stopped at cycle %" PRI_avr_cycle_count,
+				 avr->cycle);
+	}
+}
+
+// Change memory behind the core's back.
+static void scribble(avr_t *avr) {
+	uint8_t junk[16];
+	uint32_t addr = avr->ramend - 64;
+
+	memset(junk, 0xa5, sizeof(junk));
+	avr_loadcode(avr, junk, sizeof(junk), 0x800);
+	// as gdb writes memory
+	memcpy(avr->data + addr, junk, sizeof(junk));
+	avr_checkpoint_touch_data(avr, addr, sizeof(junk));
+}
+
+int main(int argc, char **argv) {
+	struct state start, after;
+	avr_checkpoint_t *a, *b;
+	avr_t *avr;
+
+	tests_init(argc, argv);
+	avr = tests_init_avr("attiny85_spm_test.axf");
+
+	run_until(avr, 100);
+	if (avr->flash[PAGE] == 0x34)
+		fail("Flash page written too early");
+	save(avr, &start);
+	a = avr_checkpoint_take(avr);
+	if (!a)
+		fail("avr_checkpoint_take() failed");
+
+	// past the page write, with SRAM written by the firmware
+	while (avr->flash[PAGE] != 0x34 || avr->flash[PAGE + 1] != 0x12)
+		run_until(avr, avr->cycle + 1);
+	run_until(avr, avr->cycle + 200);
+	save(avr, &after);
+	scribble(avr);
+
+	// the last checkpoint taken, from the dirty blocks
+	if (avr_checkpoint_restore(a))
+		fail("Restore of the base checkpoint failed");
+	check(avr, &start, "base restore");
+
+	// the firmware does the same again
+	run_until(avr, after.cycle);
+	check(avr, &after, "second run");
+	b = avr_checkpoint_take(avr);
+	if (!b)
+		fail("avr_checkpoint_take() failed");
+	scribble(avr);
+
+	// not the base any more: all of memory
+	if (avr_checkpoint_restore(a))
+		fail("Restore of the older checkpoint failed");
+	check(avr, &start, "full restore");
+	if (avr_checkpoint_restore(b))
+		fail("Restore of the newer checkpoint failed");
+	check(avr, &after, "full restore, newer");
+
+	// and the base again, after running on
+	run_until(avr, avr->cycle + 100);
+	scribble(avr);
+	if (avr_checkpoint_restore(b))
+		fail("Restore of the base checkpoint failed");
+	check(avr, &after, "base restore, newer");
+
+	avr_checkpoint_free(a);
+	avr_checkpoint_free(b);
+	avr_terminate(avr);
+	free(start.data);
+	free(start.flash);
+	free(after.data);
+	free(after.flash);
+	tests_success();
+	return 0;
+}
@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tests.h"
+#include "sim_shared_flash.h"
+
+/*
+ * Two instances of the SPM firmware share their flash: the same image,
+ * with no page of it copied. The first one runs, rewriting a page with
+ * SPM, and avr_loadcode() writes to the second: each must only see its own
+ * writes, and only then have pages of its own. A third instance made after
+ * that still gets the firmware as it was loaded.
+ */
+
+#define SPM_PAGE	0x1000		// what the firmware writes, with 0x1234
+#define LOADED		0x0800		// what avr_loadcode() writes
+
+// Pages of the mapping at 'addr' copied on write, in kB.
+static long copied_kb(const void *addr) {
+	char line[256];
+	unsigned long start, end;
+	long kb = -1;
+	int in = 0;
+	FILE *f = fopen("/proc/self/smaps", "r");
+
+	if (!f)
+		fail("Can't read /proc/self/smaps");
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%lx-%lx ", &start, &end) == 2)
+			in = start == (unsigned long)addr;
+		else if (in && sscanf(line, "Anonymous: %ld kB", &kb) == 1)
+			break;
+	}
+	fclose(f);
+	if (kb < 0)
+		fail("No mapping at %p", addr);
+	return kb;
+}
+
+static avr_t *shared(uint8_t *image) {
+	avr_t *avr = tests_init_avr("attiny85_spm_test.axf");
+
+	if (avr_shared_flash_start(avr)) {
+		// no memfd_create(), nothing to test
+		avr_terminate(avr);
+		tests_success();
+		exit(0);
+	}
+	if (memcmp(avr->flash, image, avr->flashend + 1))
+		fail("The shared flash is not the firmware");
+	return avr;
+}
+
+int main(int argc, char **argv) {
+	static const char *expected = "Wrote 64 bytes to address 4096\r\n"
+								  "Check Pass";
+	static uint8_t code[] = { 0xa5, 0x5a, 0xc3, 0x3c };
+	struct output_buffer buf;
+	avr_t *a, *b, *c;
+	uint8_t *image;
+	int state;
+
+	tests_init(argc, argv);
+	// the firmware as loaded, unshared
+	a = tests_init_avr("attiny85_spm_test.axf");
+	image = malloc(a->flashend + 1);
+	memcpy(image, a->flash, a->flashend + 1);
+	avr_terminate(a);
+	if (image[SPM_PAGE] == 0x34 && image[SPM_PAGE + 1] == 0x12)
+		fail("The page is written before the firmware runs");
+
+	a = shared(image);
+	b = shared(image);
+	if (a->shared_flash != b->shared_flash || a->flash == b->flash ||
+			a->shared_flash->refs != 2)
+		fail("The instances don't share an image");
+	if (copied_kb(a->flash) || copied_kb(b->flash))
+		fail("Pages copied before any write: %ldkB and %ldkB",
+			 copied_kb(a->flash), copied_kb(b->flash));
+
+	// SPM in the first
+	init_output_buffer(&buf);
+	avr_register_io_write(a, 0x2f, reg_output_cb, &buf);
+	do {
+		state = avr_run(a);
+	} while (state != cpu_Done && state != cpu_Crashed && a->cycle < 1000000);
+	if (strcmp(buf.str, expected))
+		fail("Outputs differ: expected \"%s\", got \"%s\"", expected, buf.str);
+	if (a->flash[SPM_PAGE] != 0x34 || a->flash[SPM_PAGE + 1] != 0x12)
+		fail("SPM did not write the first instance's flash");
+	if (memcmp(b->flash, image, b->flashend + 1))
+		fail("SPM in the first instance changed the second's flash");
+	if (!copied_kb(a->flash) || copied_kb(b->flash))
+		fail("After SPM, %ldkB and %ldkB copied",
+			 copied_kb(a->flash), copied_kb(b->flash));
+
+	// avr_loadcode() in the second
+	avr_loadcode(b, code, sizeof(code), LOADED);
+	if (memcmp(b->flash + LOADED, code, sizeof(code)))
+		fail("avr_loadcode() did not write the second instance's flash");
+	if (memcmp(a->flash + LOADED, image + LOADED, sizeof(code)))
+		fail("avr_loadcode() in the second instance changed the first's");
+	if (!copied_kb(b->flash))
+		fail("avr_loadcode() wrote to a shared page");
+
+	// the image itself was never written
+	c = shared(image);
+	if (c->shared_flash != a->shared_flash || c->shared_flash->refs != 3)
+		fail("A third instance doesn't share the image");
+
+	avr_terminate(a);
+	avr_terminate(b);
+	if (c->shared_flash->refs != 1)
+		fail("%d references left", c->shared_flash->refs);
+	avr_terminate(c);
+	free(image);
+	tests_success();
+	return 0;
+}
@@ -11,7 +11,8 @@
 #include <stdarg.h>
 #include <unistd.h>
 
-avr_cycle_count_t tests_cycle_count = 0;
+// Per thread, so that instances can be run in parallel.
+__thread avr_cycle_count_t tests_cycle_count = 0;
 int tests_disable_stdout = 1;
 
 static char *test_name = "(uninitialized test)";
@@ -54,7 +55,8 @@ cycle_timer_longjmp_cb(struct avr_t *avr, avr_cycle_count_t when, void *param) {
 	return 0;	// clear warning
 }
 
-static jmp_buf *special_deinit_jmpbuf = NULL;
+// Per thread as well; avr->custom.data stays the test's own.
+static __thread jmp_buf *special_deinit_jmpbuf = NULL;
 
 static void special_deinit_longjmp_cb(struct avr_t *avr, void *data) {
 	if (special_deinit_jmpbuf)
@@ -143,6 +145,7 @@ int tests_run_test(avr_t *avr, unsigned long run_usec, int (*run)(avr_t *)) {
 		/* Normal cleanup before exit, includes VCD flush. */
 
 		avr->custom.deinit = NULL;
+		special_deinit_jmpbuf = NULL;
 		avr_terminate(avr);
 
 		if (reason == 1) {
@@ -70,7 +70,7 @@ void tests_assert_cycles_at_most(unsigned long n);
 // the range is inclusive
 void tests_assert_cycles_between(unsigned long min, unsigned long max);
 
-extern avr_cycle_count_t tests_cycle_count;
+extern __thread avr_cycle_count_t tests_cycle_count;
 extern int tests_disable_stdout;
 
 #endif